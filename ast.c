@@ -0,0 +1,428 @@
+/*
+ * ast.c - arena allocator, construction and evaluation of expression trees.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ast.h"
+#include "parser.h"
+
+#define ARENA_BLOCK_SIZE 65536
+
+/* Depth up to which eval_node() recurses before walking subtrees instead */
+#define EVAL_RECURSION_LIMIT 32
+
+/* Values kept on the C stack by walk_eval() before it allocates */
+#define EVAL_LOCAL_STACK 64
+
+/**
+ * arena_alloc - bump-allocates memory from the arena.
+ * @arena: the arena to allocate from.
+ * @size: number of bytes needed.
+ *
+ * Moves on to the next block when the current one is full, reusing blocks
+ * kept from before the last reset and allocating a new one only at the end
+ * of the chain.
+ * Returns the memory, or NULL when out of memory.
+ */
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+
+    ArenaBlock *block = arena->current;
+    while (block != NULL && block->used + size > block->size) {
+        block = block->next;
+        if (block != NULL)
+            block->used = 0;
+    }
+
+    if (block == NULL) {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(ArenaBlock) + block_size);
+        if (block == NULL)
+            return NULL;
+        block->size = block_size;
+        block->used = 0;
+        block->next = NULL;
+        if (arena->current != NULL) {
+            // Splice in after the current block, ahead of any blocks skipped
+            block->next = arena->current->next;
+            arena->current->next = block;
+        } else {
+            arena->first = block;
+        }
+    }
+
+    arena->current = block;
+    void *memory = (char *)block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+/**
+ * arena_reset - makes the whole arena available again.
+ * @arena: the arena to reset.
+ *
+ * Only the first block is rewound here; later blocks are rewound as
+ * arena_alloc() reaches them, so a reset costs the same however large the
+ * arena has grown.
+ */
+void arena_reset(Arena *arena) {
+    arena->current = arena->first;
+    if (arena->first != NULL)
+        arena->first->used = 0;
+}
+
+/**
+ * arena_free - returns the arena's memory to the system.
+ * @arena: the arena to release.
+ */
+void arena_free(Arena *arena) {
+    ArenaBlock *block = arena->first;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first = NULL;
+    arena->current = NULL;
+}
+
+/**
+ * new_num_node - creates a literal node.
+ * @arena: the arena holding the node.
+ * @value: the value of the literal.
+ */
+Node *new_num_node(Arena *arena, Value value) {
+    Node *node = arena_alloc(arena, sizeof(Node));
+    if (node != NULL) {
+        node->kind = NODE_NUM;
+        node->value = value;
+        node->left = NULL;
+        node->right = NULL;
+    }
+    return node;
+}
+
+/**
+ * new_op_node - creates an operator node.
+ * @arena: the arena holding the node.
+ * @kind: the operator.
+ * @left: the left operand.
+ * @right: the right operand.
+ */
+Node *new_op_node(Arena *arena, NodeKind kind, Node *left, Node *right) {
+    Node *node = arena_alloc(arena, sizeof(Node));
+    if (node != NULL) {
+        node->kind = kind;
+        node->value = 0;
+        node->left = left;
+        node->right = right;
+    }
+    return node;
+}
+
+/**
+ * new_var_node - creates a node reading a variable.
+ * @arena: the arena holding the node.
+ * @slot: the slot of the variable.
+ */
+Node *new_var_node(Arena *arena, int slot) {
+    Node *node = new_num_node(arena, slot);
+    if (node != NULL)
+        node->kind = NODE_VAR;
+    return node;
+}
+
+/**
+ * new_assign_node - creates a node assigning an expression to a variable.
+ * @arena: the arena holding the node.
+ * @slot: the slot of the variable.
+ * @operand: the expression.
+ */
+Node *new_assign_node(Arena *arena, int slot, Node *operand) {
+    Node *node = new_op_node(arena, NODE_ASSIGN, operand, NULL);
+    if (node != NULL)
+        node->value = slot;
+    return node;
+}
+
+/**
+ * eval_power - raises base to a non-negative exponent.
+ * @base: the base.
+ * @exponent: the exponent.
+ * @value: receives the result.
+ *
+ * Exponentiation by squaring: one multiplication per bit of the exponent,
+ * each checked for overflow. Once a square overflows with exponent bits
+ * left the result would overflow too, so every overflow is detected and no
+ * result that fits is rejected.
+ * Returns 0 on success, ERROR if the exponent is negative, or
+ * EXPONENT_OVERFLOW or EXPONENT_OUT_OF_RANGE if the result does not fit in a
+ * Value.
+ */
+int eval_power(Value base, Value exponent, Value *value) {
+    if (exponent < 0) {
+        return ERROR;
+    }
+
+    Value result = 1, square = base;
+    for (;;) {
+        if ((exponent & 1) && __builtin_mul_overflow(result, square, &result))
+            break;
+        exponent >>= 1;
+        if (exponent == 0) {
+            *value = result;
+            return 0;
+        }
+        if (__builtin_mul_overflow(square, square, &square))
+            break;
+    }
+
+    // Too large a power of a positive base is an overflow, of a negative one out of range
+    return base > 0 ? EXPONENT_OVERFLOW : EXPONENT_OUT_OF_RANGE;
+}
+
+/**
+ * tree_walk_init - starts a postorder walk of a tree.
+ * @walk: the walk.
+ * @root: root of the tree.
+ */
+void tree_walk_init(TreeWalk *walk, const Node *root) {
+    walk->stack = walk->local;
+    walk->count = 1;
+    walk->capacity = TREE_WALK_LOCAL;
+    walk->failed = 0;
+    walk->local[0].node = root;
+    walk->local[0].visited = 0;
+}
+
+/*
+ * enter - pushes a node onto the path of a walk.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int enter(TreeWalk *walk, const Node *node) {
+    if (walk->count == walk->capacity) {
+        size_t size = 2 * (size_t)walk->capacity * sizeof(TreeWalkEntry);
+        TreeWalkEntry *grown = walk->stack == walk->local ? malloc(size)
+                                                          : realloc(walk->stack, size);
+        if (grown == NULL)
+            return -1;
+        if (walk->stack == walk->local)
+            memcpy(grown, walk->local, sizeof(walk->local));
+        walk->stack = grown;
+        walk->capacity *= 2;
+    }
+    walk->stack[walk->count].node = node;
+    walk->stack[walk->count].visited = 0;
+    walk->count++;
+    return 0;
+}
+
+/**
+ * tree_walk_next - returns the next node of a postorder walk.
+ * @walk: the walk.
+ *
+ * The node on top of the path is returned once all its operands have been
+ * entered and returned; until then its next operand is entered.
+ * Returns the node, or NULL at the end or when out of memory.
+ */
+const Node *tree_walk_next(TreeWalk *walk) {
+    while (walk->count > 0) {
+        TreeWalkEntry *top = &walk->stack[walk->count - 1];
+        const Node *node = top->node;
+
+        int operands = node->kind == NODE_NUM || node->kind == NODE_VAR ? 0 :
+                       node->kind == NODE_ASSIGN ? 1 : 2;
+        if (top->visited == operands) {
+            walk->count--;
+            return node;
+        }
+        if (enter(walk, top->visited++ == 0 ? node->left : node->right) != 0) {
+            walk->failed = 1;
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * tree_walk_free - releases the memory of a walk.
+ * @walk: the walk.
+ */
+void tree_walk_free(TreeWalk *walk) {
+    if (walk->stack != walk->local)
+        free(walk->stack);
+    walk->stack = walk->local;
+    walk->count = 0;
+}
+
+/*
+ * apply - applies a binary operator to its operands.
+ * Returns 0 on success, or the error code of a runtime error.
+ */
+static inline int apply(NodeKind kind, Value left, Value right, Value *value) {
+    switch (kind) {
+        case NODE_ADD:
+            if (__builtin_add_overflow(left, right, value))
+                return INTEGER_OVERFLOW;
+            break;
+        case NODE_SUB:
+            if (__builtin_sub_overflow(left, right, value))
+                return INTEGER_OVERFLOW;
+            break;
+        case NODE_MUL:
+            if (__builtin_mul_overflow(left, right, value))
+                return INTEGER_OVERFLOW;
+            break;
+        case NODE_DIV:
+            if (right == 0)
+                return DIVISION_BY_ZERO;
+            if (left == VALUE_MIN && right == -1)
+                return INTEGER_OVERFLOW;
+            *value = left / right;
+            break;
+        case NODE_POW:
+            return eval_power(left, right, value);
+        case NODE_LT:
+            *value = left < right;
+            break;
+        case NODE_LE:
+            *value = left <= right;
+            break;
+        case NODE_GT:
+            *value = left > right;
+            break;
+        case NODE_GE:
+            *value = left >= right;
+            break;
+        case NODE_EQ:
+            *value = left == right;
+            break;
+        case NODE_NE:
+            *value = left != right;
+            break;
+        default:
+            return INVALID_OPERATOR;
+    }
+    return 0;
+}
+
+/**
+ * eval_operator - applies a binary operator to two values.
+ * @kind: the operator.
+ * @left: the left operand.
+ * @right: the right operand.
+ * @value: receives the result.
+ *
+ * Returns 0 on success, or the error code of a runtime error.
+ */
+int eval_operator(NodeKind kind, Value left, Value right, Value *value) {
+    return apply(kind, left, right, value);
+}
+
+/*
+ * walk_eval - evaluates a tree of any depth with constant C stack. The nodes
+ * are visited in postorder: a literal or a variable pushes its value onto a
+ * value stack and an operator replaces the top two values with its result,
+ * as the VM does.
+ * Returns 0 on success, or the error code of a runtime error.
+ */
+static int walk_eval(const Node *node, const Value *variables, Value *value) {
+    Value local_values[EVAL_LOCAL_STACK];
+    Value *values = local_values;
+    int count = 0, capacity = EVAL_LOCAL_STACK;
+    int status = 0;
+    TreeWalk walk;
+
+    tree_walk_init(&walk, node);
+    while ((node = tree_walk_next(&walk)) != NULL) {
+        if (node->kind != NODE_NUM && node->kind != NODE_VAR) {
+            count--;
+            if ((status = apply(node->kind, values[count - 1], values[count], &values[count - 1])) != 0)
+                break;
+            continue;
+        }
+
+        if (count == capacity) {
+            Value *grown = values == local_values ? malloc(2 * capacity * sizeof(Value))
+                                                  : realloc(values, 2 * capacity * sizeof(Value));
+            if (grown == NULL) {
+                walk.failed = 1;
+                break;
+            }
+            if (values == local_values)
+                memcpy(grown, local_values, sizeof(local_values));
+            values = grown;
+            capacity *= 2;
+        }
+        values[count++] = node->kind == NODE_VAR ? variables[node->value] : node->value;
+    }
+
+    if (walk.failed) {
+        status = OUT_OF_MEMORY;
+    } else if (status == 0) {
+        *value = values[0];
+    }
+    tree_walk_free(&walk);
+    if (values != local_values)
+        free(values);
+    return status;
+}
+
+/*
+ * eval_depth - evaluates a subtree found at the given depth. Shallow trees,
+ * which are nearly all of them, are evaluated by plain recursion; subtrees
+ * below EVAL_RECURSION_LIMIT are handed to walk_eval(), which bounds the C
+ * stack use whatever the depth of the tree.
+ */
+static int eval_depth(const Node *node, const Value *variables, Value *value, int depth) {
+    if (node->kind == NODE_NUM) {
+        *value = node->value;
+        return 0;
+    }
+    if (node->kind == NODE_VAR) {
+        *value = variables[node->value];
+        return 0;
+    }
+    if (depth == EVAL_RECURSION_LIMIT)
+        return walk_eval(node, variables, value);
+
+    Value left, right;
+    int status;
+    if ((status = eval_depth(node->left, variables, &left, depth + 1)) != 0 ||
+        (status = eval_depth(node->right, variables, &right, depth + 1)) != 0)
+        return status;
+    return apply(node->kind, left, right, value);
+}
+
+/**
+ * eval_node - evaluates an expression tree.
+ * @node: root of the tree.
+ * @value: receives the value.
+ *
+ * Nothing is written; error_message() describes the error codes.
+ * Returns 0 on success, or the error code of a runtime error.
+ */
+int eval_node(const Node *node, Value *value) {
+    return eval_depth(node, NULL, value, 0);
+}
+
+/**
+ * eval_statement - evaluates the tree of a line that may name variables.
+ * @node: root of the tree.
+ * @variables: values of the variables, indexed by slot.
+ * @value: receives the value.
+ *
+ * Returns 0 on success, or the error code of a runtime error.
+ */
+int eval_statement(const Node *node, Value *variables, Value *value) {
+    if (node->kind != NODE_ASSIGN)
+        return eval_depth(node, variables, value, 0);
+
+    int status = eval_depth(node->left, variables, value, 0);
+    if (status == 0)
+        variables[node->value] = *value;
+    return status;
+}
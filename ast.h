@@ -0,0 +1,246 @@
+/**
+ * @file ast.h
+ * @brief Abstract syntax tree for parsed expressions and the arena that holds
+ * its nodes. The parser builds a tree for each line instead of computing the
+ * value while it reads tokens, so a parsed expression can be evaluated,
+ * inspected or transformed as many times as needed. Nodes are bump-allocated
+ * from an arena that is reset in constant time between lines, so parsing does
+ * not call malloc or free per node once the arena has grown to its working
+ * size.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef AST_H
+#define AST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
+
+/*
+ * Type of the values of expressions. Values are 32-bit ints unless the
+ * interpreter is built with -DVALUE_64, which evaluates in 64 bits instead.
+ * In both widths every operation detects a result that does not fit.
+ */
+#ifdef VALUE_64
+typedef int64_t Value;
+typedef uint64_t UValue;
+#define VALUE_MIN INT64_MIN
+#define VALUE_MAX INT64_MAX
+#define VALUE_FORMAT "%" PRId64
+#else
+typedef int Value;
+typedef unsigned int UValue;
+#define VALUE_MIN INT_MIN
+#define VALUE_MAX INT_MAX
+#define VALUE_FORMAT "%d"
+#endif
+
+/**
+ * Node kinds. NODE_NUM and NODE_VAR are leaves, NODE_ASSIGN has its one
+ * operand on the left, and every other kind is a binary operator.
+ * NODE_VAR reads a variable and NODE_ASSIGN stores its operand's value in
+ * one; an assignment is only ever the root of a tree.
+ */
+typedef enum {
+    NODE_NUM,
+    NODE_ADD, NODE_SUB, NODE_MUL, NODE_DIV, NODE_POW,
+    NODE_LT, NODE_LE, NODE_GT, NODE_GE, NODE_EQ, NODE_NE,
+    NODE_VAR, NODE_ASSIGN
+} NodeKind;
+
+/**
+ * An expression tree node. Literals keep their value, variables and
+ * assignments the slot of their variable, operators their operands.
+ */
+typedef struct Node {
+    unsigned char kind;     /* NodeKind of the node */
+    Value value;            /* Value of a NODE_NUM literal, or a slot */
+    struct Node *left;
+    struct Node *right;
+} Node;
+
+/* A block of arena memory; blocks are chained and kept across resets */
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+} ArenaBlock;
+
+/**
+ * Bump allocator for the nodes of a batch of lines.
+ */
+typedef struct {
+    ArenaBlock *first;
+    ArenaBlock *current;
+} Arena;
+
+/**
+ * Allocates memory from the arena. The memory is released all at once by
+ * arena_reset() or arena_free().
+ *
+ * @param arena The arena to allocate from.
+ * @param size Number of bytes needed.
+ * @return Pointer to the memory, or NULL when out of memory.
+ */
+void *arena_alloc(Arena *arena, size_t size);
+
+/**
+ * Makes all memory of the arena available again without returning it to
+ * the system. Runs in constant time.
+ *
+ * @param arena The arena to reset.
+ */
+void arena_reset(Arena *arena);
+
+/**
+ * Returns all memory of the arena to the system.
+ *
+ * @param arena The arena to release.
+ */
+void arena_free(Arena *arena);
+
+/**
+ * Creates a literal node.
+ *
+ * @param arena The arena holding the node.
+ * @param value The value of the literal.
+ * @return The new node, or NULL when out of memory.
+ */
+Node *new_num_node(Arena *arena, Value value);
+
+/**
+ * Creates an operator node.
+ *
+ * @param arena The arena holding the node.
+ * @param kind The operator.
+ * @param left The left operand.
+ * @param right The right operand.
+ * @return The new node, or NULL when out of memory.
+ */
+Node *new_op_node(Arena *arena, NodeKind kind, Node *left, Node *right);
+
+/**
+ * Creates a node reading a variable.
+ *
+ * @param arena The arena holding the node.
+ * @param slot The slot of the variable.
+ * @return The new node, or NULL when out of memory.
+ */
+Node *new_var_node(Arena *arena, int slot);
+
+/**
+ * Creates a node assigning the value of an expression to a variable.
+ *
+ * @param arena The arena holding the node.
+ * @param slot The slot of the variable.
+ * @param operand The expression.
+ * @return The new node, or NULL when out of memory.
+ */
+Node *new_assign_node(Arena *arena, int slot, Node *operand);
+
+/* Number of walk entries kept inside the walk before it allocates */
+#define TREE_WALK_LOCAL 64
+
+/* A node on the path of a walk */
+typedef struct {
+    const Node *node;
+    int visited;            /* Number of its operands already entered */
+} TreeWalkEntry;
+
+/**
+ * Iterator over the nodes of a tree in postorder, every operator after its
+ * operands. The path from the root is kept on an explicit stack instead
+ * of the C stack, so trees of any depth can be walked, and it is held inside
+ * the walk itself unless the tree is deeper than TREE_WALK_LOCAL.
+ */
+typedef struct {
+    TreeWalkEntry *stack;
+    int count;
+    int capacity;
+    int failed;             /* Set if the stack could not be grown */
+    TreeWalkEntry local[TREE_WALK_LOCAL];
+} TreeWalk;
+
+/**
+ * Starts a walk of a tree.
+ *
+ * @param walk The walk.
+ * @param root Root of the tree.
+ */
+void tree_walk_init(TreeWalk *walk, const Node *root);
+
+/**
+ * Returns the next node of a walk.
+ *
+ * @param walk The walk.
+ * @return The next node in postorder, or NULL at the end of the tree or when
+ * out of memory, in which case walk->failed is set.
+ */
+const Node *tree_walk_next(TreeWalk *walk);
+
+/**
+ * Releases the memory of a walk.
+ *
+ * @param walk The walk.
+ */
+void tree_walk_free(TreeWalk *walk);
+
+/**
+ * Raises base to a non-negative exponent, the semantics of the ^ operator
+ * shared by every evaluator. The power is computed exactly, by squaring, in
+ * integer arithmetic.
+ *
+ * @param base The base.
+ * @param exponent The exponent.
+ * @param value Receives the result.
+ * @return 0 on success, ERROR if the exponent is negative, or
+ * EXPONENT_OVERFLOW or EXPONENT_OUT_OF_RANGE if the result does not fit in a
+ * Value.
+ */
+int eval_power(Value base, Value exponent, Value *value);
+
+/**
+ * Applies a binary operator to two values, as every tree evaluator does.
+ *
+ * @param kind The operator.
+ * @param left The left operand.
+ * @param right The right operand.
+ * @param value Receives the result.
+ * @return 0 on success, or the error code of a runtime error such as
+ * DIVISION_BY_ZERO or INTEGER_OVERFLOW.
+ */
+int eval_operator(NodeKind kind, Value left, Value right, Value *value);
+
+/**
+ * Evaluates an expression tree. The tree is walked with a TreeWalk, so the
+ * C stack use does not depend on its depth.
+ *
+ * Results that do not fit in a Value, from + - * and the one overflowing
+ * division VALUE_MIN / -1, are INTEGER_OVERFLOW errors in every evaluator.
+ * Nothing is written; error_message() describes the error codes.
+ *
+ * @param node Root of the tree.
+ * @param value Receives the value of the expression.
+ * @return 0 on success, or the error code of a runtime error such as
+ * DIVISION_BY_ZERO or INTEGER_OVERFLOW.
+ */
+int eval_node(const Node *node, Value *value);
+
+/**
+ * Evaluates the tree of a line that may name variables, as eval_node() does.
+ * A variable is read from its slot of the array, and an assignment stores
+ * the value in its slot only if the evaluation succeeds.
+ *
+ * @param node Root of the tree.
+ * @param variables Values of the variables, indexed by slot.
+ * @param value Receives the value of the expression.
+ * @return 0 on success, or the error code of a runtime error.
+ */
+int eval_statement(const Node *node, Value *variables, Value *value);
+
+#endif // AST_H
@@ -0,0 +1,776 @@
+/*
+ * batch.c - serial and multi-threaded evaluation of input files.
+ * The parallel mode runs a reader, the worker threads and a writer around a
+ * ring of chunk slots. The calling thread reads chunks of whole lines into
+ * free slots and writes finished slots in input order; the workers take
+ * filled slots in the order they were read and interpret them into private
+ * output buffers. The pipelined mode passes chunks from a reader thread to
+ * an evaluator thread to the calling thread, which formats the output, and
+ * back to the reader through single-producer/single-consumer rings.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#define _GNU_SOURCE    /* memrchr */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "batch.h"
+#include "parser.h"
+#include "ring.h"
+#include "input.h"
+
+/* Bytes read into a chunk at a time; a chunk always ends on a line boundary */
+#define CHUNK_BYTES (64 * 1024)
+
+/* Slots per worker, so the reader and writer can run ahead of the workers */
+#define SLOTS_PER_THREAD 4
+
+/* Chunks circulating through the pipeline */
+#define PIPELINE_CHUNKS 8
+
+/*
+ * debug_sink - finds the sink of the parser's debug output, if it has one.
+ */
+static DiagSink *debug_sink(LineInterpreter *interp) {
+    return interp->diag.file != NULL ? &interp->diag : NULL;
+}
+
+/*
+ * mark - charges the time since the last mark to a phase, if instrumented.
+ */
+static inline void mark(LineInterpreter *interp, Phase phase) {
+    if (interp->stats != NULL)
+        stats_mark(interp->stats, phase, &interp->tick);
+}
+
+/*
+ * evaluate_values - parses and evaluates the lexed tokens of a line in
+ * Values, in the DAG unless the line names variables.
+ * Returns 0 on success, otherwise an error code.
+ */
+static int evaluate_values(LineInterpreter *interp, const char *line, size_t length, int count,
+                           Value *value) {
+    if (interp->dag != NULL &&
+        (interp->variables == NULL || !has_identifiers(interp->tokens.tokens, count)))
+        return evaluate_tokens_dag(line, length, interp->tokens.tokens, count, &interp->arena,
+                                   interp->dag, debug_sink(interp), value);
+    return evaluate_tokens(line, length, interp->tokens.tokens, count, &interp->arena,
+                           interp->variables, debug_sink(interp), value);
+}
+
+/*
+ * finish - ends the output phase of a line and records the line, if
+ * instrumented.
+ * Returns 0.
+ */
+static int finish(LineInterpreter *interp, const char *line, size_t length, int status,
+                  uint64_t start) {
+    if (interp->stats != NULL) {
+        stats_mark(interp->stats, PHASE_OUTPUT, &interp->tick);
+        stats_line(interp->stats, line, length, status, interp->tick - start);
+    }
+    return 0;
+}
+
+/**
+ * interpret_line - interprets one line.
+ * @interp: the buffers of the calling thread.
+ * @out: the output writer.
+ * @line: the line.
+ * @length: length of the line.
+ *
+ * Returns 0 on success, or -1 when out of memory.
+ */
+int interpret_line(LineInterpreter *interp, OutputWriter *out, const char *line, size_t length) {
+    uint64_t start = interp->tick;
+
+    interp->status = 0;
+    // One lexer pass feeds both the lexical error check and the parser
+    int count = lex_line(&interp->tokens, line, length);
+    if (count < 0)
+        return -1;
+    if (length == 0) {
+        mark(interp, PHASE_LEX);
+        output_blank(out, line, length); // Empty line, nothing to evaluate
+        return finish(interp, line, length, STATS_BLANK, start);
+    }
+    if (has_lexical_errors(interp->tokens.tokens, count)) {
+        mark(interp, PHASE_LEX);
+        output_lexical_errors(out, line, length, interp->tokens.tokens, count);
+        return finish(interp, line, length, STATS_LEXICAL_ERROR, start);
+    }
+    mark(interp, PHASE_LEX);
+
+    Value result;
+    int status;
+    char *digits = NULL;
+    ResultCache *cache = interp->cache;
+    if (cache != NULL && interp->variables != NULL && has_identifiers(interp->tokens.tokens, count))
+        cache = NULL;
+    if (cache == NULL ||
+        !cache_lookup(cache, line, length, interp->tokens.tokens, count, &status, &result)) {
+        arena_reset(&interp->arena); // The previous line's tree is no longer needed
+        if (interp->big != NULL)
+            status = evaluate_tokens_big(line, length, interp->tokens.tokens, count,
+                                         &interp->arena, interp->big, debug_sink(interp),
+                                         &result, &digits);
+        else
+            status = evaluate_values(interp, line, length, count, &result);
+        // The cache only holds Values
+        if (cache != NULL && digits == NULL)
+            cache_store(cache, status, result);
+    }
+    // A cached error is reported as often as the line repeats
+    interp->status = status;
+    report_error(interp->errors, status);
+    mark(interp, PHASE_EVALUATE);
+
+    if (digits != NULL) {
+        output_digits(out, line, length, digits, strlen(digits));
+        free(digits);
+        return finish(interp, line, length, 0, start);
+    }
+    output_result(out, line, length, status, result);
+    return finish(interp, line, length, status, start);
+}
+
+/**
+ * free_line_interpreter - releases the buffers of a line interpreter, writing
+ * out its debug output.
+ * @interp: the line interpreter.
+ */
+void free_line_interpreter(LineInterpreter *interp) {
+    free_token_buffer(&interp->tokens);
+    arena_free(&interp->arena);
+    diag_close(&interp->diag);
+}
+
+/**
+ * interpret_text - interprets every line of an input file.
+ * @in: the input file.
+ * @out: the output writer.
+ * @cache: result cache, or NULL.
+ * @big: arbitrary-precision evaluator, or NULL.
+ * @variables: variables the lines may name, or NULL.
+ * @dag: DAG the lines are built in, or NULL.
+ * @stats: instrumentation counters, or NULL.
+ *
+ * Returns 0 on success, or 1 when out of memory.
+ */
+int interpret_text(FILE *in, OutputWriter *out, ResultCache *cache, BigEvaluator *big,
+                   Variables *variables, Dag *dag, Stats *stats) {
+    LineInterpreter interp = { .cache = cache, .big = big, .variables = variables,
+                               .dag = dag, .errors = stderr, .stats = stats };
+    LineReader reader;
+    const char *line;
+    size_t length;
+    int status = 0, result;
+
+    interp.tokens.identifiers = variables != NULL;
+    diag_open(&interp.diag, stdout);
+    if (line_reader_open(&reader, in) != 0) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        return 1;
+    }
+    if (stats != NULL)
+        interp.tick = stats_now();
+    while ((result = line_reader_next(&reader, &line, &length)) > 0) {
+        mark(&interp, PHASE_READ);
+        if (interpret_line(&interp, out, line, length) != 0) {
+            result = -1;
+            break;
+        }
+    }
+    if (result < 0) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        status = 1;
+    }
+
+    free_line_interpreter(&interp);
+    line_reader_close(&reader);
+    return status;
+}
+
+/* A chunk of whole input lines and the output produced for it */
+typedef struct {
+    char *input;
+    size_t length;
+    size_t capacity;
+    OutputWriter output;    /* Kept in memory until it is written in order */
+    char *diag;             /* Debug output of the lines, for stdout in order */
+    size_t diag_length;
+    char *errors;           /* Error messages of the lines, for stderr in order */
+    size_t errors_length;
+    int status;             /* 0, or -1 if the worker ran out of memory */
+    int done;               /* Set once the output is ready to be written */
+} Chunk;
+
+/* State shared by the reader, the workers and the writer */
+typedef struct {
+    Chunk *slots;
+    int slot_count;
+    unsigned long filled;       /* Chunks read so far */
+    unsigned long taken;        /* Chunks taken by workers so far */
+    int finished;               /* No more chunks will be read */
+    OutputFormat format;
+    pthread_mutex_t lock;
+    pthread_cond_t work;        /* Signaled when a chunk is filled */
+    pthread_cond_t output;      /* Signaled when a chunk is done */
+} ChunkQueue;
+
+typedef struct {
+    ChunkQueue *queue;
+    LineInterpreter interp;
+} Worker;
+
+/*
+ * interpret_chunk - interprets the lines of a chunk into its output buffer.
+ * The debug output and the error messages of the lines are kept with the
+ * chunk too, so they are written in input order as a serial run writes them.
+ */
+static void interpret_chunk(LineInterpreter *interp, Chunk *chunk, OutputFormat format) {
+    free(chunk->diag);
+    free(chunk->errors);
+    chunk->diag = chunk->errors = NULL;
+    chunk->diag_length = chunk->errors_length = 0;
+    FILE *diag = open_memstream(&chunk->diag, &chunk->diag_length);
+    FILE *errors = open_memstream(&chunk->errors, &chunk->errors_length);
+    if (diag == NULL || errors == NULL ||
+        (chunk->output.buffer == NULL && output_init(&chunk->output, NULL, format) != 0)) {
+        if (diag != NULL)
+            fclose(diag);
+        if (errors != NULL)
+            fclose(errors);
+        chunk->status = -1;
+        return;
+    }
+    diag_open(&interp->diag, diag);
+    interp->errors = errors;
+
+    const char *line = chunk->input;
+    const char *end = chunk->input + chunk->length;
+    chunk->status = 0;
+    while (line < end) {
+        // The last line of a file may lack its newline
+        const char *newline = find_newline(line, end);
+        if (interpret_line(interp, &chunk->output, line, newline - line) != 0) {
+            chunk->status = -1;
+            break;
+        }
+        line = newline + 1;
+    }
+    diag_close(&interp->diag);
+    interp->errors = NULL;
+    if (fclose(diag) != 0 || fclose(errors) != 0 || chunk->output.error)
+        chunk->status = -1;
+}
+
+/*
+ * write_messages - writes the debug output and the error messages of a
+ * finished chunk.
+ */
+static void write_messages(const Chunk *chunk) {
+    if (chunk->diag_length > 0)
+        fwrite(chunk->diag, 1, chunk->diag_length, stdout);
+    if (chunk->errors_length > 0)
+        fwrite(chunk->errors, 1, chunk->errors_length, stderr);
+}
+
+/*
+ * worker_main - takes filled chunks in input order until the reader is done.
+ */
+static void *worker_main(void *arg) {
+    Worker *worker = arg;
+    ChunkQueue *queue = worker->queue;
+
+    pthread_mutex_lock(&queue->lock);
+    for (;;) {
+        while (queue->taken == queue->filled && !queue->finished)
+            pthread_cond_wait(&queue->work, &queue->lock);
+        if (queue->taken == queue->filled)
+            break;
+        Chunk *chunk = &queue->slots[queue->taken++ % queue->slot_count];
+        pthread_mutex_unlock(&queue->lock);
+
+        interpret_chunk(&worker->interp, chunk, queue->format);
+
+        pthread_mutex_lock(&queue->lock);
+        chunk->done = 1;
+        pthread_cond_broadcast(&queue->output);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return NULL;
+}
+
+/*
+ * reserve - makes room for at least extra more bytes in a chunk.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int reserve(Chunk *chunk, size_t extra) {
+    if (chunk->length + extra <= chunk->capacity)
+        return 0;
+    size_t capacity = chunk->capacity ? chunk->capacity : CHUNK_BYTES;
+    while (capacity < chunk->length + extra)
+        capacity *= 2;
+    char *grown = realloc(chunk->input, capacity);
+    if (grown == NULL)
+        return -1;
+    chunk->input = grown;
+    chunk->capacity = capacity;
+    return 0;
+}
+
+/*
+ * fill_chunk - reads the next chunk of whole lines. The chunk starts with the
+ * partial line left over from the previous chunk, and the partial line at its
+ * own end is moved to carry for the next one.
+ * Returns 1 if a chunk was read, 0 at the end of the input, or -1 when out of
+ * memory.
+ */
+static int fill_chunk(FILE *in, Chunk *chunk, Chunk *carry) {
+    chunk->length = 0;
+    if (reserve(chunk, carry->length + CHUNK_BYTES) != 0)
+        return -1;
+    if (carry->length > 0)
+        memcpy(chunk->input, carry->input, carry->length);
+    chunk->length = carry->length;
+    carry->length = 0;
+
+    for (;;) {
+        size_t read = fread(chunk->input + chunk->length, 1,
+                            chunk->capacity - chunk->length, in);
+        if (read == 0)
+            return chunk->length > 0; // The rest of the input, newline or not
+
+        char *start = chunk->input + chunk->length;
+        chunk->length += read;
+        char *last = memrchr(start, '\n', read);
+        if (last != NULL) {
+            size_t tail = chunk->input + chunk->length - (last + 1);
+            if (reserve(carry, tail) != 0)
+                return -1;
+            memcpy(carry->input, last + 1, tail);
+            carry->length = tail;
+            chunk->length -= tail;
+            return 1;
+        }
+        // No line ends in this chunk yet; keep reading the long line
+        if (reserve(chunk, CHUNK_BYTES) != 0)
+            return -1;
+    }
+}
+
+/**
+ * interpret_parallel - interprets every line of an input file on a pool of
+ * worker threads.
+ * @in: the input file.
+ * @out: the output writer.
+ * @threads: number of worker threads.
+ * @cache_bytes: combined cache cap of the workers, or 0 for no caches.
+ * @dag_bytes: combined DAG cap of the workers, or 0 for no DAGs.
+ * @bignum: nonzero to give each worker an arbitrary-precision evaluator.
+ *
+ * Returns 0 on success, or 1 when out of memory.
+ */
+int interpret_parallel(FILE *in, OutputWriter *out, int threads, size_t cache_bytes,
+                       size_t dag_bytes, int bignum) {
+    ChunkQueue queue = { .slot_count = threads * SLOTS_PER_THREAD, .format = out->format };
+    Worker *workers = calloc(threads, sizeof(Worker));
+    pthread_t *ids = calloc(threads, sizeof(pthread_t));
+    Chunk carry = {0};
+    int status = 0, started = 0;
+
+    queue.slots = calloc(queue.slot_count, sizeof(Chunk));
+    if (workers == NULL || ids == NULL || queue.slots == NULL) {
+        free(workers);
+        free(ids);
+        free(queue.slots);
+        fprintf(stderr, "Error: Out of memory.\n");
+        return 1;
+    }
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.work, NULL);
+    pthread_cond_init(&queue.output, NULL);
+
+    for (; started < threads; started++) {
+        workers[started].queue = &queue;
+        if (cache_bytes > 0 &&
+            (workers[started].interp.cache = cache_create(cache_bytes / threads)) == NULL)
+            break;
+        if (bignum && (workers[started].interp.big = big_create()) == NULL) {
+            cache_destroy(workers[started].interp.cache);
+            break;
+        }
+        if (!bignum && dag_bytes > 0 &&
+            (workers[started].interp.dag = dag_create(dag_bytes / threads)) == NULL) {
+            cache_destroy(workers[started].interp.cache);
+            break;
+        }
+        if (pthread_create(&ids[started], NULL, worker_main, &workers[started]) != 0) {
+            cache_destroy(workers[started].interp.cache);
+            big_destroy(workers[started].interp.big);
+            dag_destroy(workers[started].interp.dag);
+            break;
+        }
+    }
+    if (started == 0)
+        status = 1;
+
+    unsigned long written = 0;
+    int more = status == 0;
+    while (more || written < queue.filled) {
+        // Read ahead while a slot is free, unless the next output is ready
+        Chunk *next = &queue.slots[written % queue.slot_count];
+        pthread_mutex_lock(&queue.lock);
+        int ready = written < queue.filled && next->done;
+        pthread_mutex_unlock(&queue.lock);
+
+        if (more && !ready && queue.filled - written < (unsigned long)queue.slot_count) {
+            Chunk *chunk = &queue.slots[queue.filled % queue.slot_count];
+            int result = fill_chunk(in, chunk, &carry);
+            if (result < 0)
+                status = 1;
+            pthread_mutex_lock(&queue.lock);
+            if (result > 0) {
+                chunk->done = 0;
+                queue.filled++;
+                pthread_cond_signal(&queue.work);
+            } else {
+                more = 0;
+                queue.finished = 1;
+                pthread_cond_broadcast(&queue.work);
+            }
+            pthread_mutex_unlock(&queue.lock);
+            continue;
+        }
+
+        pthread_mutex_lock(&queue.lock);
+        while (!next->done)
+            pthread_cond_wait(&queue.output, &queue.lock);
+        pthread_mutex_unlock(&queue.lock);
+
+        write_messages(next);
+        output_bytes(out, next->output.buffer, next->output.length);
+        next->output.length = 0;
+        written++;
+        if (next->status != 0) {
+            // Stop where the serial run stops; later chunks are discarded unwritten
+            status = 1;
+            more = 0;
+            pthread_mutex_lock(&queue.lock);
+            queue.finished = 1;
+            pthread_cond_broadcast(&queue.work);
+            while (written < queue.filled) {
+                next = &queue.slots[written % queue.slot_count];
+                while (!next->done)
+                    pthread_cond_wait(&queue.output, &queue.lock);
+                next->output.length = 0;
+                written++;
+            }
+            pthread_mutex_unlock(&queue.lock);
+        }
+    }
+    if (status != 0)
+        fprintf(stderr, "Error: Out of memory.\n");
+
+    pthread_mutex_lock(&queue.lock);
+    queue.finished = 1;
+    pthread_cond_broadcast(&queue.work);
+    pthread_mutex_unlock(&queue.lock);
+    for (int i = 0; i < started; i++) {
+        pthread_join(ids[i], NULL);
+        if (workers[i].interp.cache != NULL) {
+            cache_report(workers[i].interp.cache, stderr);
+            cache_destroy(workers[i].interp.cache);
+        }
+        if (workers[i].interp.dag != NULL) {
+            dag_report(workers[i].interp.dag, stderr);
+            dag_destroy(workers[i].interp.dag);
+        }
+        big_destroy(workers[i].interp.big);
+        free_line_interpreter(&workers[i].interp);
+    }
+
+    for (int i = 0; i < queue.slot_count; i++) {
+        free(queue.slots[i].input);
+        free(queue.slots[i].diag);
+        free(queue.slots[i].errors);
+        output_free(&queue.slots[i].output);
+    }
+    free(carry.input);
+    free(queue.slots);
+    free(workers);
+    free(ids);
+    pthread_mutex_destroy(&queue.lock);
+    pthread_cond_destroy(&queue.work);
+    pthread_cond_destroy(&queue.output);
+    return status;
+}
+
+/* What the evaluator found out about a line */
+typedef enum {
+    LINE_BLANK,             /* Nothing to report */
+    LINE_LEXICAL_ERROR,     /* Text that is not a lexeme; the writer reports it */
+    LINE_EVALUATED,         /* Status and value are set */
+    LINE_FAILED             /* Out of memory; the output stops before this line */
+} LineKind;
+
+typedef struct {
+    size_t start;           /* Offset of the line in the chunk */
+    size_t length;
+    unsigned char kind;
+    int status;
+    Value value;
+} LineResult;
+
+/* A chunk and the results of its lines */
+typedef struct {
+    Chunk text;
+    LineResult *lines;
+    size_t line_count;
+    size_t line_capacity;
+} PipelineChunk;
+
+typedef struct {
+    FILE *in;
+    Ring filled;                /* Reader to evaluator */
+    Ring evaluated;             /* Evaluator to writer */
+    Ring free_chunks;           /* Writer back to reader */
+    LineInterpreter interp;     /* The evaluator's buffers */
+    atomic_int failed;          /* Set once a stage has run out of memory */
+    StallCounter reader_stalls;
+    StallCounter evaluator_stalls;
+    StallCounter writer_stalls;
+} Pipeline;
+
+/*
+ * reader_main - fills free chunks until the end of the input, then sends NULL
+ * down the pipeline.
+ */
+static void *reader_main(void *arg) {
+    Pipeline *pipeline = arg;
+    Chunk carry = {0};
+
+    for (;;) {
+        PipelineChunk *chunk = ring_pop(&pipeline->free_chunks, &pipeline->reader_stalls);
+        int result = atomic_load(&pipeline->failed) ? 0 :
+                     fill_chunk(pipeline->in, &chunk->text, &carry);
+        if (result < 0)
+            atomic_store(&pipeline->failed, 1);
+        if (result <= 0)
+            break;
+        ring_push(&pipeline->filled, chunk, &pipeline->reader_stalls);
+    }
+    ring_push(&pipeline->filled, NULL, &pipeline->reader_stalls);
+    free(carry.input);
+    return NULL;
+}
+
+/*
+ * evaluate_chunk - evaluates the lines of a chunk into its results, leaving
+ * the text for the writer to echo.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int evaluate_chunk(LineInterpreter *interp, PipelineChunk *chunk) {
+    const char *line = chunk->text.input;
+    const char *end = chunk->text.input + chunk->text.length;
+
+    chunk->line_count = 0;
+    while (line < end) {
+        // The last line of a file may lack its newline
+        const char *newline = find_newline(line, end);
+
+        if (chunk->line_count == chunk->line_capacity) {
+            size_t capacity = chunk->line_capacity ? chunk->line_capacity * 2 : 1024;
+            LineResult *grown = realloc(chunk->lines, capacity * sizeof(LineResult));
+            if (grown == NULL)
+                return -1;
+            chunk->lines = grown;
+            chunk->line_capacity = capacity;
+        }
+        LineResult *result = &chunk->lines[chunk->line_count++];
+        result->start = line - chunk->text.input;
+        result->length = newline - line;
+        result->kind = LINE_BLANK;
+
+        int count = lex_line(&interp->tokens, line, newline - line);
+        if (count < 0) {
+            result->kind = LINE_FAILED;
+            return -1;
+        }
+        if (count > 0 && has_lexical_errors(interp->tokens.tokens, count)) {
+            result->kind = LINE_LEXICAL_ERROR;
+        } else if (newline > line) {
+            ResultCache *cache = interp->cache;
+            if (interp->variables != NULL && has_identifiers(interp->tokens.tokens, count))
+                cache = NULL; // The value depends on the lines before
+            result->kind = LINE_EVALUATED;
+            if (cache == NULL || !cache_lookup(cache, line, newline - line, interp->tokens.tokens,
+                                               count, &result->status, &result->value)) {
+                arena_reset(&interp->arena);
+                result->status = evaluate_values(interp, line, newline - line, count,
+                                                 &result->value);
+                if (cache != NULL)
+                    cache_store(cache, result->status, result->value);
+            }
+            report_error(interp->errors, result->status);
+        }
+        line = newline + 1;
+    }
+    return 0;
+}
+
+/*
+ * evaluator_main - evaluates chunks until the reader sends NULL. After a
+ * failure, chunks are passed on without their lines.
+ */
+static void *evaluator_main(void *arg) {
+    Pipeline *pipeline = arg;
+
+    for (;;) {
+        PipelineChunk *chunk = ring_pop(&pipeline->filled, &pipeline->evaluator_stalls);
+        if (chunk != NULL) {
+            if (atomic_load(&pipeline->failed))
+                chunk->line_count = 0;
+            else if (evaluate_chunk(&pipeline->interp, chunk) != 0)
+                atomic_store(&pipeline->failed, 1);
+        }
+        ring_push(&pipeline->evaluated, chunk, &pipeline->evaluator_stalls);
+        if (chunk == NULL)
+            break;
+    }
+    return NULL;
+}
+
+/*
+ * write_chunk - formats the output of an evaluated chunk.
+ * Returns 0 on success, or -1 if the chunk ends with a failed line.
+ */
+static int write_chunk(OutputWriter *out, const PipelineChunk *chunk, TokenBuffer *tokens) {
+    for (size_t i = 0; i < chunk->line_count; i++) {
+        const LineResult *result = &chunk->lines[i];
+        const char *line = chunk->text.input + result->start;
+
+        switch (result->kind) {
+            case LINE_BLANK:
+                output_blank(out, line, result->length);
+                break;
+            case LINE_LEXICAL_ERROR: {
+                // Rare enough that the writer lexes the line again itself
+                int count = lex_line(tokens, line, result->length);
+                if (count < 0)
+                    return -1;
+                output_lexical_errors(out, line, result->length, tokens->tokens, count);
+                break;
+            }
+            case LINE_EVALUATED:
+                output_result(out, line, result->length, result->status, result->value);
+                break;
+            default:
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * report_stage - writes how long one stage waited on its queues.
+ */
+static void report_stage(FILE *stats, const char *name, const StallCounter *stalls) {
+    fprintf(stats, "Pipeline: %-9s waited %.3f s in %lu stalls\n", name,
+            stalls->seconds, stalls->stalls);
+}
+
+/**
+ * interpret_pipelined - interprets every line of an input file in a reader,
+ * evaluator and writer pipeline.
+ * @in: the input file.
+ * @out: the output writer.
+ * @cache: result cache used by the evaluator, or NULL.
+ * @dag: DAG the evaluator builds the lines in, or NULL.
+ * @variables: variables the lines may name, or NULL.
+ * @stats: file receiving the stall counters, or NULL.
+ *
+ * Returns 0 on success, or 1 when out of memory.
+ */
+int interpret_pipelined(FILE *in, OutputWriter *out, ResultCache *cache, Dag *dag,
+                        Variables *variables, FILE *stats) {
+    Pipeline pipeline = { .in = in, .interp = { .cache = cache, .variables = variables,
+                                                .dag = dag, .errors = stderr } };
+    PipelineChunk *chunks = calloc(PIPELINE_CHUNKS, sizeof(PipelineChunk));
+    TokenBuffer tokens = { .identifiers = variables != NULL };
+    pthread_t reader, evaluator;
+    int status = 0;
+
+    pipeline.interp.tokens.identifiers = variables != NULL;
+    diag_open(&pipeline.interp.diag, stdout);
+    atomic_init(&pipeline.failed, 0);
+    // Each ring has room for every chunk plus the final NULL, so only
+    // running out of free chunks holds the reader back
+    if (chunks == NULL ||
+        ring_init(&pipeline.filled, PIPELINE_CHUNKS + 1) != 0 ||
+        ring_init(&pipeline.evaluated, PIPELINE_CHUNKS + 1) != 0 ||
+        ring_init(&pipeline.free_chunks, PIPELINE_CHUNKS) != 0) {
+        status = 1;
+        goto done;
+    }
+    for (int i = 0; i < PIPELINE_CHUNKS; i++)
+        ring_push(&pipeline.free_chunks, &chunks[i], &pipeline.writer_stalls);
+
+    if (pthread_create(&reader, NULL, reader_main, &pipeline) != 0) {
+        status = 1;
+        goto done;
+    }
+    if (pthread_create(&evaluator, NULL, evaluator_main, &pipeline) != 0) {
+        // Keep the reader from waiting for chunks forever
+        atomic_store(&pipeline.failed, 1);
+        for (;;) {
+            PipelineChunk *chunk = ring_pop(&pipeline.filled, &pipeline.writer_stalls);
+            if (chunk == NULL)
+                break;
+            ring_push(&pipeline.free_chunks, chunk, &pipeline.writer_stalls);
+        }
+        pthread_join(reader, NULL);
+        status = 1;
+        goto done;
+    }
+
+    // The calling thread is the writer, recycling chunks until the final NULL
+    for (;;) {
+        PipelineChunk *chunk = ring_pop(&pipeline.evaluated, &pipeline.writer_stalls);
+        if (chunk == NULL)
+            break;
+        if (status == 0 && write_chunk(out, chunk, &tokens) != 0)
+            status = 1;
+        ring_push(&pipeline.free_chunks, chunk, &pipeline.writer_stalls);
+    }
+    pthread_join(reader, NULL);
+    pthread_join(evaluator, NULL);
+    if (atomic_load(&pipeline.failed))
+        status = 1;
+
+    if (stats != NULL) {
+        report_stage(stats, "reader", &pipeline.reader_stalls);
+        report_stage(stats, "evaluator", &pipeline.evaluator_stalls);
+        report_stage(stats, "writer", &pipeline.writer_stalls);
+    }
+
+done:
+    if (status != 0)
+        fprintf(stderr, "Error: Out of memory.\n");
+    for (int i = 0; chunks != NULL && i < PIPELINE_CHUNKS; i++) {
+        free(chunks[i].text.input);
+        free(chunks[i].lines);
+    }
+    free(chunks);
+    ring_free(&pipeline.filled);
+    ring_free(&pipeline.evaluated);
+    ring_free(&pipeline.free_chunks);
+    free_line_interpreter(&pipeline.interp);
+    free_token_buffer(&tokens);
+    return status;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file batch.h
+ * @brief Evaluation of whole input files, one line after another or on a
+ * pool of threads. Every line is independent, so the parallel mode splits the
+ * input into chunks of whole lines and hands them to worker threads. Each
+ * worker formats its results into a private buffer, and the buffers are
+ * written in input order, so the output is byte-identical to the serial run.
+ * The pipelined mode instead overlaps reading, evaluation and output
+ * formatting on three threads joined by lock-free queues, which helps even
+ * when one thread could evaluate the whole file.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "lexer.h"
+#include "ast.h"
+#include "cache.h"
+#include "bignum.h"
+#include "output.h"
+#include "variables.h"
+#include "stats.h"
+#include "diag.h"
+#include "dag.h"
+
+/**
+ * The buffers one thread needs to interpret lines, reused from line to line.
+ */
+typedef struct {
+    TokenBuffer tokens;
+    Arena arena;
+    ResultCache *cache;     /* Result cache, or NULL to evaluate every line */
+    BigEvaluator *big;      /* Arbitrary-precision evaluator, or NULL for Values */
+    Variables *variables;   /* Variables lines may name, or NULL to allow no names */
+    Dag *dag;               /* DAG shared by the lines, or NULL to build a tree per line */
+    DiagSink diag;          /* Receives the parser's debug output if opened */
+    FILE *errors;           /* Receives the message of each error, or NULL */
+    int status;             /* Error code of the last line interpreted, or 0 */
+    Stats *stats;           /* Instrumentation counters, or NULL */
+    uint64_t tick;          /* Tick of the last phase mark when stats is set */
+} LineInterpreter;
+
+/**
+ * Interprets one line and writes its record: the line is empty, has
+ * lexical errors, or is evaluated. A line of spaces, or one with anything
+ * after its semicolon such as the CR of a CRLF file, is a syntax error.
+ * Lines naming variables are not cached or built in the DAG, since their
+ * values depend on the lines before them.
+ *
+ * @param interp The buffers of the calling thread.
+ * @param out Writer receiving the record.
+ * @param line The line, without its newline; it need not be NUL-terminated.
+ * @param length Length of the line in bytes.
+ * @return 0 on success, or -1 when out of memory.
+ */
+int interpret_line(LineInterpreter *interp, OutputWriter *out, const char *line, size_t length);
+
+/**
+ * Releases the buffers of a line interpreter and writes out its debug
+ * output. The cache and the evaluator are not destroyed.
+ *
+ * @param interp The line interpreter.
+ */
+void free_line_interpreter(LineInterpreter *interp);
+
+/**
+ * Interprets every line of an input file on the calling thread.
+ *
+ * @param in The input file.
+ * @param out Writer receiving the records.
+ * @param cache Result cache, or NULL to evaluate every line.
+ * @param big Evaluator for arbitrary precision, or NULL to evaluate in
+ * Values. Values too wide for a Value are not cached.
+ * @param variables Variables the lines may name and assign, or NULL to allow
+ * no names. Not supported with big.
+ * @param dag DAG the lines are built in, or NULL to build a tree per line.
+ * Not used with big.
+ * @param stats Instrumentation counters receiving the time of each phase and
+ * each line, or NULL to run without instrumentation.
+ * @return 0 on success, or 1 when out of memory.
+ */
+int interpret_text(FILE *in, OutputWriter *out, ResultCache *cache, BigEvaluator *big,
+                   Variables *variables, Dag *dag, Stats *stats);
+
+/**
+ * Interprets every line of an input file on a pool of worker threads. The
+ * output is the same as that of interpret_text(), and so are the debug
+ * output on stdout and the error messages on stderr: each chunk keeps its
+ * own, and they are written with its records. A line served from a cache
+ * writes no debug output, so with caches, whose hits differ from a serial
+ * run's, stdout can differ. Lines are interpreted out of order, so they
+ * cannot name variables.
+ *
+ * @param in The input file.
+ * @param out Writer receiving the records.
+ * @param threads Number of worker threads.
+ * @param cache_bytes If not 0, each worker caches results within an equal
+ * share of this many bytes and its counters are written to stderr at the end.
+ * @param dag_bytes If not 0, each worker builds its lines in a DAG capped at
+ * an equal share of this many bytes, whose counters are written to stderr at
+ * the end. Not used with bignum.
+ * @param bignum If not 0, each worker evaluates with arbitrary precision.
+ * @return 0 on success, or 1 when out of memory.
+ */
+int interpret_parallel(FILE *in, OutputWriter *out, int threads, size_t cache_bytes,
+                       size_t dag_bytes, int bignum);
+
+/**
+ * Interprets every line of an input file in a three-stage pipeline: a reader
+ * thread reads chunks of lines, an evaluator thread evaluates them and the
+ * calling thread formats the output. The output is the same as that of
+ * interpret_text().
+ *
+ * @param in The input file.
+ * @param out Writer receiving the records.
+ * @param cache Result cache used by the evaluator, or NULL.
+ * @param dag DAG the evaluator builds the lines in, or NULL.
+ * @param variables Variables the lines may name and assign, or NULL to allow
+ * no names.
+ * @param stats If not NULL, receives how long each stage waited on the
+ * others, which shows the stage that limits throughput.
+ * @return 0 on success, or 1 when out of memory.
+ */
+int interpret_pipelined(FILE *in, OutputWriter *out, ResultCache *cache, Dag *dag,
+                        Variables *variables, FILE *stats);
+
+#endif // BATCH_H
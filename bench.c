@@ -0,0 +1,2308 @@
+/*
+ * bench.c - throughput benchmarks for the interpreter's components.
+ * Each benchmark loads an input file into memory once and then runs the
+ * component under test over every line a number of times, so only the
+ * component itself is timed.
+ *
+ * Usage: bench <benchmark> <inputfile> [repeat]
+ *        bench generate <corpus> <lines> [seed]
+ *        bench suite [lines] [seed]
+ *        bench load <socket> <inputfile> [requests] [connections]
+ *
+ * generate writes a synthetic corpus from corpus.c to stdout. suite times
+ * the tokenizer, the parser and the whole interpreter separately over every
+ * kind of synthetic corpus and prints one JSON object per line for each.
+ * load sends the input file as requests to a server started with
+ * interpreter -s over several connections at once and prints the request
+ * rate and latency percentiles.
+ *
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "lexer.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "vm.h"
+#include "jit.h"
+#include "batch.h"
+#include "context.h"
+#include "input.h"
+#include "output.h"
+#include "corpus.h"
+#include "server.h"
+#include "columns.h"
+#include "diag.h"
+#include "compress.h"
+#include "dag.h"
+#include "util.h"
+
+#ifdef HAVE_PCRE
+#include <pcre.h>
+#endif
+
+#define DEFAULT_REPEAT 10000
+#define DIFFERENTIAL_TREES 100000
+#define COLUMN_TEMPLATES 1000
+#define DEFAULT_SUITE_LINES 20000
+#define DEFAULT_SEED 1
+#define SUITE_PASSES 5
+#define DEFAULT_LOAD_REQUESTS 1000
+#define DEFAULT_LOAD_CONNECTIONS 4
+
+/* An input file held in memory as an array of lines */
+typedef struct {
+    char *data;
+    char **lines;
+    size_t *lengths;
+    size_t count;
+    int names;              /* Set if lines name variables, as in the variables corpus */
+} Corpus;
+
+/* Keeps results alive so the compiler cannot drop the benchmarked work */
+static volatile long sink;
+
+/*
+ * silence - redirects a standard stream to /dev/null.
+ * Returns the descriptor to pass to unsilence(), or -1 on failure.
+ */
+static int silence(FILE *stream) {
+    if (stream == stdout)
+        diag_flush(diag_stdout());
+    fflush(stream);
+    int saved = dup(fileno(stream));
+    if (saved >= 0 && freopen("/dev/null", "w", stream) == NULL) {
+        close(saved);
+        return -1;
+    }
+    return saved;
+}
+
+/*
+ * unsilence - restores a stream redirected by silence().
+ */
+static void unsilence(FILE *stream, int saved) {
+    if (saved < 0)
+        return;
+    if (stream == stdout)
+        diag_flush(diag_stdout()); // bexpr() and get_token() buffer their debug output
+    fflush(stream);
+    dup2(saved, fileno(stream));
+    close(saved);
+}
+
+/*
+ * capture - redirects a standard stream to an anonymous temporary file, so
+ * what is written to it can be counted.
+ * Returns the file, or NULL on failure; *saved receives the descriptor to
+ * pass to unsilence().
+ */
+static FILE *capture(FILE *stream, int *saved) {
+    FILE *file = tmpfile();
+    *saved = -1;
+    if (file == NULL)
+        return NULL;
+    if (stream == stdout)
+        diag_flush(diag_stdout());
+    fflush(stream);
+    *saved = dup(fileno(stream));
+    if (*saved < 0 || dup2(fileno(file), fileno(stream)) < 0) {
+        if (*saved >= 0)
+            close(*saved);
+        *saved = -1;
+        fclose(file);
+        return NULL;
+    }
+    return file;
+}
+
+/*
+ * captured_bytes - restores a stream redirected by capture() and closes the
+ * file it was redirected to.
+ * Returns the number of bytes written to the stream meanwhile.
+ */
+static long captured_bytes(FILE *stream, FILE *file, int saved) {
+    struct stat st;
+    unsilence(stream, saved);
+    long bytes = fstat(fileno(file), &st) == 0 ? (long)st.st_size : -1;
+    fclose(file);
+    return bytes;
+}
+
+/*
+ * split_corpus - splits text into NUL-terminated lines, taking ownership of
+ * it. The text must have room for one byte past its size.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int split_corpus(char *data, size_t size, Corpus *corpus) {
+    corpus->data = data;
+    corpus->names = 0;
+    corpus->lines = malloc((size + 1) * sizeof(char *));
+    corpus->lengths = malloc((size + 1) * sizeof(size_t));
+    if (!corpus->lines || !corpus->lengths)
+        return -1;
+    corpus->data[size] = '\0';
+
+    corpus->count = 0;
+    char *line = corpus->data;
+    for (size_t i = 0; i <= size; i++) {
+        if (corpus->data[i] == '\n' || i == size) {
+            if (i == size && line == corpus->data + size)
+                break;
+            corpus->data[i] = '\0';
+            corpus->lines[corpus->count] = line;
+            corpus->lengths[corpus->count] = corpus->data + i - line;
+            corpus->count++;
+            line = corpus->data + i + 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * load_corpus - reads a file and splits it into NUL-terminated lines.
+ * Returns 0 on success, or -1 if the file could not be read.
+ */
+static int load_corpus(const char *path, Corpus *corpus) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return -1;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+
+    char *data = malloc(size + 1);
+    if (data == NULL || fread(data, 1, size, file) != (size_t)size) {
+        free(data);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    return split_corpus(data, size, corpus);
+}
+
+/*
+ * free_corpus - releases a corpus.
+ */
+static void free_corpus(Corpus *corpus) {
+    free(corpus->data);
+    free(corpus->lines);
+    free(corpus->lengths);
+}
+
+/*
+ * parse_corpus - parses every line of the corpus into a tree.
+ * Lines with lexical or syntax errors are left out, and nothing is written.
+ * Returns the number of trees stored in roots.
+ */
+static size_t parse_corpus(const Corpus *corpus, Arena *arena, Node **roots) {
+    TokenBuffer buf = {0};
+    size_t count = 0;
+
+    for (size_t i = 0; i < corpus->count; i++) {
+        int ntokens = lex_line(&buf, corpus->lines[i], corpus->lengths[i]);
+        TokenStream ts = { .text = corpus->lines[i], .length = corpus->lengths[i],
+                           .tokens = buf.tokens, .count = ntokens, .arena = arena };
+        Node *root = ntokens > 0 ? parse_bexpr(&ts) : NULL;
+        if (root != NULL)
+            roots[count++] = root;
+    }
+
+    free_token_buffer(&buf);
+    return count;
+}
+
+/*
+ * report - prints the throughput of one benchmark run.
+ */
+static void report(const char *name, size_t lines, double seconds) {
+    printf("%-24s %12.0f lines/s %10.1f ns/line\n", name,
+           lines / seconds, seconds * 1e9 / lines);
+}
+
+/*
+ * report_bandwidth - prints the throughput of one benchmark run in bytes.
+ */
+static void report_bandwidth(const char *name, size_t bytes, double seconds) {
+    printf("%-24s %12.2f GB/s\n", name, bytes / seconds / 1e9);
+}
+
+/*
+ * join_corpus - rebuilds the text of the corpus, repeated, with a newline
+ * after every line.
+ * Returns the text, or NULL when out of memory.
+ */
+static char *join_corpus(const Corpus *corpus, int repeat, size_t *size) {
+    size_t length = 0;
+    for (size_t i = 0; i < corpus->count; i++)
+        length += corpus->lengths[i] + 1;
+    char *text = malloc(length * repeat);
+    if (text == NULL)
+        return NULL;
+
+    char *end = text;
+    for (int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < corpus->count; i++) {
+            memcpy(end, corpus->lines[i], corpus->lengths[i]);
+            end += corpus->lengths[i];
+            *end++ = '\n';
+        }
+    }
+    *size = length * repeat;
+    return text;
+}
+
+/*
+ * check_stream - feeds text to the stream lexer in chunks of a given size
+ * and checks that the lexemes, put back together, are those lex_line()
+ * finds in each line of the corpus.
+ */
+static void check_stream(const Corpus *corpus, const char *text, size_t size, size_t chunk) {
+    TokenBuffer buf = { .identifiers = corpus->names };
+    LexStream stream;
+    LexPiece piece;
+    char *lexeme = NULL;
+    size_t length = 0, capacity = 0;
+    size_t line = 0;
+    int index = 0, count = 0;
+
+    lex_stream_init(&stream, corpus->names);
+    for (size_t offset = 0; ; offset += chunk) {
+        if (offset < size)
+            lex_stream_feed(&stream, text + offset, size - offset < chunk ? size - offset : chunk);
+        else
+            lex_stream_end(&stream);
+        while (lex_stream_next(&stream, &piece)) {
+            if (length + piece.length > capacity) {
+                capacity = 2 * (length + piece.length);
+                if ((lexeme = realloc(lexeme, capacity)) == NULL) {
+                    fprintf(stderr, "lexer: out of memory\n");
+                    exit(1);
+                }
+            }
+            memcpy(lexeme + length, piece.text, piece.length);
+            length += piece.length;
+            if (!(piece.flags & LEX_LAST))
+                continue;
+
+            // The next lexeme lex_line() finds
+            while (index == count && line < corpus->count) {
+                count = lex_line(&buf, corpus->lines[line], corpus->lengths[line]);
+                index = 0;
+                line++;
+            }
+            const Token *tok = index < count ? &buf.tokens[index++] : NULL;
+            if (tok == NULL || tok->category != piece.category || tok->length != length ||
+                memcmp(corpus->lines[line - 1] + tok->start, lexeme, length) != 0) {
+                fprintf(stderr, "lexer: line %zu differs in chunks of %zu: '%.*s'\n",
+                        line, chunk, (int)length, lexeme);
+                exit(1);
+            }
+            length = 0;
+        }
+        if (offset >= size)
+            break;
+    }
+    while (index == count && line < corpus->count) {
+        count = lex_line(&buf, corpus->lines[line], corpus->lengths[line]);
+        index = 0;
+        line++;
+    }
+    if (index < count) {
+        fprintf(stderr, "lexer: the stream ends early in chunks of %zu\n", chunk);
+        exit(1);
+    }
+    free(lexeme);
+    free_token_buffer(&buf);
+}
+
+/*
+ * bench_lexer - times the table-driven lexer on lines and on the corpus as
+ * one stream, after checking that both find the same lexemes, and the
+ * per-line PCRE compile-and-match loop it replaced when built with
+ * -DHAVE_PCRE.
+ */
+static void bench_lexer(const Corpus *corpus, int repeat) {
+    TokenBuffer buf = { .identifiers = corpus->names };
+    double start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < corpus->count; i++)
+            sink += lex_line(&buf, corpus->lines[i], corpus->lengths[i]);
+    }
+    report("lexer/dfa", corpus->count * repeat, monotonic_seconds() - start);
+    free_token_buffer(&buf);
+
+    size_t size;
+    char *text = join_corpus(corpus, 1, &size);
+    if (text == NULL) {
+        fprintf(stderr, "lexer: out of memory\n");
+        return;
+    }
+    static const size_t chunks[] = { 1, 2, 3, 7, 64, 4096 };
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++)
+        check_stream(corpus, text, size, chunks[c]);
+
+    LexStream stream;
+    LexPiece piece;
+    start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        lex_stream_init(&stream, corpus->names);
+        for (size_t offset = 0; ; offset += 65536) {
+            if (offset < size)
+                lex_stream_feed(&stream, text + offset, size - offset < 65536 ? size - offset : 65536);
+            else
+                lex_stream_end(&stream);
+            while (lex_stream_next(&stream, &piece))
+                sink += piece.flags;
+            if (offset >= size)
+                break;
+        }
+    }
+    report("lexer/stream", corpus->count * repeat, monotonic_seconds() - start);
+    free(text);
+
+#ifdef HAVE_PCRE
+    const char *error;
+    int erroffset;
+    int ovector[30];
+
+    start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < corpus->count; i++) {
+            pcre *re = pcre_compile("(\\d+|!=|==|<=|>=|[=+\\-*/^<>();])", 0,
+                                    &error, &erroffset, NULL);
+            int pos = 0;
+            while (pcre_exec(re, NULL, corpus->lines[i], corpus->lengths[i],
+                             pos, 0, ovector, 30) >= 0) {
+                pos = ovector[1];
+                sink++;
+            }
+            pcre_free(re);
+        }
+    }
+    report("lexer/pcre", corpus->count * repeat, monotonic_seconds() - start);
+#else
+    printf("%-24s (build with -DHAVE_PCRE -lpcre to compare)\n", "lexer/pcre");
+#endif
+}
+
+/*
+ * bench_vm - times the bytecode VM against the tree-walking evaluator on
+ * expressions that have already been parsed, after checking both agree.
+ */
+static void bench_vm(const Corpus *corpus, int repeat) {
+    Arena arena = {0};
+    Node **roots = malloc(corpus->count * sizeof(Node *));
+    size_t count = parse_corpus(corpus, &arena, roots);
+    Program *programs = calloc(count ? count : 1, sizeof(Program));
+
+    for (size_t i = 0; i < count; i++) {
+        Value tree_value = 0, vm_value = 0;
+        compile_program(&programs[i], roots[i]);
+        int tree_status = eval_node(roots[i], &tree_value);
+        int vm_status = run_program(&programs[i], NULL, &vm_value);
+        if (tree_status != vm_status || (tree_status == 0 && tree_value != vm_value)) {
+            fprintf(stderr, "vm: result differs from the tree evaluator\n");
+            exit(1);
+        }
+    }
+
+    Value value;
+    double start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < count; i++) {
+            eval_node(roots[i], &value);
+            sink += value;
+        }
+    }
+    double tree_time = monotonic_seconds() - start;
+    report("eval/tree", count * repeat, tree_time);
+
+    start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < count; i++) {
+            run_program(&programs[i], NULL, &value);
+            sink += value;
+        }
+    }
+    double vm_time = monotonic_seconds() - start;
+    report("eval/vm", count * repeat, vm_time);
+    printf("%-24s %12.2fx\n", "eval/vm speedup", tree_time / vm_time);
+
+    for (size_t i = 0; i < count; i++)
+        free_program(&programs[i]);
+    free(programs);
+    free(roots);
+    arena_free(&arena);
+}
+
+/*
+ * bench_variables - times programs over variables, as generated by
+ * "bench generate variables". Every line is parsed once with its names
+ * resolved to slots, then evaluated again and again from the tree and the
+ * bytecode, which read the slots by index; the VM must agree with the tree.
+ * For comparison, the lookups of every name by hashing, which the slots
+ * save each evaluation, and the whole interpreter with -V are timed too.
+ */
+static void bench_variables(const Corpus *corpus, int repeat) {
+    Variables variables = {0};
+    TokenBuffer buf = { .identifiers = 1 };
+    Arena arena = {0};
+    Node **roots = malloc(corpus->count * sizeof(Node *));
+    Program *programs = calloc(corpus->count, sizeof(Program));
+    const char **names = NULL;
+    unsigned int *name_lengths = NULL;
+    size_t count = 0, references = 0, name_capacity = 0;
+    if (roots == NULL || programs == NULL) {
+        fprintf(stderr, "variables: out of memory\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < corpus->count; i++) {
+        const char *line = corpus->lines[i];
+        int ntokens = lex_line(&buf, line, corpus->lengths[i]);
+        if (ntokens <= 0 || has_lexical_errors(buf.tokens, ntokens))
+            continue;
+        for (int t = 0; t < ntokens; t++) {
+            if (buf.tokens[t].category != IDENTIFIER)
+                continue;
+            if (references == name_capacity) {
+                name_capacity = name_capacity ? name_capacity * 2 : 1024;
+                names = realloc(names, name_capacity * sizeof(char *));
+                name_lengths = realloc(name_lengths, name_capacity * sizeof(unsigned int));
+                if (names == NULL || name_lengths == NULL) {
+                    fprintf(stderr, "variables: out of memory\n");
+                    exit(1);
+                }
+            }
+            names[references] = line + buf.tokens[t].start;
+            name_lengths[references++] = buf.tokens[t].length;
+        }
+
+        // Run each line once so later lines can read what it assigns
+        TokenStream ts = { .text = line, .length = corpus->lengths[i], .tokens = buf.tokens,
+                           .count = ntokens, .arena = &arena, .variables = &variables };
+        Node *root = parse_bexpr(&ts);
+        Value value;
+        if (root == NULL)
+            continue;
+        if (eval_statement(root, variables.values, &value) == 0 && root->kind == NODE_ASSIGN)
+            variables.assigned[root->value] = 1;
+        if (compile_program(&programs[count], root) != 0) {
+            fprintf(stderr, "variables: out of memory\n");
+            exit(1);
+        }
+        roots[count++] = root;
+    }
+    if (count == 0) {
+        fprintf(stderr, "variables: no line of the input can be evaluated\n");
+        exit(1);
+    }
+    printf("%-24s %12d slots %10.1f names/line\n", "variables/slots",
+           variables.count, (double)references / count);
+
+    // Both evaluators start from the same values and must end with the same
+    size_t bytes = variables.count * sizeof(Value);
+    Value *tree_values = malloc(bytes ? bytes : 1);
+    Value *vm_values = malloc(bytes ? bytes : 1);
+    if (tree_values == NULL || vm_values == NULL) {
+        fprintf(stderr, "variables: out of memory\n");
+        exit(1);
+    }
+    memcpy(tree_values, variables.values, bytes);
+    memcpy(vm_values, variables.values, bytes);
+    for (size_t i = 0; i < count; i++) {
+        Value tree_value = 0, vm_value = 0;
+        int tree_status = eval_statement(roots[i], tree_values, &tree_value);
+        int vm_status = run_program(&programs[i], vm_values, &vm_value);
+        if (tree_status != vm_status || (tree_status == 0 && tree_value != vm_value)) {
+            fprintf(stderr, "variables: result differs from the tree evaluator\n");
+            exit(1);
+        }
+    }
+    if (memcmp(tree_values, vm_values, bytes) != 0) {
+        fprintf(stderr, "variables: variables differ from the tree evaluator's\n");
+        exit(1);
+    }
+
+    Value value;
+    double start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < count; i++) {
+            eval_statement(roots[i], tree_values, &value);
+            sink += value;
+        }
+    }
+    report("variables/tree", count * repeat, monotonic_seconds() - start);
+
+    start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < count; i++) {
+            run_program(&programs[i], vm_values, &value);
+            sink += value;
+        }
+    }
+    report("variables/vm", count * repeat, monotonic_seconds() - start);
+
+    start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < references; i++)
+            sink += variable_lookup(&variables, names[i], name_lengths[i]);
+    }
+    report("variables/lookups", count * repeat, monotonic_seconds() - start);
+
+    // The interpreter starts every pass with no variables
+    OutputWriter out;
+    if (output_init(&out, NULL, FORMAT_TEXT) != 0) {
+        fprintf(stderr, "variables: out of memory\n");
+        exit(1);
+    }
+    start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        Variables fresh = {0};
+        LineInterpreter interp = { .tokens = { .identifiers = 1 }, .variables = &fresh };
+        out.length = 0;
+        for (size_t i = 0; i < corpus->count; i++)
+            interpret_line(&interp, &out, corpus->lines[i], corpus->lengths[i]);
+        free_line_interpreter(&interp);
+        free_variables(&fresh);
+    }
+    report("variables/interpret", corpus->count * repeat, monotonic_seconds() - start);
+
+    output_free(&out);
+    for (size_t i = 0; i < count; i++)
+        free_program(&programs[i]);
+    free(programs);
+    free(roots);
+    free(names);
+    free(name_lengths);
+    free(tree_values);
+    free(vm_values);
+    free_token_buffer(&buf);
+    free_variables(&variables);
+    arena_free(&arena);
+}
+
+/*
+ * next_random - xorshift generator, seeded so runs are reproducible.
+ */
+static unsigned long next_random(unsigned long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/*
+ * random_tree - builds a random expression tree of at most the given depth.
+ * Literals are small and include zero and negative values so that division
+ * by zero, negative exponents and overflow all occur.
+ */
+static Node *random_tree(Arena *arena, int depth, unsigned long *state) {
+    if (depth == 0 || next_random(state) % 4 == 0)
+        return new_num_node(arena, (int)(next_random(state) % 41) - 20);
+
+    NodeKind kind = NODE_ADD + next_random(state) % (NODE_NE - NODE_ADD + 1);
+    Node *left = random_tree(arena, depth - 1, state);
+    Node *right = random_tree(arena, depth - 1, state);
+    return new_op_node(arena, kind, left, right);
+}
+
+/*
+ * check_jit - runs a tree through the tree evaluator and the JIT and
+ * exits if the status or the value differ.
+ */
+static void check_jit(const Node *root, Program *prog) {
+    JitCode jit;
+    Value tree_value = 0, jit_value = 0;
+
+    compile_program(prog, root);
+    if (jit_compile(prog, &jit) != 0) {
+        fprintf(stderr, "jit: could not compile an expression\n");
+        exit(1);
+    }
+    int tree_status = eval_node(root, &tree_value);
+    int jit_status = jit_run(&jit, &jit_value);
+    if (tree_status != jit_status || (tree_status == 0 && tree_value != jit_value)) {
+        fprintf(stderr, "jit: result differs from the tree evaluator\n");
+        exit(1);
+    }
+    jit_free(&jit);
+}
+
+/*
+ * bench_jit - checks the JIT against the tree evaluator on the corpus and on
+ * seeded random trees, then times it against the VM.
+ */
+static void bench_jit(const Corpus *corpus, int repeat) {
+    if (!jit_available()) {
+        printf("%-24s (not supported on this machine)\n", "eval/jit");
+        return;
+    }
+
+    Arena arena = {0};
+    Node **roots = malloc(corpus->count * sizeof(Node *));
+    size_t count = parse_corpus(corpus, &arena, roots);
+    Program check = {0};
+
+    // Differential check; the evaluators must agree on error codes too
+    for (size_t i = 0; i < count; i++)
+        check_jit(roots[i], &check);
+    Arena scratch = {0};
+    unsigned long state = 88172645463325252UL;
+    for (int i = 0; i < DIFFERENTIAL_TREES; i++) {
+        arena_reset(&scratch);
+        check_jit(random_tree(&scratch, 6, &state), &check);
+    }
+    arena_free(&scratch);
+    free_program(&check);
+    printf("%-24s %12d trees agree\n", "eval/jit differential",
+           (int)count + DIFFERENTIAL_TREES);
+
+    Program *programs = calloc(count ? count : 1, sizeof(Program));
+    JitCode *code = calloc(count ? count : 1, sizeof(JitCode));
+    for (size_t i = 0; i < count; i++) {
+        compile_program(&programs[i], roots[i]);
+        jit_compile(&programs[i], &code[i]);
+    }
+
+    Value value;
+    double start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < count; i++) {
+            run_program(&programs[i], NULL, &value);
+            sink += value;
+        }
+    }
+    double vm_time = monotonic_seconds() - start;
+    report("eval/vm", count * repeat, vm_time);
+
+    start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < count; i++) {
+            jit_run(&code[i], &value);
+            sink += value;
+        }
+    }
+    double jit_time = monotonic_seconds() - start;
+    report("eval/jit", count * repeat, jit_time);
+    printf("%-24s %12.2fx\n", "eval/jit speedup", vm_time / jit_time);
+
+    for (size_t i = 0; i < count; i++) {
+        free_program(&programs[i]);
+        jit_free(&code[i]);
+    }
+    free(programs);
+    free(code);
+    free(roots);
+    arena_free(&arena);
+}
+
+/*
+ * put_template - writes a random template of at most the given depth over
+ * the columns, with every operator in parentheses. Literals are small and
+ * include zero and negative values, as in random_tree().
+ * Returns the end of the text.
+ */
+static char *put_template(char *p, const Variables *names, int depth, unsigned long *state) {
+    static const char *const ops[] = {
+        "+", "-", "*", "/", "^", "<", "<=", ">", ">=", "==", "!=",
+    };
+
+    if (depth == 0 || next_random(state) % 4 == 0) {
+        if (next_random(state) % 3 == 0)
+            return p + sprintf(p, "%d", (int)(next_random(state) % 41) - 20);
+        int slot = next_random(state) % names->count;
+        memcpy(p, names->names + names->offsets[slot], names->lengths[slot]);
+        return p + names->lengths[slot];
+    }
+    *p++ = '(';
+    p = put_template(p, names, depth - 1, state);
+    p += sprintf(p, " %s ", ops[next_random(state) % (sizeof(ops) / sizeof(ops[0]))]);
+    p = put_template(p, names, depth - 1, state);
+    *p++ = ')';
+    return p;
+}
+
+/*
+ * run_columns - evaluates a compiled template over rows held in blocks,
+ * each row starting with the status its fields were parsed with.
+ */
+static void run_columns(ColumnProgram *cp, Value **columns, size_t rows, const int *parsed,
+                        Value *values, int *status) {
+    for (size_t first = 0; first < rows; first += COLUMN_BLOCK) {
+        int count = rows - first < COLUMN_BLOCK ? rows - first : COLUMN_BLOCK;
+        memcpy(status + first, parsed + first, count * sizeof(int));
+        column_evaluate(cp, (const Value *const *)(columns + first / COLUMN_BLOCK * cp->columns),
+                        count, values + first, status + first);
+    }
+}
+
+/*
+ * check_columns - evaluates a template over rows with the portable
+ * operators and, if the CPU has them, the AVX2 operators, and exits unless
+ * every row gets the status and the value the VM gives it.
+ */
+static void check_columns(ColumnProgram *cp, Value **columns, size_t rows, const int *parsed,
+                          const Value *row_major, Value *values, int *status) {
+    int vector = cp->vector;
+
+    for (int pass = 0; pass <= vector; pass++) {
+        cp->vector = pass;
+        run_columns(cp, columns, rows, parsed, values, status);
+        for (size_t i = 0; i < rows; i++) {
+            Value value = 0;
+            int expected = parsed[i];
+            if (expected == 0)
+                expected = run_program(&cp->program, (Value *)row_major + i * cp->columns, &value);
+            if (status[i] != expected || (expected == 0 && values[i] != value)) {
+                fprintf(stderr, "columns: row %zu differs from the VM\n", i + 1);
+                exit(1);
+            }
+        }
+    }
+    cp->vector = vector;
+}
+
+/*
+ * substitute_row - does what driving bexpr() once per row would: writes the
+ * row's values into the text of the template in place of the column names,
+ * then tokenizes, parses and evaluates the text.
+ * Returns 0 or the error code of the row.
+ */
+static int substitute_row(const char *template, const TokenBuffer *tokens, const int *slots,
+                          const Value *row, char *line, TokenBuffer *buf, Arena *arena,
+                          Value *value) {
+    char *p = line;
+    for (int t = 0; t < tokens->count; t++) {
+        const Token *tok = &tokens->tokens[t];
+        if (slots[t] >= 0) {
+            p += sprintf(p, VALUE_FORMAT, row[slots[t]]);
+        } else {
+            memcpy(p, template + tok->start, tok->length);
+            p += tok->length;
+        }
+        *p++ = ' ';
+    }
+    // The line ends with the template's semicolon, not the space after it
+    size_t length = p > line ? p - line - 1 : 0;
+    int count = lex_line(buf, line, length);
+    arena_reset(arena);
+    return evaluate_tokens(line, length, buf->tokens, count, arena, NULL, NULL, value);
+}
+
+/*
+ * bench_columns - evaluates templates over a CSV input whose first line
+ * names the columns, such as the rows corpus. Seeded random templates are
+ * first checked against the VM row by row. A template combining every
+ * column is then timed four ways: substituting each row into its text and
+ * interpreting that, running its bytecode once per row, and running it over
+ * blocks of rows with the portable and with the AVX2 operators.
+ */
+static void bench_columns(const Corpus *corpus, int repeat) {
+    static const char *const ops[] = { " * ", " + ", " / ", " - " };
+    ColumnProgram cp = {0};
+
+    if (corpus->count < 2 || column_header(&cp, corpus->lines[0], corpus->lengths[0]) != 0) {
+        printf("%-24s (the input is not a CSV header followed by rows)\n", "columns");
+        column_free(&cp);
+        return;
+    }
+    int ncolumns = cp.columns;
+    size_t rows = corpus->count - 1;
+    size_t blocks = (rows + COLUMN_BLOCK - 1) / COLUMN_BLOCK;
+    size_t longest = 0;
+    for (int c = 0; c < ncolumns; c++) {
+        if (cp.names.lengths[c] > longest)
+            longest = cp.names.lengths[c];
+    }
+    Value *data = malloc(blocks * ncolumns * COLUMN_BLOCK * sizeof(Value));
+    Value **columns = malloc(blocks * ncolumns * sizeof(Value *));
+    Value *row_major = malloc(rows * ncolumns * sizeof(Value));
+    int *parsed = malloc(blocks * COLUMN_BLOCK * sizeof(int));
+    int *status = malloc(blocks * COLUMN_BLOCK * sizeof(int));
+    Value *values = malloc(blocks * COLUMN_BLOCK * sizeof(Value));
+    // Room for a random template of depth 4 or the combined one
+    char *text = malloc((longest + 32) * (64 + ncolumns));
+    if (data == NULL || columns == NULL || row_major == NULL || parsed == NULL ||
+        status == NULL || values == NULL || text == NULL) {
+        fprintf(stderr, "columns: out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < blocks * ncolumns; i++)
+        columns[i] = data + i * COLUMN_BLOCK;
+
+    double start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < rows; i++)
+            parsed[i] = column_parse_row(&cp, corpus->lines[i + 1], corpus->lengths[i + 1],
+                                         columns + i / COLUMN_BLOCK * ncolumns, i % COLUMN_BLOCK);
+    }
+    report("columns/parse", rows * repeat, monotonic_seconds() - start);
+    for (size_t i = 0; i < rows; i++) {
+        for (int c = 0; c < ncolumns; c++)
+            row_major[i * ncolumns + c] = columns[i / COLUMN_BLOCK * ncolumns + c][i % COLUMN_BLOCK];
+    }
+
+    // Differential check over the first blocks; ^ only has the portable operator
+    unsigned long state = 88172645463325252UL;
+    size_t checked = rows < 4 * COLUMN_BLOCK ? rows : 4 * COLUMN_BLOCK;
+    for (int t = 0; t < COLUMN_TEMPLATES; t++) {
+        char *end = put_template(text, &cp.names, 4, &state);
+        *end++ = ';';
+        if (column_compile(&cp, text, end - text) != 0) {
+            fprintf(stderr, "columns: could not compile %.*s\n", (int)(end - text), text);
+            exit(1);
+        }
+        check_columns(&cp, columns, checked, parsed, row_major, values, status);
+    }
+    printf("%-24s %12d templates agree\n", "columns/differential", COLUMN_TEMPLATES);
+
+    char *end = text;
+    for (int c = 0; c < ncolumns; c++) {
+        if (c > 0)
+            end += sprintf(end, "%s", ops[(c - 1) % 4]);
+        memcpy(end, cp.names.names + cp.names.offsets[c], cp.names.lengths[c]);
+        end += cp.names.lengths[c];
+    }
+    *end++ = ';';
+    if (column_compile(&cp, text, end - text) != 0) {
+        fprintf(stderr, "columns: could not compile %.*s\n", (int)(end - text), text);
+        exit(1);
+    }
+    check_columns(&cp, columns, rows, parsed, row_major, values, status);
+    printf("%-24s %.*s\n", "columns/template", (int)(end - text), text);
+
+    // Substitution writes at most a Value's digits and a space per token
+    TokenBuffer template_tokens = { .identifiers = 1 }, buf = {0};
+    Arena arena = {0};
+    int count = lex_line(&template_tokens, text, end - text);
+    int *slots = malloc(count * sizeof(int));
+    char *line = malloc(count * 24);
+    if (count <= 0 || slots == NULL || line == NULL) {
+        fprintf(stderr, "columns: out of memory\n");
+        exit(1);
+    }
+    for (int t = 0; t < count; t++) {
+        const Token *tok = &template_tokens.tokens[t];
+        slots[t] = tok->category == IDENTIFIER
+                 ? variable_lookup(&cp.names, text + tok->start, tok->length) : -1;
+    }
+    for (size_t i = 0; i < rows; i++) {
+        Value value = 0;
+        int result = substitute_row(text, &template_tokens, slots, row_major + i * ncolumns,
+                                    line, &buf, &arena, &value);
+        if (parsed[i] == 0 && (result != status[i] || (result == 0 && value != values[i]))) {
+            fprintf(stderr, "columns: row %zu differs when substituted\n", i + 1);
+            exit(1);
+        }
+    }
+
+    start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < rows; i++) {
+            Value value;
+            sink += substitute_row(text, &template_tokens, slots, row_major + i * ncolumns,
+                                   line, &buf, &arena, &value);
+        }
+    }
+    report("columns/substitute", rows * repeat, monotonic_seconds() - start);
+
+    start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < rows; i++) {
+            Value value;
+            sink += run_program(&cp.program, row_major + i * ncolumns, &value);
+        }
+    }
+    double row_time = monotonic_seconds() - start;
+    report("columns/rows", rows * repeat, row_time);
+
+    int vector = cp.vector;
+    cp.vector = 0;
+    start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++)
+        run_columns(&cp, columns, rows, parsed, values, status);
+    double block_time = monotonic_seconds() - start;
+    report("columns/blocks", rows * repeat, block_time);
+    printf("%-24s %12.2fx\n", "columns/blocks speedup", row_time / block_time);
+
+    if (vector) {
+        cp.vector = 1;
+        start = monotonic_seconds();
+        for (int r = 0; r < repeat; r++)
+            run_columns(&cp, columns, rows, parsed, values, status);
+        double vector_time = monotonic_seconds() - start;
+        report("columns/avx2", rows * repeat, vector_time);
+        printf("%-24s %12.2fx\n", "columns/avx2 speedup", row_time / vector_time);
+    } else {
+        printf("%-24s (needs AVX2 and 32-bit values)\n", "columns/avx2");
+    }
+
+    free(slots);
+    free(line);
+    free_token_buffer(&template_tokens);
+    free_token_buffer(&buf);
+    arena_free(&arena);
+    free(data);
+    free(columns);
+    free(row_major);
+    free(parsed);
+    free(status);
+    free(values);
+    free(text);
+    column_free(&cp);
+}
+
+/*
+ * run_batch - interprets a text held in memory into an output buffer, on the
+ * calling thread when threads is 0, with variables if names is set and
+ * instrumented if stats is. The interpreter's debug output and runtime
+ * messages are suppressed while it runs.
+ * Returns the time taken in seconds.
+ */
+static double run_batch(char *text, size_t size, int threads, int names, Stats *stats,
+                        char **output, size_t *output_size) {
+    Variables variables = {0};
+    FILE *in = fmemopen(text, size, "r");
+    OutputWriter out;
+    if (in == NULL || output_init(&out, NULL, FORMAT_TEXT) != 0) {
+        fprintf(stderr, "threads: could not open the memory streams\n");
+        exit(1);
+    }
+
+    int saved_stdout = silence(stdout);
+    int saved_stderr = silence(stderr);
+    double start = monotonic_seconds();
+    if (threads == 0)
+        interpret_text(in, &out, NULL, NULL, names ? &variables : NULL, NULL, stats);
+    else
+        interpret_parallel(in, &out, threads, 0, 0, 0);
+    double seconds = monotonic_seconds() - start;
+    unsilence(stderr, saved_stderr);
+    unsilence(stdout, saved_stdout);
+
+    fclose(in);
+    free_variables(&variables);
+    *output = out.buffer;
+    *output_size = out.length;
+    return seconds;
+}
+
+/*
+ * bench_threads - times the multi-threaded interpreter on 1 up to as many
+ * threads as there are online cores, over the corpus repeated, against the
+ * serial interpreter. Every run must produce the serial run's output.
+ */
+static void bench_threads(const Corpus *corpus, int repeat) {
+    size_t size;
+    char *text = join_corpus(corpus, repeat, &size);
+    if (text == NULL) {
+        fprintf(stderr, "threads: out of memory\n");
+        return;
+    }
+    size_t lines = corpus->count * repeat;
+
+    char *expected, *output;
+    size_t expected_size, output_size;
+    double serial_time = run_batch(text, size, 0, 0, NULL, &expected, &expected_size);
+    report("batch/serial", lines, serial_time);
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1)
+        cores = 1;
+    double one_thread_time = 0;
+    for (long threads = 1; ; threads = threads * 2 < cores ? threads * 2 : cores) {
+        double seconds = run_batch(text, size, threads, 0, NULL, &output, &output_size);
+        if (output_size != expected_size || memcmp(output, expected, expected_size) != 0) {
+            fprintf(stderr, "threads: output differs from the serial run\n");
+            exit(1);
+        }
+        free(output);
+        if (threads == 1)
+            one_thread_time = seconds;
+
+        char name[32];
+        snprintf(name, sizeof(name), "batch/%ld threads", threads);
+        report(name, lines, seconds);
+        snprintf(name, sizeof(name), "batch/%ld speedup", threads);
+        printf("%-24s %12.2fx\n", name, one_thread_time / seconds);
+        if (threads == cores)
+            break;
+    }
+
+    free(expected);
+    free(text);
+}
+
+/* Runs of each kind in the instrumentation benchmark; the fastest counts */
+#define STATS_RUNS 5
+
+/*
+ * bench_stats - times the serial interpreter over the corpus repeated with
+ * and without instrumentation, alternating the two, and writes the summary
+ * of the last instrumented run. Both must produce the same output.
+ */
+static void bench_stats(const Corpus *corpus, int repeat) {
+    size_t size;
+    char *text = join_corpus(corpus, repeat, &size);
+    if (text == NULL) {
+        fprintf(stderr, "stats: out of memory\n");
+        return;
+    }
+    size_t lines = corpus->count * repeat;
+
+    char *expected = NULL, *output;
+    size_t expected_size, output_size;
+    double off = 0, on = 0;
+    Stats stats;
+    for (int run = 0; run < STATS_RUNS; run++) {
+        double seconds = run_batch(text, size, 0, corpus->names, NULL, &output, &output_size);
+        if (run == 0 || seconds < off)
+            off = seconds;
+        if (expected == NULL) {
+            expected = output;
+            expected_size = output_size;
+        } else {
+            free(output);
+        }
+
+        stats_init(&stats);
+        seconds = run_batch(text, size, 0, corpus->names, &stats, &output, &output_size);
+        if (run == 0 || seconds < on)
+            on = seconds;
+        if (output_size != expected_size || memcmp(output, expected, expected_size) != 0) {
+            fprintf(stderr, "stats: instrumented output differs\n");
+            exit(1);
+        }
+        free(output);
+    }
+
+    report("stats/off", lines, off);
+    report("stats/on", lines, on);
+    printf("%-24s %+12.1f%%\n", "stats/overhead", (on / off - 1) * 100);
+    stats_write(&stats, stdout);
+    free(expected);
+    free(text);
+}
+
+/* One thread of the context benchmark */
+typedef struct {
+    const Corpus *corpus;
+    const EvalResult *expected;
+    int repeat;
+    pthread_barrier_t *start;
+    size_t disagreements;
+} ContextWorker;
+
+/*
+ * same_result - compares two results field by field.
+ */
+static int same_result(const EvalResult *a, const EvalResult *b) {
+    return a->status == b->status && a->value == b->value && a->error == b->error &&
+           a->offset == b->offset && a->length == b->length;
+}
+
+/*
+ * context_main - evaluates the corpus repeat times in a context of its own,
+ * counting the results that differ from the expected ones.
+ */
+static void *context_main(void *arg) {
+    ContextWorker *worker = arg;
+    const Corpus *corpus = worker->corpus;
+    EvalContext *context = context_create();
+    EvalResult result;
+
+    pthread_barrier_wait(worker->start);
+    for (int r = 0; context != NULL && r < worker->repeat; r++) {
+        for (size_t i = 0; i < corpus->count; i++) {
+            context_evaluate(context, corpus->lines[i], corpus->lengths[i], &result);
+            worker->disagreements += !same_result(&result, &worker->expected[i]);
+        }
+    }
+    if (context == NULL)
+        worker->disagreements = corpus->count;
+    context_destroy(context);
+    return NULL;
+}
+
+/*
+ * bench_contexts - evaluates the corpus through evaluation contexts from 1
+ * up to twice as many threads as there are online cores (at least 4), all
+ * at once. Every thread must get the results of a serial pass, and nothing
+ * may be written on stdout or stderr while they run, which is checked by
+ * capturing both.
+ */
+static void bench_contexts(const Corpus *corpus, int repeat) {
+    EvalResult *expected = malloc(corpus->count * sizeof(EvalResult));
+    EvalContext *context = context_create();
+    if (expected == NULL || context == NULL) {
+        fprintf(stderr, "contexts: out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < corpus->count; i++)
+        context_evaluate(context, corpus->lines[i], corpus->lengths[i], &expected[i]);
+    context_destroy(context);
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    long limit = cores > 2 ? 2 * cores : 4;
+    for (long threads = 1; threads <= limit; threads *= 2) {
+        pthread_t *ids = malloc(threads * sizeof(pthread_t));
+        ContextWorker *workers = calloc(threads, sizeof(ContextWorker));
+        pthread_barrier_t start;
+        if (ids == NULL || workers == NULL) {
+            fprintf(stderr, "contexts: out of memory\n");
+            exit(1);
+        }
+        int saved_stdout, saved_stderr;
+        FILE *out = capture(stdout, &saved_stdout);
+        FILE *err = capture(stderr, &saved_stderr);
+        if (out == NULL || err == NULL) {
+            if (err != NULL)
+                captured_bytes(stderr, err, saved_stderr);
+            if (out != NULL)
+                captured_bytes(stdout, out, saved_stdout);
+            fprintf(stderr, "contexts: could not capture the output\n");
+            exit(1);
+        }
+        pthread_barrier_init(&start, NULL, threads + 1);
+        for (long i = 0; i < threads; i++) {
+            workers[i] = (ContextWorker){ corpus, expected, repeat, &start, 0 };
+            if (pthread_create(&ids[i], NULL, context_main, &workers[i]) != 0) {
+                fprintf(stderr, "contexts: could not start a thread\n");
+                exit(1);
+            }
+        }
+        // The workers are held at the barrier until the clock has been read
+        double begin = monotonic_seconds();
+        pthread_barrier_wait(&start);
+        size_t disagreements = 0;
+        for (long i = 0; i < threads; i++) {
+            pthread_join(ids[i], NULL);
+            disagreements += workers[i].disagreements;
+        }
+        double seconds = monotonic_seconds() - begin;
+        long written = captured_bytes(stderr, err, saved_stderr);
+        written += captured_bytes(stdout, out, saved_stdout);
+        pthread_barrier_destroy(&start);
+        free(workers);
+        free(ids);
+
+        char name[40];
+        snprintf(name, sizeof(name), "context/%ld threads", threads);
+        report(name, corpus->count * repeat * threads, seconds);
+        if (disagreements != 0) {
+            fprintf(stderr, "contexts: %zu results differ from the serial pass\n", disagreements);
+            exit(1);
+        }
+        if (written != 0) {
+            fprintf(stderr, "contexts: %ld bytes were written while the contexts ran\n", written);
+            exit(1);
+        }
+    }
+    free(expected);
+}
+
+/*
+ * evaluate_corpus - lexes and evaluates every line, in the DAG if one is
+ * given, storing the status and the value of each; lines that do not lex
+ * get status 1.
+ */
+static void evaluate_corpus(const Corpus *corpus, TokenBuffer *buf, Arena *arena, Dag *dag,
+                            int *statuses, Value *values) {
+    for (size_t i = 0; i < corpus->count; i++) {
+        int count = lex_line(buf, corpus->lines[i], corpus->lengths[i]);
+        values[i] = 0;
+        if (count <= 0 || has_lexical_errors(buf->tokens, count)) {
+            statuses[i] = 1;
+            continue;
+        }
+        arena_reset(arena);
+        if (dag != NULL)
+            statuses[i] = evaluate_tokens_dag(corpus->lines[i], corpus->lengths[i], buf->tokens,
+                                              count, arena, dag, NULL, &values[i]);
+        else
+            statuses[i] = evaluate_tokens(corpus->lines[i], corpus->lengths[i], buf->tokens,
+                                          count, arena, NULL, NULL, &values[i]);
+    }
+}
+
+/*
+ * bench_dag - times lexing and evaluating every line as a tree of its own,
+ * then built in one DAG per pass over the corpus, which must give every
+ * line the same status and value. The counters of the last DAG follow.
+ */
+static void bench_dag(const Corpus *corpus, int repeat) {
+    int *expected_status = malloc(corpus->count * sizeof(int));
+    Value *expected_value = malloc(corpus->count * sizeof(Value));
+    int *statuses = malloc(corpus->count * sizeof(int));
+    Value *values = malloc(corpus->count * sizeof(Value));
+    TokenBuffer buf = {0};
+    Arena arena = {0};
+    Dag *dag = NULL;
+    if (expected_status == NULL || expected_value == NULL || statuses == NULL || values == NULL) {
+        fprintf(stderr, "dag: out of memory\n");
+        exit(1);
+    }
+    if (corpus->names) {
+        fprintf(stderr, "dag: lines naming variables are not built in a DAG\n");
+        exit(1);
+    }
+
+    double start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++)
+        evaluate_corpus(corpus, &buf, &arena, NULL, expected_status, expected_value);
+    report("dag/trees", corpus->count * repeat, monotonic_seconds() - start);
+
+    double seconds = 0;
+    for (int r = 0; r < repeat; r++) {
+        dag_destroy(dag);
+        if ((dag = dag_create((size_t)1 << 30)) == NULL) {
+            fprintf(stderr, "dag: out of memory\n");
+            exit(1);
+        }
+        start = monotonic_seconds();
+        evaluate_corpus(corpus, &buf, &arena, dag, statuses, values);
+        seconds += monotonic_seconds() - start;
+    }
+    report("dag/shared", corpus->count * repeat, seconds);
+
+    for (size_t i = 0; i < corpus->count; i++) {
+        // The value of a line that fails is undefined
+        if (statuses[i] != expected_status[i] ||
+            (statuses[i] == 0 && values[i] != expected_value[i])) {
+            fprintf(stderr, "dag: line %zu gives %d/" VALUE_FORMAT ", expected %d/" VALUE_FORMAT "\n",
+                    i + 1, statuses[i], values[i], expected_status[i], expected_value[i]);
+            exit(1);
+        }
+    }
+    dag_report(dag, stdout);
+    dag_destroy(dag);
+    free_token_buffer(&buf);
+    arena_free(&arena);
+    free(expected_status);
+    free(expected_value);
+    free(statuses);
+    free(values);
+}
+
+/*
+ * bench_input - times finding line boundaries in the corpus repeated, first
+ * in memory with a byte loop, memchr() and find_newline(), then reading a
+ * file of it with getline() and with the line reader.
+ */
+static void bench_input(const Corpus *corpus, int repeat) {
+    size_t size;
+    char *text = join_corpus(corpus, repeat, &size);
+    if (text == NULL) {
+        fprintf(stderr, "input: out of memory\n");
+        return;
+    }
+    const char *end = text + size;
+
+    double start = monotonic_seconds();
+    for (const char *p = text; p < end; p++)
+        sink += *p == '\n';
+    report_bandwidth("scan/bytes", size, monotonic_seconds() - start);
+
+    start = monotonic_seconds();
+    for (const char *p = text; (p = memchr(p, '\n', end - p)) != NULL; p++)
+        sink++;
+    report_bandwidth("scan/memchr", size, monotonic_seconds() - start);
+
+    start = monotonic_seconds();
+    for (const char *p = text; (p = find_newline(p, end)) < end; p++)
+        sink++;
+    report_bandwidth("scan/find_newline", size, monotonic_seconds() - start);
+
+    char path[] = "/tmp/benchXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, text, size) != (ssize_t)size) {
+        fprintf(stderr, "input: could not write %s\n", path);
+        exit(1);
+    }
+    close(fd);
+    free(text);
+
+    FILE *file = fopen(path, "r");
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    start = monotonic_seconds();
+    while ((length = getline(&line, &capacity, file)) != -1)
+        sink += length;
+    report_bandwidth("read/getline", size, monotonic_seconds() - start);
+    free(line);
+    fclose(file);
+
+    file = fopen(path, "r");
+    LineReader reader;
+    const char *view;
+    size_t view_length;
+    start = monotonic_seconds();
+    if (line_reader_open(&reader, file) == 0) {
+        while (line_reader_next(&reader, &view, &view_length) > 0)
+            sink += view_length;
+        report_bandwidth(reader.mapped ? "read/line reader (mmap)" : "read/line reader",
+                         size, monotonic_seconds() - start);
+        line_reader_close(&reader);
+    }
+    fclose(file);
+    unlink(path);
+}
+
+/*
+ * read_lines - reads every line of a file with the line reader, through a
+ * decompression thread if it is compressed.
+ * Returns a checksum of the lines, or 0 if the file could not be read.
+ */
+static unsigned long read_lines(const char *path, size_t *bytes) {
+    FILE *file = fopen(path, "r");
+    CompressedStream decoder;
+    FILE *stream;
+    LineReader reader;
+    const char *view;
+    size_t view_length;
+    unsigned long checksum = 0;
+
+    *bytes = 0;
+    if (file == NULL)
+        return 0;
+    if (compressed_open_input(&decoder, file, &stream) == 0) {
+        if (line_reader_open(&reader, stream) == 0) {
+            while (line_reader_next(&reader, &view, &view_length) > 0) {
+                for (size_t i = 0; i < view_length; i++)
+                    checksum = checksum * 31 + (unsigned char)view[i];
+                *bytes += view_length + 1;
+            }
+            line_reader_close(&reader);
+        }
+        if (compressed_close(&decoder) != 0)
+            checksum = 0;
+    }
+    fclose(file);
+    return checksum;
+}
+
+/*
+ * bench_compressed - compresses a file of the corpus repeated with each
+ * format this build has, then times reading it back through the
+ * decompression thread against reading the plain file, checking the lines
+ * read are the same. Files made by gzip(1) and zstd(1) are checked by
+ * run_fixtures().
+ */
+static void bench_compressed(const Corpus *corpus, int repeat) {
+    static const struct {
+        const char *name;
+        Compression kind;
+    } formats[] = {
+        { "compressed/gzip", COMPRESS_GZIP },
+        { "compressed/zstd", COMPRESS_ZSTD },
+    };
+    size_t size, bytes;
+    char *text = join_corpus(corpus, repeat, &size);
+    if (text == NULL) {
+        fprintf(stderr, "compressed: out of memory\n");
+        return;
+    }
+
+    char plain[] = "/tmp/benchXXXXXX";
+    int fd = mkstemp(plain);
+    if (fd < 0 || write(fd, text, size) != (ssize_t)size) {
+        fprintf(stderr, "compressed: could not write %s\n", plain);
+        exit(1);
+    }
+    close(fd);
+
+    double start = monotonic_seconds();
+    unsigned long expected = read_lines(plain, &bytes);
+    report_bandwidth("compressed/none", bytes, monotonic_seconds() - start);
+
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        char path[] = "/tmp/benchXXXXXX";
+        CompressedStream encoder;
+        FILE *stream;
+        fd = mkstemp(path);
+        FILE *file = fd >= 0 ? fdopen(fd, "w") : NULL;
+        if (file == NULL) {
+            fprintf(stderr, "compressed: could not write %s\n", path);
+            exit(1);
+        }
+        int opened = compressed_open_output(&encoder, file, formats[f].kind, &stream);
+        if (opened == 0) {
+            fwrite(text, 1, size, stream);
+            opened = compressed_close(&encoder);
+        }
+        long compressed_size = ftell(file);
+        fclose(file);
+        if (opened == COMPRESS_UNSUPPORTED) {
+            printf("%-24s not in this build\n", formats[f].name);
+            unlink(path);
+            continue;
+        }
+        if (opened != 0) {
+            fprintf(stderr, "compressed: could not write %s\n", path);
+            exit(1);
+        }
+
+        start = monotonic_seconds();
+        unsigned long checksum = read_lines(path, &bytes);
+        double seconds = monotonic_seconds() - start;
+        if (checksum != expected) {
+            fprintf(stderr, "%s: lines read differ from the plain file\n", formats[f].name);
+            exit(1);
+        }
+        printf("%-24s %12.2f GB/s %9.1f%% of the size\n", formats[f].name,
+               bytes / seconds / 1e9, 100.0 * compressed_size / size);
+        unlink(path);
+    }
+    unlink(plain);
+    free(text);
+}
+
+/*
+ * bench_output - times writing the result of every corpus line with
+ * fprintf() against the output writer in each of its formats. Lines are
+ * given the value of their length, which exercises numbers of all sizes.
+ */
+static void bench_output(const Corpus *corpus, int repeat) {
+    FILE *null = fopen("/dev/null", "w");
+    if (null == NULL)
+        return;
+
+    double start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < corpus->count; i++) {
+            int value = (int)(corpus->lengths[i] * 2654435761u);
+            fprintf(null, "%s\n", corpus->lines[i]);
+            fprintf(null, "Syntax OK\nValue is %d\n", value);
+        }
+    }
+    fflush(null);
+    report("output/fprintf", corpus->count * repeat, monotonic_seconds() - start);
+
+    static const struct {
+        const char *name;
+        OutputFormat format;
+    } formats[] = {
+        { "output/text", FORMAT_TEXT },
+        { "output/json", FORMAT_JSON },
+        { "output/binary", FORMAT_BINARY },
+    };
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        OutputWriter out;
+        if (output_init(&out, null, formats[f].format) != 0)
+            break;
+        start = monotonic_seconds();
+        for (int r = 0; r < repeat; r++) {
+            for (size_t i = 0; i < corpus->count; i++) {
+                int value = (int)(corpus->lengths[i] * 2654435761u);
+                output_result(&out, corpus->lines[i], corpus->lengths[i], 0, value);
+            }
+        }
+        output_flush(&out);
+        report(formats[f].name, corpus->count * repeat, monotonic_seconds() - start);
+        output_free(&out);
+    }
+    fclose(null);
+}
+
+/*
+ * report_ops - prints the throughput of one run of single operations.
+ */
+static void report_ops(const char *name, size_t ops, double seconds) {
+    printf("%-24s %12.0f ops/s %12.2f ns/op\n", name, ops / seconds, seconds * 1e9 / ops);
+}
+
+/*
+ * libm_power - the floating-point ^ that eval_power() replaced, kept to
+ * compare against.
+ */
+static int libm_power(Value base, Value exponent, Value *value) {
+    if (exponent < 0) {
+        return ERROR;
+    }
+
+    if (exponent > (log(VALUE_MAX) / log(base)) && base != 0 && base != 1) {
+        fprintf(stderr, "Error: Exponentiation overflow.\n");
+        return ERROR;
+    }
+
+    errno = 0;
+    double result = pow((double)base, (double)exponent);
+
+    if (errno != 0 || result > VALUE_MAX || result < VALUE_MIN) {
+        fprintf(stderr, "Error: Exponentiation result out of int range.\n");
+        return ERROR;
+    }
+    *value = (Value)result;
+    return 0;
+}
+
+/*
+ * bench_arith - times ^ by squaring against the libm version on seeded
+ * operands, counting the results on which they disagree, then checked
+ * + and * against wrapping ones. The input file is not used; repeat sets
+ * the number of passes over the operands.
+ */
+static void bench_arith(const Corpus *corpus, int repeat) {
+    (void)corpus;
+    enum { PAIRS = 4096 };
+    static Value bases[PAIRS], exponents[PAIRS];
+    unsigned long state = 88172645463325252UL;
+
+    // Mostly small powers, with large bases and overflowing exponents mixed in
+    for (int i = 0; i < PAIRS; i++) {
+        unsigned long kind = next_random(&state) % 4;
+        bases[i] = (Value)(next_random(&state) % (kind == 0 ? 100000 : 21)) - (kind == 0 ? 0 : 10);
+        exponents[i] = (Value)(next_random(&state) % (kind == 3 ? 64 : 12));
+    }
+
+    int saved_stderr = silence(stderr);
+    int disagree = 0;
+    for (int i = 0; i < PAIRS; i++) {
+        Value exact = 0, approximate = 0;
+        int exact_status = eval_power(bases[i], exponents[i], &exact);
+        int libm_status = libm_power(bases[i], exponents[i], &approximate);
+        disagree += (exact_status != 0) != (libm_status != 0) || (exact_status == 0 && exact != approximate);
+    }
+
+    Value value;
+    double start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        for (int i = 0; i < PAIRS; i++) {
+            libm_power(bases[i], exponents[i], &value);
+            sink += value;
+        }
+    }
+    report_ops("power/libm", (size_t)PAIRS * repeat, monotonic_seconds() - start);
+
+    start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        for (int i = 0; i < PAIRS; i++) {
+            eval_power(bases[i], exponents[i], &value);
+            sink += value;
+        }
+    }
+    report_ops("power/squaring", (size_t)PAIRS * repeat, monotonic_seconds() - start);
+    unsilence(stderr, saved_stderr);
+    printf("%-24s %12d of %d results\n", "power/disagreements", disagree, PAIRS);
+
+    start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        for (int i = 0; i < PAIRS; i++) {
+            UValue sum = (UValue)bases[i] + (UValue)exponents[i];
+            sink += (Value)(sum * (UValue)bases[i]);
+        }
+    }
+    report_ops("arith/wrapping", (size_t)PAIRS * repeat, monotonic_seconds() - start);
+
+    int overflows = 0;
+    start = monotonic_seconds();
+    for (int r = 0; r < repeat; r++) {
+        for (int i = 0; i < PAIRS; i++) {
+            Value sum, product;
+            if (__builtin_add_overflow(bases[i], exponents[i], &sum) ||
+                __builtin_mul_overflow(sum, bases[i], &product)) {
+                overflows++;
+                continue;
+            }
+            sink += product;
+        }
+    }
+    report_ops("arith/checked", (size_t)PAIRS * repeat, monotonic_seconds() - start);
+    sink += overflows;
+}
+
+/*
+ * schoolbook_mul - r = a * b by the quadratic method only, to compare
+ * against big_mul().
+ */
+static void schoolbook_mul(Limb *r, const Limb *a, size_t na, const Limb *b, size_t nb) {
+    memset(r, 0, (na + nb) * sizeof(Limb));
+    for (size_t j = 0; j < nb; j++) {
+        uint64_t carry = 0;
+        for (size_t i = 0; i < na; i++) {
+            carry += (uint64_t)a[i] * b[j] + r[i + j];
+            r[i + j] = (Limb)carry;
+            carry >>= 32;
+        }
+        r[j + na] = (Limb)carry;
+    }
+}
+
+/*
+ * naive_decimal - converts a positive value held in limbs to decimal by
+ * dividing the whole number by 10^9 for every nine digits, to compare
+ * against big_to_decimal().
+ * Returns the digits (malloc'd), or NULL when out of memory.
+ */
+static char *naive_decimal(const BigInt *a) {
+    size_t n = a->length, width = n * 10 + 1;
+    Limb *limbs = malloc(n * sizeof(Limb));
+    char *digits = malloc(width + 1);
+    if (limbs == NULL || digits == NULL) {
+        free(limbs);
+        free(digits);
+        return NULL;
+    }
+    memcpy(limbs, a->limbs, n * sizeof(Limb));
+
+    char *p = digits + width;
+    *p = '\0';
+    while (n > 0) {
+        uint64_t remainder = 0;
+        for (size_t i = n; i-- > 0;) {
+            remainder = remainder << 32 | limbs[i];
+            limbs[i] = (Limb)(remainder / 1000000000u);
+            remainder %= 1000000000u;
+        }
+        while (n > 0 && limbs[n - 1] == 0)
+            n--;
+        for (int i = 0; i < 9; i++) {
+            *--p = '0' + remainder % 10;
+            remainder /= 10;
+        }
+    }
+    while (p[0] == '0' && p[1] != '\0')
+        p++;
+    memmove(digits, p, digits + width - p + 1);
+    free(limbs);
+    return digits;
+}
+
+/*
+ * bench_bignum - times big_mul() against schoolbook multiplication and
+ * big_to_decimal() against repeated division, on powers of 3 and 7 of
+ * growing size, checking that the decimal conversions agree. The input
+ * file is not used; repeat sets the passes over the smallest operands, and
+ * fewer passes are made over larger ones.
+ */
+static void bench_bignum(const Corpus *corpus, int repeat) {
+    (void)corpus;
+    static const size_t sizes[] = { 16, 64, 256, 1024, 4096 };
+    BigInt a, b, exponent, r;
+    big_init(&a);
+    big_init(&b);
+    big_init(&exponent);
+    big_init(&r);
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t n = sizes[s];
+        int passes = repeat / (int)n + 1;
+        char name[32];
+
+        // Operands of about n limbs: 3 has 1.58 bits, 7 has 2.81
+        big_set(&exponent, (int64_t)n * 20);
+        big_set(&r, 3);
+        if (big_pow(&a, &r, &exponent) != 0)
+            break;
+        big_set(&exponent, (int64_t)n * 11);
+        big_set(&r, 7);
+        if (big_pow(&b, &r, &exponent) != 0)
+            break;
+
+        Limb *product = malloc((a.length + b.length) * sizeof(Limb));
+        if (product == NULL)
+            break;
+        double start = monotonic_seconds();
+        for (int i = 0; i < passes; i++) {
+            schoolbook_mul(product, a.limbs, a.length, b.limbs, b.length);
+            sink += product[0];
+        }
+        snprintf(name, sizeof(name), "mul/schoolbook/%zu", n);
+        report_ops(name, passes, monotonic_seconds() - start);
+        free(product);
+
+        start = monotonic_seconds();
+        for (int i = 0; i < passes; i++) {
+            big_mul(&r, &a, &b);
+            sink += r.length;
+        }
+        snprintf(name, sizeof(name), "mul/karatsuba/%zu", n);
+        report_ops(name, passes, monotonic_seconds() - start);
+
+        char *naive = NULL, *fast = NULL;
+        size_t length;
+        start = monotonic_seconds();
+        for (int i = 0; i < passes; i++) {
+            free(naive);
+            naive = naive_decimal(&a);
+        }
+        snprintf(name, sizeof(name), "decimal/naive/%zu", n);
+        report_ops(name, passes, monotonic_seconds() - start);
+
+        start = monotonic_seconds();
+        for (int i = 0; i < passes; i++) {
+            free(fast);
+            fast = big_to_decimal(&a, &length);
+        }
+        snprintf(name, sizeof(name), "decimal/split/%zu", n);
+        report_ops(name, passes, monotonic_seconds() - start);
+        if (naive == NULL || fast == NULL || strcmp(naive, fast) != 0)
+            printf("%-24s %12s\n", "decimal/disagreement", name + sizeof("decimal/split/") - 1);
+        free(naive);
+        free(fast);
+    }
+
+    big_free(&a);
+    big_free(&b);
+    big_free(&exponent);
+    big_free(&r);
+}
+
+/*
+ * time_tokenizer - times the tokenizer program's get_token() on every line.
+ * Its lexeme listing on stdout is suppressed and its lexical errors go to
+ * /dev/null.
+ */
+static double time_tokenizer(const Corpus *corpus, int passes) {
+    FILE *null = fopen("/dev/null", "w");
+    if (null == NULL)
+        return 0;
+
+    int saved_stdout = silence(stdout);
+    double start = monotonic_seconds();
+    for (int r = 0; r < passes; r++) {
+        for (size_t i = 0; i < corpus->count; i++)
+            get_token(corpus->lines[i], null);
+    }
+    double seconds = monotonic_seconds() - start;
+    unsilence(stdout, saved_stdout);
+    fclose(null);
+    return seconds;
+}
+
+/*
+ * time_statements - times what bexpr() does for a line, tokenizing, parsing
+ * and evaluating it, on lines that name variables. Every pass starts with
+ * no variables.
+ */
+static double time_statements(const Corpus *corpus, int passes) {
+    TokenBuffer buf = { .identifiers = 1 };
+    Arena arena = {0};
+    Value value;
+
+    double start = monotonic_seconds();
+    for (int r = 0; r < passes; r++) {
+        Variables variables = {0};
+        for (size_t i = 0; i < corpus->count; i++) {
+            int count = lex_line(&buf, corpus->lines[i], corpus->lengths[i]);
+            arena_reset(&arena);
+            if (count > 0)
+                sink += evaluate_tokens(corpus->lines[i], corpus->lengths[i], buf.tokens, count,
+                                        &arena, &variables, NULL, &value);
+        }
+        free_variables(&variables);
+    }
+    double seconds = monotonic_seconds() - start;
+    free_token_buffer(&buf);
+    arena_free(&arena);
+    return seconds;
+}
+
+/*
+ * time_parser - times bexpr() on every line, with its debug output and
+ * runtime messages suppressed. bexpr() allows no names, so lines naming
+ * variables are timed with time_statements() instead.
+ */
+static double time_parser(const Corpus *corpus, int passes) {
+    if (corpus->names)
+        return time_statements(corpus, passes);
+
+    int saved_stdout = silence(stdout);
+    int saved_stderr = silence(stderr);
+    double start = monotonic_seconds();
+    for (int r = 0; r < passes; r++) {
+        for (size_t i = 0; i < corpus->count; i++)
+            sink += bexpr(corpus->lines[i]);
+    }
+    double seconds = monotonic_seconds() - start;
+    unsilence(stderr, saved_stderr);
+    unsilence(stdout, saved_stdout);
+    return seconds;
+}
+
+/*
+ * time_end_to_end - times the serial interpreter over the corpus text,
+ * from reading the lines to formatting the output.
+ */
+static double time_end_to_end(const Corpus *corpus, int passes) {
+    size_t size, output_size;
+    char *output;
+    char *text = join_corpus(corpus, passes, &size);
+    if (text == NULL)
+        return 0;
+
+    double seconds = run_batch(text, size, 0, corpus->names, NULL, &output, &output_size);
+    free(output);
+    free(text);
+    return seconds;
+}
+
+/* The stages timed by the suite */
+static const struct {
+    const char *name;
+    double (*time)(const Corpus *, int);
+} suite_stages[] = {
+    { "tokenizer", time_tokenizer },
+    { "parser", time_parser },
+    { "end_to_end", time_end_to_end },
+};
+
+/*
+ * run_suite_stage - times one stage over one corpus in a child process, so
+ * that the peak resident set size reported is that of the stage alone
+ * (plus the corpus it inherits), and prints the result as one JSON line.
+ * Returns 0 on success, or -1 if the child failed.
+ */
+static int run_suite_stage(size_t stage, CorpusKind kind, const Corpus *corpus) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0) {
+        double seconds = suite_stages[stage].time(corpus, SUITE_PASSES);
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        size_t lines = corpus->count * SUITE_PASSES;
+        printf("{\"benchmark\":\"%s\",\"corpus\":\"%s\",\"lines\":%zu,"
+               "\"seconds\":%.6f,\"lines_per_second\":%.0f,\"ns_per_line\":%.1f,"
+               "\"peak_rss_kb\":%ld}\n",
+               suite_stages[stage].name, corpus_kind_name(kind), lines, seconds,
+               seconds > 0 ? lines / seconds : 0, seconds * 1e9 / lines, usage.ru_maxrss);
+        fflush(stdout);
+        _exit(seconds > 0 ? 0 : 1);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1;
+    return 0;
+}
+
+/*
+ * run_suite - generates every kind of corpus and times each stage over it,
+ * printing one JSON line per stage and corpus.
+ * Returns 0 on success, or 1 if any run failed.
+ */
+static int run_suite(size_t lines, unsigned long seed) {
+    int failed = 0;
+
+    for (int kind = 0; kind < NUM_CORPUS_KINDS; kind++) {
+        size_t size;
+        char *text = generate_corpus(kind, lines, seed, &size);
+        char *data = text != NULL ? realloc(text, size + 1) : NULL;
+        Corpus corpus = {0};
+        if (data == NULL || split_corpus(data, size, &corpus) != 0) {
+            fprintf(stderr, "suite: out of memory\n");
+            free(data != NULL ? data : text);
+            free(corpus.lines);
+            free(corpus.lengths);
+            return 1;
+        }
+        corpus.names = kind == CORPUS_VARIABLES;
+        if (kind == CORPUS_ROWS) {
+            free_corpus(&corpus); // Rows are input for templates, timed by bench columns
+            continue;
+        }
+
+        for (size_t stage = 0; stage < sizeof(suite_stages) / sizeof(suite_stages[0]); stage++) {
+            if (run_suite_stage(stage, kind, &corpus) != 0) {
+                fprintf(stderr, "suite: %s failed on the %s corpus\n",
+                        suite_stages[stage].name, corpus_kind_name(kind));
+                failed = 1;
+            }
+        }
+        free_corpus(&corpus);
+    }
+    return failed;
+}
+
+/*
+ * write_generated - writes a generated corpus to stdout.
+ * Returns 0 on success, or 1 on failure.
+ */
+static int write_generated(const char *name, size_t lines, unsigned long seed) {
+    int kind = corpus_kind(name);
+    if (kind < 0) {
+        fprintf(stderr, "Error: Unknown corpus %s.\n", name);
+        return 1;
+    }
+
+    size_t size;
+    char *text = generate_corpus(kind, lines, seed, &size);
+    if (text == NULL) {
+        fprintf(stderr, "generate: out of memory\n");
+        return 1;
+    }
+    int failed = fwrite(text, 1, size, stdout) != size || fflush(stdout) != 0;
+    free(text);
+    return failed;
+}
+
+/* Files made by gzip(1) and zstd(1) from an input file, named by suffix */
+static const struct {
+    const char *suffix;
+    int truncated;          /* Cut short, so it must be refused */
+    int zstd;               /* Refused by a build without zstd */
+} fixtures[] = {
+    { ".gz", 0, 0 },            /* gzip -n -9 */
+    { ".members.gz", 0, 0 },    /* Two gzip members, concatenated */
+    { ".truncated.gz", 1, 0 },  /* The first half of the .gz file */
+    { ".zst", 0, 1 },           /* zstd -19 */
+};
+
+/*
+ * read_file - reads a whole file into a NUL-terminated buffer.
+ * Returns the buffer, or NULL on failure.
+ */
+static char *read_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    rewind(file);
+    char *data = length >= 0 ? malloc(length + 1) : NULL;
+    if (data != NULL && fread(data, 1, length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    if (data != NULL) {
+        data[length] = '\0';
+        *size = length;
+    }
+    return data;
+}
+
+/*
+ * run_interpreter - runs the interpreter on an input file, with its stdout
+ * discarded and its stderr written to a file.
+ * Returns the exit status of the interpreter, or -1 if it did not exit.
+ */
+static int run_interpreter(const char *interpreter, const char *input, const char *output,
+                           const char *errors) {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0) {
+        if (freopen("/dev/null", "w", stdout) == NULL || freopen(errors, "w", stderr) == NULL)
+            _exit(127);
+        execl(interpreter, interpreter, input, output, (char *)NULL);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status))
+        return -1;
+    return WEXITSTATUS(status);
+}
+
+/*
+ * run_fixtures - runs the interpreter on the compressed fixtures of an
+ * input file and on the file itself. Each fixture must give the output and
+ * the error messages of the plain file, except that the truncated one, and
+ * the zstd one in a build without zstd, must fail with status 1 and say
+ * why on stderr.
+ * Returns 0 if every fixture passed, or 1 otherwise.
+ */
+static int run_fixtures(const char *interpreter, const char *input) {
+    char expected_path[] = "/tmp/benchXXXXXX", output_path[] = "/tmp/benchXXXXXX";
+    char errors_path[] = "/tmp/benchXXXXXX";
+    int fds[3] = { mkstemp(expected_path), mkstemp(output_path), mkstemp(errors_path) };
+    size_t expected_size, expected_errors_size, size, errors_size;
+    int failed = 0;
+
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] < 0) {
+            fprintf(stderr, "fixtures: could not create a temporary file\n");
+            return 1;
+        }
+        close(fds[i]);
+    }
+    char *expected = NULL, *expected_errors = NULL;
+    if (run_interpreter(interpreter, input, expected_path, errors_path) != 0 ||
+        (expected = read_file(expected_path, &expected_size)) == NULL ||
+        (expected_errors = read_file(errors_path, &expected_errors_size)) == NULL) {
+        fprintf(stderr, "fixtures: %s failed on %s\n", interpreter, input);
+        failed = 1;
+    }
+
+    for (size_t f = 0; !failed && f < sizeof(fixtures) / sizeof(fixtures[0]); f++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s%s", input, fixtures[f].suffix);
+        int status = run_interpreter(interpreter, path, output_path, errors_path);
+        char *output = read_file(output_path, &size);
+        char *errors = read_file(errors_path, &errors_size);
+        int passed;
+
+#ifdef HAVE_ZSTD
+        int refused = fixtures[f].truncated;
+#else
+        int refused = fixtures[f].truncated || fixtures[f].zstd;
+#endif
+        if (refused)
+            passed = status == 1 && errors != NULL &&
+                     strstr(errors, fixtures[f].zstd ? "-DHAVE_ZSTD" : "Could not decompress");
+        else
+            passed = status == 0 && output != NULL && errors != NULL &&
+                     size == expected_size && memcmp(output, expected, size) == 0 &&
+                     errors_size == expected_errors_size &&
+                     memcmp(errors, expected_errors, errors_size) == 0;
+        printf("%-28s %s\n", path, !passed ? "FAILED" : refused ? "refused" : "same as plain");
+        failed |= !passed;
+        free(output);
+        free(errors);
+    }
+
+    unlink(expected_path);
+    unlink(output_path);
+    unlink(errors_path);
+    free(expected);
+    free(expected_errors);
+    return failed;
+}
+
+/* One connection of the load generator */
+typedef struct {
+    const char *path;            /* Path of the server's socket */
+    const unsigned char *frame;  /* Request frame, header included */
+    size_t frame_size;
+    int requests;                /* Requests to send, one at a time */
+    pthread_barrier_t *start;
+    double *latencies;           /* Seconds from sending each request to its response */
+    size_t response_size;        /* Length of every response */
+    int failed;                  /* Set if the connection failed or responses differ */
+} LoadClient;
+
+/*
+ * transfer_all - sends or receives exactly size bytes on a socket.
+ * Returns 0 on success, or -1 if the connection failed or closed.
+ */
+static int transfer_all(int fd, unsigned char *data, size_t size, int sending) {
+    while (size > 0) {
+        ssize_t n = sending ? send(fd, data, size, MSG_NOSIGNAL) : recv(fd, data, size, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/*
+ * load_main - connects to the server and sends the request frame the given
+ * number of times, timing each round trip.
+ */
+static void *load_main(void *arg) {
+    LoadClient *client = arg;
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    strncpy(address.sun_path, client->path, sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+        client->failed = 1;
+
+    unsigned char *response = NULL;
+    size_t capacity = 0;
+    pthread_barrier_wait(client->start);
+    for (int r = 0; !client->failed && r < client->requests; r++) {
+        unsigned char header[SERVER_HEADER];
+        double begin = monotonic_seconds();
+        if (transfer_all(fd, (unsigned char *)client->frame, client->frame_size, 1) != 0 ||
+            transfer_all(fd, header, SERVER_HEADER, 0) != 0) {
+            client->failed = 1;
+            break;
+        }
+        size_t size = frame_length(header);
+        if (size > capacity) {
+            free(response);
+            capacity = size;
+            response = malloc(capacity);
+        }
+        if ((size > 0 && response == NULL) || transfer_all(fd, response, size, 0) != 0) {
+            client->failed = 1;
+            break;
+        }
+        client->latencies[r] = monotonic_seconds() - begin;
+        if (r == 0)
+            client->response_size = size;
+        else if (size != client->response_size)
+            client->failed = 1;
+    }
+    free(response);
+    if (fd >= 0)
+        close(fd);
+    return NULL;
+}
+
+/*
+ * compare_seconds - orders latencies for qsort().
+ */
+static int compare_seconds(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * report_latency - prints one latency in milliseconds.
+ */
+static void report_latency(const char *name, double seconds) {
+    printf("%-24s %12.3f ms\n", name, seconds * 1e3);
+}
+
+/*
+ * run_load - generates load against a running server: each of the given
+ * number of connections sends the whole input file as one request, waits
+ * for its response and repeats. Prints the request rate, the line rate and
+ * the latency percentiles over all requests.
+ * Returns 0 on success, or 1 if a connection fails or responses differ.
+ */
+static int run_load(const char *path, const char *input, int requests, int connections) {
+    Corpus corpus;
+    if (load_corpus(input, &corpus) != 0 || corpus.count == 0) {
+        fprintf(stderr, "Error: Could not read %s.\n", input);
+        return 1;
+    }
+    if (requests < 1 || connections < 1) {
+        fprintf(stderr, "load: requests and connections must be positive\n");
+        return 1;
+    }
+
+    size_t size;
+    char *text = join_corpus(&corpus, 1, &size);
+    unsigned char *frame = text ? malloc(SERVER_HEADER + size) : NULL;
+    size_t total = (size_t)requests * connections;
+    double *latencies = malloc(total * sizeof(double));
+    pthread_t *ids = malloc(connections * sizeof(pthread_t));
+    LoadClient *clients = calloc(connections, sizeof(LoadClient));
+    if (frame == NULL || latencies == NULL || ids == NULL || clients == NULL) {
+        fprintf(stderr, "load: out of memory\n");
+        exit(1);
+    }
+    if (size > SERVER_MAX_FRAME) {
+        fprintf(stderr, "load: %s is larger than a request may be\n", input);
+        exit(1);
+    }
+    put_frame_length(frame, size);
+    memcpy(frame + SERVER_HEADER, text, size);
+    free(text);
+
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, connections + 1);
+    for (int i = 0; i < connections; i++) {
+        clients[i] = (LoadClient){ path, frame, SERVER_HEADER + size, requests, &start,
+                                   latencies + (size_t)i * requests, 0, 0 };
+        if (pthread_create(&ids[i], NULL, load_main, &clients[i]) != 0) {
+            fprintf(stderr, "load: could not start a thread\n");
+            exit(1);
+        }
+    }
+    pthread_barrier_wait(&start);
+    double begin = monotonic_seconds();
+    int failed = 0;
+    for (int i = 0; i < connections; i++) {
+        pthread_join(ids[i], NULL);
+        failed |= clients[i].failed || clients[i].response_size != clients[0].response_size;
+    }
+    double seconds = monotonic_seconds() - begin;
+    pthread_barrier_destroy(&start);
+
+    if (failed) {
+        fprintf(stderr, "load: a connection to %s failed or its responses differ\n", path);
+    } else {
+        qsort(latencies, total, sizeof(double), compare_seconds);
+        printf("%-24s %12.0f requests/s\n", "load/requests", total / seconds);
+        report("load/lines", corpus.count * total, seconds);
+        report_latency("load/p50", latencies[total / 2]);
+        report_latency("load/p99", latencies[total * 99 / 100]);
+        report_latency("load/max", latencies[total - 1]);
+    }
+    free(clients);
+    free(ids);
+    free(latencies);
+    free(frame);
+    free_corpus(&corpus);
+    return failed;
+}
+
+/* The benchmarks that can be selected on the command line */
+static const struct {
+    const char *name;
+    void (*run)(const Corpus *, int);
+} benchmarks[] = {
+    { "lexer", bench_lexer },
+    { "vm", bench_vm },
+    { "variables", bench_variables },
+    { "jit", bench_jit },
+    { "columns", bench_columns },
+    { "threads", bench_threads },
+    { "stats", bench_stats },
+    { "contexts", bench_contexts },
+    { "dag", bench_dag },
+    { "input", bench_input },
+    { "compressed", bench_compressed },
+    { "output", bench_output },
+    { "arith", bench_arith },
+    { "bignum", bench_bignum },
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+int main(int argc, char *argv[]) {
+    if (argc >= 4 && argc <= 5 && strcmp(argv[1], "generate") == 0)
+        return write_generated(argv[2], strtoul(argv[3], NULL, 10),
+                               argc == 5 ? strtoul(argv[4], NULL, 10) : DEFAULT_SEED);
+    if (argc >= 2 && argc <= 4 && strcmp(argv[1], "suite") == 0)
+        return run_suite(argc >= 3 ? strtoul(argv[2], NULL, 10) : DEFAULT_SUITE_LINES,
+                         argc == 4 ? strtoul(argv[3], NULL, 10) : DEFAULT_SEED);
+    if (argc == 4 && strcmp(argv[1], "fixtures") == 0)
+        return run_fixtures(argv[2], argv[3]);
+    if (argc >= 4 && argc <= 6 && strcmp(argv[1], "load") == 0)
+        return run_load(argv[2], argv[3], argc >= 5 ? atoi(argv[4]) : DEFAULT_LOAD_REQUESTS,
+                        argc == 6 ? atoi(argv[5]) : DEFAULT_LOAD_CONNECTIONS);
+
+    if (argc < 3 || argc > 4) {
+        printf("Usage: %s <benchmark> <inputfile> [repeat]\n"
+               "       %s generate <corpus> <lines> [seed]\n"
+               "       %s suite [lines] [seed]\n"
+               "       %s load <socket> <inputfile> [requests] [connections]\n"
+               "       %s fixtures <interpreter> <inputfile>\n",
+               argv[0], argv[0], argv[0], argv[0], argv[0]);
+        return 1;
+    }
+
+    Corpus corpus;
+    if (load_corpus(argv[2], &corpus) != 0 || corpus.count == 0) {
+        fprintf(stderr, "Error: Could not read %s.\n", argv[2]);
+        return 1;
+    }
+    int repeat = argc == 4 ? atoi(argv[3]) : DEFAULT_REPEAT;
+
+    for (size_t i = 0; i < NUM_BENCHMARKS; i++) {
+        if (strcmp(argv[1], benchmarks[i].name) == 0 ||
+            strcmp(argv[1], "all") == 0)
+            benchmarks[i].run(&corpus, repeat);
+    }
+
+    free_corpus(&corpus);
+    return 0;
+}
@@ -0,0 +1,1150 @@
+/*
+ * bignum.c - arbitrary-precision integers and the evaluator that uses them.
+ * Magnitudes are arrays of 32-bit limbs, so every limb product fits in a
+ * 64-bit integer. Results are computed into a value distinct from the
+ * operands and then normalized, returning to the inline form whenever they
+ * fit in 64 bits again.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "bignum.h"
+#include "parser.h"
+
+typedef uint64_t DoubleLimb;
+
+#define LIMB_BITS 32
+
+/* Operands shorter than this many limbs are multiplied by the schoolbook method */
+#define KARATSUBA_THRESHOLD 32
+
+/* Numbers up to this many limbs are converted to decimal by repeated division */
+#define DECIMAL_THRESHOLD 128
+
+/* Powers of ten longer than this many limbs are divided by through their reciprocals */
+#define DIVIDE_THRESHOLD 1024
+
+/* Reciprocals of up to this many limbs are computed by long division */
+#define RECIPROCAL_THRESHOLD 32
+
+/* The largest power of ten in a limb, and its number of digits */
+#define CHUNK_BASE 1000000000u
+#define CHUNK_DIGITS 9
+
+/* Entries of the value stack allocated at a time */
+#define BIG_STACK_CHUNK 64
+
+struct BigEvaluator {
+    BigInt *values;         /* Value stack; entries keep their limbs across lines */
+    size_t capacity;
+    BigInt scratch;         /* Receives each result before it replaces an operand */
+};
+
+/* The magnitude and sign of a value, a small one spread over local limbs */
+typedef struct {
+    const Limb *limbs;
+    size_t length;          /* 0 for zero */
+    int negative;
+    Limb local[2];
+} Magnitude;
+
+/* A power of ten used by the decimal conversion */
+typedef struct {
+    Limb *limbs;
+    size_t length;
+    Limb *normalized;       /* Shifted left until its top bit is set, or NULL */
+    Limb *inverse;          /* Reciprocal of normalized, length + 1 limbs */
+    int shift;
+} Power;
+
+/**
+ * big_init - initializes a value to 0.
+ * @a: the value.
+ */
+void big_init(BigInt *a) {
+    a->small = 0;
+    a->limbs = NULL;
+    a->length = 0;
+    a->capacity = 0;
+    a->negative = 0;
+}
+
+/**
+ * big_free - releases the limbs of a value.
+ * @a: the value.
+ */
+void big_free(BigInt *a) {
+    free(a->limbs);
+    big_init(a);
+}
+
+/**
+ * big_set - sets a value from a machine integer.
+ * @a: the value.
+ * @value: the integer.
+ */
+void big_set(BigInt *a, int64_t value) {
+    a->small = value;
+    a->length = 0;
+}
+
+/**
+ * big_fits - tells whether a value fits in a Value.
+ * @a: the value.
+ * @value: receives the value if it fits.
+ *
+ * Returns 1 if it fits, 0 if not.
+ */
+int big_fits(const BigInt *a, Value *value) {
+    if (a->length != 0 || a->small < VALUE_MIN || a->small > VALUE_MAX)
+        return 0;
+    *value = (Value)a->small;
+    return 1;
+}
+
+/*
+ * reserve - makes room for at least length limbs, keeping none of them.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int reserve(BigInt *a, size_t length) {
+    if (length <= a->capacity)
+        return 0;
+    size_t capacity = a->capacity ? a->capacity : 4;
+    while (capacity < length)
+        capacity *= 2;
+    Limb *grown = malloc(capacity * sizeof(Limb));
+    if (grown == NULL)
+        return -1;
+    free(a->limbs);
+    a->limbs = grown;
+    a->capacity = capacity;
+    return 0;
+}
+
+/*
+ * swap - exchanges two values, limbs included.
+ */
+static void swap(BigInt *a, BigInt *b) {
+    BigInt t = *a;
+    *a = *b;
+    *b = t;
+}
+
+/*
+ * magnitude - takes the magnitude and sign of a value.
+ */
+static void magnitude(const BigInt *a, Magnitude *m) {
+    if (a->length > 0) {
+        m->limbs = a->limbs;
+        m->length = a->length;
+        m->negative = a->negative;
+        return;
+    }
+    uint64_t u = a->small < 0 ? 0 - (uint64_t)a->small : (uint64_t)a->small;
+    m->local[0] = (Limb)u;
+    m->local[1] = (Limb)(u >> LIMB_BITS);
+    m->limbs = m->local;
+    m->length = m->local[1] ? 2 : m->local[0] ? 1 : 0;
+    m->negative = a->small < 0;
+}
+
+/*
+ * trim - returns the length of a magnitude without its leading zero limbs.
+ */
+static size_t trim(const Limb *a, size_t length) {
+    while (length > 0 && a[length - 1] == 0)
+        length--;
+    return length;
+}
+
+/*
+ * settle - finishes a result whose magnitude was written to its limbs,
+ * moving it back inline if it fits in 64 bits.
+ */
+static void settle(BigInt *r, size_t length, int negative) {
+    length = trim(r->limbs, length);
+    if (length <= 2) {
+        uint64_t u = length == 0 ? 0 : r->limbs[0];
+        if (length == 2)
+            u |= (uint64_t)r->limbs[1] << LIMB_BITS;
+        if (u <= (uint64_t)INT64_MAX || (negative && u == (uint64_t)INT64_MAX + 1)) {
+            r->small = negative ? (int64_t)(0 - u) : (int64_t)u;
+            r->length = 0;
+            return;
+        }
+    }
+    r->length = length;
+    r->negative = negative;
+}
+
+/*
+ * copy - sets r to the value of a.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int copy(BigInt *r, const BigInt *a) {
+    if (a->length == 0) {
+        big_set(r, a->small);
+        return 0;
+    }
+    if (reserve(r, a->length) != 0)
+        return -1;
+    memcpy(r->limbs, a->limbs, a->length * sizeof(Limb));
+    r->length = a->length;
+    r->negative = a->negative;
+    return 0;
+}
+
+/*
+ * compare_limbs - compares two magnitudes without leading zero limbs.
+ */
+static int compare_limbs(const Limb *a, size_t na, const Limb *b, size_t nb) {
+    if (na != nb)
+        return na < nb ? -1 : 1;
+    while (na-- > 0) {
+        if (a[na] != b[na])
+            return a[na] < b[na] ? -1 : 1;
+    }
+    return 0;
+}
+
+/*
+ * add_limbs - r = a + b where na >= nb. r has room for na + 1 limbs.
+ */
+static void add_limbs(Limb *r, const Limb *a, size_t na, const Limb *b, size_t nb) {
+    DoubleLimb carry = 0;
+    size_t i = 0;
+    for (; i < nb; i++) {
+        carry += (DoubleLimb)a[i] + b[i];
+        r[i] = (Limb)carry;
+        carry >>= LIMB_BITS;
+    }
+    for (; i < na; i++) {
+        carry += a[i];
+        r[i] = (Limb)carry;
+        carry >>= LIMB_BITS;
+    }
+    r[na] = (Limb)carry;
+}
+
+/*
+ * sub_limbs - r = a - b where a >= b. r has room for na limbs.
+ */
+static void sub_limbs(Limb *r, const Limb *a, size_t na, const Limb *b, size_t nb) {
+    DoubleLimb borrow = 0;
+    size_t i = 0;
+    for (; i < nb; i++) {
+        DoubleLimb d = (DoubleLimb)a[i] - b[i] - borrow;
+        r[i] = (Limb)d;
+        borrow = d >> (2 * LIMB_BITS - 1);
+    }
+    for (; i < na; i++) {
+        DoubleLimb d = (DoubleLimb)a[i] - borrow;
+        r[i] = (Limb)d;
+        borrow = d >> (2 * LIMB_BITS - 1);
+    }
+}
+
+/*
+ * add_into - a += b where na >= nb, carrying through the rest of a.
+ */
+static void add_into(Limb *a, size_t na, const Limb *b, size_t nb) {
+    DoubleLimb carry = 0;
+    size_t i = 0;
+    for (; i < nb; i++) {
+        carry += (DoubleLimb)a[i] + b[i];
+        a[i] = (Limb)carry;
+        carry >>= LIMB_BITS;
+    }
+    for (; carry != 0 && i < na; i++) {
+        carry += a[i];
+        a[i] = (Limb)carry;
+        carry >>= LIMB_BITS;
+    }
+}
+
+/*
+ * sub_from - a -= b where a >= b and na >= nb, borrowing through the rest of a.
+ */
+static void sub_from(Limb *a, size_t na, const Limb *b, size_t nb) {
+    DoubleLimb borrow = 0;
+    size_t i = 0;
+    for (; i < nb; i++) {
+        DoubleLimb d = (DoubleLimb)a[i] - b[i] - borrow;
+        a[i] = (Limb)d;
+        borrow = d >> (2 * LIMB_BITS - 1);
+    }
+    for (; borrow != 0 && i < na; i++) {
+        DoubleLimb d = (DoubleLimb)a[i] - borrow;
+        a[i] = (Limb)d;
+        borrow = d >> (2 * LIMB_BITS - 1);
+    }
+}
+
+/*
+ * mul_schoolbook - r = a * b. r has room for na + nb limbs and does not
+ * overlap a or b.
+ */
+static void mul_schoolbook(Limb *r, const Limb *a, size_t na, const Limb *b, size_t nb) {
+    memset(r, 0, (na + nb) * sizeof(Limb));
+    for (size_t j = 0; j < nb; j++) {
+        DoubleLimb carry = 0;
+        Limb digit = b[j];
+        if (digit == 0)
+            continue;
+        for (size_t i = 0; i < na; i++) {
+            carry += (DoubleLimb)a[i] * digit + r[i + j];
+            r[i + j] = (Limb)carry;
+            carry >>= LIMB_BITS;
+        }
+        r[j + na] = (Limb)carry;
+    }
+}
+
+/*
+ * mul_limbs - r = a * b where na >= nb. r has room for na + nb limbs and does
+ * not overlap a or b.
+ *
+ * Karatsuba's method splits both operands at m limbs, a = a1 B^m + a0 and
+ * b = b1 B^m + b0, and gets the middle product a0 b1 + a1 b0 from a single
+ * multiplication as (a0 + a1)(b0 + b1) - a0 b0 - a1 b1, so three half-size
+ * products replace four. An operand less than half as long as the other is
+ * multiplied by slices of the longer one instead, as splitting both at the
+ * same point would leave one half empty.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int mul_limbs(Limb *r, const Limb *a, size_t na, const Limb *b, size_t nb) {
+    if (nb < KARATSUBA_THRESHOLD) {
+        mul_schoolbook(r, a, na, b, nb);
+        return 0;
+    }
+
+    if (2 * nb <= na) {
+        Limb *part = malloc(2 * nb * sizeof(Limb));
+        if (part == NULL)
+            return -1;
+        memset(r, 0, (na + nb) * sizeof(Limb));
+        for (size_t i = 0; i < na; i += nb) {
+            size_t n = na - i < nb ? na - i : nb;
+            int status = n == nb ? mul_limbs(part, a + i, n, b, nb)
+                                 : mul_limbs(part, b, nb, a + i, n);
+            if (status != 0) {
+                free(part);
+                return -1;
+            }
+            add_into(r + i, na + nb - i, part, n + nb);
+        }
+        free(part);
+        return 0;
+    }
+
+    // nb > na / 2 >= m, so both high halves are nonempty
+    size_t m = na / 2;
+    const Limb *a0 = a, *a1 = a + m, *b0 = b, *b1 = b + m;
+    size_t na1 = na - m, nb1 = nb - m;
+    size_t nsa = na1 + 1, nsb = (nb1 > m ? nb1 : m) + 1;
+
+    Limb *sums = malloc((nsa + nsb + nsa + nsb) * sizeof(Limb));
+    if (sums == NULL)
+        return -1;
+    Limb *sa = sums, *sb = sums + nsa, *middle = sums + nsa + nsb;
+
+    add_limbs(sa, a1, na1, a0, m);
+    if (nb1 >= m)
+        add_limbs(sb, b1, nb1, b0, m);
+    else
+        add_limbs(sb, b0, m, b1, nb1);
+
+    // a0 b0 and a1 b1 go straight to their places in r
+    if (mul_limbs(r, a0, m, b0, m) != 0 ||
+        mul_limbs(r + 2 * m, a1, na1, b1, nb1) != 0 ||
+        mul_limbs(middle, sa, nsa, sb, nsb) != 0) {
+        free(sums);
+        return -1;
+    }
+    sub_from(middle, nsa + nsb, r, 2 * m);
+    sub_from(middle, nsa + nsb, r + 2 * m, na1 + nb1);
+    add_into(r + m, na + nb - m, middle, trim(middle, nsa + nsb));
+    free(sums);
+    return 0;
+}
+
+/*
+ * divide_limbs - q = a / b and r = a % b where na >= nb and the top limb of b
+ * is not zero. q has room for na - nb + 1 limbs and r, which may be NULL,
+ * for nb limbs.
+ *
+ * Knuth's algorithm D: b is shifted until its top bit is set, so each
+ * quotient limb estimated from the top two limbs of the remainder is at most
+ * two too large, and the estimate is corrected before and, rarely, after
+ * multiplying it out.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int divide_limbs(Limb *q, Limb *r, const Limb *a, size_t na, const Limb *b, size_t nb) {
+    if (nb == 1) {
+        DoubleLimb remainder = 0;
+        for (size_t i = na; i-- > 0;) {
+            remainder = remainder << LIMB_BITS | a[i];
+            q[i] = (Limb)(remainder / b[0]);
+            remainder %= b[0];
+        }
+        if (r != NULL)
+            r[0] = (Limb)remainder;
+        return 0;
+    }
+
+    Limb *un = malloc((na + 1 + nb) * sizeof(Limb));
+    if (un == NULL)
+        return -1;
+    Limb *vn = un + na + 1;
+    int shift = __builtin_clz(b[nb - 1]);
+
+    // The top half of a double limb shifted left is the shifted upper limb
+    for (size_t i = nb - 1; i > 0; i--)
+        vn[i] = (Limb)((((DoubleLimb)b[i] << LIMB_BITS | b[i - 1]) << shift) >> LIMB_BITS);
+    vn[0] = b[0] << shift;
+    un[na] = (Limb)(((DoubleLimb)a[na - 1] << shift) >> LIMB_BITS);
+    for (size_t i = na - 1; i > 0; i--)
+        un[i] = (Limb)((((DoubleLimb)a[i] << LIMB_BITS | a[i - 1]) << shift) >> LIMB_BITS);
+    un[0] = a[0] << shift;
+
+    for (size_t j = na - nb + 1; j-- > 0;) {
+        DoubleLimb top = (DoubleLimb)un[j + nb] << LIMB_BITS | un[j + nb - 1];
+        DoubleLimb qhat = top / vn[nb - 1];
+        DoubleLimb rhat = top % vn[nb - 1];
+        while (qhat >> LIMB_BITS ||
+               qhat * vn[nb - 2] > (rhat << LIMB_BITS | un[j + nb - 2])) {
+            qhat--;
+            rhat += vn[nb - 1];
+            if (rhat >> LIMB_BITS)
+                break;
+        }
+
+        int64_t borrow = 0, t;
+        for (size_t i = 0; i < nb; i++) {
+            DoubleLimb product = qhat * vn[i];
+            t = (int64_t)un[i + j] - borrow - (int64_t)(product & 0xFFFFFFFF);
+            un[i + j] = (Limb)t;
+            borrow = (int64_t)(product >> LIMB_BITS) - (t >> LIMB_BITS);
+        }
+        t = (int64_t)un[j + nb] - borrow;
+        un[j + nb] = (Limb)t;
+
+        q[j] = (Limb)qhat;
+        if (t < 0) {
+            // The estimate was one too large; add b back
+            q[j]--;
+            DoubleLimb carry = 0;
+            for (size_t i = 0; i < nb; i++) {
+                carry += (DoubleLimb)un[i + j] + vn[i];
+                un[i + j] = (Limb)carry;
+                carry >>= LIMB_BITS;
+            }
+            un[j + nb] += (Limb)carry;
+        }
+    }
+
+    if (r != NULL) {
+        for (size_t i = 0; i < nb; i++)
+            r[i] = (Limb)((((DoubleLimb)un[i + 1] << LIMB_BITS) | un[i]) >> shift);
+    }
+    free(un);
+    return 0;
+}
+
+/*
+ * add_signed - r = a + b, or a - b if subtract is set.
+ * Returns 0 on success, or OUT_OF_MEMORY.
+ */
+static int add_signed(BigInt *r, const BigInt *a, const BigInt *b, int subtract) {
+    if (a->length == 0 && b->length == 0) {
+        int64_t sum;
+        if (!(subtract ? __builtin_sub_overflow(a->small, b->small, &sum)
+                       : __builtin_add_overflow(a->small, b->small, &sum))) {
+            big_set(r, sum);
+            return 0;
+        }
+    }
+
+    Magnitude x, y;
+    magnitude(a, &x);
+    magnitude(b, &y);
+    int y_negative = y.negative ^ subtract;
+    const Magnitude *large = &x, *small = &y;
+    int negative = x.negative;
+
+    if (x.negative == y_negative) {
+        if (x.length < y.length) {
+            large = &y;
+            small = &x;
+        }
+        if (reserve(r, large->length + 1) != 0)
+            return OUT_OF_MEMORY;
+        add_limbs(r->limbs, large->limbs, large->length, small->limbs, small->length);
+        settle(r, large->length + 1, negative);
+        return 0;
+    }
+
+    // Opposite signs: the larger magnitude gives the sign
+    if (compare_limbs(x.limbs, x.length, y.limbs, y.length) < 0) {
+        large = &y;
+        small = &x;
+        negative = y_negative;
+    }
+    if (reserve(r, large->length) != 0)
+        return OUT_OF_MEMORY;
+    sub_limbs(r->limbs, large->limbs, large->length, small->limbs, small->length);
+    settle(r, large->length, negative);
+    return 0;
+}
+
+/**
+ * big_add - r = a + b.
+ * @r: receives the sum.
+ * @a: the left operand.
+ * @b: the right operand.
+ *
+ * Returns 0 on success, or OUT_OF_MEMORY.
+ */
+int big_add(BigInt *r, const BigInt *a, const BigInt *b) {
+    return add_signed(r, a, b, 0);
+}
+
+/**
+ * big_sub - r = a - b.
+ * @r: receives the difference.
+ * @a: the left operand.
+ * @b: the right operand.
+ *
+ * Returns 0 on success, or OUT_OF_MEMORY.
+ */
+int big_sub(BigInt *r, const BigInt *a, const BigInt *b) {
+    return add_signed(r, a, b, 1);
+}
+
+/**
+ * big_mul - r = a * b.
+ * @r: receives the product.
+ * @a: the left operand.
+ * @b: the right operand; may be a itself.
+ *
+ * Returns 0 on success, INTEGER_OVERFLOW if the product would exceed
+ * BIG_MAX_LIMBS limbs, or OUT_OF_MEMORY.
+ */
+int big_mul(BigInt *r, const BigInt *a, const BigInt *b) {
+    if (a->length == 0 && b->length == 0) {
+        int64_t product;
+        if (!__builtin_mul_overflow(a->small, b->small, &product)) {
+            big_set(r, product);
+            return 0;
+        }
+    }
+
+    Magnitude x, y;
+    magnitude(a, &x);
+    magnitude(b, &y);
+    if (x.length == 0 || y.length == 0) {
+        big_set(r, 0);
+        return 0;
+    }
+    if (x.length + y.length > BIG_MAX_LIMBS)
+        return INTEGER_OVERFLOW;
+
+    const Magnitude *large = &x, *small = &y;
+    if (x.length < y.length) {
+        large = &y;
+        small = &x;
+    }
+    if (reserve(r, x.length + y.length) != 0 ||
+        mul_limbs(r->limbs, large->limbs, large->length, small->limbs, small->length) != 0)
+        return OUT_OF_MEMORY;
+    settle(r, x.length + y.length, x.negative != y.negative);
+    return 0;
+}
+
+/**
+ * big_div - r = a / b, rounded toward zero as C division is.
+ * @r: receives the quotient.
+ * @a: the dividend.
+ * @b: the divisor.
+ *
+ * Returns 0 on success, DIVISION_BY_ZERO or OUT_OF_MEMORY.
+ */
+int big_div(BigInt *r, const BigInt *a, const BigInt *b) {
+    if (b->length == 0 && b->small == 0) {
+        return DIVISION_BY_ZERO;
+    }
+    if (a->length == 0 && b->length == 0 && !(a->small == INT64_MIN && b->small == -1)) {
+        big_set(r, a->small / b->small);
+        return 0;
+    }
+
+    Magnitude x, y;
+    magnitude(a, &x);
+    magnitude(b, &y);
+    if (compare_limbs(x.limbs, x.length, y.limbs, y.length) < 0) {
+        big_set(r, 0);
+        return 0;
+    }
+    size_t length = x.length - y.length + 1;
+    if (reserve(r, length) != 0 ||
+        divide_limbs(r->limbs, NULL, x.limbs, x.length, y.limbs, y.length) != 0)
+        return OUT_OF_MEMORY;
+    settle(r, length, x.negative != y.negative);
+    return 0;
+}
+
+/*
+ * pow_small - raises an inline base to an inline exponent in 64 bits.
+ * Returns 0 on success, or -1 if the result does not fit.
+ */
+static int pow_small(int64_t base, int64_t exponent, int64_t *value) {
+    int64_t result = 1, square = base;
+    for (;;) {
+        if ((exponent & 1) && __builtin_mul_overflow(result, square, &result))
+            return -1;
+        exponent >>= 1;
+        if (exponent == 0) {
+            *value = result;
+            return 0;
+        }
+        if (__builtin_mul_overflow(square, square, &square))
+            return -1;
+    }
+}
+
+/**
+ * big_pow - r = a ^ b.
+ * @r: receives the power.
+ * @a: the base.
+ * @b: the exponent.
+ *
+ * Powers that fit in 64 bits are computed inline; the others by repeated
+ * squaring of the base, multiplying the squares of the set bits of the
+ * exponent into the result. Bases 0, 1 and -1 are accepted with any
+ * exponent, others only if the result can stay within BIG_MAX_LIMBS limbs.
+ * Returns 0 on success, ERROR if the exponent is negative, EXPONENT_OVERFLOW
+ * if the result is too large, or the error code of a failed multiplication.
+ */
+int big_pow(BigInt *r, const BigInt *a, const BigInt *b) {
+    if (b->length > 0 ? b->negative : b->small < 0)
+        return ERROR;
+
+    if (a->length == 0 && a->small >= -1 && a->small <= 1) {
+        int odd = b->length > 0 ? b->limbs[0] & 1 : b->small & 1;
+        int zero = b->length == 0 && b->small == 0;
+        big_set(r, zero ? 1 : a->small == -1 && !odd ? 1 : a->small);
+        return 0;
+    }
+
+    int64_t value;
+    if (a->length == 0 && b->length == 0 && pow_small(a->small, b->small, &value) == 0) {
+        big_set(r, value);
+        return 0;
+    }
+
+    // The result has at least exponent * (bits of the base - 1) + 1 bits
+    Magnitude x;
+    magnitude(a, &x);
+    uint64_t bits = (uint64_t)(x.length - 1) * LIMB_BITS + (LIMB_BITS - __builtin_clz(x.limbs[x.length - 1]));
+    uint64_t least;
+    if (b->length > 0 || __builtin_mul_overflow(bits - 1, (uint64_t)b->small, &least) ||
+        least >= (uint64_t)BIG_MAX_LIMBS * LIMB_BITS) {
+        return EXPONENT_OVERFLOW;
+    }
+
+    uint64_t exponent = b->small;
+    BigInt result, square, product;
+    int status = 0;
+    big_init(&result);
+    big_init(&square);
+    big_init(&product);
+    big_set(&result, 1);
+    if (copy(&square, a) != 0)
+        status = OUT_OF_MEMORY;
+
+    while (status == 0) {
+        if (exponent & 1) {
+            if ((status = big_mul(&product, &result, &square)) != 0)
+                break;
+            swap(&result, &product);
+        }
+        exponent >>= 1;
+        if (exponent == 0)
+            break;
+        if ((status = big_mul(&product, &square, &square)) != 0)
+            break;
+        swap(&square, &product);
+    }
+
+    if (status == 0)
+        swap(r, &result);
+    big_free(&result);
+    big_free(&square);
+    big_free(&product);
+    return status;
+}
+
+/**
+ * big_compare - compares two values.
+ * @a: the left value.
+ * @b: the right value.
+ *
+ * Returns a negative number, 0 or a positive number as a is less than,
+ * equal to or greater than b.
+ */
+int big_compare(const BigInt *a, const BigInt *b) {
+    if (a->length == 0 && b->length == 0)
+        return (a->small > b->small) - (a->small < b->small);
+
+    Magnitude x, y;
+    magnitude(a, &x);
+    magnitude(b, &y);
+    if (x.negative != y.negative)
+        return x.negative ? -1 : 1;
+    int order = compare_limbs(x.limbs, x.length, y.limbs, y.length);
+    return x.negative ? -order : order;
+}
+
+/*
+ * multiply - r = a * b for operands of any lengths. r has room for na + nb
+ * limbs and does not overlap a or b.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int multiply(Limb *r, const Limb *a, size_t na, const Limb *b, size_t nb) {
+    if (na < nb)
+        return mul_limbs(r, b, nb, a, na);
+    return mul_limbs(r, a, na, b, nb);
+}
+
+/*
+ * reciprocal - t = floor((B^2n - 1) / p), where p has n limbs and its top bit
+ * set, so t has n + 1 limbs.
+ *
+ * Newton's iteration: the reciprocal of the top half of p, shifted into
+ * place, is correct to about half the limbs, and one step
+ * x + x (B^2n - x p) / B^2n doubles that. The few units left over are
+ * settled exactly against x p, so the result does not depend on a tight
+ * error bound.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int reciprocal(Limb *t, const Limb *p, size_t n) {
+    static const Limb one = 1;
+
+    if (n <= RECIPROCAL_THRESHOLD) {
+        Limb *ones = malloc(2 * n * sizeof(Limb));
+        if (ones == NULL)
+            return -1;
+        memset(ones, 0xFF, 2 * n * sizeof(Limb));
+        int status = divide_limbs(t, NULL, ones, 2 * n, p, n);
+        free(ones);
+        return status;
+    }
+
+    size_t h = (n + 1) / 2, k = n - h;
+    size_t ne = 2 * n + 1, nx = n + 2;
+    Limb *x = calloc(nx + ne + 3 * n + 2, sizeof(Limb));
+    if (x == NULL)
+        return -1;
+    Limb *e = x + nx, *product = e + ne;
+
+    // x = reciprocal of the top h limbs, times B^k
+    if (reciprocal(x + k, p + k, h) != 0 || multiply(e, x, n + 1, p, n) != 0) {
+        free(x);
+        return -1;
+    }
+
+    // One Newton step on the signed error e = x p - B^2n
+    int over = e[2 * n] != 0;
+    if (over) {
+        e[2 * n]--;
+    } else {
+        for (size_t i = 0; i < 2 * n; i++)
+            e[i] = ~e[i];
+        add_into(e, 2 * n, &one, 1);
+    }
+    size_t length = trim(e, ne);
+    if (multiply(product, x, n + 1, e, length) != 0) {
+        free(x);
+        return -1;
+    }
+    Limb *step = product + 2 * n;
+    size_t step_length = n + 1 + length > 2 * n ? trim(step, n + 1 + length - 2 * n) : 0;
+    if (over) {
+        sub_from(x, nx, step, step_length);
+        sub_from(x, nx, &one, 1);
+    } else {
+        add_into(x, nx, step, step_length);
+    }
+
+    // Settle x so that 0 <= B^2n - 1 - x p < p
+    Limb *q = product;
+    memset(q, 0, (2 * n + 2) * sizeof(Limb));
+    if (multiply(q, x, trim(x, nx), p, n) != 0) {
+        free(x);
+        return -1;
+    }
+    while (trim(q + 2 * n, 2) != 0) {
+        sub_from(x, nx, &one, 1);
+        sub_from(q, 2 * n + 2, p, n);
+    }
+    for (size_t i = 0; i < 2 * n; i++)
+        q[i] = ~q[i];
+    while (compare_limbs(q, trim(q, 2 * n), p, n) >= 0) {
+        add_into(x, nx, &one, 1);
+        sub_from(q, 2 * n, p, n);
+    }
+    memcpy(t, x, (n + 1) * sizeof(Limb));
+    free(x);
+    return 0;
+}
+
+/*
+ * divide_barrett - q = a / p and r = a % p for a < p B^n, where p has n limbs
+ * and its top bit set, and t is its reciprocal. q has room for n + 1 limbs
+ * and r for n limbs.
+ *
+ * Barrett's method: the top limbs of a times t, scaled back down, never
+ * overestimate the quotient and fall short of it by at most a few units,
+ * so two multiplications replace the long division.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int divide_barrett(Limb *q, Limb *r, const Limb *a, size_t na, const Limb *p, size_t n,
+                          const Limb *t) {
+    static const Limb one = 1;
+
+    memset(q, 0, (n + 1) * sizeof(Limb));
+    if (na < n) {
+        memset(r, 0, n * sizeof(Limb));
+        memcpy(r, a, na * sizeof(Limb));
+        return 0;
+    }
+
+    size_t ntop = na - (n - 1);
+    Limb *product = malloc((ntop + n + 1 + na + 1) * sizeof(Limb));
+    if (product == NULL)
+        return -1;
+    Limb *rest = product + ntop + n + 1;
+    if (multiply(product, a + n - 1, ntop, t, n + 1) != 0) {
+        free(product);
+        return -1;
+    }
+    memcpy(q, product + n + 1, ntop * sizeof(Limb));
+
+    // rest = a - q p, below a few p
+    size_t nq = trim(q, n + 1);
+    memset(rest, 0, (na + 1) * sizeof(Limb));
+    if (nq > 0 && multiply(rest, q, nq, p, n) != 0) {
+        free(product);
+        return -1;
+    }
+    for (size_t i = 0; i < na; i++)
+        rest[i] = ~rest[i];
+    add_into(rest, na, a, na);
+    add_into(rest, na, &one, 1);
+
+    while (compare_limbs(rest, trim(rest, na), p, n) >= 0) {
+        add_into(q, n + 1, &one, 1);
+        sub_from(rest, na, p, n);
+    }
+    memcpy(r, rest, n * sizeof(Limb));
+    free(product);
+    return 0;
+}
+
+/*
+ * put_chunk - writes a number below CHUNK_BASE as CHUNK_DIGITS digits.
+ */
+static void put_chunk(char *p, Limb chunk) {
+    for (int i = CHUNK_DIGITS; i-- > 0;) {
+        p[i] = '0' + chunk % 10;
+        chunk /= 10;
+    }
+}
+
+/*
+ * divide_power - q = a / power and r = a % power for a below the square of
+ * the power. q has room for n + 2 limbs and r for power->length + 1.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int divide_power(Limb *q, Limb *r, const Limb *a, size_t n, const Power *power) {
+    size_t length = power->length;
+
+    if (power->inverse == NULL)
+        return divide_limbs(q, r, a, n, power->limbs, length);
+
+    // Shift a as far as the power was shifted to set its top bit
+    Limb *shifted = malloc((n + 1) * sizeof(Limb));
+    if (shifted == NULL)
+        return -1;
+    shifted[n] = (Limb)(((DoubleLimb)a[n - 1] << power->shift) >> LIMB_BITS);
+    for (size_t i = n - 1; i > 0; i--)
+        shifted[i] = (Limb)((((DoubleLimb)a[i] << LIMB_BITS | a[i - 1]) << power->shift) >> LIMB_BITS);
+    shifted[0] = a[0] << power->shift;
+
+    int status = divide_barrett(q, r, shifted, trim(shifted, n + 1), power->normalized,
+                                length, power->inverse);
+    if (status == 0) {
+        r[length] = 0;
+        for (size_t i = 0; i < length; i++)
+            r[i] = (Limb)((((DoubleLimb)r[i + 1] << LIMB_BITS) | r[i]) >> power->shift);
+    }
+    free(shifted);
+    return status;
+}
+
+/*
+ * to_decimal - writes a magnitude below 10^width as exactly width digits,
+ * zero-padded, where width is CHUNK_DIGITS << (level + 1).
+ *
+ * powers[level] is 10^(width / 2), so a large magnitude divided by it leaves
+ * a quotient and a remainder that are both below 10^(width / 2). Each is
+ * converted one level down, and their digits placed side by side are the
+ * digits of the magnitude. Small magnitudes are divided by CHUNK_BASE limb
+ * by limb.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int to_decimal(const Limb *a, size_t n, char *out, int level, const Power *powers) {
+    size_t width = (size_t)CHUNK_DIGITS << (level + 1);
+
+    if (n <= DECIMAL_THRESHOLD) {
+        Limb local[DECIMAL_THRESHOLD];
+        char *p = out + width;
+        memcpy(local, a, n * sizeof(Limb));
+        while (n > 0) {
+            DoubleLimb remainder = 0;
+            for (size_t i = n; i-- > 0;) {
+                remainder = remainder << LIMB_BITS | local[i];
+                local[i] = (Limb)(remainder / CHUNK_BASE);
+                remainder %= CHUNK_BASE;
+            }
+            n = trim(local, n);
+            p -= CHUNK_DIGITS;
+            put_chunk(p, (Limb)remainder);
+        }
+        memset(out, '0', p - out);
+        return 0;
+    }
+
+    const Power *power = &powers[level];
+    if (compare_limbs(a, n, power->limbs, power->length) < 0) {
+        memset(out, '0', width / 2);
+        return to_decimal(a, n, out + width / 2, level - 1, powers);
+    }
+
+    // Room for the quotient of either division method
+    size_t nq = n + 2;
+    Limb *q = malloc((nq + power->length + 1) * sizeof(Limb));
+    if (q == NULL)
+        return -1;
+    Limb *r = q + nq;
+    int status = divide_power(q, r, a, n, power);
+    if (status == 0)
+        status = to_decimal(q, trim(q, n - power->length + 1), out, level - 1, powers);
+    if (status == 0)
+        status = to_decimal(r, trim(r, power->length), out + width / 2, level - 1, powers);
+    free(q);
+    return status;
+}
+
+/*
+ * square_power - sets next to the square of a power of ten, with the
+ * reciprocal used to divide by it if it is long and will be divided by.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int square_power(Power *next, const Power *last, int divided) {
+    size_t length = 2 * last->length;
+    next->inverse = NULL;
+    next->normalized = NULL;
+    if ((next->limbs = malloc(length * sizeof(Limb))) == NULL ||
+        mul_limbs(next->limbs, last->limbs, last->length, last->limbs, last->length) != 0)
+        return -1;
+    next->length = length = trim(next->limbs, length);
+    if (!divided || length <= DIVIDE_THRESHOLD)
+        return 0;
+
+    next->shift = __builtin_clz(next->limbs[length - 1]);
+    if ((next->normalized = malloc((2 * length + 1) * sizeof(Limb))) == NULL)
+        return -1;
+    for (size_t i = length - 1; i > 0; i--)
+        next->normalized[i] = (Limb)((((DoubleLimb)next->limbs[i] << LIMB_BITS |
+                                       next->limbs[i - 1]) << next->shift) >> LIMB_BITS);
+    next->normalized[0] = next->limbs[0] << next->shift;
+    next->inverse = next->normalized + length;
+    return reciprocal(next->inverse, next->normalized, length);
+}
+
+/**
+ * big_to_decimal - converts a value to decimal.
+ * @a: the value.
+ * @length: receives the number of characters.
+ *
+ * Divide and conquer: the powers 10^(9 * 2^k) are built by squaring until
+ * the square of the last one exceeds the value, which is then split around
+ * them recursively. The long powers are divided by through their
+ * reciprocals, so the conversion costs a few multiplications per level
+ * instead of a pass over the whole number for every nine digits.
+ * Returns the digits, or NULL when out of memory.
+ */
+char *big_to_decimal(const BigInt *a, size_t *length) {
+    Magnitude x;
+    magnitude(a, &x);
+
+    Power powers[64];
+    int levels = 0, status = 0;
+    Limb base = CHUNK_BASE;
+    powers[0].limbs = &base;
+    powers[0].length = 1;
+    powers[0].normalized = NULL;
+    powers[0].inverse = NULL;
+    // Stop once powers[levels]^2 >= B^(2 length - 2) >= B^n > a
+    while (status == 0 && 2 * powers[levels].length - 2 < x.length) {
+        levels++;
+        status = square_power(&powers[levels], &powers[levels - 1], x.length > DECIMAL_THRESHOLD);
+    }
+
+    size_t width = (size_t)CHUNK_DIGITS << (levels + 1);
+    char *digits = status == 0 ? malloc(width + 2) : NULL;
+    if (digits != NULL && to_decimal(x.limbs, x.length, digits + 1, levels, powers) != 0) {
+        free(digits);
+        digits = NULL;
+    }
+    for (int i = 1; i <= levels; i++) {
+        free(powers[i].limbs);
+        free(powers[i].normalized);
+    }
+    if (digits == NULL)
+        return NULL;
+
+    // Keep one digit of a zero
+    size_t start = 1;
+    while (start < width && digits[start] == '0')
+        start++;
+    if (x.negative)
+        digits[--start] = '-';
+    *length = width + 1 - start;
+    memmove(digits, digits + start, *length);
+    digits[*length] = '\0';
+    return digits;
+}
+
+/**
+ * big_create - creates an evaluator.
+ *
+ * Returns the evaluator, or NULL when out of memory.
+ */
+BigEvaluator *big_create(void) {
+    BigEvaluator *big = calloc(1, sizeof(BigEvaluator));
+    if (big != NULL)
+        big_init(&big->scratch);
+    return big;
+}
+
+/*
+ * grow_stack - adds BIG_STACK_CHUNK entries to the value stack.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int grow_stack(BigEvaluator *big) {
+    BigInt *grown = realloc(big->values, (big->capacity + BIG_STACK_CHUNK) * sizeof(BigInt));
+    if (grown == NULL)
+        return -1;
+    big->values = grown;
+    for (size_t i = 0; i < BIG_STACK_CHUNK; i++)
+        big_init(&big->values[big->capacity + i]);
+    big->capacity += BIG_STACK_CHUNK;
+    return 0;
+}
+
+/*
+ * apply - applies a binary operator to its operands.
+ * Returns 0 on success, or the error code of a runtime error.
+ */
+static int apply(NodeKind kind, BigInt *r, const BigInt *left, const BigInt *right) {
+    int order;
+    switch (kind) {
+        case NODE_ADD:
+            return big_add(r, left, right);
+        case NODE_SUB:
+            return big_sub(r, left, right);
+        case NODE_MUL:
+            return big_mul(r, left, right);
+        case NODE_DIV:
+            return big_div(r, left, right);
+        case NODE_POW:
+            return big_pow(r, left, right);
+        default:
+            break;
+    }
+
+    order = big_compare(left, right);
+    switch (kind) {
+        case NODE_LT: big_set(r, order < 0); break;
+        case NODE_LE: big_set(r, order <= 0); break;
+        case NODE_GT: big_set(r, order > 0); break;
+        case NODE_GE: big_set(r, order >= 0); break;
+        case NODE_EQ: big_set(r, order == 0); break;
+        case NODE_NE: big_set(r, order != 0); break;
+        default:
+            return INVALID_OPERATOR;
+    }
+    return 0;
+}
+
+/**
+ * big_evaluate - evaluates an expression tree with arbitrary precision.
+ * @big: the evaluator.
+ * @root: root of the tree.
+ * @value: receives the value.
+ *
+ * The tree is walked in postorder as the VM runs its code: a literal pushes
+ * its value and an operator replaces the top two values with its result.
+ * Returns 0 on success, or the error code of a runtime error.
+ */
+int big_evaluate(BigEvaluator *big, const Node *root, const BigInt **value) {
+    TreeWalk walk;
+    const Node *node;
+    size_t count = 0;
+    int status = 0;
+
+    tree_walk_init(&walk, root);
+    while ((node = tree_walk_next(&walk)) != NULL) {
+        if (node->kind == NODE_NUM) {
+            if (count == big->capacity && grow_stack(big) != 0) {
+                walk.failed = 1;
+                break;
+            }
+            big_set(&big->values[count++], node->value);
+            continue;
+        }
+        if (node->kind == NODE_VAR || node->kind == NODE_ASSIGN) {
+            status = INVALID_OPERATOR; // Variables hold Values only
+            break;
+        }
+        count--;
+        if ((status = apply(node->kind, &big->scratch, &big->values[count - 1], &big->values[count])) != 0)
+            break;
+        swap(&big->scratch, &big->values[count - 1]);
+    }
+
+    if (walk.failed)
+        status = OUT_OF_MEMORY;
+    else if (status == 0)
+        *value = &big->values[0];
+    tree_walk_free(&walk);
+    return status;
+}
+
+/**
+ * big_destroy - releases an evaluator.
+ * @big: the evaluator, or NULL.
+ */
+void big_destroy(BigEvaluator *big) {
+    if (big == NULL)
+        return;
+    for (size_t i = 0; i < big->capacity; i++)
+        big_free(&big->values[i]);
+    free(big->values);
+    big_free(&big->scratch);
+    free(big);
+}
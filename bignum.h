@@ -0,0 +1,137 @@
+/**
+ * @file bignum.h
+ * @brief Arbitrary-precision integers for the bignum evaluation mode. A value
+ * that fits in 64 bits is kept inline and operated on with checked machine
+ * arithmetic, so ordinary lines never touch the limb code; only a result that
+ * overflows is spread over an array of 32-bit limbs. Multiplication switches
+ * from the schoolbook method to Karatsuba's above a size threshold, powers are
+ * computed by repeated squaring, and decimal conversion splits the number
+ * around powers of ten recursively instead of dividing out one digit group at
+ * a time.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+
+/* Limbs allowed in one value; larger results are reported as overflows */
+#define BIG_MAX_LIMBS (1 << 18)
+
+typedef uint32_t Limb;
+
+/**
+ * An integer of any size up to BIG_MAX_LIMBS limbs. Values that fit in an
+ * int64_t are always held in small, so two values are equal exactly when
+ * both are small and equal or both are held in limbs with equal contents.
+ */
+typedef struct {
+    int64_t small;      /* The value while length is 0 */
+    Limb *limbs;        /* Magnitude, least significant limb first */
+    size_t length;      /* Limbs in use, or 0 for a small value */
+    size_t capacity;    /* Limbs allocated; kept when the value shrinks */
+    int negative;       /* Sign of a value held in limbs */
+} BigInt;
+
+/* Evaluator state reused from line to line; see big_create() */
+typedef struct BigEvaluator BigEvaluator;
+
+/**
+ * Initializes a value to 0.
+ *
+ * @param a The value.
+ */
+void big_init(BigInt *a);
+
+/**
+ * Releases the limbs of a value and sets it to 0.
+ *
+ * @param a The value.
+ */
+void big_free(BigInt *a);
+
+/**
+ * Sets a value from a machine integer.
+ *
+ * @param a The value.
+ * @param value The integer.
+ */
+void big_set(BigInt *a, int64_t value);
+
+/**
+ * Tells whether a value fits in a Value.
+ *
+ * @param a The value.
+ * @param value Receives the value if it fits.
+ * @return 1 if it fits, 0 if not.
+ */
+int big_fits(const BigInt *a, Value *value);
+
+/**
+ * Arithmetic on values. The result must not be one of the operands. Errors
+ * are returned as the same codes the other evaluators return.
+ *
+ * @param r Receives the result.
+ * @param a The left operand.
+ * @param b The right operand.
+ * @return 0 on success, or the error code of a division by zero, a negative
+ * exponent, a result larger than BIG_MAX_LIMBS limbs, or running out of
+ * memory.
+ */
+int big_add(BigInt *r, const BigInt *a, const BigInt *b);
+int big_sub(BigInt *r, const BigInt *a, const BigInt *b);
+int big_mul(BigInt *r, const BigInt *a, const BigInt *b);
+int big_div(BigInt *r, const BigInt *a, const BigInt *b);
+int big_pow(BigInt *r, const BigInt *a, const BigInt *b);
+
+/**
+ * Compares two values.
+ *
+ * @param a The left value.
+ * @param b The right value.
+ * @return A negative number, 0 or a positive number as a is less than, equal
+ * to or greater than b.
+ */
+int big_compare(const BigInt *a, const BigInt *b);
+
+/**
+ * Converts a value to decimal.
+ *
+ * @param a The value.
+ * @param length Receives the number of characters, sign included.
+ * @return The NUL-terminated digits (malloc'd), or NULL when out of memory.
+ */
+char *big_to_decimal(const BigInt *a, size_t *length);
+
+/**
+ * Creates an evaluator.
+ *
+ * @return The evaluator, or NULL when out of memory.
+ */
+BigEvaluator *big_create(void);
+
+/**
+ * Evaluates an expression tree with arbitrary precision. Trees of any depth
+ * are walked without recursion. Trees naming variables are not supported
+ * and end with INVALID_OPERATOR.
+ *
+ * @param big The evaluator.
+ * @param root Root of the tree.
+ * @param value Receives the value, which stays valid until the next call.
+ * @return 0 on success, or the error code of a runtime error.
+ */
+int big_evaluate(BigEvaluator *big, const Node *root, const BigInt **value);
+
+/**
+ * Releases an evaluator.
+ *
+ * @param big The evaluator, or NULL.
+ */
+void big_destroy(BigEvaluator *big);
+
+#endif // BIGNUM_H
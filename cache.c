@@ -0,0 +1,300 @@
+/*
+ * cache.c - LRU cache of line results keyed on normalized token sequences.
+ * Entries are chained in a hash table for lookup and linked in a list ordered
+ * from most to least recently used for eviction.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "cache.h"
+#include "util.h"
+
+#define INITIAL_BUCKETS 1024
+
+/* Marks a token with a + or - attached before it, which may be its sign */
+#define ATTACHED_SIGN 0x80
+
+/* Ends the key of a line with blanks after its last token, which the parser rejects */
+#define TRAILING_BLANKS 0xff
+
+typedef struct CacheEntry {
+    struct CacheEntry *chain;       /* Next entry in the same bucket */
+    struct CacheEntry *newer;
+    struct CacheEntry *older;
+    uint64_t hash;
+    int status;
+    Value value;
+    size_t key_length;
+    unsigned char key[];
+} CacheEntry;
+
+struct ResultCache {
+    CacheEntry **buckets;
+    size_t bucket_count;
+    size_t entry_count;
+    CacheEntry *newest;
+    CacheEntry *oldest;
+    size_t bytes;                   /* Memory held by entries and buckets */
+    size_t max_bytes;
+
+    unsigned char *key;             /* Key of the last lookup */
+    size_t key_length;
+    size_t key_capacity;
+    uint64_t key_hash;
+
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+};
+
+/*
+ * entry_size - memory charged to an entry against the cap.
+ */
+static size_t entry_size(const CacheEntry *entry) {
+    return sizeof(CacheEntry) + entry->key_length;
+}
+
+/**
+ * cache_create - creates an empty cache.
+ * @max_bytes: memory cap.
+ */
+ResultCache *cache_create(size_t max_bytes) {
+    ResultCache *cache = calloc(1, sizeof(ResultCache));
+    if (cache == NULL)
+        return NULL;
+
+    cache->buckets = calloc(INITIAL_BUCKETS, sizeof(CacheEntry *));
+    if (cache->buckets == NULL) {
+        free(cache);
+        return NULL;
+    }
+    cache->bucket_count = INITIAL_BUCKETS;
+    cache->bytes = INITIAL_BUCKETS * sizeof(CacheEntry *);
+    cache->max_bytes = max_bytes;
+    return cache;
+}
+
+/*
+ * build_key - writes the normalized key of a line into the cache's scratch
+ * buffer. Each token contributes its category; literals add their digits,
+ * which cannot be mistaken for a category byte. A space after a sign is an
+ * error whatever follows it, so every token directly after a + or - is
+ * marked, not only literals: "-(2)" and "- (2)" fail differently.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int build_key(ResultCache *cache, const char *text, size_t text_length,
+                     const Token *tokens, int count) {
+    size_t needed = 1;
+    for (int i = 0; i < count; i++)
+        needed += 1 + (tokens[i].category == INT_LITERAL ? tokens[i].length : 0);
+
+    if (needed > cache->key_capacity) {
+        unsigned char *grown = realloc(cache->key, needed);
+        if (grown == NULL)
+            return -1;
+        cache->key = grown;
+        cache->key_capacity = needed;
+    }
+
+    size_t length = 0;
+    for (int i = 0; i < count; i++) {
+        const Token *tok = &tokens[i];
+        unsigned char byte = tok->category;
+
+        if (i > 0 && (tokens[i - 1].category == ADD_OP || tokens[i - 1].category == SUB_OP) &&
+            tokens[i - 1].start + tokens[i - 1].length == tok->start)
+            byte |= ATTACHED_SIGN;
+        cache->key[length++] = byte;
+
+        if (tok->category == INT_LITERAL) {
+            memcpy(cache->key + length, text + tok->start, tok->length);
+            length += tok->length;
+        }
+    }
+    if (count > 0 && tokens[count - 1].start + tokens[count - 1].length != text_length)
+        cache->key[length++] = TRAILING_BLANKS;
+    cache->key_length = length;
+    cache->key_hash = fnv1a(cache->key, length);
+    return 0;
+}
+
+/*
+ * unlink_entry - removes an entry from the recency list.
+ */
+static void unlink_entry(ResultCache *cache, CacheEntry *entry) {
+    if (entry->newer != NULL)
+        entry->newer->older = entry->older;
+    else
+        cache->newest = entry->older;
+    if (entry->older != NULL)
+        entry->older->newer = entry->newer;
+    else
+        cache->oldest = entry->newer;
+}
+
+/*
+ * push_newest - puts an entry at the most recently used end of the list.
+ */
+static void push_newest(ResultCache *cache, CacheEntry *entry) {
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest != NULL)
+        cache->newest->newer = entry;
+    cache->newest = entry;
+    if (cache->oldest == NULL)
+        cache->oldest = entry;
+}
+
+/**
+ * cache_lookup - looks up the result of a line.
+ * @cache: the cache.
+ * @text: the line.
+ * @length: length of the line.
+ * @tokens: the tokens of the line.
+ * @count: the number of tokens.
+ * @status: receives the cached status.
+ * @value: receives the cached value.
+ *
+ * Returns 1 on a hit, 0 on a miss.
+ */
+int cache_lookup(ResultCache *cache, const char *text, size_t length, const Token *tokens,
+                 int count, int *status, Value *value) {
+    if (build_key(cache, text, length, tokens, count) != 0) {
+        cache->key_length = SIZE_MAX;   // Nothing to store after this miss
+        cache->misses++;
+        return 0;
+    }
+
+    CacheEntry *entry = cache->buckets[cache->key_hash & (cache->bucket_count - 1)];
+    for (; entry != NULL; entry = entry->chain) {
+        if (entry->hash == cache->key_hash && entry->key_length == cache->key_length &&
+            memcmp(entry->key, cache->key, cache->key_length) == 0) {
+            unlink_entry(cache, entry);
+            push_newest(cache, entry);
+            *status = entry->status;
+            *value = entry->value;
+            cache->hits++;
+            return 1;
+        }
+    }
+
+    cache->misses++;
+    return 0;
+}
+
+/*
+ * remove_oldest - evicts the least recently used entry.
+ */
+static void remove_oldest(ResultCache *cache) {
+    CacheEntry *entry = cache->oldest;
+    CacheEntry **link = &cache->buckets[entry->hash & (cache->bucket_count - 1)];
+
+    while (*link != entry)
+        link = &(*link)->chain;
+    *link = entry->chain;
+
+    unlink_entry(cache, entry);
+    cache->bytes -= entry_size(entry);
+    cache->entry_count--;
+    cache->evictions++;
+    free(entry);
+}
+
+/*
+ * grow_buckets - doubles the hash table once it averages one entry per
+ * bucket, if the cap leaves room for it.
+ */
+static void grow_buckets(ResultCache *cache) {
+    size_t count = cache->bucket_count * 2;
+    size_t added = cache->bucket_count * sizeof(CacheEntry *);
+
+    if (cache->bytes + added > cache->max_bytes)
+        return;
+    CacheEntry **buckets = calloc(count, sizeof(CacheEntry *));
+    if (buckets == NULL)
+        return;
+
+    for (size_t i = 0; i < cache->bucket_count; i++) {
+        CacheEntry *entry = cache->buckets[i];
+        while (entry != NULL) {
+            CacheEntry *chain = entry->chain;
+            entry->chain = buckets[entry->hash & (count - 1)];
+            buckets[entry->hash & (count - 1)] = entry;
+            entry = chain;
+        }
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->bucket_count = count;
+    cache->bytes += added;
+}
+
+/**
+ * cache_store - stores the result of the last looked-up line.
+ * @cache: the cache.
+ * @status: the status of the line.
+ * @value: the value of the line.
+ */
+void cache_store(ResultCache *cache, int status, Value value) {
+    if (cache->key_length == SIZE_MAX)
+        return;
+
+    size_t size = sizeof(CacheEntry) + cache->key_length;
+    if (size + cache->bucket_count * sizeof(CacheEntry *) > cache->max_bytes)
+        return; // Larger than the whole cache
+
+    while (cache->bytes + size > cache->max_bytes)
+        remove_oldest(cache);
+
+    CacheEntry *entry = malloc(size);
+    if (entry == NULL)
+        return;
+    entry->hash = cache->key_hash;
+    entry->status = status;
+    entry->value = value;
+    entry->key_length = cache->key_length;
+    memcpy(entry->key, cache->key, cache->key_length);
+
+    size_t bucket = entry->hash & (cache->bucket_count - 1);
+    entry->chain = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    push_newest(cache, entry);
+    cache->bytes += size;
+    cache->entry_count++;
+
+    if (cache->entry_count > cache->bucket_count)
+        grow_buckets(cache);
+}
+
+/**
+ * cache_report - writes the cache counters.
+ * @cache: the cache.
+ * @file: file the counters are written to.
+ */
+void cache_report(const ResultCache *cache, FILE *file) {
+    unsigned long lookups = cache->hits + cache->misses;
+    fprintf(file, "Cache: %lu hits, %lu misses (%.1f%% hit rate), %lu evictions, "
+            "%zu entries, %zu bytes\n", cache->hits, cache->misses,
+            lookups ? 100.0 * cache->hits / lookups : 0.0, cache->evictions,
+            cache->entry_count, cache->bytes);
+}
+
+/**
+ * cache_destroy - releases the cache.
+ * @cache: the cache to release.
+ */
+void cache_destroy(ResultCache *cache) {
+    if (cache == NULL)
+        return;
+    while (cache->oldest != NULL) {
+        CacheEntry *entry = cache->oldest;
+        cache->oldest = entry->newer;
+        free(entry);
+    }
+    free(cache->buckets);
+    free(cache->key);
+    free(cache);
+}
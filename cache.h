@@ -0,0 +1,75 @@
+/**
+ * @file cache.h
+ * @brief Memoizing cache of line results. Input files repeat the same
+ * expressions with only whitespace differences, so results are cached under a
+ * key built from the line's tokens rather than its characters: "2^2^3;" and
+ * "2 ^ 2 ^   3;" share one entry. The key keeps what whitespace can change,
+ * namely whether a sign is attached to the literal after it. Both values and
+ * error codes are cached. The cache is bounded by a memory cap and evicts the
+ * least recently used entry when the cap is reached.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "lexer.h"
+#include "ast.h"
+
+typedef struct ResultCache ResultCache;
+
+/**
+ * Creates an empty cache.
+ *
+ * @param max_bytes Memory cap for the entries and the hash table.
+ * @return The cache, or NULL when out of memory.
+ */
+ResultCache *cache_create(size_t max_bytes);
+
+/**
+ * Looks up the result of a line. The key built for the line is remembered, so
+ * after a miss the result can be stored with cache_store() without building
+ * the key again.
+ *
+ * @param cache The cache.
+ * @param text The line the tokens were read from.
+ * @param length Length of the line.
+ * @param tokens The tokens of the line.
+ * @param count The number of tokens.
+ * @param status Receives the cached status on a hit (0 or an error code).
+ * @param value Receives the cached value on a hit.
+ * @return 1 on a hit, 0 on a miss.
+ */
+int cache_lookup(ResultCache *cache, const char *text, size_t length, const Token *tokens,
+                 int count, int *status, Value *value);
+
+/**
+ * Stores the result of the line passed to the last cache_lookup(), evicting
+ * least recently used entries to stay within the memory cap.
+ *
+ * @param cache The cache.
+ * @param status The status of the line (0 or an error code).
+ * @param value The value of the line.
+ */
+void cache_store(ResultCache *cache, int status, Value value);
+
+/**
+ * Writes the hit, miss and eviction counters.
+ *
+ * @param cache The cache.
+ * @param file File the counters are written to.
+ */
+void cache_report(const ResultCache *cache, FILE *file);
+
+/**
+ * Releases the cache and all its entries.
+ *
+ * @param cache The cache to release.
+ */
+void cache_destroy(ResultCache *cache);
+
+#endif // CACHE_H
@@ -0,0 +1,670 @@
+/*
+ * columns.c - columnar evaluation of a template over the rows of a CSV file.
+ * The bytecode of the template is interpreted once per block of rows instead
+ * of once per row: OP_LOAD refers to the array of a column without copying
+ * it, OP_PUSH fills a scratch block, and every operator is a loop that writes
+ * its result block and records the rows it fails on. The loops are plain C,
+ * and every operator but ^ also has an AVX2 version for 32-bit values.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "columns.h"
+#include "parser.h"
+#include "lexer.h"
+#include "input.h"
+
+#if defined(__x86_64__) && !defined(VALUE_64)
+#define COLUMN_AVX2 1
+#include <immintrin.h>
+#endif
+
+/* Bytes of the template read at a time */
+#define TEMPLATE_BYTES 4096
+
+/* Rows of a block and their text, waiting to be evaluated */
+typedef struct {
+    Value **columns;        /* One array of COLUMN_BLOCK values per column */
+    Value values[COLUMN_BLOCK];
+    int status[COLUMN_BLOCK];
+    unsigned char blank[COLUMN_BLOCK];
+    size_t ends[COLUMN_BLOCK];  /* Offset in text just past each row */
+    char *text;             /* The rows, one after another, for their records */
+    size_t length;
+    size_t capacity;
+    int rows;
+} RowBlock;
+
+/*
+ * is_space - checks for a byte the lexer skips as whitespace.
+ */
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+/*
+ * trim - narrows a range of text to exclude whitespace at both ends.
+ */
+static void trim(const char *text, size_t *start, size_t *end) {
+    while (*start < *end && is_space(text[*start]))
+        (*start)++;
+    while (*end > *start && is_space(text[*end - 1]))
+        (*end)--;
+}
+
+/*
+ * is_name - checks that text is a name as the lexer scans one.
+ */
+static int is_name(const char *text, size_t length) {
+    if (length == 0 || !((text[0] >= 'a' && text[0] <= 'z') ||
+                         (text[0] >= 'A' && text[0] <= 'Z') || text[0] == '_'))
+        return 0;
+    for (size_t i = 1; i < length; i++) {
+        char c = text[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') || c == '_'))
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * column_header - reads the names of the columns.
+ * @cp: the program.
+ * @header: the header.
+ * @length: length of the header.
+ *
+ * Each name is interned in order, so the slot of a column is its number.
+ * Returns 0 on success, ERROR for an invalid or repeated name, or
+ * OUT_OF_MEMORY.
+ */
+int column_header(ColumnProgram *cp, const char *header, size_t length) {
+    size_t pos = 0;
+
+    for (;;) {
+        size_t start = pos, end = pos;
+        while (end < length && header[end] != ',')
+            end++;
+        size_t next = end + 1;
+        trim(header, &start, &end);
+        if (!is_name(header + start, end - start))
+            return ERROR;
+        int slot = variable_intern(&cp->names, header + start, end - start);
+        if (slot < 0)
+            return OUT_OF_MEMORY;
+        if (slot != cp->columns)
+            return ERROR; // Named twice
+        cp->names.assigned[slot] = 1;
+        cp->columns++;
+        if (next > length)
+            return 0;
+        pos = next;
+    }
+}
+
+/**
+ * column_compile - parses and compiles a template.
+ * @cp: the program.
+ * @text: the template.
+ * @length: length of the template.
+ *
+ * The columns are the only variables, all assigned, so the parser resolves
+ * every name of the template to its column or reports it undefined.
+ * Returns 0 on success, or the error code of the template.
+ */
+int column_compile(ColumnProgram *cp, const char *text, size_t length) {
+    TokenBuffer tokens = { .identifiers = 1 };
+    Arena arena = {0};
+    int count = lex_line(&tokens, text, length);
+    int status = 0;
+
+    if (count < 0) {
+        status = OUT_OF_MEMORY;
+    } else if (has_lexical_errors(tokens.tokens, count)) {
+        status = ERROR;
+    } else {
+        // A template is a file, which may end with a newline after the semicolon
+        size_t end = 0;
+        if (count > 0)
+            end = tokens.tokens[count - 1].start + tokens.tokens[count - 1].length;
+        TokenStream ts = { .text = text, .length = end, .tokens = tokens.tokens,
+                           .count = count, .arena = &arena, .variables = &cp->names };
+        Node *root = parse_bexpr(&ts);
+        if (root == NULL)
+            status = ts.error;
+        else if (root->kind == NODE_ASSIGN)
+            status = INVALID_OPERATOR; // A template computes a value and stores none
+        else if (compile_program(&cp->program, root) != 0)
+            status = OUT_OF_MEMORY;
+    }
+    free_token_buffer(&tokens);
+    arena_free(&arena);
+    if (status != 0)
+        return status;
+
+    free(cp->scratch);
+    free(cp->operands);
+    cp->scratch = malloc((size_t)cp->program.max_stack * COLUMN_BLOCK * sizeof(Value));
+    cp->operands = malloc(cp->program.max_stack * sizeof(Value *));
+    if (cp->scratch == NULL || cp->operands == NULL)
+        return OUT_OF_MEMORY;
+#ifdef COLUMN_AVX2
+    cp->vector = __builtin_cpu_supports("avx2") != 0;
+#else
+    cp->vector = 0;
+#endif
+    return 0;
+}
+
+/*
+ * parse_field - parses one field of a row as the parser parses a literal,
+ * signed or not.
+ * Returns 0 on success, or the error code of the field.
+ */
+static int parse_field(const char *row, size_t start, size_t end, Value *value) {
+    trim(row, &start, &end);
+    int negative = start < end && row[start] == '-';
+    if (start < end && (row[start] == '-' || row[start] == '+'))
+        start++;
+    if (start == end || row[start] < '0' || row[start] > '9')
+        return NO_DIGITS;
+
+    // A negative number may reach VALUE_MIN, one beyond -VALUE_MAX
+    UValue limit = (UValue)VALUE_MAX + negative;
+    UValue number = 0;
+    for (; start < end && row[start] >= '0' && row[start] <= '9'; start++) {
+        unsigned int digit = row[start] - '0';
+        if (number > (limit - digit) / 10)
+            return NUMBER_OUT_OF_RANGE;
+        number = number * 10 + digit;
+    }
+    if (start != end)
+        return ERROR;
+    *value = negative ? (Value)(0 - number) : (Value)number;
+    return 0;
+}
+
+/**
+ * column_parse_row - parses the fields of a row into a block.
+ * @cp: the program.
+ * @row: the row.
+ * @length: length of the row.
+ * @columns: the arrays of the columns.
+ * @index: row of the block receiving the fields.
+ *
+ * Returns 0 on success, or the error code of the row.
+ */
+int column_parse_row(const ColumnProgram *cp, const char *row, size_t length,
+                     Value *const *columns, int index) {
+    size_t pos = 0;
+    int status = 0;
+
+    for (int c = 0; c < cp->columns && status == 0; c++) {
+        if (pos > length) {
+            status = ERROR; // Too few fields
+            break;
+        }
+        size_t end = pos;
+        while (end < length && row[end] != ',')
+            end++;
+        status = parse_field(row, pos, end, &columns[c][index]);
+        pos = end + 1;
+    }
+    if (status == 0 && pos <= length)
+        status = ERROR; // Too many fields
+    if (status != 0) {
+        for (int c = 0; c < cp->columns; c++)
+            columns[c][index] = 0;
+    }
+    return status;
+}
+
+/*
+ * Runs a statement over each of n rows, with the operands in x and y, the
+ * result in r and the error, if any, in error. A row keeps its first error.
+ */
+#define ROWS(...) \
+    for (int i = 0; i < n; i++) { \
+        Value x = a[i], y = b[i], r = 0; \
+        int error = 0; \
+        __VA_ARGS__; \
+        out[i] = r; \
+        if (error != 0 && status[i] == 0) \
+            status[i] = error; \
+    }
+
+/*
+ * apply_rows - applies a binary operator to rows one at a time, with the
+ * semantics of the VM's handler for it.
+ */
+static void apply_rows(int op, Value *out, const Value *a, const Value *b, int n, int *status) {
+    switch (op) {
+        case OP_ADD:
+            ROWS(if (__builtin_add_overflow(x, y, &r)) error = INTEGER_OVERFLOW);
+            break;
+        case OP_SUB:
+            ROWS(if (__builtin_sub_overflow(x, y, &r)) error = INTEGER_OVERFLOW);
+            break;
+        case OP_MUL:
+            ROWS(if (__builtin_mul_overflow(x, y, &r)) error = INTEGER_OVERFLOW);
+            break;
+        case OP_DIV:
+            ROWS(if (y == 0) error = DIVISION_BY_ZERO;
+                 else if (x == VALUE_MIN && y == -1) error = INTEGER_OVERFLOW;
+                 else r = x / y);
+            break;
+        case OP_POW:
+            ROWS(error = eval_power(x, y, &r));
+            break;
+        case OP_LT:
+            ROWS(r = x < y);
+            break;
+        case OP_LE:
+            ROWS(r = x <= y);
+            break;
+        case OP_GT:
+            ROWS(r = x > y);
+            break;
+        case OP_GE:
+            ROWS(r = x >= y);
+            break;
+        case OP_EQ:
+            ROWS(r = x == y);
+            break;
+        case OP_NE:
+            ROWS(r = x != y);
+            break;
+        default:
+            for (int i = 0; i < n; i++) {
+                if (status[i] == 0)
+                    status[i] = INVALID_OPERATOR;
+            }
+            break;
+    }
+}
+
+#ifdef COLUMN_AVX2
+/*
+ * fail_lanes - records an error for the rows of eight lanes selected by a
+ * mask that have no error yet.
+ */
+__attribute__((target("avx2")))
+static inline void fail_lanes(int *status, __m256i failed, int error) {
+    if (_mm256_testz_si256(failed, failed))
+        return;
+    __m256i old = _mm256_loadu_si256((const __m256i *)status);
+    __m256i fresh = _mm256_and_si256(failed, _mm256_cmpeq_epi32(old, _mm256_setzero_si256()));
+    _mm256_storeu_si256((__m256i *)status,
+                        _mm256_blendv_epi8(old, _mm256_set1_epi32(error), fresh));
+}
+
+/*
+ * mul_lanes - multiplies eight lanes, failing those whose product overflows.
+ */
+__attribute__((target("avx2")))
+static inline __m256i mul_lanes(__m256i x, __m256i y, int *status) {
+    __m256i r = _mm256_mullo_epi32(x, y);
+    // High halves of the 64-bit products: even lanes from one multiply, odd from another
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epi32(x, y), 32);
+    __m256i odd = _mm256_mul_epi32(_mm256_srli_epi64(x, 32), _mm256_srli_epi64(y, 32));
+    __m256i high = _mm256_blend_epi32(even, odd, 0xaa);
+    // A product fits if its high half only repeats the sign of the low half
+    __m256i fits = _mm256_cmpeq_epi32(high, _mm256_srai_epi32(r, 31));
+    fail_lanes(status, _mm256_xor_si256(fits, _mm256_set1_epi32(-1)), INTEGER_OVERFLOW);
+    return r;
+}
+
+/*
+ * div_lanes - divides eight lanes, failing those divided by zero and
+ * VALUE_MIN / -1. A double holds every int exactly, and the rounded quotient
+ * of two ints never crosses an integer, so truncating the quotient of the
+ * doubles gives the quotient of the ints.
+ */
+__attribute__((target("avx2")))
+static inline __m256i div_lanes(__m256i x, __m256i y, int *status) {
+    __m256i zero = _mm256_cmpeq_epi32(y, _mm256_setzero_si256());
+    __m256i overflow = _mm256_and_si256(_mm256_cmpeq_epi32(x, _mm256_set1_epi32(VALUE_MIN)),
+                                        _mm256_cmpeq_epi32(y, _mm256_set1_epi32(-1)));
+    fail_lanes(status, zero, DIVISION_BY_ZERO);
+    fail_lanes(status, overflow, INTEGER_OVERFLOW);
+
+    // Lanes failed for a zero divisor are divided by 1 instead
+    y = _mm256_or_si256(y, _mm256_and_si256(zero, _mm256_set1_epi32(1)));
+    __m256d low = _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(x)),
+                                _mm256_cvtepi32_pd(_mm256_castsi256_si128(y)));
+    __m256d high = _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(x, 1)),
+                                 _mm256_cvtepi32_pd(_mm256_extracti128_si256(y, 1)));
+    return _mm256_set_m128i(_mm256_cvttpd_epi32(high), _mm256_cvttpd_epi32(low));
+}
+
+/*
+ * Runs a statement over eight rows at a time, with the operands in x and y
+ * and the result in r, for as many rows as fill whole vectors.
+ */
+#define LANES(...) \
+    for (; i + 8 <= n; i += 8) { \
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i)); \
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i)); \
+        __m256i r; \
+        __VA_ARGS__; \
+        _mm256_storeu_si256((__m256i *)(out + i), r); \
+    }
+
+/*
+ * apply_lanes - applies a binary operator to rows eight at a time.
+ * Returns the number of rows done, which leaves fewer than eight for
+ * apply_rows(), or 0 for ^, which is only done one row at a time.
+ */
+__attribute__((target("avx2")))
+static int apply_lanes(int op, Value *out, const Value *a, const Value *b, int n, int *status) {
+    const __m256i one = _mm256_set1_epi32(1);
+    int i = 0;
+
+    switch (op) {
+        case OP_ADD:
+            // A sum overflows if its sign differs from the signs of both operands
+            LANES(r = _mm256_add_epi32(x, y);
+                  fail_lanes(status + i, _mm256_srai_epi32(_mm256_and_si256(
+                      _mm256_xor_si256(x, r), _mm256_xor_si256(y, r)), 31), INTEGER_OVERFLOW));
+            break;
+        case OP_SUB:
+            // A difference overflows if the operands' signs differ and its own is y's
+            LANES(r = _mm256_sub_epi32(x, y);
+                  fail_lanes(status + i, _mm256_srai_epi32(_mm256_and_si256(
+                      _mm256_xor_si256(x, y), _mm256_xor_si256(x, r)), 31), INTEGER_OVERFLOW));
+            break;
+        case OP_MUL:
+            LANES(r = mul_lanes(x, y, status + i));
+            break;
+        case OP_DIV:
+            LANES(r = div_lanes(x, y, status + i));
+            break;
+        case OP_LT:
+            LANES(r = _mm256_and_si256(_mm256_cmpgt_epi32(y, x), one));
+            break;
+        case OP_LE:
+            LANES(r = _mm256_andnot_si256(_mm256_cmpgt_epi32(x, y), one));
+            break;
+        case OP_GT:
+            LANES(r = _mm256_and_si256(_mm256_cmpgt_epi32(x, y), one));
+            break;
+        case OP_GE:
+            LANES(r = _mm256_andnot_si256(_mm256_cmpgt_epi32(y, x), one));
+            break;
+        case OP_EQ:
+            LANES(r = _mm256_and_si256(_mm256_cmpeq_epi32(x, y), one));
+            break;
+        case OP_NE:
+            LANES(r = _mm256_andnot_si256(_mm256_cmpeq_epi32(x, y), one));
+            break;
+        default:
+            break;
+    }
+    return i;
+}
+#endif
+
+/*
+ * apply_block - applies a binary operator to the rows of a block, eight at a
+ * time where the program allows it.
+ */
+static void apply_block(const ColumnProgram *cp, int op, Value *out, const Value *a,
+                        const Value *b, int n, int *status) {
+    int done = 0;
+#ifdef COLUMN_AVX2
+    if (cp->vector)
+        done = apply_lanes(op, out, a, b, n, status);
+#else
+    (void)cp;
+#endif
+    apply_rows(op, out + done, a + done, b + done, n - done, status + done);
+}
+
+/**
+ * column_evaluate - evaluates the template over a block of rows.
+ * @cp: the program.
+ * @columns: the arrays of the columns.
+ * @rows: number of rows.
+ * @values: receives the values.
+ * @status: status of each row, updated.
+ *
+ * Stack entry d holds a column's array or block d of the scratch space, so
+ * an operator writes its result over its left operand's block and never
+ * over its right operand.
+ */
+void column_evaluate(ColumnProgram *cp, const Value *const *columns, int rows,
+                     Value *values, int *status) {
+    const Value *code = cp->program.code;
+    int depth = 0;
+
+    for (int pc = 0; code[pc] != OP_HALT; pc++) {
+        Value *block = cp->scratch + (size_t)depth * COLUMN_BLOCK;
+        switch (code[pc]) {
+            case OP_PUSH: {
+                Value literal = code[++pc];
+                for (int i = 0; i < rows; i++)
+                    block[i] = literal;
+                cp->operands[depth++] = block;
+                break;
+            }
+            case OP_LOAD:
+                cp->operands[depth++] = columns[code[++pc]];
+                break;
+            default:
+                depth--;
+                block -= 2 * COLUMN_BLOCK;
+                apply_block(cp, code[pc], block, cp->operands[depth - 1], cp->operands[depth],
+                            rows, status);
+                cp->operands[depth - 1] = block;
+                break;
+        }
+    }
+    memcpy(values, cp->operands[0], rows * sizeof(Value));
+}
+
+/**
+ * column_free - releases the memory of a program.
+ * @cp: the program.
+ */
+void column_free(ColumnProgram *cp) {
+    free_variables(&cp->names);
+    free_program(&cp->program);
+    free(cp->scratch);
+    free(cp->operands);
+    memset(cp, 0, sizeof(*cp));
+}
+
+/*
+ * read_template - reads the whole template file.
+ * Returns the text (malloc'd), or NULL on a read error or when out of memory.
+ */
+static char *read_template(FILE *file, size_t *length) {
+    char *text = NULL;
+    size_t capacity = 0;
+
+    *length = 0;
+    for (;;) {
+        if (capacity - *length < TEMPLATE_BYTES) {
+            capacity = capacity ? capacity * 2 : TEMPLATE_BYTES;
+            char *grown = realloc(text, capacity);
+            if (grown == NULL) {
+                free(text);
+                return NULL;
+            }
+            text = grown;
+        }
+        size_t count = fread(text + *length, 1, capacity - *length, file);
+        *length += count;
+        if (count == 0)
+            break;
+    }
+    if (ferror(file)) {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+
+/*
+ * new_block - allocates a block of rows for a number of columns.
+ * Returns the block, or NULL when out of memory.
+ */
+static RowBlock *new_block(int columns) {
+    RowBlock *block = calloc(1, sizeof(RowBlock));
+    if (block == NULL)
+        return NULL;
+    block->columns = malloc(columns * sizeof(Value *));
+    Value *data = malloc((size_t)columns * COLUMN_BLOCK * sizeof(Value));
+    if (block->columns == NULL || data == NULL) {
+        free(block->columns);
+        free(data);
+        free(block);
+        return NULL;
+    }
+    for (int c = 0; c < columns; c++)
+        block->columns[c] = data + (size_t)c * COLUMN_BLOCK;
+    return block;
+}
+
+/*
+ * free_block - releases a block of rows.
+ */
+static void free_block(RowBlock *block) {
+    if (block == NULL)
+        return;
+    free(block->columns[0]);
+    free(block->columns);
+    free(block->text);
+    free(block);
+}
+
+/*
+ * add_row - parses a row into the next row of a block and keeps its text.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int add_row(const ColumnProgram *cp, RowBlock *block, const char *line, size_t length) {
+    int row = block->rows;
+
+    if (block->length + length > block->capacity) {
+        size_t capacity = block->capacity ? block->capacity * 2 : 64 * 1024;
+        while (capacity < block->length + length)
+            capacity *= 2;
+        char *grown = realloc(block->text, capacity);
+        if (grown == NULL)
+            return -1;
+        block->text = grown;
+        block->capacity = capacity;
+    }
+    memcpy(block->text + block->length, line, length);
+    block->length += length;
+    block->ends[row] = block->length;
+
+    size_t start = 0, end = length;
+    trim(line, &start, &end);
+    block->blank[row] = start == end;
+    if (block->blank[row]) {
+        for (int c = 0; c < cp->columns; c++)
+            block->columns[c][row] = 0;
+        block->status[row] = 0;
+    } else {
+        block->status[row] = column_parse_row(cp, line, length, block->columns, row);
+    }
+    block->rows++;
+    return 0;
+}
+
+/*
+ * write_block - evaluates a block of rows, writes their records and empties
+ * the block.
+ */
+static void write_block(ColumnProgram *cp, RowBlock *block, OutputWriter *out, FILE *errors) {
+    size_t start = 0;
+
+    column_evaluate(cp, (const Value *const *)block->columns, block->rows,
+                    block->values, block->status);
+    for (int row = 0; row < block->rows; row++) {
+        const char *line = block->text + start;
+        size_t length = block->ends[row] - start;
+        if (block->blank[row]) {
+            output_blank(out, line, length);
+        } else {
+            report_error(errors, block->status[row]);
+            output_result(out, line, length, block->status[row], block->values[row]);
+        }
+        start = block->ends[row];
+    }
+    block->rows = 0;
+    block->length = 0;
+}
+
+/**
+ * interpret_columns - evaluates a template over every row of a CSV file.
+ * @template_file: file holding the template.
+ * @in: the CSV file.
+ * @out: the output writer.
+ * @errors: stream receiving the message of each row's error, or NULL.
+ *
+ * Returns 0 on success, or 1 on error.
+ */
+int interpret_columns(FILE *template_file, FILE *in, OutputWriter *out, FILE *errors) {
+    ColumnProgram cp = {0};
+    RowBlock *block = NULL;
+    LineReader reader;
+    const char *line;
+    size_t length, template_length;
+    int status = 1, result;
+
+    char *text = read_template(template_file, &template_length);
+    if (text == NULL) {
+        fprintf(stderr, "Error: Could not read the template.\n");
+        return 1;
+    }
+    if (line_reader_open(&reader, in) != 0) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        free(text);
+        return 1;
+    }
+
+    if ((result = line_reader_next(&reader, &line, &length)) <= 0) {
+        fprintf(stderr, result < 0 ? "Error: Out of memory.\n" : "Error: The input has no header.\n");
+        goto done;
+    }
+    if ((result = column_header(&cp, line, length)) != 0) {
+        fprintf(stderr, result == OUT_OF_MEMORY ? "Error: Out of memory.\n"
+                                                : "Error: Invalid CSV header.\n");
+        goto done;
+    }
+    if ((result = column_compile(&cp, text, template_length)) != 0) {
+        fprintf(stderr, "Error: Invalid template.\n");
+        report_error(stderr, result);
+        goto done;
+    }
+    if ((block = new_block(cp.columns)) == NULL) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        goto done;
+    }
+
+    while ((result = line_reader_next(&reader, &line, &length)) > 0) {
+        if (add_row(&cp, block, line, length) != 0) {
+            result = -1;
+            break;
+        }
+        if (block->rows == COLUMN_BLOCK)
+            write_block(&cp, block, out, errors);
+    }
+    if (result < 0) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        goto done;
+    }
+    write_block(&cp, block, out, errors);
+    status = 0;
+
+done:
+    free_block(block);
+    column_free(&cp);
+    line_reader_close(&reader);
+    free(text);
+    return status;
+}
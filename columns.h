@@ -0,0 +1,123 @@
+/**
+ * @file columns.h
+ * @brief Columnar evaluation of one expression over many rows of inputs. The
+ * input is a CSV file whose header names its columns and whose rows hold
+ * integers, and the expression is a template naming those columns in place
+ * of numbers, as in "price * quantity - discount;". The template is parsed
+ * and compiled once; the rows are then read in blocks of COLUMN_BLOCK, one
+ * array per column, and the bytecode is run over whole arrays at a time,
+ * each operator a loop over the block. With 32-bit values on a CPU with
+ * AVX2, the operators process eight rows per instruction.
+ *
+ * Every row gets its own status with the semantics of eval_node(): the
+ * first error of the row, in the order the tree evaluator would meet it, is
+ * its error, and the other rows of the block are not affected. A field that
+ * is not an integer is an error of its row, reported as the parser would
+ * report the same text as a literal.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef COLUMNS_H
+#define COLUMNS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "ast.h"
+#include "vm.h"
+#include "output.h"
+#include "variables.h"
+
+/* Rows evaluated together; each column of a block is an array of this many Values */
+#define COLUMN_BLOCK 1024
+
+/**
+ * A template compiled for the columns of a header. A zeroed program is
+ * ready for column_header().
+ */
+typedef struct {
+    Variables names;        /* Names of the columns, each slot its column */
+    int columns;            /* Number of columns of every row */
+    Program program;        /* Code of the template; OP_LOAD names a column */
+    Value *scratch;         /* One block for each stack entry */
+    const Value **operands; /* Block holding each stack entry */
+    int vector;             /* Set to use the AVX2 operators */
+} ColumnProgram;
+
+/**
+ * Reads the header of the input, which names the columns.
+ *
+ * @param cp The program.
+ * @param header The header: names separated by commas.
+ * @param length Length of the header in bytes.
+ * @return 0 on success, ERROR if a column is not a valid name or is named
+ * twice, or OUT_OF_MEMORY.
+ */
+int column_header(ColumnProgram *cp, const char *header, size_t length);
+
+/**
+ * Parses and compiles a template over the columns of the header. vector is
+ * set if the CPU has AVX2; it may be cleared afterwards to use the portable
+ * operators.
+ *
+ * @param cp The program, after column_header().
+ * @param text The template: one expression, which may span lines.
+ * @param length Length of the template in bytes.
+ * @return 0 on success, or the error code of the template: ERROR for text
+ * that is not a lexeme, the parser's error, UNDEFINED_VARIABLE for a name
+ * that is not a column, INVALID_OPERATOR for an assignment, or OUT_OF_MEMORY.
+ */
+int column_compile(ColumnProgram *cp, const char *text, size_t length);
+
+/**
+ * Parses the fields of a row into one row of a block.
+ *
+ * @param cp The program.
+ * @param row The row, without its newline.
+ * @param length Length of the row in bytes.
+ * @param columns Arrays of COLUMN_BLOCK values, one per column.
+ * @param index Row of the block receiving the fields.
+ * @return 0 on success, or the error code of the row: NO_DIGITS for a field
+ * that does not start with a number, NUMBER_OUT_OF_RANGE for a number that
+ * does not fit in a Value, or ERROR for text after the number or the wrong
+ * number of fields. The fields of a row in error are 0.
+ */
+int column_parse_row(const ColumnProgram *cp, const char *row, size_t length,
+                     Value *const *columns, int index);
+
+/**
+ * Evaluates the template over a block of rows.
+ *
+ * @param cp The program.
+ * @param columns Arrays of COLUMN_BLOCK values, one per column.
+ * @param rows Number of rows, at most COLUMN_BLOCK.
+ * @param values Receives the value of each row whose status is 0.
+ * @param status Status of each row: a row entering with an error code keeps
+ * it, and each other row receives 0 or the error code of its evaluation.
+ */
+void column_evaluate(ColumnProgram *cp, const Value *const *columns, int rows,
+                     Value *values, int *status);
+
+/**
+ * Releases the memory of a program, leaving it zeroed.
+ *
+ * @param cp The program.
+ */
+void column_free(ColumnProgram *cp);
+
+/**
+ * Evaluates a template over every row of a CSV file and writes one record
+ * per row, in row order; the header has no record. Blank rows are written
+ * as blank lines are.
+ *
+ * @param template_file File holding the template.
+ * @param in The CSV file.
+ * @param out Writer receiving the records.
+ * @param errors Receives the message of each row's error, or NULL.
+ * @return 0 on success, or 1 if the header or the template is invalid, with
+ * a message on stderr, or when out of memory.
+ */
+int interpret_columns(FILE *template_file, FILE *in, OutputWriter *out, FILE *errors);
+
+#endif // COLUMNS_H
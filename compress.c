@@ -0,0 +1,459 @@
+/*
+ * compress.c - gzip and zstd streams on a thread of their own.
+ * The interpreter and the thread are joined by a Unix socket pair rather
+ * than a pipe so the thread can write with MSG_NOSIGNAL: when the
+ * interpreter stops reading early, the thread sees EPIPE and stops instead
+ * of raising SIGPIPE. An output thread that fails keeps draining its socket
+ * until the interpreter closes it, for the same reason in the other
+ * direction. Concatenated gzip members and zstd frames are read as one
+ * stream, as gzip -d and zstd -d do.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "compress.h"
+
+/* Bytes of compressed and of plain text handled at a time */
+#define COMPRESS_BYTES (128 * 1024)
+
+/* Compression levels of the output */
+#define GZIP_LEVEL 6
+#define ZSTD_LEVEL 3
+
+static const unsigned char gzip_magic[] = { 0x1f, 0x8b };
+static const unsigned char zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+/**
+ * compression_parse - parses the name of a compression format.
+ * @text: the name.
+ * @kind: receives the format.
+ *
+ * Returns 0 on success, or -1 if the name is not a format.
+ */
+int compression_parse(const char *text, Compression *kind) {
+    if (strcmp(text, "none") == 0)
+        *kind = COMPRESS_NONE;
+    else if (strcmp(text, "gzip") == 0)
+        *kind = COMPRESS_GZIP;
+    else if (strcmp(text, "zstd") == 0)
+        *kind = COMPRESS_ZSTD;
+    else
+        return -1;
+    return 0;
+}
+
+/*
+ * send_all - writes plain text to the interpreter.
+ * Returns 0 on success, or -1 once the interpreter has stopped reading.
+ */
+static int send_all(int fd, const unsigned char *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+/*
+ * read_input - reads compressed input, the recognized prefix first.
+ * Returns the number of bytes read, 0 at the end, or -1 on a read error.
+ */
+static ssize_t read_input(CompressedStream *cs, unsigned char *buffer, size_t size) {
+    if (cs->prefix_length > 0) {
+        size_t length = cs->prefix_length;
+        memcpy(buffer, cs->prefix, length);
+        cs->prefix_length = 0;
+        return length;
+    }
+    size_t count = fread(buffer, 1, size, cs->file);
+    if (count == 0 && ferror(cs->file))
+        return -1;
+    return count;
+}
+
+/*
+ * copy_plain - passes plain input through unchanged.
+ * Returns 0 on success, or -1 on a read error.
+ */
+static int copy_plain(CompressedStream *cs, unsigned char *in, unsigned char *out) {
+    (void)out;
+    ssize_t n;
+    while ((n = read_input(cs, in, COMPRESS_BYTES)) > 0) {
+        if (send_all(cs->fd, in, n) != 0)
+            return 0;
+    }
+    return n < 0 ? -1 : 0;
+}
+
+/*
+ * inflate_gzip - decompresses gzip input, member after member.
+ * Returns 0 on success, or -1 on corrupt, truncated or unreadable input.
+ */
+static int inflate_gzip(CompressedStream *cs, unsigned char *in, unsigned char *out) {
+    z_stream zs;
+    int in_member = 0, full = 0, status = 0;
+
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK)
+        return -1;
+    for (;;) {
+        // A full buffer may leave output inside zlib with no input left
+        if (zs.avail_in == 0 && !full) {
+            ssize_t n = read_input(cs, in, COMPRESS_BYTES);
+            if (n <= 0) {
+                // Input ending inside a member is truncated
+                if (n < 0 || in_member)
+                    status = -1;
+                break;
+            }
+            zs.next_in = in;
+            zs.avail_in = n;
+        }
+        if (!in_member) {
+            inflateReset(&zs);
+            in_member = 1;
+        }
+
+        zs.next_out = out;
+        zs.avail_out = COMPRESS_BYTES;
+        int ret = inflate(&zs, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            status = -1;
+            break;
+        }
+        if (send_all(cs->fd, out, COMPRESS_BYTES - zs.avail_out) != 0)
+            break;
+        full = zs.avail_out == 0;
+        if (ret == Z_STREAM_END) {
+            in_member = 0;
+            full = 0;
+        }
+    }
+    inflateEnd(&zs);
+    return status;
+}
+
+#ifdef HAVE_ZSTD
+/*
+ * inflate_zstd - decompresses zstd input, frame after frame.
+ * Returns 0 on success, or -1 on corrupt, truncated or unreadable input.
+ */
+static int inflate_zstd(CompressedStream *cs, unsigned char *in, unsigned char *out) {
+    ZSTD_DStream *ds = ZSTD_createDStream();
+    size_t pending = 0; // 0 once a frame is decoded and flushed
+    int status = 0;
+    ssize_t n;
+
+    if (ds == NULL || ZSTD_isError(ZSTD_initDStream(ds))) {
+        ZSTD_freeDStream(ds);
+        return -1;
+    }
+    while ((n = read_input(cs, in, COMPRESS_BYTES)) > 0) {
+        ZSTD_inBuffer input = { in, n, 0 };
+        ZSTD_outBuffer output;
+        do {
+            output.dst = out;
+            output.size = COMPRESS_BYTES;
+            output.pos = 0;
+            pending = ZSTD_decompressStream(ds, &output, &input);
+            if (ZSTD_isError(pending)) {
+                ZSTD_freeDStream(ds);
+                return -1;
+            }
+            if (send_all(cs->fd, out, output.pos) != 0) {
+                ZSTD_freeDStream(ds);
+                return 0;
+            }
+        } while (input.pos < input.size || output.pos == output.size);
+    }
+    if (n < 0 || pending != 0)
+        status = -1;
+    ZSTD_freeDStream(ds);
+    return status;
+}
+#endif
+
+/*
+ * input_main - the thread decompressing an input file into the socket.
+ */
+static void *input_main(void *arg) {
+    CompressedStream *cs = arg;
+    unsigned char *in = malloc(COMPRESS_BYTES);
+    unsigned char *out = malloc(COMPRESS_BYTES);
+    int status = -1;
+
+    if (in != NULL && out != NULL) {
+        switch (cs->kind) {
+            case COMPRESS_NONE:
+                status = copy_plain(cs, in, out);
+                break;
+            case COMPRESS_GZIP:
+                status = inflate_gzip(cs, in, out);
+                break;
+            case COMPRESS_ZSTD:
+#ifdef HAVE_ZSTD
+                status = inflate_zstd(cs, in, out);
+#endif
+                break;
+        }
+    }
+    cs->failed = status != 0;
+    // The interpreter reads the end of the input
+    close(cs->fd);
+    free(in);
+    free(out);
+    return NULL;
+}
+
+/*
+ * write_output - writes compressed output to the file.
+ * Returns 0 on success, or -1 on a write error.
+ */
+static int write_output(CompressedStream *cs, const unsigned char *data, size_t length) {
+    return fwrite(data, 1, length, cs->file) == length ? 0 : -1;
+}
+
+/*
+ * deflate_gzip - compresses the plain text read from the socket as one gzip
+ * member.
+ * Returns 0 on success, or -1 on a write error.
+ */
+static int deflate_gzip(CompressedStream *cs, unsigned char *in, unsigned char *out) {
+    z_stream zs;
+    int flush = Z_NO_FLUSH, ret = Z_OK, status = 0;
+
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return -1;
+    while (flush != Z_FINISH) {
+        ssize_t n = read(cs->fd, in, COMPRESS_BYTES);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            status = -1;
+            break;
+        }
+        // The interpreter closing its end is the end of the text
+        zs.next_in = in;
+        zs.avail_in = n;
+        flush = n > 0 ? Z_NO_FLUSH : Z_FINISH;
+        do {
+            zs.next_out = out;
+            zs.avail_out = COMPRESS_BYTES;
+            ret = deflate(&zs, flush);
+            if (write_output(cs, out, COMPRESS_BYTES - zs.avail_out) != 0) {
+                deflateEnd(&zs);
+                return -1;
+            }
+        } while (zs.avail_out == 0);
+    }
+    if (ret != Z_STREAM_END)
+        status = -1;
+    deflateEnd(&zs);
+    return status;
+}
+
+#ifdef HAVE_ZSTD
+/*
+ * deflate_zstd - compresses the plain text read from the socket as one zstd
+ * frame.
+ * Returns 0 on success, or -1 on a write error.
+ */
+static int deflate_zstd(CompressedStream *cs, unsigned char *in, unsigned char *out) {
+    ZSTD_CStream *zc = ZSTD_createCStream();
+    ssize_t n;
+    size_t left;
+
+    if (zc == NULL || ZSTD_isError(ZSTD_initCStream(zc, ZSTD_LEVEL))) {
+        ZSTD_freeCStream(zc);
+        return -1;
+    }
+    while ((n = read(cs->fd, in, COMPRESS_BYTES)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        ZSTD_inBuffer input = { in, n, 0 };
+        while (input.pos < input.size) {
+            ZSTD_outBuffer output = { out, COMPRESS_BYTES, 0 };
+            if (ZSTD_isError(ZSTD_compressStream(zc, &output, &input)) ||
+                write_output(cs, out, output.pos) != 0) {
+                ZSTD_freeCStream(zc);
+                return -1;
+            }
+        }
+    }
+    do {
+        ZSTD_outBuffer output = { out, COMPRESS_BYTES, 0 };
+        left = ZSTD_endStream(zc, &output);
+        if (ZSTD_isError(left) || write_output(cs, out, output.pos) != 0) {
+            ZSTD_freeCStream(zc);
+            return -1;
+        }
+    } while (left > 0);
+    ZSTD_freeCStream(zc);
+    return n < 0 ? -1 : 0;
+}
+#endif
+
+/*
+ * output_main - the thread compressing what the interpreter writes into an
+ * output file.
+ */
+static void *output_main(void *arg) {
+    CompressedStream *cs = arg;
+    unsigned char *in = malloc(COMPRESS_BYTES);
+    unsigned char *out = malloc(COMPRESS_BYTES);
+    int status = -1;
+
+    if (in != NULL && out != NULL) {
+#ifdef HAVE_ZSTD
+        if (cs->kind == COMPRESS_ZSTD)
+            status = deflate_zstd(cs, in, out);
+        else
+#endif
+            status = deflate_gzip(cs, in, out);
+    }
+    if (status == 0 && fflush(cs->file) != 0)
+        status = -1;
+    cs->failed = status != 0;
+    // Keep taking the interpreter's output so its writes never fail
+    while (in != NULL && read(cs->fd, in, COMPRESS_BYTES) > 0)
+        ;
+    close(cs->fd);
+    free(in);
+    free(out);
+    return NULL;
+}
+
+/*
+ * start - connects a new socket pair to the interpreter and starts the
+ * thread.
+ * Returns 0 on success, or -1 on failure.
+ */
+static int start(CompressedStream *cs, void *(*main)(void *), const char *mode, FILE **stream) {
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0)
+        return -1;
+    cs->stream = fdopen(fds[0], mode);
+    if (cs->stream == NULL) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    cs->fd = fds[1];
+    if (pthread_create(&cs->thread, NULL, main, cs) != 0) {
+        fclose(cs->stream);
+        close(fds[1]);
+        cs->stream = NULL;
+        return -1;
+    }
+    cs->running = 1;
+    *stream = cs->stream;
+    return 0;
+}
+
+/**
+ * compressed_open_input - opens an input file that may be compressed.
+ * @cs: the stream state.
+ * @file: the input file.
+ * @stream: receives the file to read the plain text from.
+ *
+ * Returns 0 on success, COMPRESS_UNSUPPORTED for a format this build cannot
+ * read, or -1 on failure.
+ */
+int compressed_open_input(CompressedStream *cs, FILE *file, FILE **stream) {
+    struct stat st;
+    unsigned char magic[sizeof(cs->prefix)];
+    ssize_t length;
+    int seekable;
+
+    memset(cs, 0, sizeof(*cs));
+    cs->file = file;
+    // A regular file is recognized without moving its position, so a plain
+    // one can still be mapped; anything else is read through the thread
+    seekable = fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode);
+    if (seekable) {
+        length = pread(fileno(file), magic, sizeof(magic), 0);
+        if (length < 0)
+            length = 0;
+    } else {
+        length = fread(magic, 1, sizeof(magic), file);
+        memcpy(cs->prefix, magic, length);
+        cs->prefix_length = length;
+    }
+
+    if (length >= (ssize_t)sizeof(gzip_magic) && memcmp(magic, gzip_magic, sizeof(gzip_magic)) == 0)
+        cs->kind = COMPRESS_GZIP;
+    else if (length >= (ssize_t)sizeof(zstd_magic) && memcmp(magic, zstd_magic, sizeof(zstd_magic)) == 0)
+        cs->kind = COMPRESS_ZSTD;
+    else if (seekable) {
+        *stream = file;
+        return 0;
+    }
+#ifndef HAVE_ZSTD
+    if (cs->kind == COMPRESS_ZSTD)
+        return COMPRESS_UNSUPPORTED;
+#endif
+    return start(cs, input_main, "r", stream);
+}
+
+/**
+ * compressed_open_output - opens a stream compressed into an output file.
+ * @cs: the stream state.
+ * @file: the output file.
+ * @kind: the format.
+ * @stream: receives the file to write the plain text to.
+ *
+ * Returns 0 on success, COMPRESS_UNSUPPORTED for a format this build cannot
+ * write, or -1 on failure.
+ */
+int compressed_open_output(CompressedStream *cs, FILE *file, Compression kind, FILE **stream) {
+    memset(cs, 0, sizeof(*cs));
+    cs->file = file;
+    cs->kind = kind;
+#ifndef HAVE_ZSTD
+    if (kind == COMPRESS_ZSTD)
+        return COMPRESS_UNSUPPORTED;
+#endif
+    return start(cs, output_main, "w", stream);
+}
+
+/**
+ * compressed_close - closes the stream and waits for the thread.
+ * @cs: the stream state.
+ *
+ * Returns 0 on success, or -1 if the thread failed.
+ */
+int compressed_close(CompressedStream *cs) {
+    int status = 0;
+
+    if (!cs->running)
+        return 0;
+    // Closing the interpreter's end stops an input thread and finishes an
+    // output thread
+    if (fclose(cs->stream) != 0)
+        status = -1;
+    pthread_join(cs->thread, NULL);
+    if (cs->failed)
+        status = -1;
+    memset(cs, 0, sizeof(*cs));
+    return status;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file compress.h
+ * @brief Transparent compression of input and output files. An input file
+ * is recognized as gzip or zstd by its first bytes and decompressed on a
+ * thread of its own, which feeds the interpreter through a socket pair, so
+ * decompression overlaps evaluation and the interpreter reads the plain text
+ * from an ordinary FILE. An output file can be compressed the same way, by
+ * a thread reading what the interpreter writes.
+ *
+ * gzip uses zlib; zstd is only available in a build with -DHAVE_ZSTD and
+ * -lzstd. A plain regular input file is returned as it is, so it is still
+ * mapped into memory by the line reader.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+
+typedef enum {
+    COMPRESS_NONE,
+    COMPRESS_GZIP,
+    COMPRESS_ZSTD
+} Compression;
+
+/* Returned when a file is compressed in a format this build cannot read */
+#define COMPRESS_UNSUPPORTED -2
+
+/**
+ * A file being decompressed or compressed by a thread. A zeroed stream is
+ * not running and can be closed.
+ */
+typedef struct {
+    FILE *file;             /* The compressed file */
+    FILE *stream;           /* The interpreter's end of the socket pair */
+    int fd;                 /* The thread's end of the socket pair */
+    Compression kind;
+    unsigned char prefix[4];/* Bytes read to recognize a file that cannot seek */
+    size_t prefix_length;
+    pthread_t thread;
+    int running;
+    int failed;             /* Set by the thread on corrupt data or an I/O error */
+} CompressedStream;
+
+/**
+ * Parses the name of a compression format: none, gzip or zstd.
+ *
+ * @param text The name.
+ * @param kind Receives the format.
+ * @return 0 on success, or -1 if the name is not a format.
+ */
+int compression_parse(const char *text, Compression *kind);
+
+/**
+ * Opens an input file that may be compressed. A compressed file, or a file
+ * that cannot seek, is read by a thread and its plain text is returned as
+ * a new stream; a plain regular file is returned itself.
+ *
+ * @param cs The stream state.
+ * @param file The input file, not read from yet; it stays open until the
+ * stream is closed.
+ * @param stream Receives the file to read the plain text from.
+ * @return 0 on success, COMPRESS_UNSUPPORTED for zstd in a build without
+ * it, or -1 when out of memory or if the thread cannot start.
+ */
+int compressed_open_input(CompressedStream *cs, FILE *file, FILE **stream);
+
+/**
+ * Opens a stream whose text is compressed into an output file.
+ *
+ * @param cs The stream state.
+ * @param file The output file; it stays open until the stream is closed.
+ * @param kind The format, other than COMPRESS_NONE.
+ * @param stream Receives the file to write the plain text to.
+ * @return 0 on success, COMPRESS_UNSUPPORTED for zstd in a build without
+ * it, or -1 when out of memory or if the thread cannot start.
+ */
+int compressed_open_output(CompressedStream *cs, FILE *file, Compression kind, FILE **stream);
+
+/**
+ * Closes the stream returned by an open function and waits for the thread.
+ * An output stream is finished and flushed to its file. Neither file is
+ * closed.
+ *
+ * @param cs The stream state.
+ * @return 0 on success, or -1 if the input was corrupt or truncated or
+ * could not be read, or the output could not be written.
+ */
+int compressed_close(CompressedStream *cs);
+
+#endif // COMPRESS_H
@@ -0,0 +1,98 @@
+/*
+ * context.c - evaluation contexts for programs embedding the evaluator.
+ * A context owns a token buffer and an arena that are reused from line to
+ * line, as a LineInterpreter does for the batch modes, and classifies each
+ * line into an EvalResult instead of formatting output.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdlib.h>
+#include "context.h"
+#include "lexer.h"
+#include "parser.h"
+
+struct EvalContext {
+    TokenBuffer tokens;
+    Arena arena;
+};
+
+/**
+ * context_create - creates a context.
+ *
+ * Returns the context, or NULL when out of memory.
+ */
+EvalContext *context_create(void) {
+    return calloc(1, sizeof(EvalContext));
+}
+
+/*
+ * finish - fills in the error of a result.
+ * Returns the status.
+ */
+static EvalStatus finish(EvalResult *result, EvalStatus status, int error) {
+    if (error == OUT_OF_MEMORY)
+        status = EVAL_OUT_OF_MEMORY;
+    result->status = status;
+    result->error = error;
+    result->message = error_message(error);
+    return status;
+}
+
+/**
+ * context_evaluate - evaluates one line.
+ * @context: the context of the calling thread.
+ * @text: the line.
+ * @length: length of the line.
+ * @result: receives the outcome.
+ *
+ * Parsing and evaluation are kept apart so that ERROR is classified by the
+ * stage that returned it.
+ * Returns the status.
+ */
+EvalStatus context_evaluate(EvalContext *context, const char *text, size_t length,
+                            EvalResult *result) {
+    result->value = 0;
+    result->offset = 0;
+    result->length = 0;
+
+    int count = lex_line(&context->tokens, text, length);
+    if (count < 0)
+        return finish(result, EVAL_OUT_OF_MEMORY, OUT_OF_MEMORY);
+    if (count == 0)
+        return finish(result, EVAL_BLANK, 0);
+    for (int i = 0; i < count; i++) {
+        const Token *tok = &context->tokens.tokens[i];
+        if (tok->category == UNKNOWN) {
+            result->offset = tok->start;
+            result->length = tok->length;
+            return finish(result, EVAL_LEXICAL_ERROR, 0);
+        }
+    }
+
+    arena_reset(&context->arena); // The previous line's tree is no longer needed
+    TokenStream ts = { .text = text, .length = length, .tokens = context->tokens.tokens,
+                       .count = count, .arena = &context->arena };
+    Node *root = parse_bexpr(&ts);
+    if (root == NULL)
+        return finish(result, EVAL_SYNTAX_ERROR, ts.error);
+
+    int status = eval_node(root, &result->value);
+    if (status != 0) {
+        result->value = 0;
+        return finish(result, EVAL_RUNTIME_ERROR, status);
+    }
+    return finish(result, EVAL_OK, 0);
+}
+
+/**
+ * context_destroy - releases a context.
+ * @context: the context, or NULL.
+ */
+void context_destroy(EvalContext *context) {
+    if (context == NULL)
+        return;
+    free_token_buffer(&context->tokens);
+    arena_free(&context->arena);
+    free(context);
+}
@@ -0,0 +1,76 @@
+/**
+ * @file context.h
+ * @brief Evaluation library for programs that link the evaluator in rather
+ * than running the interpreter. An EvalContext holds the buffers that one
+ * thread needs to evaluate lines: create one per thread, evaluate any number
+ * of lines with it, then destroy it. Contexts share nothing, so threads
+ * evaluate at once without locks. Nothing is written to stdout or stderr;
+ * every outcome, errors included, is returned in an EvalResult.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <stddef.h>
+#include "ast.h"
+
+typedef struct EvalContext EvalContext;
+
+/**
+ * How the evaluation of a line ended.
+ */
+typedef enum {
+    EVAL_OK,                /* The value is set */
+    EVAL_BLANK,             /* The line holds no tokens */
+    EVAL_LEXICAL_ERROR,     /* Text that is not a lexeme; offset and length locate it */
+    EVAL_SYNTAX_ERROR,      /* The line is not an expression of the grammar */
+    EVAL_RUNTIME_ERROR,     /* Division by zero, overflow or a negative exponent */
+    EVAL_OUT_OF_MEMORY
+} EvalStatus;
+
+/**
+ * The outcome of evaluating a line.
+ */
+typedef struct {
+    EvalStatus status;
+    Value value;            /* Value of the expression if status is EVAL_OK */
+    int error;              /* Error code from parser.h, or 0 */
+    const char *message;    /* Static description of the error, or NULL */
+    size_t offset;          /* Offset of the first text that is not a lexeme */
+    size_t length;          /* Length of that text */
+} EvalResult;
+
+/**
+ * Creates a context.
+ *
+ * @return The context, or NULL when out of memory.
+ */
+EvalContext *context_create(void);
+
+/**
+ * Evaluates one line, such as "2 * (3 + 4);". The line is classified as the
+ * interpreter classifies it, and the error codes are those of parser.h:
+ * a syntax error is ERROR, MISSING_SEMICOLON, MISSING_CLOSING_PARENTHESIS,
+ * NO_DIGITS or NUMBER_OUT_OF_RANGE, and a runtime error is ERROR for a
+ * negative exponent or a more specific code such as DIVISION_BY_ZERO.
+ *
+ * @param context The context of the calling thread.
+ * @param text The line; it need not be NUL-terminated.
+ * @param length Length of the line in bytes.
+ * @param result Receives the outcome.
+ * @return The status, also stored in the result.
+ */
+EvalStatus context_evaluate(EvalContext *context, const char *text, size_t length,
+                            EvalResult *result);
+
+/**
+ * Releases a context.
+ *
+ * @param context The context, or NULL.
+ */
+void context_destroy(EvalContext *context);
+
+#endif // CONTEXT_H
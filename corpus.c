@@ -0,0 +1,433 @@
+/*
+ * corpus.c - seeded generator of synthetic input files.
+ * Lines are built into one growable buffer from a xorshift generator, so a
+ * kind, a line count and a seed always give the same bytes.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "corpus.h"
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    int failed;             /* Set once the buffer could not be grown */
+    unsigned long state;    /* State of the random generator */
+    unsigned long variables;/* Variables defined so far by the variables corpus */
+} Generator;
+
+static const char *const kind_names[NUM_CORPUS_KINDS] = {
+    [CORPUS_MIXED] = "mixed",
+    [CORPUS_CHAINS] = "chains",
+    [CORPUS_NESTED] = "nested",
+    [CORPUS_TOWERS] = "towers",
+    [CORPUS_COMPARISONS] = "comparisons",
+    [CORPUS_LEXICAL] = "lexical",
+    [CORPUS_VARIABLES] = "variables",
+    [CORPUS_ROWS] = "rows",
+};
+
+/* Binary operators of the mixed corpus, + - and * repeated to weight them */
+static const char *const mixed_operators[] = {
+    "+", "-", "*", "+", "-", "*", "/", "^", "<", ">", "<=", ">=", "==", "!=",
+};
+
+static const char *const comparison_operators[] = {
+    "<", ">", "<=", ">=", "==", "!=",
+};
+
+/* Operators between the operands of expressions using variables */
+static const char *const variable_operators[] = {
+    "+", "-", "*", "+", "-", "<", ">=", "==",
+};
+
+/* Variables the variables corpus defines at most, v0 to v4095 */
+#define MAX_VARIABLES 4096
+
+/* Text that is not a lexeme, injected into lines of the lexical corpus */
+static const char *const junk[] = {
+    "@", "#", "$", "&", "_", "~", "?", ".", "abc", "x", "!", "%", "[", "]",
+};
+
+/* Columns of the rows corpus, named in its header */
+#define ROW_COLUMNS "a,b,c,d"
+#define ROW_COLUMN_COUNT 4
+
+#define COUNT(array) (sizeof(array) / sizeof((array)[0]))
+
+/**
+ * corpus_kind_name - returns the name of a kind of corpus.
+ * @kind: the kind.
+ */
+const char *corpus_kind_name(CorpusKind kind) {
+    return kind_names[kind];
+}
+
+/**
+ * corpus_kind - looks up a kind of corpus by name.
+ * @name: the name.
+ *
+ * Returns the kind, or -1 if the name is unknown.
+ */
+int corpus_kind(const char *name) {
+    for (int kind = 0; kind < NUM_CORPUS_KINDS; kind++) {
+        if (strcmp(name, kind_names[kind]) == 0)
+            return kind;
+    }
+    return -1;
+}
+
+/*
+ * next_random - xorshift generator.
+ */
+static unsigned long next_random(Generator *gen) {
+    gen->state ^= gen->state << 13;
+    gen->state ^= gen->state >> 7;
+    gen->state ^= gen->state << 17;
+    return gen->state;
+}
+
+/*
+ * below - returns a random number in [0, limit).
+ */
+static unsigned long below(Generator *gen, unsigned long limit) {
+    return next_random(gen) % limit;
+}
+
+/*
+ * between - returns a random number in [low, high].
+ */
+static unsigned long between(Generator *gen, unsigned long low, unsigned long high) {
+    return low + below(gen, high - low + 1);
+}
+
+/*
+ * put - appends bytes to the corpus.
+ */
+static void put(Generator *gen, const char *text, size_t length) {
+    if (gen->failed)
+        return;
+    if (gen->length + length > gen->capacity) {
+        size_t capacity = gen->capacity ? gen->capacity * 2 : 64 * 1024;
+        while (capacity < gen->length + length)
+            capacity *= 2;
+        char *grown = realloc(gen->data, capacity);
+        if (grown == NULL) {
+            gen->failed = 1;
+            return;
+        }
+        gen->data = grown;
+        gen->capacity = capacity;
+    }
+    memcpy(gen->data + gen->length, text, length);
+    gen->length += length;
+}
+
+/*
+ * put_string - appends a NUL-terminated string.
+ */
+static void put_string(Generator *gen, const char *text) {
+    put(gen, text, strlen(text));
+}
+
+/*
+ * put_number - appends a non-negative number.
+ */
+static void put_number(Generator *gen, unsigned long value) {
+    char digits[24];
+    char *d = digits + sizeof(digits);
+    do {
+        *--d = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    put(gen, d, digits + sizeof(digits) - d);
+}
+
+/*
+ * put_operator - appends a binary operator, with spaces around it half the
+ * time.
+ */
+static void put_operator(Generator *gen, const char *op) {
+    int spaced = below(gen, 2);
+    if (spaced)
+        put_string(gen, " ");
+    put_string(gen, op);
+    if (spaced)
+        put_string(gen, " ");
+}
+
+/*
+ * put_expression - appends a random expression of up to four operands,
+ * nesting parenthesized expressions up to the given depth.
+ */
+static void put_expression(Generator *gen, int depth) {
+    int operands = between(gen, 1, 4);
+    const char *op = NULL;
+
+    for (int i = 0; i < operands; i++) {
+        if (op != NULL)
+            put_operator(gen, op);
+        if (depth > 0 && below(gen, 5) == 0) {
+            put_string(gen, "(");
+            put_expression(gen, depth - 1);
+            if (below(gen, 100) != 0) // Leave some parentheses unclosed
+                put_string(gen, ")");
+        } else {
+            if (below(gen, 10) == 0)
+                put_string(gen, "-"); // A sign attached to the literal
+            // Keep exponents small so that not every power overflows
+            put_number(gen, op != NULL && op[0] == '^' ? below(gen, 6) : below(gen, 1000));
+        }
+        op = mixed_operators[below(gen, COUNT(mixed_operators))];
+    }
+}
+
+/*
+ * put_mixed - appends a short expression, mostly well formed, or a blank
+ * line or a line with a lexical error.
+ */
+static void put_mixed(Generator *gen) {
+    unsigned long choice = below(gen, 100);
+
+    if (choice < 3) {
+        put(gen, "   ", below(gen, 4)); // Blank or whitespace only
+        return;
+    }
+    if (choice < 6) {
+        put_expression(gen, 1);
+        put_string(gen, junk[below(gen, COUNT(junk))]);
+        put_string(gen, ";");
+        return;
+    }
+
+    put_expression(gen, 3);
+    choice = below(gen, 100);
+    if (choice < 3)
+        return; // Missing semicolon
+    if (choice < 5)
+        put_string(gen, ")"); // Unbalanced parenthesis
+    put_string(gen, ";");
+}
+
+/*
+ * put_chain - appends a chain of 10 to 200 additions and subtractions.
+ */
+static void put_chain(Generator *gen) {
+    int terms = between(gen, 10, 200);
+
+    put_number(gen, below(gen, 100));
+    for (int i = 1; i < terms; i++) {
+        put_operator(gen, below(gen, 2) ? "+" : "-");
+        put_number(gen, below(gen, 100));
+    }
+    put_string(gen, ";");
+}
+
+/*
+ * put_nested - appends an expression nested 10 to 300 parentheses deep,
+ * each level applying one more operation to the level inside it.
+ */
+static void put_nested(Generator *gen) {
+    static const char *const ops[] = { "+", "-", "*" };
+    int depth = between(gen, 10, 300);
+
+    for (int i = 0; i < depth; i++)
+        put_string(gen, "(");
+    put_number(gen, below(gen, 10));
+    for (int i = 0; i < depth; i++) {
+        put_operator(gen, ops[below(gen, COUNT(ops))]);
+        put_number(gen, between(gen, 1, 3));
+        put_string(gen, ")");
+    }
+    put_string(gen, ";");
+}
+
+/*
+ * put_tower - appends a tower of 2 to 30 powers of small numbers. Most
+ * exponents are 0 or 1 so that some towers stay in range.
+ */
+static void put_tower(Generator *gen) {
+    int height = between(gen, 2, 30);
+
+    put_number(gen, between(gen, 1, 9));
+    for (int i = 1; i < height; i++) {
+        put_operator(gen, "^");
+        put_number(gen, below(gen, 4) == 0 ? between(gen, 2, 3) : below(gen, 2));
+    }
+    put_string(gen, ";");
+}
+
+/*
+ * put_comparisons - appends a chain of 2 to 10 comparisons between sums.
+ */
+static void put_comparisons(Generator *gen) {
+    int count = between(gen, 2, 10);
+
+    for (int i = 0; i <= count; i++) {
+        if (i > 0)
+            put_operator(gen, comparison_operators[below(gen, COUNT(comparison_operators))]);
+        put_number(gen, below(gen, 50));
+        if (below(gen, 2)) {
+            put_operator(gen, below(gen, 2) ? "+" : "-");
+            put_number(gen, below(gen, 50));
+        }
+    }
+    put_string(gen, ";");
+}
+
+/*
+ * put_lexical - appends an expression with text that is not a lexeme
+ * inserted at a random point.
+ */
+static void put_lexical(Generator *gen) {
+    size_t start = gen->length;
+    put_expression(gen, 2);
+    put_string(gen, ";");
+    if (gen->failed)
+        return;
+
+    // Move the tail of the line to make room for the junk
+    const char *text = junk[below(gen, COUNT(junk))];
+    size_t length = strlen(text);
+    size_t at = start + below(gen, gen->length - start + 1);
+    size_t tail = gen->length - at;
+    put(gen, text, length);
+    if (gen->failed)
+        return;
+    memmove(gen->data + at + length, gen->data + at, tail);
+    memcpy(gen->data + at, text, length);
+}
+
+/*
+ * put_variable - appends the name of a variable defined earlier.
+ */
+static void put_variable(Generator *gen) {
+    put_string(gen, "v");
+    put_number(gen, below(gen, gen->variables));
+}
+
+/*
+ * put_average - appends a value for an assignment: the halved or smaller
+ * difference of two variables plus a small literal, so that values drift
+ * slowly instead of overflowing.
+ */
+static void put_average(Generator *gen) {
+    put_string(gen, "(");
+    put_variable(gen);
+    put_operator(gen, below(gen, 2) ? "+" : "-");
+    put_variable(gen);
+    put_string(gen, ")");
+    put_operator(gen, "/");
+    put_number(gen, between(gen, 2, 9));
+    put_operator(gen, "+");
+    put_number(gen, below(gen, 100));
+}
+
+/*
+ * put_variables - appends a line of a program over up to MAX_VARIABLES
+ * variables: a quarter of the lines define a new variable until all are
+ * defined, a quarter assign a new value to one, and the rest are
+ * expressions of two to six variables and literals.
+ */
+static void put_variables(Generator *gen) {
+    unsigned long choice = below(gen, 4);
+
+    if (gen->variables == 0 || (choice == 0 && gen->variables < MAX_VARIABLES)) {
+        put_string(gen, "v");
+        put_number(gen, gen->variables);
+        put_string(gen, " = ");
+        if (gen->variables == 0)
+            put_number(gen, below(gen, 1000));
+        else
+            put_average(gen);
+        put_string(gen, ";");
+        gen->variables++; // Only now may later lines name it
+        return;
+    }
+    if (choice <= 1) {
+        put_variable(gen);
+        put_string(gen, " = ");
+        put_average(gen);
+        put_string(gen, ";");
+        return;
+    }
+
+    int operands = between(gen, 2, 6);
+    for (int i = 0; i < operands; i++) {
+        if (i > 0)
+            put_operator(gen, variable_operators[below(gen, COUNT(variable_operators))]);
+        if (below(gen, 4) == 0)
+            put_number(gen, below(gen, 100));
+        else
+            put_variable(gen);
+    }
+    put_string(gen, ";");
+}
+
+/*
+ * put_rows - appends the header of the rows corpus on its first line, and a
+ * row of integers on every other: mostly small, with a few zeros, a few
+ * large enough that products overflow, and a few of magnitude 2^31, which
+ * is VALUE_MIN when negative and out of range of 32 bits when positive.
+ */
+static void put_rows(Generator *gen) {
+    if (gen->length == 0) {
+        put_string(gen, ROW_COLUMNS);
+        return;
+    }
+    for (int c = 0; c < ROW_COLUMN_COUNT; c++) {
+        unsigned long choice = below(gen, 50);
+        if (c > 0)
+            put_string(gen, ",");
+        if (below(gen, 2))
+            put_string(gen, "-");
+        if (choice == 0)
+            put_number(gen, 0);
+        else if (choice == 1)
+            put_number(gen, between(gen, 100000, 2147483647));
+        else if (choice == 2)
+            put_number(gen, 2147483648UL);
+        else
+            put_number(gen, below(gen, 1000));
+    }
+}
+
+/**
+ * generate_corpus - generates a corpus.
+ * @kind: the kind of corpus.
+ * @lines: number of lines.
+ * @seed: seed of the random generator.
+ * @size: receives the size of the text.
+ *
+ * Returns the text, or NULL when out of memory.
+ */
+char *generate_corpus(CorpusKind kind, size_t lines, unsigned long seed, size_t *size) {
+    static void (*const generators[NUM_CORPUS_KINDS])(Generator *) = {
+        [CORPUS_MIXED] = put_mixed,
+        [CORPUS_CHAINS] = put_chain,
+        [CORPUS_NESTED] = put_nested,
+        [CORPUS_TOWERS] = put_tower,
+        [CORPUS_COMPARISONS] = put_comparisons,
+        [CORPUS_LEXICAL] = put_lexical,
+        [CORPUS_VARIABLES] = put_variables,
+        [CORPUS_ROWS] = put_rows,
+    };
+    // Xorshift never leaves 0, so mix the seed into a nonzero state
+    Generator gen = { .state = seed * 6364136223846793005UL + 1442695040888963407UL };
+    if (gen.state == 0)
+        gen.state = 88172645463325252UL;
+
+    for (size_t i = 0; i < lines && !gen.failed; i++) {
+        generators[kind](&gen);
+        put_string(&gen, "\n");
+    }
+    if (gen.failed) {
+        free(gen.data);
+        return NULL;
+    }
+    *size = gen.length;
+    return gen.data;
+}
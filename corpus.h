@@ -0,0 +1,60 @@
+/**
+ * @file corpus.h
+ * @brief Seeded generator of synthetic input files for benchmarks. Each kind
+ * of corpus stresses one part of the interpreter: a realistic mix of short
+ * expressions, long + and - chains, deeply nested parentheses, right
+ * associative ^ towers, chains of comparisons, lines with lexical errors,
+ * programs over thousands of variables for the -V mode, and CSV rows for
+ * the templates of the -t mode. The same kind, line count and seed always
+ * produce the same text.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stddef.h>
+
+typedef enum {
+    CORPUS_MIXED,           /* Short expressions with a few errors of each kind */
+    CORPUS_CHAINS,          /* Long + and - chains */
+    CORPUS_NESTED,          /* Deeply nested parentheses */
+    CORPUS_TOWERS,          /* Right associative ^ towers */
+    CORPUS_COMPARISONS,     /* Chains of comparisons between sums */
+    CORPUS_LEXICAL,         /* Lines with text that is not a lexeme */
+    CORPUS_VARIABLES,       /* Assignments to and uses of thousands of variables */
+    CORPUS_ROWS,            /* A CSV header and rows of integers for -t templates */
+    NUM_CORPUS_KINDS
+} CorpusKind;
+
+/**
+ * Returns the name of a kind of corpus, as accepted by corpus_kind().
+ *
+ * @param kind The kind.
+ * @return The name.
+ */
+const char *corpus_kind_name(CorpusKind kind);
+
+/**
+ * Looks up a kind of corpus by name.
+ *
+ * @param name The name.
+ * @return The kind, or -1 if the name is unknown.
+ */
+int corpus_kind(const char *name);
+
+/**
+ * Generates a corpus.
+ *
+ * @param kind The kind of corpus.
+ * @param lines Number of lines to generate.
+ * @param seed Seed of the random generator; any value is valid.
+ * @param size Receives the size of the text in bytes.
+ * @return The text, every line ending with a newline (malloc'd), or NULL
+ * when out of memory.
+ */
+char *generate_corpus(CorpusKind kind, size_t lines, unsigned long seed, size_t *size);
+
+#endif // CORPUS_H
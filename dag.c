@@ -0,0 +1,250 @@
+/*
+ * dag.c - hash-consed expression DAG of a batch.
+ * Nodes are chained in a hash table keyed by their kind, their value and
+ * the addresses of their operands, which are unique within the DAG, so two
+ * nodes are the same exactly when their keys are. The operands given to
+ * dag_op() are always literals or failed operations, since every operation
+ * that evaluates returns its literal, so operations are keyed by the values
+ * of their operands.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "dag.h"
+
+/* Buckets of a new table, fewer if the cap is small */
+#define INITIAL_BUCKETS 4096
+#define MIN_BUCKETS 64
+
+/*
+ * hash_key - mixes the key of a node. Operand addresses are aligned, so the
+ * high bits are folded into the low bits the bucket is taken from.
+ */
+static uint64_t hash_key(unsigned int kind, Value value, const Node *left, const Node *right) {
+    uint64_t hash = (kind + 1) * 0x9e3779b97f4a7c15ULL ^ (uint64_t)(UValue)value;
+    hash = (hash ^ (uintptr_t)left) * 0xff51afd7ed558ccdULL;
+    hash = (hash ^ (uintptr_t)right) * 0xc4ceb9fe1a85ec53ULL;
+    return hash ^ (hash >> 32);
+}
+
+/**
+ * dag_create - creates an empty DAG.
+ * @max_bytes: memory cap.
+ *
+ * Returns the DAG, or NULL when out of memory.
+ */
+Dag *dag_create(size_t max_bytes) {
+    Dag *dag = calloc(1, sizeof(Dag));
+    if (dag == NULL)
+        return NULL;
+
+    size_t count = INITIAL_BUCKETS;
+    while (count > MIN_BUCKETS && count * sizeof(DagNode *) > max_bytes / 2)
+        count /= 2;
+    dag->buckets = calloc(count, sizeof(DagNode *));
+    if (dag->buckets == NULL) {
+        free(dag);
+        return NULL;
+    }
+    dag->bucket_count = count;
+    dag->max_bytes = max_bytes;
+    return dag;
+}
+
+/*
+ * dag_bytes - estimates the memory held by the nodes and the table.
+ */
+static size_t dag_bytes(const Dag *dag) {
+    return dag->count * sizeof(DagNode) + dag->bucket_count * sizeof(DagNode *);
+}
+
+/**
+ * dag_begin_line - clears the DAG if it has reached its cap.
+ * @dag: the DAG.
+ */
+void dag_begin_line(Dag *dag) {
+    if (dag_bytes(dag) < dag->max_bytes || dag->count == 0)
+        return;
+    arena_reset(&dag->arena);
+    memset(dag->buckets, 0, dag->bucket_count * sizeof(DagNode *));
+    dag->count = 0;
+    dag->clears++;
+}
+
+/*
+ * grow_buckets - doubles the table once it averages one node per bucket.
+ * The table stays as it is if there is no memory for a larger one, or if it
+ * would take more than half the cap, which would leave the DAG clearing
+ * itself every line since the table is kept through clears.
+ */
+static void grow_buckets(Dag *dag) {
+    size_t count = dag->bucket_count * 2;
+    if (count * sizeof(DagNode *) > dag->max_bytes / 2)
+        return;
+    DagNode **buckets = calloc(count, sizeof(DagNode *));
+    if (buckets == NULL)
+        return;
+
+    for (size_t i = 0; i < dag->bucket_count; i++) {
+        DagNode *node = dag->buckets[i];
+        while (node != NULL) {
+            DagNode *chain = node->chain;
+            node->chain = buckets[node->hash & (count - 1)];
+            buckets[node->hash & (count - 1)] = node;
+            node = chain;
+        }
+    }
+    free(dag->buckets);
+    dag->buckets = buckets;
+    dag->bucket_count = count;
+}
+
+/*
+ * find - looks up the node with a key.
+ * Returns the node, or NULL if the DAG does not have it.
+ */
+static DagNode *find(const Dag *dag, uint64_t hash, unsigned int kind, Value value,
+                     const Node *left, const Node *right) {
+    DagNode *node = dag->buckets[hash & (dag->bucket_count - 1)];
+    for (; node != NULL; node = node->chain) {
+        if (node->hash == hash && node->node.kind == kind && node->node.value == value &&
+            node->node.left == left && node->node.right == right)
+            return node;
+    }
+    return NULL;
+}
+
+/*
+ * insert - builds a node with a key and adds it to the DAG.
+ * Returns the node, or NULL when out of memory.
+ */
+static DagNode *insert(Dag *dag, uint64_t hash, unsigned int kind, Value value,
+                       Node *left, Node *right) {
+    DagNode *node = arena_alloc(&dag->arena, sizeof(DagNode));
+    if (node == NULL)
+        return NULL;
+    node->node.kind = kind;
+    node->node.value = value;
+    node->node.left = left;
+    node->node.right = right;
+    node->status = 0;
+    node->result = node;
+    node->hash = hash;
+
+    if (dag->count >= dag->bucket_count)
+        grow_buckets(dag);
+    DagNode **bucket = &dag->buckets[hash & (dag->bucket_count - 1)];
+    node->chain = *bucket;
+    *bucket = node;
+    dag->count++;
+    dag->distinct++;
+    return node;
+}
+
+/**
+ * dag_num - finds or builds a literal.
+ * @dag: the DAG.
+ * @value: the value of the literal.
+ *
+ * Returns the node, or NULL when out of memory.
+ */
+Node *dag_num(Dag *dag, Value value) {
+    uint64_t hash = hash_key(NODE_NUM, value, NULL, NULL);
+    DagNode *node = find(dag, hash, NODE_NUM, value, NULL, NULL);
+
+    dag->requests++;
+    if (node == NULL)
+        node = insert(dag, hash, NODE_NUM, value, NULL, NULL);
+    return node != NULL ? &node->node : NULL;
+}
+
+/**
+ * dag_op - finds or builds an operation, folding it if it evaluates.
+ * @dag: the DAG.
+ * @kind: the operator.
+ * @left: the left operand.
+ * @right: the right operand.
+ *
+ * The error of a failed operand is the error of the operation, left first,
+ * as eval_node() finds it.
+ * Returns the literal of the value or the failed operation, or NULL when
+ * out of memory.
+ */
+Node *dag_op(Dag *dag, NodeKind kind, Node *left, Node *right) {
+    const DagNode *l = (const DagNode *)left, *r = (const DagNode *)right;
+    uint64_t hash = hash_key(kind, 0, left, right);
+    DagNode *node = find(dag, hash, kind, 0, left, right);
+
+    dag->requests++;
+    dag->operations++;
+    if (node != NULL)
+        return &node->result->node;
+
+    node = insert(dag, hash, kind, 0, left, right);
+    if (node == NULL)
+        return NULL;
+    if (l->status != 0 || r->status != 0) {
+        node->status = l->status != 0 ? l->status : r->status;
+        return &node->node;
+    }
+
+    Value value;
+    dag->evaluated++;
+    node->status = eval_operator(kind, left->value, right->value, &value);
+    if (node->status != 0)
+        return &node->node;
+
+    // Later requests for the operation get the literal without evaluating
+    DagNode *literal = (DagNode *)dag_num(dag, value);
+    dag->requests--;
+    if (literal == NULL)
+        return NULL;
+    node->result = literal;
+    dag->folded++;
+    return &literal->node;
+}
+
+/**
+ * dag_value - reads the value of a node.
+ * @node: the node.
+ * @value: receives the value.
+ *
+ * Returns 0 on success, or the error code of evaluating the node.
+ */
+int dag_value(const Node *node, Value *value) {
+    const DagNode *d = (const DagNode *)node;
+    if (d->status != 0)
+        return d->status;
+    *value = node->value;
+    return 0;
+}
+
+/**
+ * dag_report - writes the counters of a DAG.
+ * @dag: the DAG.
+ * @file: the stream.
+ */
+void dag_report(const Dag *dag, FILE *file) {
+    fprintf(file, "DAG: %lu nodes requested, %lu built (%.2fx deduplication), "
+            "%lu of %lu operations evaluated (%.1f%% saved), %lu clears, %zu bytes\n",
+            dag->requests, dag->distinct,
+            dag->distinct ? (double)dag->requests / dag->distinct : 0.0,
+            dag->evaluated, dag->operations,
+            dag->operations ? 100.0 * (dag->operations - dag->evaluated) / dag->operations : 0.0,
+            dag->clears, dag_bytes(dag));
+}
+
+/**
+ * dag_destroy - releases a DAG.
+ * @dag: the DAG, or NULL.
+ */
+void dag_destroy(Dag *dag) {
+    if (dag == NULL)
+        return;
+    arena_free(&dag->arena);
+    free(dag->buckets);
+    free(dag);
+}
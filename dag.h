@@ -0,0 +1,125 @@
+/**
+ * @file dag.h
+ * @brief Hash-consed expression DAG shared by the lines of a batch. The
+ * parser builds the nodes of each line through the DAG instead of the line's
+ * arena: a literal and an operator applied to the same operands are built
+ * once per batch, and every later request returns the node already built.
+ * Constant subexpressions are folded as they are built, so an operator node
+ * is replaced by the literal of its value, and two subexpressions with the
+ * same value share one literal and everything built on it. A subexpression
+ * is therefore evaluated once per batch, however many lines repeat it, and
+ * evaluating a line only reads the value of its root.
+ *
+ * An operation that fails, such as a division by zero, is kept as an
+ * operator node recording its error, and every operation on it fails with
+ * the same error, the first in postorder as eval_node() reports it.
+ *
+ * Variables change from line to line, so lines naming them are not built in
+ * a DAG. The DAG holds its nodes until its memory cap is reached between
+ * lines, when it is cleared.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef DAG_H
+#define DAG_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "ast.h"
+
+/**
+ * A node of the DAG. The node is the key: kind, value and the operands,
+ * which are always nodes of the same DAG.
+ */
+typedef struct DagNode {
+    Node node;
+    int status;                 /* 0, or the error of evaluating the node */
+    struct DagNode *result;     /* The literal an operation folds to, or the node itself */
+    uint64_t hash;
+    struct DagNode *chain;      /* Next node of the same bucket */
+} DagNode;
+
+/**
+ * The DAG of a batch and its counters.
+ */
+typedef struct {
+    Arena arena;                /* Holds the nodes until the DAG is cleared */
+    DagNode **buckets;
+    size_t bucket_count;        /* A power of two */
+    size_t count;               /* Nodes in the DAG */
+    size_t max_bytes;
+    unsigned long requests;     /* Nodes the parser asked for */
+    unsigned long operations;   /* Operator nodes among them */
+    unsigned long evaluated;    /* Operations computed; the others were shared */
+    unsigned long folded;       /* Operations replaced by the literal of their value */
+    unsigned long distinct;     /* Nodes built, over every clear */
+    unsigned long clears;
+} Dag;
+
+/**
+ * Creates a DAG.
+ *
+ * @param max_bytes Memory the nodes and the table may use before the DAG
+ * is cleared.
+ * @return The DAG, or NULL when out of memory.
+ */
+Dag *dag_create(size_t max_bytes);
+
+/**
+ * Prepares the DAG for the next line, clearing it if it has reached its
+ * memory cap. The nodes of earlier lines are not valid after a clear.
+ *
+ * @param dag The DAG.
+ */
+void dag_begin_line(Dag *dag);
+
+/**
+ * Finds or builds a literal.
+ *
+ * @param dag The DAG.
+ * @param value The value of the literal.
+ * @return The node, or NULL when out of memory.
+ */
+Node *dag_num(Dag *dag, Value value);
+
+/**
+ * Finds or builds an operator applied to two nodes of the DAG, folded to
+ * the literal of its value if it evaluates.
+ *
+ * @param dag The DAG.
+ * @param kind The operator.
+ * @param left The left operand.
+ * @param right The right operand.
+ * @return The literal of the value, the node of the failed operation, or
+ * NULL when out of memory.
+ */
+Node *dag_op(Dag *dag, NodeKind kind, Node *left, Node *right);
+
+/**
+ * Reads the value of a node of the DAG, evaluating nothing.
+ *
+ * @param node The node.
+ * @param value Receives the value.
+ * @return 0 on success, or the error code of evaluating the node.
+ */
+int dag_value(const Node *node, Value *value);
+
+/**
+ * Writes the counters of a DAG: nodes requested and built, the ratio of
+ * the two, and the operations computed and saved.
+ *
+ * @param dag The DAG.
+ * @param file The stream.
+ */
+void dag_report(const Dag *dag, FILE *file);
+
+/**
+ * Releases a DAG and its nodes.
+ *
+ * @param dag The DAG, or NULL.
+ */
+void dag_destroy(Dag *dag);
+
+#endif // DAG_H
@@ -0,0 +1,132 @@
+/*
+ * diag.c - buffered sinks for the evaluator's diagnostics.
+ * A sink formats each message with vsnprintf() straight into its buffer,
+ * so a message costs no lock and no system call; the buffer goes to the
+ * stream in one fwrite() when the next message would not fit.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "diag.h"
+
+int diag_level = DIAG_LEVEL;
+
+/* Names of the levels, indexed by level */
+static const char *const level_names[] = { "off", "error", "warn", "info", "debug" };
+
+/* The process's sink on stdout */
+static DiagSink stdout_sink;
+
+/**
+ * diag_open - opens a sink on a stream.
+ * @sink: the sink.
+ * @file: the stream receiving the messages.
+ */
+void diag_open(DiagSink *sink, FILE *file) {
+    sink->file = file;
+    sink->buffer = NULL;
+    sink->length = 0;
+}
+
+/**
+ * diag_write - formats a message into a sink's buffer.
+ * @sink: the sink.
+ * @format: the printf() format of the message.
+ */
+void diag_write(DiagSink *sink, const char *format, ...) {
+    va_list args;
+
+    if (sink->buffer == NULL)
+        sink->buffer = malloc(DIAG_BUFFER);
+    for (;;) {
+        if (sink->buffer == NULL)
+            break;
+        va_start(args, format);
+        int n = vsnprintf(sink->buffer + sink->length, DIAG_BUFFER - sink->length, format, args);
+        va_end(args);
+        if (n < 0)
+            return;
+        if (sink->length + n < DIAG_BUFFER) {
+            sink->length += n;
+            return;
+        }
+        // The message did not fit: write out what came before and retry
+        if (sink->length == 0)
+            break;
+        diag_flush(sink);
+    }
+
+    // No buffer, or a message longer than the buffer
+    va_start(args, format);
+    vfprintf(sink->file, format, args);
+    va_end(args);
+}
+
+/**
+ * diag_flush - writes the buffered messages to the stream.
+ * @sink: the sink.
+ *
+ * Returns 0 on success, or -1 on a write error.
+ */
+int diag_flush(DiagSink *sink) {
+    size_t length = sink->length;
+    sink->length = 0;
+    if (length > 0 && fwrite(sink->buffer, 1, length, sink->file) != length)
+        return -1;
+    return 0;
+}
+
+/**
+ * diag_close - writes the buffered messages and releases the buffer.
+ * @sink: the sink, or NULL.
+ */
+void diag_close(DiagSink *sink) {
+    if (sink == NULL)
+        return;
+    if (sink->file != NULL)
+        diag_flush(sink);
+    free(sink->buffer);
+    memset(sink, 0, sizeof(*sink));
+}
+
+/**
+ * diag_parse_level - parses the name or number of a level.
+ * @text: the level.
+ * @level: receives the level.
+ *
+ * Returns 0 on success, or -1 if the text is not a level.
+ */
+int diag_parse_level(const char *text, int *level) {
+    int count = sizeof(level_names) / sizeof(level_names[0]);
+    for (int i = 0; i < count; i++) {
+        if (strcmp(text, level_names[i]) == 0 ||
+            (text[0] == '0' + i && text[1] == '\0')) {
+            *level = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * close_stdout_sink - writes out the stdout sink at exit.
+ */
+static void close_stdout_sink(void) {
+    diag_close(&stdout_sink);
+}
+
+/**
+ * diag_stdout - finds the process's sink on stdout.
+ *
+ * Returns the sink.
+ */
+DiagSink *diag_stdout(void) {
+    if (stdout_sink.file == NULL) {
+        diag_open(&stdout_sink, stdout);
+        atexit(close_stdout_sink);
+    }
+    return &stdout_sink;
+}
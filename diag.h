@@ -0,0 +1,122 @@
+/**
+ * @file diag.h
+ * @brief Diagnostics of the evaluator: the debug lines the parser and the
+ * tokenizer write for every line they process. Each message has a level,
+ * and is written only if its level is at most both the compile-time level,
+ * DIAG_LEVEL, and the runtime level, diag_level. A message above
+ * DIAG_LEVEL is removed by the compiler with its arguments, so a release
+ * build (-DNDEBUG, or -DDIAG_LEVEL=DIAG_WARN) formats nothing on the
+ * evaluation path. The runtime level starts at DIAG_LEVEL and is set once,
+ * before any thread starts; the interpreter's -d option sets it.
+ *
+ * Messages go to a DiagSink, which formats them into a buffer of its own
+ * and writes the buffer to its stream when it fills and when it is closed.
+ * A sink belongs to one thread; threads sharing a stream each get a sink,
+ * and each write to the stream is one call.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef DIAG_H
+#define DIAG_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define DIAG_OFF 0
+#define DIAG_ERROR 1
+#define DIAG_WARN 2
+#define DIAG_INFO 3
+#define DIAG_DEBUG 4
+
+/* Highest level compiled in */
+#ifndef DIAG_LEVEL
+#ifdef NDEBUG
+#define DIAG_LEVEL DIAG_WARN
+#else
+#define DIAG_LEVEL DIAG_DEBUG
+#endif
+#endif
+
+/* Bytes a sink buffers before writing to its stream */
+#define DIAG_BUFFER (64 * 1024)
+
+/**
+ * A buffered stream of diagnostics. A zeroed sink has no stream; open it
+ * with diag_open().
+ */
+typedef struct {
+    FILE *file;             /* Stream the buffer is written to */
+    char *buffer;           /* Allocated on the first message */
+    size_t length;          /* Bytes waiting in the buffer */
+} DiagSink;
+
+/* Highest level written at runtime, at most DIAG_LEVEL */
+extern int diag_level;
+
+/**
+ * Writes a message to a sink if its level is enabled, formatting its
+ * arguments only then. The sink may be NULL to drop every message.
+ */
+#define DIAG(sink, level, ...) \
+    do { \
+        if ((level) <= DIAG_LEVEL && (level) <= diag_level && (sink) != NULL) \
+            diag_write((sink), __VA_ARGS__); \
+    } while (0)
+
+/**
+ * Opens a sink on a stream. Opening does not allocate, so it cannot fail.
+ *
+ * @param sink The sink.
+ * @param file The stream receiving the messages.
+ */
+void diag_open(DiagSink *sink, FILE *file);
+
+/**
+ * Formats a message into a sink's buffer, writing the buffer out first if
+ * the message does not fit. Use DIAG() instead, which checks the levels.
+ * Without memory for the buffer, the message is written straight to the
+ * stream.
+ *
+ * @param sink The sink.
+ * @param format The printf() format of the message.
+ */
+void diag_write(DiagSink *sink, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * Writes the buffered messages to the sink's stream.
+ *
+ * @param sink The sink.
+ * @return 0 on success, or -1 on a write error.
+ */
+int diag_flush(DiagSink *sink);
+
+/**
+ * Writes the buffered messages and releases the buffer, leaving the sink
+ * zeroed.
+ *
+ * @param sink The sink, or NULL.
+ */
+void diag_close(DiagSink *sink);
+
+/**
+ * Parses a level: off, error, warn, info, debug, or its number.
+ *
+ * @param text The level.
+ * @param level Receives the level.
+ * @return 0 on success, or -1 if the text is not a level.
+ */
+int diag_parse_level(const char *text, int *level);
+
+/**
+ * Finds the process's sink on stdout, used by the entry points without a
+ * sink of their own (bexpr() and get_token()). It is written out at exit,
+ * and is not safe to use from more than one thread.
+ *
+ * @return The sink.
+ */
+DiagSink *diag_stdout(void);
+
+#endif // DIAG_H
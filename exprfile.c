@@ -0,0 +1,403 @@
+/*
+ * exprfile.c - writes and executes precompiled expression files.
+ *
+ * Layout, in native byte order:
+ *   header     ExprFileHeader
+ *   path       the source path, padded to a multiple of 8 bytes
+ *   records    one per input line, each aligned to the size of a Value:
+ *                uint32 kind, uint32 text_length, uint32 code_length,
+ *                uint32 max_stack, int32 status, uint32 reserved (zero),
+ *                text padded to the size of a Value, Value code[]
+ * Values are int32 unless built with -DVALUE_64, whose files are int64 and
+ * carry a version of their own. Code loading or storing variables indexes
+ * an array of header.variable_count Values.
+ * The checksum covers the path and the records. It only catches accidental
+ * damage, so the records and their code are also verified before any of
+ * them runs.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "exprfile.h"
+#include "parser.h"
+#include "vm.h"
+#include "jit.h"
+#include "util.h"
+
+#define EXPRFILE_MAGIC "EXPRBIN"
+#ifdef VALUE_64
+#define EXPRFILE_VERSION 0x103
+#else
+#define EXPRFILE_VERSION 3
+#endif
+
+/* Alignment of records, so code can be run in place */
+#define RECORD_ALIGN sizeof(Value)
+
+/* Record kinds */
+#define RECORD_TEXT 0   /* text is the line's complete output */
+#define RECORD_EXPR 1   /* text is the echo; the code computes the verdict */
+
+/* Header flags */
+#define FLAG_NAMES 1    /* Compiled with variables allowed */
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t path_length;
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t record_count;
+    uint64_t payload_size;      /* Bytes after the header */
+    uint64_t checksum;
+    uint32_t flags;
+    uint32_t variable_count;    /* Slots of the variables the code names */
+} ExprFileHeader;
+
+typedef struct {
+    uint32_t kind;
+    uint32_t text_length;
+    uint32_t code_length;
+    uint32_t max_stack;
+    int32_t status;             /* Error code a text record reports on stderr, or 0 */
+    uint32_t reserved;          /* Keeps the text aligned to the size of a Value */
+} RecordHeader;
+
+/* Growable byte buffer for the payload */
+typedef struct {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+} ByteBuffer;
+
+/*
+ * append - appends bytes, padded with zeros to a multiple of align.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int append(ByteBuffer *buf, const void *bytes, size_t count, size_t align) {
+    size_t padded = (count + align - 1) / align * align;
+
+    if (buf->length + padded > buf->capacity) {
+        size_t capacity = buf->capacity ? buf->capacity * 2 : 4096;
+        while (capacity < buf->length + padded)
+            capacity *= 2;
+        unsigned char *grown = realloc(buf->data, capacity);
+        if (grown == NULL)
+            return -1;
+        buf->data = grown;
+        buf->capacity = capacity;
+    }
+    memcpy(buf->data + buf->length, bytes, count);
+    memset(buf->data + buf->length + count, 0, padded - count);
+    buf->length += padded;
+    return 0;
+}
+
+/*
+ * append_record - appends one line's record to the payload.
+ */
+static int append_record(ByteBuffer *buf, uint32_t kind, const char *text, size_t text_length,
+                         const Program *prog, int status) {
+    RecordHeader record = { .kind = kind, .text_length = (uint32_t)text_length,
+                            .status = status };
+    if (prog != NULL) {
+        record.code_length = prog->length;
+        record.max_stack = prog->max_stack;
+    }
+    if (append(buf, &record, sizeof(record), RECORD_ALIGN) != 0 ||
+        append(buf, text, text_length, RECORD_ALIGN) != 0)
+        return -1;
+    if (prog != NULL)
+        return append(buf, prog->code, prog->length * sizeof(Value), RECORD_ALIGN);
+    return 0;
+}
+
+/**
+ * exprfile_compile - compiles an input file to a binary expression file.
+ * @input: the input file.
+ * @source_path: path of the input file.
+ * @binary_path: path of the binary file to write.
+ * @names: whether lines may name variables.
+ *
+ * Whether a line can read a variable depends on whether the assignments
+ * before it succeeded, so each assignment is run as it is compiled.
+ * Returns 0 on success, or -1 on failure.
+ */
+int exprfile_compile(FILE *input, const char *source_path, const char *binary_path, int names) {
+    ByteBuffer payload = {0};
+    ExprFileHeader header = {0};
+    TokenBuffer tokens = { .identifiers = names };
+    Variables variables = {0};
+    Arena arena = {0};
+    Program prog = {0};
+    OutputWriter text;
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t read;
+    int status = 0;
+
+    struct stat st;
+    if (stat(source_path, &st) != 0 || output_init(&text, NULL, FORMAT_TEXT) != 0)
+        return -1;
+    memcpy(header.magic, EXPRFILE_MAGIC, sizeof(EXPRFILE_MAGIC));
+    header.version = EXPRFILE_VERSION;
+    header.path_length = strlen(source_path);
+    header.source_size = st.st_size;
+    header.source_mtime_sec = st.st_mtim.tv_sec;
+    header.source_mtime_nsec = st.st_mtim.tv_nsec;
+    header.flags = names ? FLAG_NAMES : 0;
+    if (append(&payload, source_path, header.path_length, 8) != 0)
+        status = -1;
+
+    while (status == 0 && (read = getline(&line, &len, input)) != -1) {
+        if (read > 0 && line[read - 1] == '\n') line[--read] = '\0';
+        header.record_count++;
+
+        int count = lex_line(&tokens, line, read);
+        if (count < 0) {
+            status = -1;
+            break;
+        }
+        TokenStream ts = { .text = line, .length = read, .tokens = tokens.tokens, .count = count,
+                           .arena = &arena, .variables = names ? &variables : NULL };
+        Node *root = NULL;
+        arena_reset(&arena);
+
+        if (read > 0 && !has_lexical_errors(tokens.tokens, count))
+            root = parse_bexpr(&ts);
+
+        if (root != NULL) {
+            status = compile_program(&prog, root);
+            Value value;
+            if (status == 0 && root->kind == NODE_ASSIGN &&
+                run_program(&prog, variables.values, &value) == 0)
+                variables.assigned[root->value] = 1;
+            if (status == 0)
+                status = append_record(&payload, RECORD_EXPR, line, read, &prog, 0);
+            continue;
+        }
+
+        // Everything this line prints is known now, so store the text itself,
+        // and the error whose message -X writes on stderr as a text run would
+        text.length = 0;
+        if (read == 0)
+            output_blank(&text, line, read);
+        else if (has_lexical_errors(tokens.tokens, count))
+            output_lexical_errors(&text, line, read, tokens.tokens, count);
+        else
+            output_result(&text, line, read, ts.error, 0);
+        status = text.error ? -1 : append_record(&payload, RECORD_TEXT, text.buffer, text.length,
+                                                 NULL, ts.error);
+    }
+
+    header.variable_count = variables.count;
+    header.payload_size = payload.length;
+    header.checksum = fnv1a(payload.data, payload.length);
+
+    FILE *binary = status == 0 ? fopen(binary_path, "wb") : NULL;
+    if (binary == NULL ||
+        fwrite(&header, sizeof(header), 1, binary) != 1 ||
+        fwrite(payload.data, 1, payload.length, binary) != payload.length)
+        status = -1;
+    if (binary != NULL && fclose(binary) != 0)
+        status = -1;
+
+    free(line);
+    output_free(&text);
+    free(payload.data);
+    free_token_buffer(&tokens);
+    free_variables(&variables);
+    arena_free(&arena);
+    free_program(&prog);
+    return status;
+}
+
+/* One record of a mapped file */
+typedef struct {
+    const RecordHeader *record;
+    const char *text;
+    Program prog;           /* The record's code, run in place */
+} RecordView;
+
+/*
+ * next_record - reads the record at an offset of the payload and advances
+ * the offset past it.
+ * Returns 0 on success, or -1 if the record runs past the payload.
+ */
+static int next_record(const ExprFileHeader *header, const unsigned char *payload,
+                       size_t *offset, RecordView *view) {
+    if (header->payload_size - *offset < sizeof(RecordHeader))
+        return -1;
+    const RecordHeader *record = (const RecordHeader *)(payload + *offset);
+    size_t text_space = (record->text_length + RECORD_ALIGN - 1) / RECORD_ALIGN * RECORD_ALIGN;
+    size_t code_bytes = (size_t)record->code_length * sizeof(Value);
+    size_t left = header->payload_size - *offset - sizeof(RecordHeader);
+    if (text_space > left || code_bytes > left - text_space)
+        return -1;
+
+    view->record = record;
+    view->text = (const char *)(record + 1);
+    view->prog = (Program){ .code = (Value *)(view->text + text_space),
+                            .length = (int)record->code_length,
+                            .max_stack = (int)record->max_stack };
+    *offset += sizeof(RecordHeader) + text_space + code_bytes;
+    return 0;
+}
+
+/*
+ * verify_records - checks every record of a file before any is run: each
+ * lies within the payload, is of a known kind, and carries code only if it
+ * is an expression, code that verify_program() accepts. Only text records
+ * carry an error code. The records must fill the payload exactly.
+ * Returns 0 if the records are valid, or -1 if they are not.
+ */
+static int verify_records(const ExprFileHeader *header, const unsigned char *payload) {
+    size_t offset = (header->path_length + 7) / 8 * 8;
+    RecordView view;
+
+    if (offset > header->payload_size || header->variable_count > INT_MAX)
+        return -1;
+    for (uint64_t i = 0; i < header->record_count; i++) {
+        if (next_record(header, payload, &offset, &view) != 0 || view.record->reserved != 0)
+            return -1;
+        if (view.record->kind == RECORD_TEXT) {
+            if (view.record->code_length != 0)
+                return -1;
+        } else if (view.record->kind != RECORD_EXPR || view.record->status != 0 ||
+                   view.record->code_length > INT_MAX || view.record->max_stack > INT_MAX ||
+                   verify_program(&view.prog, (int)header->variable_count) != 0) {
+            return -1;
+        }
+    }
+    return offset == header->payload_size ? 0 : -1;
+}
+
+/*
+ * translate_records - translates the programs of a verified file to native
+ * code, in the order of its expression records.
+ * On failure, jit is left without entry points and the VM runs everything.
+ */
+static void translate_records(const ExprFileHeader *header, const unsigned char *payload,
+                              JitBatch *jit) {
+    size_t offset = (header->path_length + 7) / 8 * 8;
+    RecordView view;
+    int count = 0;
+
+    if (header->record_count > INT_MAX)
+        return;
+    Program *progs = malloc((header->record_count + 1) * sizeof(Program));
+    if (progs == NULL)
+        return;
+    for (uint64_t i = 0; i < header->record_count; i++) {
+        next_record(header, payload, &offset, &view);
+        if (view.record->kind == RECORD_EXPR)
+            progs[count++] = view.prog;
+    }
+    jit_compile_all(progs, count, jit);
+    free(progs);
+}
+
+/**
+ * exprfile_execute - runs a binary expression file.
+ * @binary_path: path of the binary file.
+ * @output: writer receiving the output, in text format.
+ * @source_path: receives the recorded source path when the file is stale.
+ * @names: receives whether variables were allowed when the file is stale.
+ * @jit: if not 0, run the expressions as native code where they translate.
+ *
+ * Returns 0 on success, EXPRFILE_STALE, or EXPRFILE_INVALID.
+ */
+int exprfile_execute(const char *binary_path, OutputWriter *output, char **source_path,
+                     int *names, int jit) {
+    int fd = open(binary_path, O_RDONLY);
+    if (fd < 0)
+        return EXPRFILE_INVALID;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ExprFileHeader)) {
+        close(fd);
+        return EXPRFILE_INVALID;
+    }
+    size_t size = st.st_size;
+    const unsigned char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return EXPRFILE_INVALID;
+
+    const ExprFileHeader *header = (const ExprFileHeader *)map;
+    const unsigned char *payload = map + sizeof(ExprFileHeader);
+    int status = 0;
+
+    if (memcmp(header->magic, EXPRFILE_MAGIC, sizeof(EXPRFILE_MAGIC)) != 0 ||
+        header->version != EXPRFILE_VERSION ||
+        header->payload_size != size - sizeof(ExprFileHeader) ||
+        header->path_length > header->payload_size ||
+        fnv1a(payload, header->payload_size) != header->checksum) {
+        munmap((void *)map, size);
+        return EXPRFILE_INVALID;
+    }
+
+    // A missing source is not stale: the binary file may be deployed alone
+    char *path = strndup((const char *)payload, header->path_length);
+    struct stat source;
+    if (path != NULL && stat(path, &source) == 0 &&
+        ((uint64_t)source.st_size != header->source_size ||
+         source.st_mtim.tv_sec != header->source_mtime_sec ||
+         source.st_mtim.tv_nsec != header->source_mtime_nsec)) {
+        status = EXPRFILE_STALE;
+    }
+    if (status == EXPRFILE_STALE && source_path != NULL) {
+        *source_path = path;
+        path = NULL;
+    }
+    if (status == EXPRFILE_STALE && names != NULL)
+        *names = (header->flags & FLAG_NAMES) != 0;
+    free(path);
+
+    // Nothing runs or is written until every record has been checked, so a
+    // corrupt or crafted file produces no output at all
+    if (status == 0 && verify_records(header, payload) != 0)
+        status = EXPRFILE_INVALID;
+
+    Value *variables = NULL;
+    if (status == 0 && header->variable_count > 0 &&
+        (variables = calloc(header->variable_count, sizeof(Value))) == NULL)
+        status = EXPRFILE_INVALID;
+
+    JitBatch native = {0};
+    if (status == 0 && jit)
+        translate_records(header, payload, &native);
+
+    size_t offset = (header->path_length + 7) / 8 * 8;
+    RecordView view;
+    int expr = 0;
+    for (uint64_t i = 0; status == 0 && i < header->record_count; i++) {
+        next_record(header, payload, &offset, &view);
+        if (view.record->kind == RECORD_EXPR) {
+            Value value;
+            int result = native.run != NULL && native.run[expr] != NULL ?
+                native.run[expr](&value) : run_program(&view.prog, variables, &value);
+            expr++;
+            report_error(stderr, result);
+            output_result(output, view.text, view.record->text_length, result, value);
+        } else {
+            report_error(stderr, view.record->status);
+            output_bytes(output, view.text, view.record->text_length);
+        }
+    }
+
+    jit_free_all(&native);
+    free(variables);
+    munmap((void *)map, size);
+    return status;
+}
@@ -0,0 +1,69 @@
+/**
+ * @file exprfile.h
+ * @brief Precompiled expression files. Compiling an input file once stores
+ * every line in a versioned binary file: lines that cannot be evaluated keep
+ * their finished output text and the error whose message they write on
+ * stderr, and every other line keeps its echo text and its bytecode. Executing the binary file maps it into memory and runs the
+ * bytecode in place, with no lexing or parsing, so repeated runs only pay
+ * for evaluation and output.
+ *
+ * A file compiled with variables allowed runs the bytecode of every line
+ * against one array of variables, so lines assign variables in order.
+ *
+ * The header records the size and modification time of the source file and a
+ * checksum of the contents. A binary file whose source has changed since it
+ * was compiled is reported as stale so the caller can fall back to the text.
+ * The bytecode of every record is verified before any line runs, so a
+ * damaged or crafted file is rejected without writing any output.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef EXPRFILE_H
+#define EXPRFILE_H
+
+#include <stdio.h>
+#include "output.h"
+
+/* Results of exprfile_execute() besides success */
+#define EXPRFILE_STALE -1       /* The source file changed after compiling */
+#define EXPRFILE_INVALID -2     /* Not a binary file of this version, or corrupt */
+
+/**
+ * Compiles an input file to a binary expression file. Nothing is written on
+ * stdout or stderr: the error of a line is stored with its record, and -X
+ * reports it when the file is executed.
+ *
+ * @param input The input file, read to the end.
+ * @param source_path Path of the input file, recorded for staleness checks.
+ * @param binary_path Path of the binary file to write.
+ * @param names If not 0, lines may name and assign variables, as in the -V
+ * mode.
+ * @return 0 on success, or -1 if the binary file could not be written.
+ */
+int exprfile_compile(FILE *input, const char *source_path, const char *binary_path, int names);
+
+/**
+ * Executes a binary expression file, writing the same output and the same
+ * error messages on stderr the text interpreter writes for its source.
+ *
+ * @param binary_path Path of the binary file.
+ * @param output Writer receiving the output. Lines that cannot be evaluated
+ * are stored as finished text, so the writer must use the text format.
+ * @param source_path If not NULL, receives the source path recorded in the
+ * binary file (malloc'd) when the result is EXPRFILE_STALE.
+ * @param names If not NULL, receives whether variables were allowed when the
+ * file was compiled, for interpreting the source the same way, when the
+ * result is EXPRFILE_STALE.
+ * @param jit If not 0, the expressions are translated to native code
+ * together with jit_compile_all(), into a single mapping, before any of
+ * them runs. Each expression that cannot be translated is run by the VM,
+ * as is the whole file if the mapping cannot be made. The output is the
+ * same either way.
+ * @return 0 on success, EXPRFILE_STALE, or EXPRFILE_INVALID.
+ */
+int exprfile_execute(const char *binary_path, OutputWriter *output, char **source_path,
+                     int *names, int jit);
+
+#endif // EXPRFILE_H
@@ -0,0 +1,185 @@
+/*
+ * input.c - zero-copy line reader and vectorized newline scan.
+ * Mapped files and buffered reads share one splitting loop: a mapping is a
+ * buffer that already holds the whole input, and a buffered reader refills
+ * its buffer whenever the next newline is not in it yet.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "input.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/* Initial buffer size when the input cannot be mapped */
+#define READ_BYTES (64 * 1024)
+
+/*
+ * find_newline_bytes - scans one byte at a time.
+ */
+static const char *find_newline_bytes(const char *p, const char *end) {
+    while (p < end && *p != '\n')
+        p++;
+    return p;
+}
+
+#if defined(__x86_64__)
+/*
+ * find_newline_sse2 - compares 16 bytes at a time. SSE2 is part of x86-64,
+ * so this needs no CPU check.
+ */
+static const char *find_newline_sse2(const char *p, const char *end) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)p);
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline));
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+    }
+    return find_newline_bytes(p, end);
+}
+
+/*
+ * find_newline_avx2 - compares 32 bytes at a time, finishing with SSE2.
+ */
+__attribute__((target("avx2")))
+static const char *find_newline_avx2(const char *p, const char *end) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    for (; end - p >= 32; p += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)p);
+        unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, newline));
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+    }
+    return find_newline_sse2(p, end);
+}
+#endif
+
+/**
+ * find_newline - finds the first newline in a range.
+ * @p: start of the range.
+ * @end: end of the range.
+ *
+ * Returns a pointer to the newline, or end if there is none.
+ */
+const char *find_newline(const char *p, const char *end) {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2"))
+        return find_newline_avx2(p, end);
+    return find_newline_sse2(p, end);
+#else
+    return find_newline_bytes(p, end);
+#endif
+}
+
+/**
+ * line_reader_open - maps a file, or prepares to read it in blocks.
+ * @reader: the reader.
+ * @file: the file.
+ *
+ * Returns 0 on success, or -1 when out of memory.
+ */
+int line_reader_open(LineReader *reader, FILE *file) {
+    struct stat st;
+
+    memset(reader, 0, sizeof(*reader));
+    reader->file = file;
+
+    // Files reporting a size of 0 may still have contents, as in /proc
+    int fd = fileno(file);
+    if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            reader->data = map;
+            reader->length = st.st_size;
+            reader->mapped = 1;
+            reader->eof = 1;
+            return 0;
+        }
+    }
+
+    reader->buffer = malloc(READ_BYTES);
+    if (reader->buffer == NULL)
+        return -1;
+    reader->capacity = READ_BYTES;
+    reader->data = reader->buffer;
+    return 0;
+}
+
+/*
+ * refill - moves the unfinished line to the front of the buffer and reads
+ * more input after it, growing the buffer if the line fills it.
+ * Returns 0 on success, or -1 on a read error or when out of memory.
+ */
+static int refill(LineReader *reader) {
+    size_t rest = reader->length - reader->pos;
+    memmove(reader->buffer, reader->buffer + reader->pos, rest);
+    reader->length = rest;
+    reader->pos = 0;
+
+    if (reader->length == reader->capacity) {
+        char *grown = realloc(reader->buffer, reader->capacity * 2);
+        if (grown == NULL)
+            return -1;
+        reader->buffer = grown;
+        reader->data = grown;
+        reader->capacity *= 2;
+    }
+
+    // Reads this large bypass the stream's own buffer
+    size_t count = fread(reader->buffer + reader->length, 1,
+                         reader->capacity - reader->length, reader->file);
+    if (count == 0) {
+        if (ferror(reader->file))
+            return -1;
+        reader->eof = 1;
+    }
+    reader->length += count;
+    return 0;
+}
+
+/**
+ * line_reader_next - returns the next line.
+ * @reader: the reader.
+ * @line: receives the start of the line.
+ * @length: receives the length of the line.
+ *
+ * Returns 1 if a line was returned, 0 at the end of the input, or -1 on error.
+ */
+int line_reader_next(LineReader *reader, const char **line, size_t *length) {
+    for (;;) {
+        const char *start = reader->data + reader->pos;
+        const char *end = reader->data + reader->length;
+        const char *newline = find_newline(start, end);
+
+        if (newline < end || (reader->eof && start < end)) {
+            // At the end of the input the last line may lack its newline
+            *line = start;
+            *length = newline - start;
+            reader->pos += *length + (newline < end);
+            return 1;
+        }
+        if (reader->eof)
+            return 0;
+        if (refill(reader) != 0)
+            return -1;
+    }
+}
+
+/**
+ * line_reader_close - releases the input held by a reader.
+ * @reader: the reader.
+ */
+void line_reader_close(LineReader *reader) {
+    if (reader->mapped)
+        munmap((void *)reader->data, reader->length);
+    free(reader->buffer);
+    memset(reader, 0, sizeof(*reader));
+}
@@ -0,0 +1,69 @@
+/**
+ * @file input.h
+ * @brief Zero-copy line reader for input files. A regular file is mapped into
+ * memory and every line is handed out as a pointer into the mapping and a
+ * length, so no line is ever copied. Pipes, memory streams and other files
+ * that cannot be mapped are read in large blocks into one buffer and split
+ * the same way.
+ * Line boundaries are found with a vectorized newline scan: AVX2 when the CPU
+ * has it, otherwise SSE2, otherwise one byte at a time.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+typedef struct {
+    const char *data;       /* The mapping, or the buffer in buffered mode */
+    size_t length;          /* Bytes available in data */
+    size_t pos;             /* Offset of the next line */
+    int mapped;             /* 1 if data is a mapping of the whole file */
+    FILE *file;             /* File read from in buffered mode */
+    int eof;                /* Set once a buffered read has hit the end */
+    char *buffer;
+    size_t capacity;
+} LineReader;
+
+/**
+ * Opens a line reader on a file that has not been read from yet.
+ *
+ * @param reader The reader.
+ * @param file The file; it must stay open until the reader is closed.
+ * @return 0 on success, or -1 when out of memory.
+ */
+int line_reader_open(LineReader *reader, FILE *file);
+
+/**
+ * Returns the next line, without its newline. The line is not NUL-terminated
+ * and stays valid until the next call.
+ *
+ * @param reader The reader.
+ * @param line Receives a pointer to the first byte of the line.
+ * @param length Receives the length of the line.
+ * @return 1 if a line was returned, 0 at the end of the input, or -1 on a
+ * read error or when out of memory.
+ */
+int line_reader_next(LineReader *reader, const char **line, size_t *length);
+
+/**
+ * Unmaps or frees the input held by a reader. The file is not closed.
+ *
+ * @param reader The reader.
+ */
+void line_reader_close(LineReader *reader);
+
+/**
+ * Finds the first newline in a range of bytes.
+ *
+ * @param p Start of the range.
+ * @param end End of the range.
+ * @return A pointer to the newline, or end if there is none.
+ */
+const char *find_newline(const char *p, const char *end);
+
+#endif // INPUT_H
@@ -6,9 +6,200 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
 #include "parser.h"
 #include "tokenizer.h"
+#include "lexer.h"
+#include "cache.h"
+#include "exprfile.h"
+#include "batch.h"
+#include "output.h"
+#include "server.h"
+#include "columns.h"
+#include "stats.h"
+#include "diag.h"
+#include "compress.h"
+#include "watch.h"
+#include "dag.h"
 
+/**
+ * parse_size - parses a byte count with an optional k, m or g suffix.
+ * @text: the text to parse.
+ * @size: receives the byte count.
+ *
+ * Returns 0 on success, or -1 if the text is not a valid size.
+ */
+static int parse_size(const char *text, size_t *size) {
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+
+    if (end == text)
+        return -1;
+    switch (*end) {
+        case 'g': case 'G': value <<= 10; // fall through
+        case 'm': case 'M': value <<= 10; // fall through
+        case 'k': case 'K': value <<= 10; end++; break;
+        default: break;
+    }
+    if (*end != '\0')
+        return -1;
+    *size = value;
+    return 0;
+}
+
+/**
+ * parse_count - parses a positive decimal count.
+ * @text: the text to parse.
+ * @count: receives the count.
+ *
+ * Returns 0 on success, or -1 if the text is not a count from 1 to INT_MAX.
+ */
+static int parse_count(const char *text, int *count) {
+    char *end;
+    long value;
+
+    errno = 0;
+    value = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno != 0 || value < 1 || value > INT_MAX)
+        return -1;
+    *count = value;
+    return 0;
+}
+
+#define USAGE "Usage: %s [-c cache_bytes] [-D dag_bytes] [-j threads | -p] [-b | -V] [-f text|json|binary] [-C | -X [-J] | -S statsfile] [-d level] [-z gzip|zstd] <inputfile> <outputfile>\n" \
+              "       %s -i | -w [-c cache_bytes] [-b] [-f text|json|binary] [-d level] <inputfile> <outputfile>\n" \
+              "       %s -s <socket> [-c cache_bytes] [-j threads] [-b] [-f text|json|binary]\n" \
+              "       %s -t <template> [-f text|json|binary] [-z gzip|zstd] <csvfile> <outputfile>\n"
+
+/**
+ * open_input - opens the plain text of an input file that may be compressed.
+ * @path: path of the file, for messages.
+ * @file: the open file.
+ * @cs: receives the decompression state.
+ * @stream: receives the file to read the plain text from.
+ *
+ * Returns 0 on success, or 1 on error, after reporting it.
+ */
+static int open_input(const char *path, FILE *file, CompressedStream *cs, FILE **stream) {
+    int status = compressed_open_input(cs, file, stream);
+
+    if (status == COMPRESS_UNSUPPORTED) {
+        fprintf(stderr, "Error: %s is compressed with zstd; rebuild with -DHAVE_ZSTD and -lzstd.\n",
+                path);
+        return 1;
+    }
+    if (status != 0) {
+        fprintf(stderr, "Error: Could not decompress %s.\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * close_input - finishes reading an input file that may be compressed.
+ * @path: path of the file, for messages.
+ * @cs: the decompression state.
+ *
+ * Returns 0 on success, or 1 if the file was corrupt or truncated, after
+ * reporting it.
+ */
+static int close_input(const char *path, CompressedStream *cs) {
+    if (compressed_close(cs) != 0) {
+        fprintf(stderr, "Error: Could not decompress %s.\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * execute_binary - runs a precompiled expression file.
+ * @binary_path: path of the binary file.
+ * @out: the output writer.
+ * @cache: result cache used if the text source has to be interpreted instead.
+ * @jit: if not 0, run the expressions as native code where they translate.
+ *
+ * Falls back to interpreting the recorded source file when the binary file is stale,
+ * with variables if they were allowed when it was compiled.
+ * Returns 0 on success, or 1 on error.
+ */
+static int execute_binary(const char *binary_path, OutputWriter *out, ResultCache *cache,
+                          int jit) {
+    char *source_path = NULL;
+    int names = 0;
+    int status = exprfile_execute(binary_path, out, &source_path, &names, jit);
+
+    if (status == EXPRFILE_INVALID) {
+        fprintf(stderr, "Error: %s is not a valid compiled expression file.\n", binary_path);
+        return 1;
+    }
+    if (status == EXPRFILE_STALE) {
+        fprintf(stderr, "Warning: %s is older than %s, interpreting the source.\n",
+                binary_path, source_path);
+        FILE *inputFile = fopen(source_path, "r");
+        if (inputFile == NULL) {
+            fprintf(stderr, "Error: Could not open %s.\n", source_path);
+            free(source_path);
+            return 1;
+        }
+        CompressedStream decoder;
+        FILE *source;
+        if (open_input(source_path, inputFile, &decoder, &source) != 0) {
+            fclose(inputFile);
+            free(source_path);
+            return 1;
+        }
+        Variables variables = {0};
+        status = interpret_text(source, out, cache, NULL, names ? &variables : NULL, NULL,
+                                NULL);
+        free_variables(&variables);
+        if (close_input(source_path, &decoder) != 0)
+            status = 1;
+        fclose(inputFile);
+    }
+    free(source_path);
+    return status;
+}
+
+/**
+ * run_incremental - updates an output file incrementally, once or on every
+ * change of the input file.
+ * @input_path: path of the input file.
+ * @output_path: path of the output file.
+ * @format: format of the output.
+ * @cache_bytes: cap of the result cache, or 0 for none.
+ * @bignum: nonzero to evaluate with arbitrary precision.
+ * @follow: nonzero to keep watching the input file.
+ *
+ * Returns 0 on success, or 1 on error.
+ */
+static int run_incremental(const char *input_path, const char *output_path, OutputFormat format,
+                           size_t cache_bytes, int bignum, int follow) {
+    ResultCache *cache = NULL;
+    BigEvaluator *big = NULL;
+    WatchCounts counts;
+    int status;
+
+    if ((cache_bytes > 0 && (cache = cache_create(cache_bytes)) == NULL) ||
+        (bignum && (big = big_create()) == NULL)) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        cache_destroy(cache);
+        return 1;
+    }
+    if (follow)
+        status = watch(input_path, output_path, format, cache, big);
+    else if ((status = watch_update(input_path, output_path, format, cache, big, &counts)) == 0)
+        watch_report(&counts, stderr);
+
+    if (cache != NULL) {
+        cache_report(cache, stderr);
+        cache_destroy(cache);
+    }
+    big_destroy(big);
+    return status;
+}
 
 /**
  * main - the entry point of the interpreter.
@@ -16,58 +207,328 @@
  * @argv: the array of command-line arguments.
  *
  * This function checks command-line arguments, opens the input and output files, and processes
- * each line of the input file. It prints whether the syntax is OK and, if so, the value of the
- * evaluated expression. It handles file opening/closing and memory deallocation.
+ * each line of the input file. It handles file opening/closing and memory deallocation.
+ *
+ * Options:
+ *   -c <bytes>  cache line results in at most this much memory (suffixes k, m, g) and
+ *               report the cache counters on stderr at exit.
+ *   -D <bytes>  build the lines in one hash-consed DAG shared across the input, in at
+ *               most this much memory (suffixes k, m, g), so a subexpression repeated
+ *               on many lines is evaluated once, and report the DAG counters on stderr
+ *               at exit; see dag.h. Not with -b, -C, -X, -t, -i or -w; lines naming
+ *               variables are built as trees. With -j, each thread has a DAG within an
+ *               equal share of the cap.
+ *   -j <n>      evaluate the lines on n threads; the output is the same as with one. With
+ *               -c, each thread caches results within an equal share of the cap.
+ *   -p          read, evaluate and write the output on three threads in a pipeline, and
+ *               report how long each stage waited on the others on stderr at exit.
+ *   -b          evaluate with arbitrary precision, so results are exact however large
+ *               they grow. Serial and -j runs only, writing text or json.
+ *   -V          allow variables: "name = expr;" assigns the value of expr to name, and
+ *               later lines may use name in place of a number. Serial, -p, -C and -X runs
+ *               only; lines naming variables are not cached.
+ *   -f <format> write the results as text (the default), as JSON lines, or as fixed-width
+ *               binary records; see output.h. -X only writes text.
+ *   -C          compile the input file to a binary expression file named by <outputfile>
+ *               instead of evaluating it. Not with -j or -p.
+ *   -X          execute the binary expression file <inputfile>, falling back to its text
+ *               source when the binary file is stale. Not with -j or -p.
+ *   -J          with -X, translate each expression to x86-64 machine code and run it
+ *               natively; see jit.h. Expressions the JIT cannot translate, such as those
+ *               naming variables, and every expression on other machines, run on the VM.
+ *   -s <socket> run as a server answering batches of lines sent to a Unix domain socket,
+ *               on -j worker threads (one per online core by default), until SIGINT or
+ *               SIGTERM; see server.h. No files are named.
+ *   -t <template> evaluate the one expression in the file <template> over every row of
+ *               the CSV file <inputfile>, whose header names the columns the expression
+ *               uses in place of numbers; see columns.h.
+ *   -S <file>   time each phase of each line and write a JSON summary of the run to
+ *               <file>, or to stderr if it is "-": the time spent reading, lexing,
+ *               evaluating and formatting, percentiles of the latency of a line, the
+ *               count of each status and the slowest lines; see stats.h. Serial runs only.
+ *   -d <level>  write the diagnostics up to this level (off, error, warn, info or debug)
+ *               on stdout. The default is every level compiled in: debug, or warn in a
+ *               build with -DNDEBUG, which compiles the parser's debug lines away.
+ *   -z <format> compress <outputfile> with gzip or zstd as it is written, on a thread of
+ *               its own; see compress.h. Not with -C, whose output is binary already.
+ *   -i          update <outputfile> incrementally: only lines that are not in the sidecar
+ *               file <outputfile>.lines left by the previous -i run are evaluated, and
+ *               the records of the others are copied; see watch.h. Serial runs only,
+ *               without -V.
+ *   -w          as -i, then again every time <inputfile> is saved, until SIGINT or
+ *               SIGTERM.
+ *
+ * An input file compressed with gzip or zstd is recognized by its first bytes and
+ * decompressed as it is read, on a thread of its own. zstd needs a build with
+ * -DHAVE_ZSTD and -lzstd.
  *
  * Returns 0 on success, or 1 on error such as invalid arguments or file access issues.
  */
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        printf("Usage: %s <inputfile> <outputfile>\n", argv[0]);
+    size_t cache_bytes = 0;
+    size_t dag_bytes = 0;
+    int threads = 0;
+    int pipelined = 0;
+    int bignum = 0;
+    int names = 0;
+    OutputFormat format = FORMAT_TEXT;
+    int mode = 0;
+    const char *socket_path = NULL;
+    const char *template_path = NULL;
+    const char *stats_path = NULL;
+    Compression compression = COMPRESS_NONE;
+    int incremental = 0;
+    int jit = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "c:D:j:pbVf:CXJs:t:S:d:z:iw")) != -1) {
+        switch (option) {
+            case 'c':
+                if (parse_size(optarg, &cache_bytes) != 0) {
+                    fprintf(stderr, "Error: Invalid cache size '%s'.\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'D':
+                if (parse_size(optarg, &dag_bytes) != 0 || dag_bytes == 0) {
+                    fprintf(stderr, "Error: Invalid DAG size '%s'.\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'j':
+                if (parse_count(optarg, &threads) != 0) {
+                    fprintf(stderr, "Error: Invalid thread count '%s'.\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'p':
+                pipelined = 1;
+                break;
+            case 'b':
+                bignum = 1;
+                break;
+            case 'V':
+                names = 1;
+                break;
+            case 'f':
+                if (output_parse_format(optarg, &format) != 0) {
+                    fprintf(stderr, "Error: Unknown output format '%s'.\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'C':
+            case 'X':
+                mode = option;
+                break;
+            case 'J':
+                jit = 1;
+                break;
+            case 's':
+                socket_path = optarg;
+                break;
+            case 't':
+                template_path = optarg;
+                break;
+            case 'S':
+                stats_path = optarg;
+                break;
+            case 'd':
+                if (diag_parse_level(optarg, &diag_level) != 0) {
+                    fprintf(stderr, "Error: Unknown diagnostic level '%s'.\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'z':
+                if (compression_parse(optarg, &compression) != 0) {
+                    fprintf(stderr, "Error: Unknown compression '%s'.\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'i':
+            case 'w':
+                incremental = option;
+                break;
+            default:
+                printf(USAGE, argv[0], argv[0], argv[0], argv[0]);
+                return 1;
+        }
+    }
+    // Binary records have no room for arbitrary precision
+    if (bignum && format == FORMAT_BINARY) {
+        printf(USAGE, argv[0], argv[0], argv[0], argv[0]);
+        return 1;
+    }
+    if (socket_path != NULL) {
+        if (argc != optind || pipelined || mode != 0 || names || template_path != NULL ||
+            stats_path != NULL || compression != COMPRESS_NONE || incremental || dag_bytes > 0 ||
+            jit) {
+            printf(USAGE, argv[0], argv[0], argv[0], argv[0]);
+            return 1;
+        }
+        if (threads == 0) {
+            long cores = sysconf(_SC_NPROCESSORS_ONLN);
+            threads = cores > 0 ? cores : 1;
+        }
+        return serve(socket_path, threads, cache_bytes, bignum, format);
+    }
+    if (threads == 0)
+        threads = 1;
+    // Binary expression files store the text of lines that cannot be evaluated,
+    // and bytecode has no room for arbitrary precision. Lines naming variables
+    // depend on the lines before them, so they cannot be split among threads.
+    // A template is evaluated over whole blocks of rows, in a mode of its own.
+    // Only the serial loop is instrumented. Incremental runs reuse the record
+    // of a line by its text alone, and rewrite the output file in place of it.
+    // The DAG holds Values, and only for lines interpreted from text.
+    // Compiling and executing binary files run on the calling thread alone,
+    // and only executing runs bytecode the JIT can translate.
+    if (argc - optind != 2 || (pipelined && threads > 1) || (mode == 'X' && format != FORMAT_TEXT) ||
+        (jit && mode != 'X') ||
+        (mode != 0 && (threads > 1 || pipelined)) ||
+        (bignum && (pipelined || mode != 0)) || (names && (bignum || threads > 1)) ||
+        (template_path != NULL && (cache_bytes > 0 || threads > 1 || pipelined || bignum ||
+                                   names || mode != 0)) ||
+        (stats_path != NULL && (threads > 1 || pipelined || mode != 0 || template_path != NULL)) ||
+        (compression != COMPRESS_NONE && mode == 'C') ||
+        (incremental && (threads > 1 || pipelined || names || mode != 0 || template_path != NULL ||
+                         stats_path != NULL || compression != COMPRESS_NONE)) ||
+        (dag_bytes > 0 && (bignum || mode != 0 || template_path != NULL || incremental))) {
+        printf(USAGE, argv[0], argv[0], argv[0], argv[0]);
         return 1;
     }
+    const char *input_path = argv[optind];
+    const char *output_path = argv[optind + 1];
 
-    FILE *inputFile = fopen(argv[1], "r");
-    FILE *outputFile = fopen(argv[2], "w");
+    if (incremental)
+        return run_incremental(input_path, output_path, format, cache_bytes, bignum,
+                               incremental == 'w');
 
-    if (!inputFile || !outputFile) {
-        fprintf(stderr, "Error: Could not open file(s).\n");
-        return 1;
+    CompressedStream decoder = {0}, encoder = {0};
+    FILE *input = NULL, *output;
+
+    if (mode == 'C') {
+        FILE *inputFile = fopen(input_path, "r");
+        if (!inputFile) {
+            fprintf(stderr, "Error: Could not open file(s).\n");
+            return 1;
+        }
+        if (open_input(input_path, inputFile, &decoder, &input) != 0) {
+            fclose(inputFile);
+            return 1;
+        }
+        int status = exprfile_compile(input, input_path, output_path, names);
+        int closed = close_input(input_path, &decoder);
+        fclose(inputFile);
+        if (closed != 0)
+            return 1;
+        if (status != 0) {
+            fprintf(stderr, "Error: Could not write %s.\n", output_path);
+            return 1;
+        }
+        return 0;
     }
 
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t read;
+    FILE *inputFile = mode == 'X' ? NULL : fopen(input_path, "r");
+    FILE *outputFile = fopen(output_path, format == FORMAT_BINARY ? "wb" : "w");
 
-    while ((read = getline(&line, &len, inputFile)) != -1) {
-        // Remove newline character if present
-        if (read > 0 && line[read - 1] == '\n') line[read - 1] = '\0';
-        
-        fprintf(outputFile, "%s\n", line); // Print the expression as it is
+    FILE *statsFile = NULL;
+    if (stats_path != NULL)
+        statsFile = strcmp(stats_path, "-") == 0 ? stderr : fopen(stats_path, "w");
 
-        int result = bexpr(line);
+    if ((mode != 'X' && !inputFile) || !outputFile || (stats_path != NULL && !statsFile)) {
+        fprintf(stderr, "Error: Could not open file(s).\n");
+        return 1;
+    }
+    if (inputFile != NULL && open_input(input_path, inputFile, &decoder, &input) != 0)
+        return 1;
+    output = outputFile;
+    if (compression != COMPRESS_NONE) {
+        int opened = compressed_open_output(&encoder, outputFile, compression, &output);
+        if (opened == COMPRESS_UNSUPPORTED) {
+            fprintf(stderr, "Error: zstd output needs a build with -DHAVE_ZSTD and -lzstd.\n");
+            return 1;
+        }
+        if (opened != 0) {
+            fprintf(stderr, "Error: Could not compress %s.\n", output_path);
+            return 1;
+        }
+    }
 
-        switch (result){
-            case ERROR:
-                fprintf(outputFile, "Syntax Error\n");
-                break;
-            case MISSING_SEMICOLON:
-                fprintf(outputFile, "===> ';' expected\nSyntax Error\n");
-                break;
-            case MISSING_CLOSING_PARENTHESIS: 
-                fprintf(outputFile, "===> ')' expected\nSyntax Error\n");
-                break;
-            default:
-                fprintf(outputFile, "Syntax OK\nValue is %d\n", result);
-                break;
+    OutputWriter out;
+    if (output_init(&out, output, format) != 0) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        return 1;
+    }
+
+    int status;
+    Stats stats;
+    if (template_path != NULL) {
+        FILE *templateFile = fopen(template_path, "r");
+        if (templateFile == NULL) {
+            fprintf(stderr, "Error: Could not open file(s).\n");
+            return 1;
+        }
+        status = interpret_columns(templateFile, input, &out, stderr);
+        fclose(templateFile);
+    } else if (mode != 'X' && threads > 1) {
+        status = interpret_parallel(input, &out, threads, cache_bytes, dag_bytes, bignum);
+    } else {
+        ResultCache *cache = NULL;
+        BigEvaluator *big = NULL;
+        Dag *dag = NULL;
+        Variables variables = {0};
+        if ((cache_bytes > 0 && (cache = cache_create(cache_bytes)) == NULL) ||
+            (bignum && (big = big_create()) == NULL) ||
+            (dag_bytes > 0 && (dag = dag_create(dag_bytes)) == NULL)) {
+            fprintf(stderr, "Error: Out of memory.\n");
+            return 1;
         }
 
-        get_token(line, outputFile);
+        if (mode == 'X')
+            status = execute_binary(input_path, &out, cache, jit);
+        else if (pipelined)
+            status = interpret_pipelined(input, &out, cache, dag, names ? &variables : NULL,
+                                         stderr);
+        else {
+            if (statsFile != NULL)
+                stats_init(&stats);
+            status = interpret_text(input, &out, cache, big, names ? &variables : NULL, dag,
+                                    statsFile != NULL ? &stats : NULL);
+        }
 
+        if (cache != NULL) {
+            cache_report(cache, stderr);
+            cache_destroy(cache);
+        }
+        if (dag != NULL) {
+            dag_report(dag, stderr);
+            dag_destroy(dag);
+        }
+        big_destroy(big);
+        free_variables(&variables);
     }
 
-    free(line);
-    fclose(inputFile);
+    if (output_flush(&out) != 0) {
+        fprintf(stderr, "Error: Could not write %s.\n", output_path);
+        status = 1;
+    }
+    output_free(&out);
+    if (compressed_close(&encoder) != 0) {
+        fprintf(stderr, "Error: Could not write %s.\n", output_path);
+        status = 1;
+    }
+    if (statsFile != NULL) {
+        if (stats_write(&stats, statsFile) != 0) {
+            fprintf(stderr, "Error: Could not write %s.\n", stats_path);
+            status = 1;
+        }
+        if (statsFile != stderr)
+            fclose(statsFile);
+    }
+    if (close_input(input_path, &decoder) != 0)
+        status = 1;
+    if (inputFile != NULL)
+        fclose(inputFile);
     fclose(outputFile);
-    return 0;
+    return status;
 }
@@ -0,0 +1,403 @@
+/*
+ * jit.c - translates bytecode programs to x86-64 machine code.
+ * The VM's stack depth at every instruction is known when compiling, so each
+ * stack slot becomes a fixed offset in the native stack frame and the
+ * generated code does no stack-pointer bookkeeping. rbx points at the slots
+ * and r12 holds the result pointer passed in rdi.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "jit.h"
+#include "parser.h"
+
+/* The generated code works on 32-bit values only */
+#if defined(__x86_64__) && defined(__unix__) && !defined(VALUE_64)
+#define JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Deepest stack kept in a native frame; deeper programs stay on the VM. The
+ * frame is reserved with one sub rsp and never probed, so it is held to one
+ * page (4-byte slots) and cannot step over the guard page below the stack.
+ */
+#define JIT_MAX_STACK 1024
+
+#ifdef JIT_X86_64
+
+/* Machine code being assembled, with the jumps still to be patched */
+typedef struct {
+    unsigned char *code;
+    size_t length;
+    size_t capacity;
+    size_t *error_jumps;        /* Offsets of rel32 fields jumping to error */
+    size_t *div_zero_jumps;     /* Offsets of rel32 fields jumping to div_zero */
+    size_t *overflow_jumps;     /* Offsets of rel32 fields jumping to overflow */
+    int error_count;
+    int div_zero_count;
+    int overflow_count;
+    int failed;
+} Assembler;
+
+static void emit_bytes(Assembler *as, const void *bytes, size_t count) {
+    if (as->length + count > as->capacity) {
+        size_t capacity = as->capacity ? as->capacity * 2 : 256;
+        while (capacity < as->length + count)
+            capacity *= 2;
+        unsigned char *grown = realloc(as->code, capacity);
+        if (grown == NULL) {
+            as->failed = 1;
+            return;
+        }
+        as->code = grown;
+        as->capacity = capacity;
+    }
+    memcpy(as->code + as->length, bytes, count);
+    as->length += count;
+}
+
+static void emit_byte(Assembler *as, unsigned char byte) {
+    emit_bytes(as, &byte, 1);
+}
+
+static void emit_u32(Assembler *as, uint32_t word) {
+    emit_bytes(as, &word, 4);
+}
+
+/*
+ * emit_slot - emits an opcode whose ModRM operand is [rbx + disp32].
+ * @reg: the register field of the ModRM byte.
+ */
+static void emit_slot(Assembler *as, unsigned char opcode, int reg, int slot) {
+    emit_byte(as, opcode);
+    emit_byte(as, 0x80 | (reg << 3) | 3);
+    emit_u32(as, slot * 4);
+}
+
+/*
+ * emit_jump - emits a two-byte conditional jump whose target is patched later.
+ * Returns the offset of the rel32 field, recorded in the given list.
+ */
+static void emit_jump(Assembler *as, unsigned char condition, size_t **list, int *count) {
+    size_t *grown = realloc(*list, (*count + 1) * sizeof(size_t));
+    if (grown == NULL) {
+        as->failed = 1;
+        return;
+    }
+    *list = grown;
+    emit_byte(as, 0x0f);
+    emit_byte(as, condition);
+    (*list)[(*count)++] = as->length;
+    emit_u32(as, 0);
+}
+
+static void patch_jumps(Assembler *as, const size_t *list, int count, size_t target) {
+    for (int i = 0; i < count; i++) {
+        int32_t rel = (int32_t)(target - (list[i] + 4));
+        memcpy(as->code + list[i], &rel, 4);
+    }
+}
+
+static void emit_call(Assembler *as, const void *function) {
+    uint64_t address = (uint64_t)(uintptr_t)function;
+    emit_bytes(as, "\x48\xb8", 2);          // mov rax, imm64
+    emit_bytes(as, &address, 8);
+    emit_bytes(as, "\xff\xd0", 2);          // call rax
+}
+
+/* setcc opcode of each comparison */
+static const unsigned char setcc[] = {
+    [OP_LT] = 0x9c, [OP_LE] = 0x9e, [OP_GT] = 0x9f,
+    [OP_GE] = 0x9d, [OP_EQ] = 0x94, [OP_NE] = 0x95,
+};
+
+/*
+ * assemble - generates the machine code of a program.
+ * Returns 0 on success, or -1 on an unsupported opcode or when out of memory.
+ */
+static int assemble(const Program *prog, Assembler *as) {
+    if (prog->max_stack > JIT_MAX_STACK)
+        return -1;
+    uint32_t frame = ((uint32_t)prog->max_stack * 4 + 15) & ~15u;
+    int depth = 0;
+
+    emit_byte(as, 0x55);                        // push rbp
+    emit_bytes(as, "\x48\x89\xe5", 3);          // mov rbp, rsp
+    emit_byte(as, 0x53);                        // push rbx
+    emit_bytes(as, "\x41\x54", 2);              // push r12
+    emit_bytes(as, "\x49\x89\xfc", 3);          // mov r12, rdi
+    emit_bytes(as, "\x48\x81\xec", 3);          // sub rsp, frame
+    emit_u32(as, frame);
+    emit_bytes(as, "\x48\x89\xe3", 3);          // mov rbx, rsp
+
+    for (int pc = 0; pc < prog->length; pc++) {
+        int op = prog->code[pc];
+        int left = depth - 2, right = depth - 1;
+
+        switch (op) {
+            case OP_PUSH:
+                emit_slot(as, 0xc7, 0, depth);  // mov dword [slot], imm32
+                emit_u32(as, (uint32_t)prog->code[++pc]);
+                depth++;
+                continue;
+            case OP_HALT:
+                emit_slot(as, 0x8b, 0, depth - 1);          // mov eax, [slot]
+                emit_bytes(as, "\x41\x89\x04\x24", 4);      // mov [r12], eax
+                emit_bytes(as, "\x31\xc0", 2);              // xor eax, eax
+                emit_bytes(as, "\x48\x8d\x65\xf0", 4);      // lea rsp, [rbp-16]
+                emit_bytes(as, "\x41\x5c\x5b\x5d\xc3", 5);  // pop r12/rbx/rbp; ret
+                continue;
+            case OP_POW:
+                emit_slot(as, 0x8b, 7, left);   // mov edi, [left]
+                emit_slot(as, 0x8b, 6, right);  // mov esi, [right]
+                emit_byte(as, 0x48);
+                emit_slot(as, 0x8d, 2, left);   // lea rdx, [left]
+                emit_call(as, (const void *)eval_power);
+                emit_bytes(as, "\x85\xc0", 2);  // test eax, eax
+                emit_jump(as, 0x85, &as->error_jumps, &as->error_count);
+                depth--;
+                continue;
+            case OP_LOAD:
+            case OP_STORE:
+                return -1;  // Programs naming variables stay on the VM
+            default:
+                break;
+        }
+
+        emit_slot(as, 0x8b, 0, left);       // mov eax, [left]
+        emit_slot(as, 0x8b, 1, right);      // mov ecx, [right]
+        switch (op) {
+            case OP_ADD:
+                emit_bytes(as, "\x01\xc8", 2);              // add eax, ecx
+                emit_jump(as, 0x80, &as->overflow_jumps, &as->overflow_count);
+                break;
+            case OP_SUB:
+                emit_bytes(as, "\x29\xc8", 2);              // sub eax, ecx
+                emit_jump(as, 0x80, &as->overflow_jumps, &as->overflow_count);
+                break;
+            case OP_MUL:
+                emit_bytes(as, "\x0f\xaf\xc1", 3);          // imul eax, ecx
+                emit_jump(as, 0x80, &as->overflow_jumps, &as->overflow_count);
+                break;
+            case OP_DIV:
+                emit_bytes(as, "\x85\xc9", 2);              // test ecx, ecx
+                emit_jump(as, 0x84, &as->div_zero_jumps, &as->div_zero_count);
+                emit_bytes(as, "\x83\xf9\xff", 3);          // cmp ecx, -1
+                emit_bytes(as, "\x75\x0b", 2);              // jne past the next check
+                emit_byte(as, 0x3d);                        // cmp eax, INT_MIN
+                emit_u32(as, 0x80000000u);
+                emit_jump(as, 0x84, &as->overflow_jumps, &as->overflow_count);
+                emit_bytes(as, "\x99\xf7\xf9", 3);          // cdq; idiv ecx
+                break;
+            case OP_LT: case OP_LE: case OP_GT:
+            case OP_GE: case OP_EQ: case OP_NE:
+                emit_bytes(as, "\x39\xc8\x0f", 3);          // cmp eax, ecx
+                emit_byte(as, setcc[op]);                   // setcc al
+                emit_bytes(as, "\xc0\x0f\xb6\xc0", 4);      // movzx eax, al
+                break;
+            default:
+                return -1;
+        }
+        emit_slot(as, 0x89, 0, left);       // mov [left], eax
+        depth--;
+    }
+
+    // Runtime errors: return the error code of an overflow or a division by
+    // zero, or the one eval_power() left in eax
+    patch_jumps(as, as->overflow_jumps, as->overflow_count, as->length);
+    emit_byte(as, 0xb8);                        // mov eax, INTEGER_OVERFLOW
+    emit_u32(as, (uint32_t)INTEGER_OVERFLOW);
+    size_t skip = as->length + 1;
+    emit_byte(as, 0xe9);                        // jmp error
+    emit_u32(as, 0);
+    patch_jumps(as, as->div_zero_jumps, as->div_zero_count, as->length);
+    emit_byte(as, 0xb8);                        // mov eax, DIVISION_BY_ZERO
+    emit_u32(as, (uint32_t)DIVISION_BY_ZERO);
+    patch_jumps(as, as->error_jumps, as->error_count, as->length);
+    if (!as->failed)
+        patch_jumps(as, &skip, 1, as->length);
+    emit_bytes(as, "\x48\x8d\x65\xf0", 4);      // lea rsp, [rbp-16]
+    emit_bytes(as, "\x41\x5c\x5b\x5d\xc3", 5);  // pop r12/rbx/rbp; ret
+
+    return as->failed ? -1 : 0;
+}
+
+/*
+ * map_code - copies assembled code to a private writable mapping which is
+ * then made read-only and executable, so no page is ever writable and
+ * executable at once, and releases the assembler's buffers.
+ * Returns the mapping, or NULL if it could not be made.
+ */
+static void *map_code(Assembler *as, size_t *size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    void *memory = NULL;
+
+    *size = (as->length + page - 1) & ~(page - 1);
+    if (*size > 0) {
+        memory = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            memory = NULL;
+        } else {
+            memcpy(memory, as->code, as->length);
+            if (mprotect(memory, *size, PROT_READ | PROT_EXEC) != 0) {
+                munmap(memory, *size);
+                memory = NULL;
+            }
+        }
+    }
+    free(as->code);
+    free(as->error_jumps);
+    free(as->div_zero_jumps);
+    free(as->overflow_jumps);
+    return memory;
+}
+
+#endif // JIT_X86_64
+
+/**
+ * jit_available - reports whether native code can be generated.
+ */
+int jit_available(void) {
+#ifdef JIT_X86_64
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * jit_compile - translates a program to native code.
+ * @prog: the program to translate.
+ * @jit: receives the native code.
+ *
+ * Returns 0 on success, or -1 if the program must be run by the VM instead.
+ */
+int jit_compile(const Program *prog, JitCode *jit) {
+    jit->memory = NULL;
+    jit->size = 0;
+    jit->run = NULL;
+
+#ifdef JIT_X86_64
+    Assembler as = {0};
+    size_t size;
+    if (assemble(prog, &as) != 0)
+        as.length = 0;          // Nothing to map; the buffers are still freed
+    void *memory = map_code(&as, &size);
+
+    if (memory == NULL)
+        return -1;
+    jit->memory = memory;
+    jit->size = size;
+    jit->run = (int (*)(Value *))memory;
+    return 0;
+#else
+    (void)prog;
+    return -1;
+#endif
+}
+
+/**
+ * jit_compile_all - translates many programs to native code in one mapping.
+ * @progs: the programs to translate.
+ * @count: the number of programs.
+ * @jit: receives the native code.
+ *
+ * Mapping each program on its own costs three system calls, more than a
+ * short program takes to run, so programs that run once are translated
+ * together. A program that cannot be translated gets no entry point.
+ * Returns 0 on success, or -1 if the JIT is unavailable or out of memory.
+ */
+int jit_compile_all(const Program *progs, int count, JitBatch *jit) {
+    jit->memory = NULL;
+    jit->size = 0;
+    jit->run = NULL;
+    jit->count = 0;
+
+#ifdef JIT_X86_64
+    size_t *starts = malloc((count > 0 ? count : 1) * sizeof(size_t));
+    Assembler as = {0};
+
+    for (int i = 0; starts != NULL && i < count && !as.failed; i++) {
+        // Jumps are relative, so each program is assembled in place after
+        // the last one, with lists of its own jumps
+        starts[i] = as.length;
+        as.error_count = as.div_zero_count = as.overflow_count = 0;
+        if (assemble(&progs[i], &as) != 0) {
+            as.length = starts[i];
+            starts[i] = SIZE_MAX;
+        }
+    }
+    size_t size;
+    int failed = starts == NULL || as.failed;
+    if (failed)
+        as.length = 0;
+    void *memory = map_code(&as, &size);
+    int (**run)(Value *) = failed ? NULL : malloc((count > 0 ? count : 1) * sizeof(*run));
+
+    if (run == NULL || (memory == NULL && size > 0)) {
+        if (memory != NULL)
+            munmap(memory, size);
+        free(run);
+        free(starts);
+        return -1;
+    }
+    for (int i = 0; i < count; i++)
+        run[i] = starts[i] == SIZE_MAX ? NULL : (int (*)(Value *))((char *)memory + starts[i]);
+    free(starts);
+    jit->memory = memory;
+    jit->size = size;
+    jit->run = run;
+    jit->count = count;
+    return 0;
+#else
+    (void)progs;
+    (void)count;
+    return -1;
+#endif
+}
+
+/**
+ * jit_run - runs native code.
+ * @jit: the native code.
+ * @value: receives the value.
+ *
+ * Returns 0 on success, or the error code of a runtime error.
+ */
+int jit_run(const JitCode *jit, Value *value) {
+    return jit->run(value);
+}
+
+/**
+ * jit_free - unmaps native code.
+ * @jit: the native code to release.
+ */
+void jit_free(JitCode *jit) {
+#ifdef JIT_X86_64
+    if (jit->memory != NULL)
+        munmap(jit->memory, jit->size);
+#endif
+    jit->memory = NULL;
+    jit->size = 0;
+    jit->run = NULL;
+}
+
+/**
+ * jit_free_all - unmaps native code generated by jit_compile_all().
+ * @jit: the native code to release.
+ */
+void jit_free_all(JitBatch *jit) {
+#ifdef JIT_X86_64
+    if (jit->memory != NULL)
+        munmap(jit->memory, jit->size);
+#endif
+    free(jit->run);
+    jit->memory = NULL;
+    jit->size = 0;
+    jit->run = NULL;
+    jit->count = 0;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file jit.h
+ * @brief Optional native code backend for expressions that are evaluated in
+ * tight loops. A compiled Program is translated to x86-64 machine code that
+ * is mapped into executable pages, removing the VM's dispatch entirely. The
+ * generated code keeps the VM's semantics: a division by zero or any
+ * overflow ends evaluation with the same error code. On other architectures, in builds
+ * with 64-bit values, for programs that load or store variables, or if
+ * executable memory cannot be mapped, jit_compile() fails and callers keep
+ * using run_program().
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h>
+#include "vm.h"
+
+/**
+ * Native code generated for one program.
+ */
+typedef struct {
+    void *memory;               /* Executable mapping holding the code */
+    size_t size;                /* Size of the mapping */
+    int (*run)(Value *value);   /* Entry point; same contract as run_program() */
+} JitCode;
+
+/**
+ * Native code generated for many programs in one mapping.
+ */
+typedef struct {
+    void *memory;               /* Executable mapping holding the code */
+    size_t size;                /* Size of the mapping */
+    int (**run)(Value *value);  /* Entry point of each program, or NULL */
+    int count;                  /* Number of programs */
+} JitBatch;
+
+/**
+ * Reports whether native code can be generated on this machine.
+ *
+ * @return 1 if jit_compile() is supported, otherwise 0.
+ */
+int jit_available(void);
+
+/**
+ * Translates a program to native code.
+ *
+ * @param prog The program to translate.
+ * @param jit Receives the native code.
+ * @return 0 on success, or -1 if the JIT is unavailable, the program needs a
+ * deeper stack than fits in a native frame, names variables, or memory
+ * could not be mapped, in which case the program should be run with
+ * run_program().
+ */
+int jit_compile(const Program *prog, JitCode *jit);
+
+/**
+ * Translates many programs to native code in a single mapping, which is
+ * far cheaper than jit_compile() for each when every program runs once.
+ * Programs that jit_compile() would reject get a NULL entry point and
+ * should be run with run_program(); the others are run by calling their
+ * entry point, with the same contract as run_program().
+ *
+ * @param progs The programs to translate.
+ * @param count Number of programs.
+ * @param jit Receives the native code.
+ * @return 0 on success, or -1 if the JIT is unavailable or memory could not
+ * be allocated or mapped, in which case every program should be run with
+ * run_program().
+ */
+int jit_compile_all(const Program *progs, int count, JitBatch *jit);
+
+/**
+ * Runs native code generated by jit_compile().
+ *
+ * @param jit The native code.
+ * @param value Receives the value of the expression.
+ * @return 0 on success, or the error code of a runtime error.
+ */
+int jit_run(const JitCode *jit, Value *value);
+
+/**
+ * Unmaps native code.
+ *
+ * @param jit The native code to release.
+ */
+void jit_free(JitCode *jit);
+
+/**
+ * Unmaps native code generated by jit_compile_all().
+ *
+ * @param jit The native code to release.
+ */
+void jit_free_all(JitBatch *jit);
+
+#endif // JIT_H
@@ -0,0 +1,482 @@
+/*
+ * lexer.c - table-driven lexer for the expression language.
+ * The automaton below replaces the PCRE pattern the tokenizer used to
+ * compile for every line. Both tables are constant and built by the
+ * compiler, so there is no setup cost at run time. The stream lexer runs
+ * the same automaton one byte at a time, keeping between chunks only the
+ * automaton state and the short lexemes (at most two bytes) and whitespace
+ * it cannot decide on yet.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "lexer.h"
+
+/* Character classes, the columns of the transition table */
+enum {
+    C_OTHER, C_SPACE, C_DIGIT, C_PLUS, C_MINUS, C_STAR, C_SLASH, C_CARET,
+    C_LPAREN, C_RPAREN, C_SEMI, C_LT, C_GT, C_EQ, C_BANG, C_ALPHA,
+    NUM_CLASSES
+};
+
+/*
+ * Automaton states; S_DEAD means no lexeme can continue. S_NAMES starts as
+ * S_START does but also accepts names.
+ */
+enum {
+    S_DEAD, S_START, S_NAMES, S_IDENT, S_INT, S_ADD, S_SUB, S_MULT, S_DIV, S_EXPON,
+    S_LPAREN, S_RPAREN, S_SEMI, S_LT, S_LE, S_GT, S_GE, S_ASSIGN,
+    S_EQUALS, S_BANG, S_NOT_EQUALS,
+    NUM_STATES
+};
+
+#define NO_TOKEN 0xff
+
+static const unsigned char char_class[256] = {
+    [' '] = C_SPACE, ['\t'] = C_SPACE, ['\r'] = C_SPACE,
+    ['\n'] = C_SPACE, ['\v'] = C_SPACE, ['\f'] = C_SPACE,
+    ['0' ... '9'] = C_DIGIT,
+    ['+'] = C_PLUS, ['-'] = C_MINUS, ['*'] = C_STAR, ['/'] = C_SLASH,
+    ['^'] = C_CARET, ['('] = C_LPAREN, [')'] = C_RPAREN, [';'] = C_SEMI,
+    ['<'] = C_LT, ['>'] = C_GT, ['='] = C_EQ, ['!'] = C_BANG,
+    ['a' ... 'z'] = C_ALPHA, ['A' ... 'Z'] = C_ALPHA, ['_'] = C_ALPHA,
+};
+
+/* The transitions out of both start states */
+#define START_TRANSITIONS \
+    [C_DIGIT] = S_INT, [C_PLUS] = S_ADD, [C_MINUS] = S_SUB, \
+    [C_STAR] = S_MULT, [C_SLASH] = S_DIV, [C_CARET] = S_EXPON, \
+    [C_LPAREN] = S_LPAREN, [C_RPAREN] = S_RPAREN, [C_SEMI] = S_SEMI, \
+    [C_LT] = S_LT, [C_GT] = S_GT, [C_EQ] = S_ASSIGN, [C_BANG] = S_BANG
+
+static const unsigned char transition[NUM_STATES][NUM_CLASSES] = {
+    [S_START] = { START_TRANSITIONS },
+    [S_NAMES] = { START_TRANSITIONS, [C_ALPHA] = S_IDENT },
+    [S_IDENT] = { [C_ALPHA] = S_IDENT, [C_DIGIT] = S_IDENT },
+    [S_INT] = { [C_DIGIT] = S_INT },
+    [S_LT] = { [C_EQ] = S_LE },
+    [S_GT] = { [C_EQ] = S_GE },
+    [S_ASSIGN] = { [C_EQ] = S_EQUALS },
+    [S_BANG] = { [C_EQ] = S_NOT_EQUALS },
+};
+
+static const unsigned char accept[NUM_STATES] = {
+    [S_DEAD] = NO_TOKEN, [S_START] = NO_TOKEN, [S_NAMES] = NO_TOKEN,
+    [S_BANG] = NO_TOKEN, [S_IDENT] = IDENTIFIER,
+    [S_INT] = INT_LITERAL, [S_ADD] = ADD_OP, [S_SUB] = SUB_OP,
+    [S_MULT] = MULT_OP, [S_DIV] = DIV_OP, [S_EXPON] = EXPON_OP,
+    [S_LPAREN] = LEFT_PAREN, [S_RPAREN] = RIGHT_PAREN, [S_SEMI] = SEMI_COLON,
+    [S_LT] = LESS_THEN_OP, [S_LE] = LESS_THEN_OR_EQUAL_OP,
+    [S_GT] = GREATER_THEN_OP, [S_GE] = GREATER_THEN_OR_EQUAL_OP,
+    [S_ASSIGN] = ASSIGN_OP, [S_EQUALS] = EQUALS_OP,
+    [S_NOT_EQUALS] = NOT_EQUALS_OP,
+};
+
+/*
+ * match_at - runs the automaton from a position and start state.
+ * Returns the length of the longest lexeme starting at pos, or 0 if none
+ * does, and stores its category.
+ */
+static size_t match_at(const char *text, size_t len, size_t pos, unsigned char start,
+                       unsigned char *category) {
+    unsigned char state = start;
+    size_t matched = 0;
+
+    for (size_t p = pos; p < len; p++) {
+        state = transition[state][char_class[(unsigned char)text[p]]];
+        if (state == S_DEAD)
+            break;
+        if (accept[state] != NO_TOKEN) {
+            *category = accept[state];
+            matched = p + 1 - pos;
+        }
+    }
+    return matched;
+}
+
+/*
+ * scan - scans the next lexeme of a line from the given start state.
+ * Returns the offset just past the lexeme, or 0 once only whitespace is left.
+ */
+static size_t scan(const char *text, size_t len, size_t pos, unsigned char start, Token *tok) {
+    while (pos < len && char_class[(unsigned char)text[pos]] == C_SPACE)
+        pos++;
+    if (pos == len)
+        return 0;
+
+    unsigned char category;
+    size_t matched = match_at(text, len, pos, start, &category);
+    if (matched > 0) {
+        tok->category = category;
+        tok->start = pos;
+        tok->length = matched;
+        return pos + matched;
+    }
+
+    // Not a lexeme: the unknown text runs up to where the next lexeme starts
+    size_t end = pos + 1;
+    while (end < len && match_at(text, len, end, start, &category) == 0)
+        end++;
+    size_t next = end;
+    if (end == len) {
+        while (char_class[(unsigned char)text[end - 1]] == C_SPACE)
+            end--;
+    }
+
+    tok->category = UNKNOWN;
+    tok->start = pos;
+    tok->length = end - pos;
+    return next;
+}
+
+/**
+ * lex_next - scans the next lexeme of a line.
+ * @text: the line being scanned.
+ * @len: length of the line.
+ * @pos: offset at which scanning starts.
+ * @tok: receives the lexeme.
+ *
+ * Returns the offset just past the lexeme, or 0 once only whitespace is left.
+ */
+size_t lex_next(const char *text, size_t len, size_t pos, Token *tok) {
+    return scan(text, len, pos, S_START, tok);
+}
+
+/**
+ * lex_line - tokenizes a whole line into a reusable buffer.
+ * @buf: buffer receiving the tokens.
+ * @text: the line to tokenize.
+ * @len: length of the line.
+ *
+ * Returns the number of tokens found, or -1 when out of memory.
+ */
+int lex_line(TokenBuffer *buf, const char *text, size_t len) {
+    unsigned char start = buf->identifiers ? S_NAMES : S_START;
+    size_t pos = 0;
+    Token tok;
+
+    buf->count = 0;
+    while ((pos = scan(text, len, pos, start, &tok)) != 0) {
+        if (buf->count == buf->capacity) {
+            int capacity = buf->capacity ? buf->capacity * 2 : 64;
+            Token *grown = realloc(buf->tokens, capacity * sizeof(Token));
+            if (grown == NULL)
+                return -1;
+            buf->tokens = grown;
+            buf->capacity = capacity;
+        }
+        buf->tokens[buf->count++] = tok;
+    }
+    return buf->count;
+}
+
+/* Modes of a stream */
+enum { M_SKIP, M_TOKEN, M_UNKNOWN };
+
+/* Text of each category whose lexemes are all alike, for lexemes held back */
+static const char *const fixed_text[] = {
+    [ADD_OP] = "+", [SUB_OP] = "-", [MULT_OP] = "*", [DIV_OP] = "/",
+    [LEFT_PAREN] = "(", [RIGHT_PAREN] = ")", [EXPON_OP] = "^", [ASSIGN_OP] = "=",
+    [LESS_THEN_OP] = "<", [LESS_THEN_OR_EQUAL_OP] = "<=", [GREATER_THEN_OP] = ">",
+    [GREATER_THEN_OR_EQUAL_OP] = ">=", [EQUALS_OP] = "==", [NOT_OP] = "!",
+    [NOT_EQUALS_OP] = "!=", [SEMI_COLON] = ";",
+};
+
+/**
+ * lex_stream_init - starts a stream with no chunk.
+ * @ls: the stream.
+ * @identifiers: set to scan names.
+ */
+void lex_stream_init(LexStream *ls, int identifiers) {
+    memset(ls, 0, sizeof(*ls));
+    ls->start = identifiers ? S_NAMES : S_START;
+    ls->mode = M_SKIP;
+    ls->spaces = SIZE_MAX;
+    ls->drained = 1;
+}
+
+/**
+ * lex_stream_feed - feeds the next chunk of a stream.
+ * @ls: the stream.
+ * @chunk: the chunk.
+ * @length: length of the chunk.
+ */
+void lex_stream_feed(LexStream *ls, const char *chunk, size_t length) {
+    ls->chunk = chunk;
+    ls->length = length;
+    ls->pos = 0;
+    ls->from = 0;
+    ls->spaces = SIZE_MAX;
+    ls->drained = 0;
+}
+
+/**
+ * lex_stream_end - marks the end of a stream.
+ * @ls: the stream.
+ */
+void lex_stream_end(LexStream *ls) {
+    lex_stream_feed(ls, "", 0);
+    ls->ended = 1;
+}
+
+/*
+ * push - queues a piece of the open lexeme. Empty pieces are only queued to
+ * end a lexeme.
+ */
+static void push(LexStream *ls, unsigned char category, int last, const char *text,
+                 size_t length) {
+    if (length == 0 && !last)
+        return;
+    LexPiece *piece = &ls->queue[ls->queued++];
+    piece->category = category;
+    piece->flags = (ls->opened ? 0 : LEX_FIRST) | (last ? LEX_LAST : 0);
+    piece->text = text;
+    piece->length = length;
+    ls->opened = !last;
+}
+
+/*
+ * push_carry - queues the whitespace held back from earlier chunks as part of
+ * the unknown text.
+ */
+static void push_carry(LexStream *ls) {
+    push(ls, UNKNOWN, 0, ls->carry, ls->carry_length);
+    ls->carry_length = 0;
+}
+
+/*
+ * push_token - queues the rest of the open lexeme, which ends before pos.
+ */
+static void push_token(LexStream *ls) {
+    unsigned char category = accept[ls->state];
+    if (ls->held)
+        push(ls, category, 1, fixed_text[category], strlen(fixed_text[category]));
+    else
+        push(ls, category, 1, ls->chunk + ls->from, ls->pos - ls->from);
+    ls->held = 0;
+    ls->mode = M_SKIP;
+}
+
+/*
+ * end_unknown - queues the rest of the open unknown text. At the end of a
+ * line its trailing whitespace is dropped; otherwise it is kept.
+ */
+static void end_unknown(LexStream *ls, int line_end) {
+    size_t end = ls->pos;
+    if (line_end) {
+        ls->carry_length = 0;
+        if (ls->spaces != SIZE_MAX)
+            end = ls->spaces;
+    } else if (ls->carry_length > 0) {
+        push_carry(ls);
+    }
+    push(ls, UNKNOWN, 1, ls->chunk + ls->from, end - ls->from);
+    ls->spaces = SIZE_MAX;
+    ls->mode = M_SKIP;
+}
+
+/*
+ * begin_unknown - turns a lone '!', which opens a lexeme only if '='
+ * follows, into the start of unknown text.
+ */
+static void begin_unknown(LexStream *ls) {
+    if (ls->held)
+        push(ls, UNKNOWN, 0, fixed_text[NOT_OP], 1);
+    else
+        ls->opened = 0;
+    ls->held = 0;
+    ls->spaces = SIZE_MAX;
+    ls->mode = M_UNKNOWN;
+}
+
+/*
+ * drain - handles the end of a chunk: returns the open lexeme's text from
+ * the chunk, since the chunk will be gone, or ends it at the end of the
+ * stream.
+ */
+static void drain(LexStream *ls) {
+    ls->drained = 1;
+    if (ls->ended) {
+        // The end of the stream ends the last line
+        if (ls->mode == M_TOKEN && ls->state == S_BANG)
+            begin_unknown(ls);
+        if (ls->mode == M_TOKEN) {
+            push_token(ls);
+        } else if (ls->mode == M_UNKNOWN) {
+            if (ls->bang) {
+                ls->bang = 0;
+                push(ls, UNKNOWN, 1, fixed_text[NOT_OP], 1);
+                ls->mode = M_SKIP;
+            } else {
+                end_unknown(ls, 1);
+            }
+        }
+        return;
+    }
+
+    if (ls->mode == M_TOKEN) {
+        if (ls->state == S_INT || ls->state == S_IDENT)
+            push(ls, accept[ls->state], 0, ls->chunk + ls->from, ls->pos - ls->from);
+        else
+            ls->held = 1; // At most two bytes, whose text the category gives
+    } else if (ls->mode == M_UNKNOWN && !ls->bang) {
+        if (ls->spaces == SIZE_MAX) {
+            push(ls, UNKNOWN, 0, ls->chunk + ls->from, ls->pos - ls->from);
+            return;
+        }
+        // Hold back the trailing whitespace until it is known to be inside
+        push(ls, UNKNOWN, 0, ls->chunk + ls->from, ls->spaces - ls->from);
+        size_t length = ls->pos - ls->spaces;
+        if (ls->carry_length + length <= LEX_CARRY) {
+            memcpy(ls->carry + ls->carry_length, ls->chunk + ls->spaces, length);
+            ls->carry_length += length;
+        } else {
+            push_carry(ls);
+            push(ls, UNKNOWN, 0, ls->chunk + ls->spaces, length);
+        }
+    }
+}
+
+/*
+ * run - scans the chunk until a piece is queued or the chunk is used up.
+ */
+static void run(LexStream *ls) {
+    while (ls->queued == 0) {
+        if (ls->pos == ls->length) {
+            if (!ls->drained)
+                drain(ls);
+            return;
+        }
+
+        unsigned char c = ls->chunk[ls->pos];
+        unsigned char class = char_class[c];
+        unsigned char next;
+        switch (ls->mode) {
+            case M_SKIP:
+                if (class != C_SPACE) {
+                    next = transition[ls->start][class];
+                    ls->mode = next == S_DEAD ? M_UNKNOWN : M_TOKEN;
+                    ls->state = next;
+                    ls->from = ls->pos;
+                    ls->opened = 0;
+                    ls->spaces = SIZE_MAX;
+                }
+                ls->pos++;
+                break;
+
+            case M_TOKEN:
+                next = transition[ls->state][class];
+                if (next != S_DEAD) {
+                    ls->state = next;
+                    ls->pos++;
+                } else if (ls->state == S_BANG) {
+                    begin_unknown(ls); // c is scanned again as unknown text
+                } else {
+                    push_token(ls); // c is scanned again between lexemes
+                }
+                break;
+
+            case M_UNKNOWN:
+                if (ls->bang) {
+                    // The '!' ending the previous chunk is resolved by c
+                    ls->bang = 0;
+                    if (c == '=') {
+                        end_unknown(ls, 0);
+                        ls->held = 1;
+                        ls->state = S_NOT_EQUALS;
+                        ls->pos++;
+                        push_token(ls);
+                    } else {
+                        push(ls, UNKNOWN, 0, fixed_text[NOT_OP], 1);
+                    }
+                    break;
+                }
+                if (c == '\n') {
+                    end_unknown(ls, 1);
+                } else if (class == C_SPACE) {
+                    if (ls->spaces == SIZE_MAX)
+                        ls->spaces = ls->pos;
+                    ls->pos++;
+                } else if (c == '!' && ls->pos + 1 == ls->length && !ls->ended) {
+                    // Whether it opens "!=" is up to the next chunk
+                    if (ls->carry_length > 0)
+                        push_carry(ls);
+                    push(ls, UNKNOWN, 0, ls->chunk + ls->from, ls->pos - ls->from);
+                    ls->bang = 1;
+                    ls->pos++;
+                    ls->drained = 1;
+                } else if ((c == '!' && ls->chunk[ls->pos + 1] == '=') ||
+                           (c != '!' && transition[ls->start][class] != S_DEAD)) {
+                    end_unknown(ls, 0); // c opens a lexeme
+                } else {
+                    if (ls->carry_length > 0)
+                        push_carry(ls);
+                    ls->spaces = SIZE_MAX;
+                    ls->pos++;
+                }
+                break;
+        }
+    }
+}
+
+/**
+ * lex_stream_next - returns the next piece of a lexeme.
+ * @ls: the stream.
+ * @piece: receives the piece.
+ *
+ * Returns 1 if a piece was found, or 0 when the next chunk is needed.
+ */
+int lex_stream_next(LexStream *ls, LexPiece *piece) {
+    if (ls->taken == ls->queued) {
+        ls->taken = ls->queued = 0;
+        run(ls);
+        if (ls->queued == 0)
+            return 0;
+    }
+    *piece = ls->queue[ls->taken++];
+    return 1;
+}
+
+/**
+ * has_lexical_errors - checks a line for unknown tokens.
+ * @tokens: the tokens of the line.
+ * @count: the number of tokens.
+ *
+ * Returns 1 if any token is unknown, otherwise 0.
+ */
+int has_lexical_errors(const Token *tokens, int count) {
+    for (int i = 0; i < count; i++) {
+        if (tokens[i].category == UNKNOWN)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * has_identifiers - checks a line for names.
+ * @tokens: the tokens of the line.
+ * @count: the number of tokens.
+ *
+ * Returns 1 if any token is a name, otherwise 0.
+ */
+int has_identifiers(const Token *tokens, int count) {
+    for (int i = 0; i < count; i++) {
+        if (tokens[i].category == IDENTIFIER)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * free_token_buffer - releases a token buffer.
+ * @buf: the buffer to release.
+ */
+void free_token_buffer(TokenBuffer *buf) {
+    free(buf->tokens);
+    buf->tokens = NULL;
+    buf->count = 0;
+    buf->capacity = 0;
+}
@@ -0,0 +1,184 @@
+/**
+ * @file lexer.h
+ * @brief Table-driven lexer shared by the tokenizer and the interpreter. The
+ * lexer is a deterministic finite automaton whose character-class and
+ * transition tables are built at compile time, so scanning a line costs one
+ * table lookup per input byte and no per-line setup. It recognizes exactly the
+ * lexemes of the former PCRE pattern: integer literals, the two-character
+ * operators != == <= >= and the single characters = + - * / ^ < > ( ) ;.
+ * Every other run of text is reported as an UNKNOWN token, except that a
+ * token buffer can be set to also recognize names of variables: a letter or
+ * underscore followed by letters, digits and underscores.
+ *
+ * Besides whole lines, the lexer can scan a stream fed in chunks of any size
+ * (LexStream). Its state carries over from chunk to chunk, so a lexeme may
+ * span chunks and a line may be of any length, in constant memory: lexemes
+ * are returned as pieces pointing into the chunks, never copied.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stddef.h>
+#include "tokenizer.h"
+
+/**
+ * A lexeme found in a line of input. The token does not own its text; it
+ * refers back to the line by byte offset and length.
+ */
+typedef struct {
+    unsigned char category; /* TokenCategory of the lexeme */
+    unsigned int start;     /* Offset of the first byte in the line */
+    unsigned int length;    /* Number of bytes in the lexeme */
+} Token;
+
+/**
+ * Growable token array, reused from line to line so lexing a line does not
+ * allocate once the buffer has reached its working size.
+ */
+typedef struct {
+    Token *tokens;
+    int count;
+    int capacity;
+    int identifiers;        /* Set to scan names as IDENTIFIER tokens */
+} TokenBuffer;
+
+/* Flags of a LexPiece */
+#define LEX_FIRST 1         /* The piece starts its lexeme */
+#define LEX_LAST 2          /* The piece ends its lexeme */
+
+/* Bytes of whitespace a stream holds back at the end of a chunk */
+#define LEX_CARRY 64
+
+/**
+ * A piece of a lexeme found in a stream. A lexeme that lies within one
+ * chunk is one piece flagged both LEX_FIRST and LEX_LAST; a longer one is
+ * returned in order as several pieces, the last of which may be empty. The
+ * text stays valid until the next chunk is fed.
+ */
+typedef struct {
+    unsigned char category; /* TokenCategory of the lexeme */
+    unsigned char flags;    /* LEX_FIRST and LEX_LAST */
+    const char *text;       /* Into the chunk, or the lexer's own constant text */
+    size_t length;
+} LexPiece;
+
+/**
+ * State of a lexer scanning a stream. A newline ends a line, so the lexemes
+ * of each line of the stream are those lex_line() finds in it, with one
+ * exception: unknown text followed by more than LEX_CARRY bytes of
+ * whitespace spanning a chunk boundary keeps that whitespace even at the end
+ * of its line. Initialize with lex_stream_init().
+ */
+typedef struct {
+    const char *chunk;      /* The chunk being scanned */
+    size_t length;
+    size_t pos;             /* Offset of the next byte to scan */
+    size_t from;            /* Offset of the open lexeme's text not yet returned */
+    size_t spaces;          /* Offset of trailing whitespace of unknown text, or SIZE_MAX */
+    unsigned char start;    /* Start state of the automaton */
+    unsigned char mode;     /* Between lexemes, in a lexeme or in unknown text */
+    unsigned char state;    /* State of the automaton in a lexeme */
+    unsigned char opened;   /* A piece of the open lexeme was returned */
+    unsigned char held;     /* The open lexeme began in an earlier chunk and is short */
+    unsigned char bang;     /* Unknown text ended the chunk with a '!' */
+    unsigned char drained;  /* The end of the chunk has been handled */
+    unsigned char ended;    /* No chunk follows */
+    char carry[LEX_CARRY];  /* Whitespace after unknown text, from earlier chunks */
+    size_t carry_length;
+    LexPiece queue[4];      /* Pieces found but not yet returned */
+    int queued;
+    int taken;
+} LexStream;
+
+/**
+ * Scans the next lexeme of a line, skipping any leading whitespace. The
+ * longest lexeme starting at the first non-whitespace byte is returned. If no
+ * lexeme starts there, the text up to the start of the next lexeme (trailing
+ * whitespace excluded at the end of the line) is returned as UNKNOWN.
+ *
+ * @param text The line being scanned; it does not need to be NUL-terminated.
+ * @param len Length of the line in bytes.
+ * @param pos Offset at which scanning starts.
+ * @param tok Receives the lexeme found.
+ * @return The offset just past the lexeme, or 0 if only whitespace remained.
+ */
+size_t lex_next(const char *text, size_t len, size_t pos, Token *tok);
+
+/**
+ * Tokenizes a whole line into the given buffer, replacing its contents.
+ * Names are scanned as IDENTIFIER tokens if the buffer's identifiers field is
+ * set, and are unknown text otherwise.
+ *
+ * @param buf Buffer receiving the tokens; grown as needed.
+ * @param text The line to tokenize.
+ * @param len Length of the line in bytes.
+ * @return The number of tokens, or -1 if the buffer could not be grown.
+ */
+int lex_line(TokenBuffer *buf, const char *text, size_t len);
+
+/**
+ * Starts a stream with no chunk.
+ *
+ * @param ls The stream.
+ * @param identifiers Set to scan names as IDENTIFIER tokens.
+ */
+void lex_stream_init(LexStream *ls, int identifiers);
+
+/**
+ * Feeds the next chunk of a stream. lex_stream_next() must have returned 0
+ * for the previous chunk.
+ *
+ * @param ls The stream.
+ * @param chunk The chunk; it must stay valid until the next chunk is fed.
+ * @param length Length of the chunk in bytes.
+ */
+void lex_stream_feed(LexStream *ls, const char *chunk, size_t length);
+
+/**
+ * Marks the end of a stream, after which lex_stream_next() returns the rest
+ * of the last lexeme.
+ *
+ * @param ls The stream.
+ */
+void lex_stream_end(LexStream *ls);
+
+/**
+ * Returns the next piece of a lexeme from the chunk fed last.
+ *
+ * @param ls The stream.
+ * @param piece Receives the piece.
+ * @return 1 if a piece was found, or 0 once the chunk is used up and the
+ * next chunk is needed, or once the stream has ended.
+ */
+int lex_stream_next(LexStream *ls, LexPiece *piece);
+
+/**
+ * Checks whether a line contained text that is not a lexeme.
+ *
+ * @param tokens The tokens of the line.
+ * @param count The number of tokens.
+ * @return 1 if any token is UNKNOWN, otherwise 0.
+ */
+int has_lexical_errors(const Token *tokens, int count);
+
+/**
+ * Checks whether a line names a variable.
+ *
+ * @param tokens The tokens of the line.
+ * @param count The number of tokens.
+ * @return 1 if any token is an IDENTIFIER, otherwise 0.
+ */
+int has_identifiers(const Token *tokens, int count);
+
+/**
+ * Releases the memory held by a token buffer.
+ *
+ * @param buf The buffer to release.
+ */
+void free_token_buffer(TokenBuffer *buf);
+
+#endif // LEXER_H
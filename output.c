@@ -0,0 +1,510 @@
+/*
+ * output.c - buffered output writer for line results.
+ * Each record reserves room for its worst case once and is then formatted
+ * straight into the buffer.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "output.h"
+#include "parser.h"
+
+/* Size of the buffer, and so of the writes to the file */
+#define OUTPUT_BUFFER (1024 * 1024)
+
+/* Initial size of the buffer of a writer without a file */
+#define MEMORY_BUFFER (64 * 1024)
+
+/* Room for everything in a record besides copies of the input text */
+#define RECORD_SPACE 128
+
+/* Room for one lexical error besides the offending text */
+#define LEXEME_SPACE 48
+
+/* Size of a binary record */
+#define BINARY_RECORD 16
+
+/* Copies a string literal to p and advances p past it */
+#define PUT(p, literal) (memcpy((p), (literal), sizeof(literal) - 1), (p) + sizeof(literal) - 1)
+
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/* JSON names of the statuses, indexed by OutputStatus */
+static const char *const status_names[] = {
+    [OUTPUT_OK] = "ok",
+    [OUTPUT_BLANK] = "blank",
+    [OUTPUT_LEXICAL_ERROR] = "lexical_error",
+    [OUTPUT_ERROR] = "error",
+    [OUTPUT_MISSING_SEMICOLON] = "missing_semicolon",
+    [OUTPUT_MISSING_PARENTHESIS] = "missing_parenthesis",
+};
+
+/**
+ * output_init - initializes a writer.
+ * @out: the writer.
+ * @file: the output file, or NULL.
+ * @format: the output format.
+ *
+ * Returns 0 on success, or -1 when out of memory.
+ */
+int output_init(OutputWriter *out, FILE *file, OutputFormat format) {
+    out->format = format;
+    out->file = file;
+    out->length = 0;
+    out->error = 0;
+    out->capacity = file != NULL ? OUTPUT_BUFFER : MEMORY_BUFFER;
+    out->buffer = malloc(out->capacity);
+    return out->buffer != NULL ? 0 : -1;
+}
+
+/**
+ * output_parse_format - parses the name of an output format.
+ * @name: the name.
+ * @format: receives the format.
+ *
+ * Returns 0 on success, or -1 if the name is unknown.
+ */
+int output_parse_format(const char *name, OutputFormat *format) {
+    if (strcmp(name, "text") == 0)
+        *format = FORMAT_TEXT;
+    else if (strcmp(name, "json") == 0)
+        *format = FORMAT_JSON;
+    else if (strcmp(name, "binary") == 0)
+        *format = FORMAT_BINARY;
+    else
+        return -1;
+    return 0;
+}
+
+/*
+ * write_buffer - writes the buffer to the file and empties it.
+ */
+static void write_buffer(OutputWriter *out) {
+    if (out->length > 0 && fwrite(out->buffer, 1, out->length, out->file) != out->length)
+        out->error = 1;
+    out->length = 0;
+}
+
+/*
+ * reserve - makes room for extra more bytes, writing the buffer out first if
+ * there is a file and growing it if that is not enough.
+ * Returns a pointer to the free space, or NULL when out of memory.
+ */
+static char *reserve(OutputWriter *out, size_t extra) {
+    if (out->length + extra > out->capacity && out->file != NULL)
+        write_buffer(out);
+    if (out->length + extra > out->capacity) {
+        size_t capacity = out->capacity * 2;
+        while (capacity < out->length + extra)
+            capacity *= 2;
+        char *grown = realloc(out->buffer, capacity);
+        if (grown == NULL) {
+            out->error = 1;
+            return NULL;
+        }
+        out->buffer = grown;
+        out->capacity = capacity;
+    }
+    return out->buffer + out->length;
+}
+
+/*
+ * format_int - writes the decimal digits of a value, two at a time.
+ * Returns a pointer just past the last digit.
+ */
+static char *format_int(char *p, Value value) {
+    UValue magnitude = value < 0 ? 0 - (UValue)value : (UValue)value;
+    char digits[20];
+    char *d = digits + sizeof(digits);
+
+    while (magnitude >= 100) {
+        unsigned int pair = magnitude % 100;
+        magnitude /= 100;
+        d -= 2;
+        memcpy(d, digit_pairs + 2 * pair, 2);
+    }
+    if (magnitude >= 10) {
+        d -= 2;
+        memcpy(d, digit_pairs + 2 * magnitude, 2);
+    } else {
+        *--d = '0' + magnitude;
+    }
+
+    if (value < 0)
+        *p++ = '-';
+    size_t count = digits + sizeof(digits) - d;
+    memcpy(p, d, count);
+    return p + count;
+}
+
+/**
+ * utf8_sequence - measures the UTF-8 sequence at the start of some text.
+ * @text: the text.
+ * @length: number of bytes of the text, at least 1.
+ *
+ * The ranges of the second byte are those of the Unicode standard's table of
+ * well-formed sequences, which excludes overlong forms and surrogates.
+ * Returns the length of the sequence, or 0 if it is not valid.
+ */
+size_t utf8_sequence(const char *text, size_t length) {
+    const unsigned char *s = (const unsigned char *)text;
+    unsigned char low = 0x80, high = 0xbf;
+    size_t count;
+
+    if (s[0] < 0x80)
+        return 1;
+    if (s[0] < 0xc2 || s[0] > 0xf4)
+        return 0;
+    if (s[0] < 0xe0) {
+        count = 2;
+    } else if (s[0] < 0xf0) {
+        count = 3;
+        if (s[0] == 0xe0)
+            low = 0xa0;
+        else if (s[0] == 0xed)
+            high = 0x9f;
+    } else {
+        count = 4;
+        if (s[0] == 0xf0)
+            low = 0x90;
+        else if (s[0] == 0xf4)
+            high = 0x8f;
+    }
+    if (length < count || s[1] < low || s[1] > high)
+        return 0;
+    for (size_t i = 2; i < count; i++) {
+        if (s[i] < 0x80 || s[i] > 0xbf)
+            return 0;
+    }
+    return count;
+}
+
+/*
+ * put_json_string - writes text as a JSON string, quotes included. Bytes
+ * that are not valid UTF-8 become U+FFFD, so the record is always valid
+ * JSON. Needs room for 6 bytes per input byte plus 2.
+ */
+static char *put_json_string(char *p, const char *text, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+
+    *p++ = '"';
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = text[i];
+        if (c == '"' || c == '\\') {
+            *p++ = '\\';
+            *p++ = c;
+        } else if (c < 0x20) {
+            p = PUT(p, "\\u00");
+            *p++ = hex[c >> 4];
+            *p++ = hex[c & 0xf];
+        } else if (c < 0x80) {
+            *p++ = c;
+        } else {
+            size_t count = utf8_sequence(text + i, length - i);
+            if (count == 0) {
+                p = PUT(p, "\\ufffd");
+                continue;
+            }
+            memcpy(p, text + i, count);
+            p += count;
+            i += count - 1;
+        }
+    }
+    *p++ = '"';
+    return p;
+}
+
+/*
+ * put_le32 - writes a 32-bit value in little-endian byte order.
+ */
+static char *put_le32(char *p, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        *p++ = (char)(value >> (8 * i));
+    return p;
+}
+
+#ifdef VALUE_64
+/*
+ * put_le64 - writes a 64-bit value in little-endian byte order.
+ */
+static char *put_le64(char *p, uint64_t value) {
+    for (int i = 0; i < 8; i++)
+        *p++ = (char)(value >> (8 * i));
+    return p;
+}
+#endif
+
+/*
+ * write_binary - appends a binary record.
+ */
+static void write_binary(OutputWriter *out, OutputStatus status, Value value) {
+    char *p = reserve(out, BINARY_RECORD);
+    if (p == NULL)
+        return;
+    if (status != OUTPUT_OK)
+        value = 0;
+    p = put_le32(p, status);
+    p = put_le32(p, (uint32_t)value);
+#ifdef VALUE_64
+    put_le64(p, (uint64_t)value);
+#else
+    memset(p, 0, BINARY_RECORD - 8);
+#endif
+    out->length += BINARY_RECORD;
+}
+
+/*
+ * begin_json - writes the start of a JSON record, up to and including the
+ * status. The caller has reserved room for it.
+ */
+static char *begin_json(char *p, const char *line, size_t length, OutputStatus status) {
+    p = PUT(p, "{\"text\":");
+    p = put_json_string(p, line, length);
+    p = PUT(p, ",\"status\":\"");
+    size_t name_length = strlen(status_names[status]);
+    memcpy(p, status_names[status], name_length);
+    p += name_length;
+    *p++ = '"';
+    return p;
+}
+
+/*
+ * status_code - maps an evaluation status to its output status.
+ */
+static OutputStatus status_code(int status) {
+    switch (status) {
+        case 0:
+            return OUTPUT_OK;
+        case MISSING_SEMICOLON:
+            return OUTPUT_MISSING_SEMICOLON;
+        case MISSING_CLOSING_PARENTHESIS:
+            return OUTPUT_MISSING_PARENTHESIS;
+        default:
+            return OUTPUT_ERROR;
+    }
+}
+
+/**
+ * output_blank - writes the record of a line with nothing to evaluate.
+ * @out: the writer.
+ * @line: the line.
+ * @length: length of the line.
+ */
+void output_blank(OutputWriter *out, const char *line, size_t length) {
+    char *p;
+
+    switch (out->format) {
+        case FORMAT_TEXT:
+            if ((p = reserve(out, length + 1)) == NULL)
+                return;
+            memcpy(p, line, length);
+            p[length] = '\n';
+            out->length += length + 1;
+            break;
+        case FORMAT_JSON:
+            if ((p = reserve(out, 6 * length + RECORD_SPACE)) == NULL)
+                return;
+            p = begin_json(p, line, length, OUTPUT_BLANK);
+            p = PUT(p, "}\n");
+            out->length = p - out->buffer;
+            break;
+        case FORMAT_BINARY:
+            write_binary(out, OUTPUT_BLANK, 0);
+            break;
+    }
+}
+
+/**
+ * output_lexical_errors - writes the record of a line with lexical errors.
+ * @out: the writer.
+ * @line: the line.
+ * @length: length of the line.
+ * @tokens: the tokens of the line.
+ * @count: the number of tokens.
+ */
+void output_lexical_errors(OutputWriter *out, const char *line, size_t length,
+                           const Token *tokens, int count) {
+    char *p;
+
+    switch (out->format) {
+        case FORMAT_TEXT:
+            if ((p = reserve(out, 2 * length + (size_t)count * LEXEME_SPACE + 1)) == NULL)
+                return;
+            memcpy(p, line, length);
+            p += length;
+            *p++ = '\n';
+            for (int i = 0; i < count; i++) {
+                if (tokens[i].category != UNKNOWN)
+                    continue;
+                p = PUT(p, "===> '");
+                memcpy(p, line + tokens[i].start, tokens[i].length);
+                p += tokens[i].length;
+                p = PUT(p, "'\nLexical Error: not a lexeme\n");
+            }
+            out->length = p - out->buffer;
+            break;
+        case FORMAT_JSON:
+            if ((p = reserve(out, 12 * length + (size_t)count * 3 + RECORD_SPACE)) == NULL)
+                return;
+            p = begin_json(p, line, length, OUTPUT_LEXICAL_ERROR);
+            p = PUT(p, ",\"lexemes\":[");
+            char separator = 0;
+            for (int i = 0; i < count; i++) {
+                if (tokens[i].category != UNKNOWN)
+                    continue;
+                if (separator)
+                    *p++ = separator;
+                p = put_json_string(p, line + tokens[i].start, tokens[i].length);
+                separator = ',';
+            }
+            p = PUT(p, "]}\n");
+            out->length = p - out->buffer;
+            break;
+        case FORMAT_BINARY:
+            write_binary(out, OUTPUT_LEXICAL_ERROR, 0);
+            break;
+    }
+}
+
+/**
+ * output_result - writes the record of an evaluated line.
+ * @out: the writer.
+ * @line: the line.
+ * @length: length of the line.
+ * @status: 0 or the error code of the line.
+ * @value: the value of the line.
+ */
+void output_result(OutputWriter *out, const char *line, size_t length, int status, Value value) {
+    OutputStatus code = status_code(status);
+    char *p;
+
+    switch (out->format) {
+        case FORMAT_TEXT:
+            if ((p = reserve(out, length + RECORD_SPACE)) == NULL)
+                return;
+            memcpy(p, line, length);
+            p += length;
+            *p++ = '\n';
+            switch (code) {
+                case OUTPUT_OK:
+                    p = PUT(p, "Syntax OK\nValue is ");
+                    p = format_int(p, value);
+                    *p++ = '\n';
+                    break;
+                case OUTPUT_MISSING_SEMICOLON:
+                    p = PUT(p, "===> ';' expected\nSyntax Error\n");
+                    break;
+                case OUTPUT_MISSING_PARENTHESIS:
+                    p = PUT(p, "===> ')' expected\nSyntax Error\n");
+                    break;
+                default:
+                    p = PUT(p, "Syntax Error\n");
+                    break;
+            }
+            out->length = p - out->buffer;
+            break;
+        case FORMAT_JSON:
+            if ((p = reserve(out, 6 * length + RECORD_SPACE)) == NULL)
+                return;
+            p = begin_json(p, line, length, code);
+            if (code == OUTPUT_OK) {
+                p = PUT(p, ",\"value\":");
+                p = format_int(p, value);
+            }
+            p = PUT(p, "}\n");
+            out->length = p - out->buffer;
+            break;
+        case FORMAT_BINARY:
+            write_binary(out, code, value);
+            break;
+    }
+}
+
+/**
+ * output_digits - writes the record of a line evaluated to a wide value.
+ * @out: the writer.
+ * @line: the line.
+ * @length: length of the line.
+ * @digits: the value in decimal.
+ * @count: number of characters of the value.
+ */
+void output_digits(OutputWriter *out, const char *line, size_t length,
+                   const char *digits, size_t count) {
+    char *p;
+
+    switch (out->format) {
+        case FORMAT_TEXT:
+            if ((p = reserve(out, length + count + RECORD_SPACE)) == NULL)
+                return;
+            memcpy(p, line, length);
+            p += length;
+            *p++ = '\n';
+            p = PUT(p, "Syntax OK\nValue is ");
+            break;
+        case FORMAT_JSON:
+            if ((p = reserve(out, 6 * length + count + RECORD_SPACE)) == NULL)
+                return;
+            p = begin_json(p, line, length, OUTPUT_OK);
+            p = PUT(p, ",\"value\":");
+            break;
+        default:
+            out->error = 1; // Binary records hold at most 64 bits
+            return;
+    }
+    memcpy(p, digits, count);
+    p += count;
+    p = out->format == FORMAT_JSON ? PUT(p, "}\n") : PUT(p, "\n");
+    out->length = p - out->buffer;
+}
+
+/**
+ * output_bytes - appends formatted bytes.
+ * @out: the writer.
+ * @bytes: the bytes.
+ * @length: number of bytes.
+ */
+void output_bytes(OutputWriter *out, const void *bytes, size_t length) {
+    // Blocks as large as the buffer go straight to the file
+    if (out->file != NULL && length >= out->capacity) {
+        write_buffer(out);
+        if (fwrite(bytes, 1, length, out->file) != length)
+            out->error = 1;
+        return;
+    }
+    char *p = reserve(out, length);
+    if (p == NULL)
+        return;
+    memcpy(p, bytes, length);
+    out->length += length;
+}
+
+/**
+ * output_flush - writes the buffered output to the file.
+ * @out: the writer.
+ *
+ * Returns 0 on success, or -1 if any write has failed.
+ */
+int output_flush(OutputWriter *out) {
+    if (out->file != NULL) {
+        write_buffer(out);
+        if (fflush(out->file) != 0)
+            out->error = 1;
+    }
+    return out->error ? -1 : 0;
+}
+
+/**
+ * output_free - releases the buffer of a writer.
+ * @out: the writer.
+ */
+void output_free(OutputWriter *out) {
+    free(out->buffer);
+    out->buffer = NULL;
+    out->length = out->capacity = 0;
+}
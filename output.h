@@ -0,0 +1,162 @@
+/**
+ * @file output.h
+ * @brief Output writer for the results of input lines. Results are formatted
+ * into one large reusable buffer, with integers converted by hand instead of
+ * through printf, and the buffer is written out in large blocks. Three
+ * formats are offered, each with exactly one record per input line, in input
+ * order:
+ *
+ *   text    the echoed line followed by the human-readable verdict, as the
+ *           interpreter has always printed it.
+ *   json    one JSON object per line, such as
+ *           {"text":"2+3;","status":"ok","value":5}. The status is one of
+ *           ok, blank, lexical_error (with a "lexemes" array of the text
+ *           that is not a lexeme), error, missing_semicolon and
+ *           missing_parenthesis. Input text that is not valid UTF-8 is
+ *           written with U+FFFD in place of each invalid byte.
+ *   binary  16-byte little-endian records: an int32 status code from
+ *           OutputStatus, an int32 value (0 unless the status is
+ *           OUTPUT_OK), and 8 reserved zero bytes. Builds with 64-bit
+ *           values store the full value as an int64 in those last 8
+ *           bytes, and its low 32 bits in the int32.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "lexer.h"
+#include "ast.h"
+
+typedef enum {
+    FORMAT_TEXT,
+    FORMAT_JSON,
+    FORMAT_BINARY
+} OutputFormat;
+
+/* Status codes of the binary format */
+typedef enum {
+    OUTPUT_OK = 0,
+    OUTPUT_BLANK = 1,
+    OUTPUT_LEXICAL_ERROR = 2,
+    OUTPUT_ERROR = 3,
+    OUTPUT_MISSING_SEMICOLON = 4,
+    OUTPUT_MISSING_PARENTHESIS = 5
+} OutputStatus;
+
+typedef struct {
+    OutputFormat format;
+    FILE *file;         /* Receives the buffer when it fills, or NULL to keep all output in memory */
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    int error;          /* Set if a write failed or memory ran out */
+} OutputWriter;
+
+/**
+ * Initializes a writer.
+ *
+ * @param out The writer.
+ * @param file File the output is written to, or NULL to collect it in the
+ * buffer until the caller takes it.
+ * @param format The output format.
+ * @return 0 on success, or -1 when out of memory.
+ */
+int output_init(OutputWriter *out, FILE *file, OutputFormat format);
+
+/**
+ * Parses the name of an output format: text, json or binary.
+ *
+ * @param name The name.
+ * @param format Receives the format.
+ * @return 0 on success, or -1 if the name is unknown.
+ */
+int output_parse_format(const char *name, OutputFormat *format);
+
+/**
+ * Writes the record of a line with nothing to evaluate.
+ *
+ * @param out The writer.
+ * @param line The line.
+ * @param length Length of the line.
+ */
+void output_blank(OutputWriter *out, const char *line, size_t length);
+
+/**
+ * Writes the record of a line containing text that is not a lexeme.
+ *
+ * @param out The writer.
+ * @param line The line.
+ * @param length Length of the line.
+ * @param tokens The tokens of the line.
+ * @param count The number of tokens.
+ */
+void output_lexical_errors(OutputWriter *out, const char *line, size_t length,
+                           const Token *tokens, int count);
+
+/**
+ * Writes the record of an evaluated line.
+ *
+ * @param out The writer.
+ * @param line The line.
+ * @param length Length of the line.
+ * @param status 0 or the error code of the line.
+ * @param value The value of the line when the status is 0.
+ */
+void output_result(OutputWriter *out, const char *line, size_t length, int status, Value value);
+
+/**
+ * Writes the record of a line whose value is too wide for a Value, given as
+ * decimal text. The binary format has no room for such values, so only text
+ * and json writers may be given one.
+ *
+ * @param out The writer.
+ * @param line The line.
+ * @param length Length of the line.
+ * @param digits The value in decimal, with a leading '-' if negative.
+ * @param count Number of characters of the value.
+ */
+void output_digits(OutputWriter *out, const char *line, size_t length,
+                   const char *digits, size_t count);
+
+/**
+ * Appends bytes that are already formatted.
+ *
+ * @param out The writer.
+ * @param bytes The bytes.
+ * @param length Number of bytes.
+ */
+void output_bytes(OutputWriter *out, const void *bytes, size_t length);
+
+/**
+ * Writes the buffered output to the file. Does nothing for a writer without
+ * a file.
+ *
+ * @param out The writer.
+ * @return 0 on success, or -1 if any write has failed.
+ */
+int output_flush(OutputWriter *out);
+
+/**
+ * Measures the UTF-8 sequence at the start of some text. Overlong forms,
+ * surrogates and code points above U+10FFFF are not valid.
+ *
+ * @param text The text.
+ * @param length Number of bytes of the text, at least 1.
+ * @return The length of the sequence, from 1 to 4, or 0 if the text does not
+ * start with a valid sequence.
+ */
+size_t utf8_sequence(const char *text, size_t length);
+
+/**
+ * Releases the buffer of a writer, without flushing it.
+ *
+ * @param out The writer.
+ */
+void output_free(OutputWriter *out);
+
+#endif // OUTPUT_H
@@ -1,7 +1,16 @@
 /*
- * parser.c - recursive descent parser for a simple expression language.
- * Most of the functions in this file model a non-terminal in the
- * grammar listed below
+ * parser.c - parser for a simple expression language.
+ * The parser accepts the grammar listed below. It reads the token array
+ * produced by the lexer, so the characters of a line are only scanned once,
+ * and builds an expression tree in an arena; ast.c evaluates the tree.
+ * Expressions are parsed by precedence climbing with explicit stacks rather
+ * than by recursion, so no input can exhaust the C stack.
+ * A line that fails writes at most one message on stderr, the one of its
+ * error code. The recursive parser also traced each level a failed factor
+ * passed through ("Error in stmt: factor returned ERROR", "Error in ftail:
+ * factor returned ERROR"); there are no such levels any more, and cached,
+ * threaded and compiled runs keep only the error code of a line, so the
+ * trace is not written.
  * Author: Dagmawi Negatu and Darwin Bueso Galdamez
  * Date: April 2024
  */
@@ -9,17 +18,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <ctype.h>
 #include <string.h>
-#include <errno.h>
 #include <limits.h>
-#include <math.h>
 #include "tokenizer.h"
 #include "parser.h"
+#include "ast.h"
 
 
 /*
- * <bexpr> ::= <expr> ;
+ * <bexpr> ::= <expr> ; | <name> = <expr> ;
  * <expr> ::=  <term> <ttail>
  * <ttail> ::=  <add_sub_tok> <term> <ttail> | e
  * <term> ::=  <stmt> <stail>
@@ -27,418 +34,575 @@
  * <stmt> ::=  <factor> <ftail>
  * <ftail> ::=  <compare_tok> <factor> <ftail> | e
  * <factor> ::=  <expp> ^ <factor> | <expp>
- * <expp> ::=  ( <expr> ) | <num>
+ * <expp> ::=  ( <expr> ) | <num> | <name>
  * <add_sub_tok> ::=  + | -
  * <mul_div_tok> ::=  * | /
  * <compare_tok> ::=  < | > | <= | >= | != | ==
  * <num> ::=  {0 | 1 | 2 | 3 | 4 | 5 | 6 | 7 | 8 | 9}+
- */
-
-/**
- * bexpr - parses the expression rule from the grammar.
- * @token: the input expression to parse.
+ * <name> ::=  {a-z | A-Z | _} {a-z | A-Z | _ | 0-9}*
  *
- * this function starts the parsing process. It expects a complete expression followed by a semicolon.
- * Returns the result of the expression if it's valid, otherwise returns ERROR.
+ * Names, and with them assignments, are only accepted when the token stream
+ * has variables, as in the -V mode; a name is then resolved to its slot as
+ * the line is parsed.
  */
-int bexpr(char *token){
-    char *tempToken = token;
-    int result = expr(&tempToken);
-
-    if (result == MISSING_CLOSING_PARENTHESIS){
-        return MISSING_CLOSING_PARENTHESIS;
-    }else if (result == ERROR) {
-        return ERROR; // If the expression is invalid, return error
-    }
-    printf("Result is %d", result);
 
-     //Check for the semicolon after the expression
-     if (*tempToken != ';') {
-        return MISSING_SEMICOLON;
-     }
-
-    // Move past the semicolon
-    tempToken++;
-
-    // Check if the expression ends after the semicolon
-    if (*tempToken != '\0') {
-//        fprintf(stderr, "Syntax Error: Unexpected characters after semicolon\n");
-        return ERROR;
-    }
-
-
-    return result;
+/*
+ * current - returns the token under the cursor, or NULL at the end of the line.
+ */
+static const Token *current(TokenStream *ts) {
+    return ts->pos < ts->count ? &ts->tokens[ts->pos] : NULL;
 }
 
-/**
- * expr - parses the <expr> non-terminal of the grammar.
- * @expr: pointer to the string containing the expression to parse.
- *
- * this function parses an expression, which consists of a term and an optional tail (ttail).
- * Returns the computed value of the term combined with any additional terms found in the tail.
+/*
+ * current_is - checks the category of the token under the cursor.
  */
-int expr(char **expr) {
-    int term_val = term(expr);
-    if (term_val == ERROR || term_val == MISSING_CLOSING_PARENTHESIS) 
-        return term_val;
-    
-    int result = ttail(expr, term_val);
-    if (result == ERROR || result == MISSING_CLOSING_PARENTHESIS)
-        return result;
-
-    return result;
+static int current_is(TokenStream *ts, TokenCategory category) {
+    const Token *tok = current(ts);
+    return tok != NULL && tok->category == category;
+}
 
+/*
+ * fail - records a syntax error and returns NULL for the caller to propagate.
+ */
+static Node *fail(TokenStream *ts, int error) {
+    ts->error = error;
+    return NULL;
+}
 
-   
+/*
+ * checked - turns an arena allocation failure into a syntax error result.
+ */
+static Node *checked(TokenStream *ts, Node *node) {
+    return node != NULL ? node : fail(ts, OUT_OF_MEMORY);
 }
 
 /**
- * ttail - parses the <ttail> non-terminal of the grammar.
- * @expr: pointer to the string containing the expression to parse.
- * @acc: accumulated value from previous terms.
+ * error_message - describes an error code.
+ * @status: the error code.
  *
- * This function recursively processes a series of terms connected by addition or subtraction.
- * Returns the cumulative value of these terms.
+ * The plain syntax errors ERROR, MISSING_SEMICOLON and
+ * MISSING_CLOSING_PARENTHESIS have no message; the output shows them.
+ * Returns a static string, or NULL if the code has no message.
  */
-int ttail(char **expr, int acc) {
-
-
-    char op = add_sub_tok(expr);
-
-    while (op != '\0') {
-        int term_val = term(expr);
-        if (term_val == ERROR || term_val == MISSING_CLOSING_PARENTHESIS || term_val == MISSING_SEMICOLON){
-            return term_val;
-        }
-
-        if (op == '+') {
-            acc += term_val; 
-        } else if (op == '-') {
-            acc -= term_val; 
-        }
-
-        op = add_sub_tok(expr);
-
+const char *error_message(int status) {
+    switch (status) {
+        case NO_DIGITS: return "Syntax error: no digits found";
+        case NUMBER_OUT_OF_RANGE: return "Error: number out of range";
+        case DIVISION_BY_ZERO: return "Runtime Error: Division by zero.";
+        case INTEGER_OVERFLOW: return "Runtime Error: Integer overflow.";
+        case EXPONENT_OVERFLOW: return "Error: Exponentiation overflow.";
+        case EXPONENT_OUT_OF_RANGE: return "Error: Exponentiation result out of int range.";
+        case INVALID_OPERATOR: return "Runtime Error: Invalid operator.";
+        case OUT_OF_MEMORY: return "Error: Out of memory.";
+        case UNDEFINED_VARIABLE: return "Error: Undefined variable.";
+        default: return NULL;
     }
-    return acc;
+}
 
+/**
+ * report_error - writes the message of an error code, if it has one.
+ * @file: the stream receiving the message, or NULL to drop it.
+ * @status: the error code, or 0.
+ */
+void report_error(FILE *file, int status) {
+    const char *message = error_message(status);
+    if (file != NULL && message != NULL)
+        fprintf(file, "%s\n", message);
 }
 
 /**
- * term - parses the <term> non-terminal of the grammar.
- * @expr: pointer to the string containing the expression to parse.
+ * bexpr - parses the expression rule from the grammar.
+ * @token: the input expression to parse.
  *
- * this function parses a term, which consists of a statement and an optional tail (stail).
- * Returns the computed value of the statement.
+ * Convenience entry point for a NUL-terminated line: the line is tokenized,
+ * parsed and evaluated, with its debug output on the stdout sink and its
+ * error message on stderr.
+ * Returns the result of the expression if it's valid, otherwise returns ERROR.
  */
-int term(char **expr) {
-    int stmt_val = stmt(expr);
-    if (stmt_val == ERROR || stmt_val == MISSING_CLOSING_PARENTHESIS) {
-        return stmt_val;
-    }
-
-    int result = stail(expr, stmt_val);
-
-    if (result == ERROR || result == MISSING_CLOSING_PARENTHESIS)
-        return result;  // Pass the error up the call stack
+Value bexpr(char *token) {
+    TokenBuffer buf = {0};
+    size_t length = strlen(token);
+    int count = lex_line(&buf, token, length);
+    Value result = count < 0 ? ERROR : bexpr_tokens(token, length, buf.tokens, count);
 
+    free_token_buffer(&buf);
     return result;
 }
 
 /**
- * stail - parses the <stail> non-terminal of the grammar.
- * @expr: pointer to the string containing the expression to parse.
- * @acc: accumulated value from previous statements.
+ * bexpr_tokens - parses and evaluates the tokens of a line.
+ * @text: the line the tokens were read from.
+ * @length: length of the line.
+ * @tokens: the tokens of the line.
+ * @count: the number of tokens.
  *
- * this function recursively processes a series of statements connected by multiplication or division.
- * Returns the cumulative value of these statements.
+ * Returns the result of the expression if it's valid, otherwise returns the
+ * error code.
  */
-int stail(char **expr, int acc) {
-    char op = mul_div_tok(expr);
-
-    while (op != '\0') {
-        int stmt_val = stmt(expr);        
-        
-        if (stmt_val == ERROR || stmt_val == MISSING_CLOSING_PARENTHESIS || stmt_val == MISSING_SEMICOLON) {
-            return stmt_val;
-        }
-
-        //if (op == (char)ERROR) {
-         //   return ERROR;
-        //}
-
-        if (op == '*') {
-            acc *= stmt_val;
-        } else if (op == '/') {
-           if (stmt_val == 0) {
-                fprintf(stderr, "Runtime Error: Division by zero.\n");
-                return ERROR;
-            }
-            acc /= stmt_val;
-        }
+Value bexpr_tokens(const char *text, size_t length, const Token *tokens, int count) {
+    Arena arena = {0};
+    Value value;
+    int status = evaluate_tokens(text, length, tokens, count, &arena, NULL, diag_stdout(),
+                                 &value);
+
+    report_error(stderr, status);
+    arena_free(&arena);
+    return status == 0 ? value : status;
+}
 
-        op = mul_div_tok(expr);
+/**
+ * evaluate_tokens - parses the tokens of a line into a tree and evaluates it.
+ * @text: the line the tokens were read from.
+ * @length: length of the line.
+ * @tokens: the tokens of the line.
+ * @count: the number of tokens.
+ * @arena: arena receiving the tree; the caller resets it between lines.
+ * @variables: the variables the line may name and assign, or NULL to allow
+ * no names.
+ * @diag: sink receiving the debug output, or NULL.
+ * @value: receives the value of the expression.
+ *
+ * Unlike bexpr(), the status is kept apart from the value, so an expression
+ * whose value equals one of the error codes is still reported correctly.
+ * The value of an assignment is the value assigned; the variable is only
+ * assigned if the evaluation succeeds. Nothing is written but the debug
+ * output; error_message() describes the status.
+ * Returns 0 on success, otherwise an error code.
+ */
+int evaluate_tokens(const char *text, size_t length, const Token *tokens, int count,
+                    Arena *arena, Variables *variables, DiagSink *diag, Value *value) {
+    TokenStream ts = { .text = text, .length = length, .tokens = tokens, .count = count,
+                       .arena = arena, .diag = diag, .variables = variables };
+    Node *root = parse_bexpr(&ts);
+    int status;
+
+    if (root == NULL) {
+        return ts.error;
     }
-
-    return acc;
+    if (variables == NULL) {
+        status = eval_node(root, value);
+    } else {
+        status = eval_statement(root, variables->values, value);
+        if (status == 0 && root->kind == NODE_ASSIGN)
+            variables->assigned[root->value] = 1;
+    }
+    if (status != 0) {
+        return status;
+    }
+    DIAG(diag, DIAG_DEBUG, "Result is " VALUE_FORMAT, *value);
+    return 0;
 }
 
-
 /**
- * stmt - parses the <stmt> non-terminal of the grammar.
- * @expr: pointer to the string containing the expression to parse.
+ * evaluate_tokens_dag - parses the tokens of a line into a DAG shared with
+ * the earlier lines, which evaluates it as it is built.
+ * @text: the line the tokens were read from.
+ * @length: length of the line.
+ * @tokens: the tokens of the line.
+ * @count: the number of tokens.
+ * @arena: arena receiving the parser's stacks of deep lines; the caller
+ * resets it between lines.
+ * @dag: the DAG.
+ * @diag: sink receiving the debug output, or NULL.
+ * @value: receives the value of the expression.
  *
- * this function parses a statement, which consists of a factor and an optional tail (ftail).
- * Returns the computed value of the factor.
+ * The status and the value are those evaluate_tokens() finds without
+ * variables; subexpressions already in the DAG are not evaluated again.
+ * Returns 0 on success, otherwise an error code.
  */
-int stmt(char **expr) {
-
-    int factor_val = factor(expr);
-
-    if (factor_val == ERROR) {
-        fprintf(stderr, "Error in stmt: factor returned ERROR\n");
-        return ERROR;
+int evaluate_tokens_dag(const char *text, size_t length, const Token *tokens, int count,
+                        Arena *arena, Dag *dag, DiagSink *diag, Value *value) {
+    TokenStream ts = { .text = text, .length = length, .tokens = tokens, .count = count,
+                       .arena = arena, .diag = diag, .dag = dag };
+    Node *root;
+    int status;
+
+    dag_begin_line(dag);
+    root = parse_bexpr(&ts);
+    if (root == NULL) {
+        return ts.error;
     }
-
-    int result = ftail(expr, factor_val);
-
-    return result;
+    if ((status = dag_value(root, value)) != 0) {
+        return status;
+    }
+    DIAG(diag, DIAG_DEBUG, "Result is " VALUE_FORMAT, *value);
+    return 0;
 }
 
 /**
- * ftail - parses the <ftail> non-terminal of the grammar.
- * @expr: pointer to the string containing the expression to parse.
- * @acc: accumulated value from previous factors.
+ * evaluate_tokens_big - parses the tokens of a line into a tree and evaluates
+ * it with arbitrary precision.
+ * @text: the line the tokens were read from.
+ * @length: length of the line.
+ * @tokens: the tokens of the line.
+ * @count: the number of tokens.
+ * @arena: arena receiving the tree; the caller resets it between lines.
+ * @big: the evaluator.
+ * @diag: sink receiving the debug output, or NULL.
+ * @value: receives the value of the expression if it fits in a Value.
+ * @digits: receives NULL if the value fits, or else its decimal digits, which
+ * the caller frees.
  *
- * function recursively processes a series of factors connected by comparison operators.
- * Returns the boolean result of these comparisons.
+ * Returns 0 on success, otherwise an error code.
  */
-int ftail(char **expr, int acc) {
-    char* comp_op = compare_tok(expr);
-    if (comp_op == NULL) {
-        return acc;
+int evaluate_tokens_big(const char *text, size_t length, const Token *tokens, int count,
+                        Arena *arena, BigEvaluator *big, DiagSink *diag, Value *value,
+                        char **digits) {
+    TokenStream ts = { .text = text, .length = length, .tokens = tokens, .count = count,
+                       .arena = arena, .diag = diag };
+    Node *root = parse_bexpr(&ts);
+    const BigInt *result;
+    size_t digit_count;
+    int status;
+
+    *digits = NULL;
+    if (root == NULL) {
+        return ts.error;
     }
-    
-    int factor_val = factor(expr); 
-    if (factor_val == ERROR) {
-        fprintf(stderr, "Error in ftail: factor returned ERROR\n");
-        return ERROR;
+    if ((status = big_evaluate(big, root, &result)) != 0) {
+        return status;
     }
-
-    int result;
-    if (strcmp(comp_op, "<") == 0) {
-        result =  acc < factor_val;
-    } else if (strcmp(comp_op, ">") == 0) {
-        result = acc > factor_val;
-    } else if (strcmp(comp_op, "<=") == 0) {
-        result = acc <= factor_val;
-    } else if (strcmp(comp_op, ">=") == 0) {
-        result = acc >= factor_val;
-    } else if (strcmp(comp_op, "!=") == 0) {
-        result = acc != factor_val;
-    } else if (strcmp(comp_op, "==") == 0) {
-        result = acc == factor_val;
-    }else{
-        fprintf(stderr, "Runtime Error: Invalid comparison operator.\n");
-        return ERROR;
+    if (big_fits(result, value)) {
+        DIAG(diag, DIAG_DEBUG, "Result is " VALUE_FORMAT, *value);
+        return 0;
     }
-
-    return ftail(expr, result);
-
+    if ((*digits = big_to_decimal(result, &digit_count)) == NULL) {
+        return OUT_OF_MEMORY;
+    }
+    DIAG(diag, DIAG_DEBUG, "Result is %s", *digits);
+    return 0;
 }
 
 /**
- * factor - parses the <factor> non-terminal of the grammar.
- * @expr: pointer to the string containing the expression to parse.
+ * parse_bexpr - parses the <bexpr> non-terminal of the grammar.
+ * @ts: the token stream being parsed.
  *
- * This function parses a factor, which is an exponentiated expression or an expp.
- * Returns the computed value of the exponentiation.
+ * this function starts the parsing process. It expects a complete expression followed by a semicolon
+ * and nothing after it, not even a space or a carriage return, optionally preceded by the name it
+ * is assigned to.
+ * Returns the tree of the expression, or NULL with ts->error set.
  */
-int factor(char **expr) {
-    int base = expp(expr); 
-
-    //if (base == ERROR) {
-      //  return ERROR;
-    //}
-
-    // Check if expp returned ERROR or MISSING_CLOSING_PARENTHESIS
-    if (base == ERROR || base == MISSING_CLOSING_PARENTHESIS) {
-        return base;  // Propagate the error upwards without further processing
+Node *parse_bexpr(TokenStream *ts) {
+    int target = -1;
+
+    // A name and = start an assignment; the name gets a slot even if the line fails
+    if (ts->variables != NULL && current_is(ts, IDENTIFIER) &&
+        ts->pos + 1 < ts->count && ts->tokens[ts->pos + 1].category == ASSIGN_OP) {
+        const Token *tok = current(ts);
+        target = variable_intern(ts->variables, ts->text + tok->start, tok->length);
+        if (target < 0) {
+            return fail(ts, OUT_OF_MEMORY);
+        }
+        ts->pos += 2;
     }
-    
-    while (isspace(**expr)) (*expr)++; 
-    
-    if (**expr == '^') {
-
-        (*expr)++; 
-        while (isspace(**expr)) (*expr)++;
 
-        int exponent = factor(expr); 
+    Node *root = expr(ts);
 
-        if (exponent == ERROR || exponent < 0) {
-            return ERROR;
-        }
+    if (root == NULL) {
+        return NULL;
+    }
 
+     //Check for the semicolon after the expression
+     if (!current_is(ts, SEMI_COLON)) {
+        return fail(ts, MISSING_SEMICOLON);
+     }
 
-        if (exponent > (log(INT_MAX) / log(base)) && base != 0 && base != 1) {
-            fprintf(stderr, "Error: Exponentiation overflow.\n");
-            return ERROR;
-        }
-        
-        errno = 0;
-        double result = pow((double)base, (double)exponent);
+    // Move past the semicolon
+    const Token *semicolon = current(ts);
+    ts->pos++;
 
-        if (errno != 0 || result > INT_MAX || result < INT_MIN) { 
-            fprintf(stderr, "Error: Exponentiation result out of int range.\n");
-            return ERROR;
-        }
-        return (int)result;
+    // Check if the line ends with the semicolon; the lexer drops whitespace,
+    // so trailing blanks and a CR show only in the length of the line
+    if (ts->pos != ts->count || semicolon->start + semicolon->length != ts->length) {
+        return fail(ts, ERROR);
     }
 
-    return base;
+    if (target >= 0) {
+        return checked(ts, new_assign_node(ts->arena, target, root));
+    }
+    return root;
 }
 
-/**
- * expp - parses the <expp> non-terminal of the grammar.
- * @current_expr: pointer to the string containing the expression to parse.
- *
- * function parses an expp, which is either a parenthesized expression or a number.
- * Returns the computed value of the parenthesized expression or the number.
- */
-int expp(char **current_expr) {
-    while (isspace(**current_expr)) (*current_expr)++;
+/* Number of stack entries kept on the C stack before the arena is used */
+#define PARSE_LOCAL_STACK 64
 
-    if (**current_expr == '(') { 
-        (*current_expr)++;
+/* The operator stack holds NODE_NUM to mark an open parenthesis */
+#define OPEN_PAREN NODE_NUM
 
-        int value = expr(current_expr); 
+/* Operator node of each binary operator token, NODE_NUM for other tokens */
+static const unsigned char binary_kind[UNKNOWN + 1] = {
+    [ADD_OP] = NODE_ADD, [SUB_OP] = NODE_SUB,
+    [MULT_OP] = NODE_MUL, [DIV_OP] = NODE_DIV,
+    [LESS_THEN_OP] = NODE_LT, [LESS_THEN_OR_EQUAL_OP] = NODE_LE,
+    [GREATER_THEN_OP] = NODE_GT, [GREATER_THEN_OR_EQUAL_OP] = NODE_GE,
+    [EQUALS_OP] = NODE_EQ, [NOT_EQUALS_OP] = NODE_NE,
+    [EXPON_OP] = NODE_POW,
+};
 
-        printf("Debug: Current char after expr() in expp: '%c'\n", **current_expr); // Debugging output
-        
-        if (value == ERROR) {
-            return ERROR; // Return ERROR if the inner expression is invalid
-        }
-        
-        if (**current_expr != ')') {
-            //fprintf(stderr, "Error: Expected ')' but got '%c'\n", **current_expr);
-            return MISSING_CLOSING_PARENTHESIS;
-        }
-        (*current_expr)++; // Consume the closing parenthesis
-        while (isspace(**current_expr)) (*current_expr)++;
-   
-        return value;
-    } else {
-        return num(current_expr); 
+/*
+ * Binding strength of each operator, one level per non-terminal of the
+ * grammar: <ttail>, <stail>, <ftail> and <factor>. An open parenthesis binds
+ * weakest so that no operator is ever reduced past it.
+ */
+static const unsigned char precedence[] = {
+    [OPEN_PAREN] = 0,
+    [NODE_ADD] = 1, [NODE_SUB] = 1,
+    [NODE_MUL] = 2, [NODE_DIV] = 2,
+    [NODE_LT] = 3, [NODE_LE] = 3, [NODE_GT] = 3,
+    [NODE_GE] = 3, [NODE_EQ] = 3, [NODE_NE] = 3,
+    [NODE_POW] = 4,
+};
+
+/* Operand and operator stacks of the expression parser */
+typedef struct {
+    Node **operands;
+    int operand_count;
+    int operand_capacity;
+    unsigned char *operators;   /* NodeKind of each pending operator */
+    int operator_count;
+    int operator_capacity;
+} ParseStack;
 
+/*
+ * grow - doubles a stack by moving it into the arena. Stacks that outgrow
+ * their space on the C stack live in the arena from then on, so deep lines
+ * reuse the arena's blocks instead of allocating.
+ * Returns the new stack, or NULL with ts->error set when out of memory.
+ */
+static void *grow(TokenStream *ts, const void *items, int *capacity, size_t size) {
+    void *grown = arena_alloc(ts->arena, 2 * (size_t)*capacity * size);
+    if (grown == NULL) {
+        checked(ts, NULL);
+        return NULL;
     }
+    memcpy(grown, items, (size_t)*capacity * size);
+    *capacity *= 2;
+    return grown;
 }
 
-/**
- * add_sub_tok - identifies addition and subtraction tokens.
- * @expr: pointer to the string containing the expression to parse.
- *
- * Returns the addition or subtraction character if found, otherwise returns a null character.
+/*
+ * push_operand - pushes a tree onto the operand stack.
+ * Returns 0 on success, or -1 with ts->error set.
  */
-char add_sub_tok(char **expr) {
-    while (isspace(**expr)) (*expr)++;
+static int push_operand(TokenStream *ts, ParseStack *stack, Node *node) {
+    if (stack->operand_count == stack->operand_capacity &&
+        (stack->operands = grow(ts, stack->operands, &stack->operand_capacity, sizeof(Node *))) == NULL)
+        return -1;
+    stack->operands[stack->operand_count++] = node;
+    return 0;
+}
 
-    char op = **expr;
+/*
+ * push_operator - pushes an operator or an open parenthesis.
+ * Returns 0 on success, or -1 with ts->error set.
+ */
+static int push_operator(TokenStream *ts, ParseStack *stack, unsigned char kind) {
+    if (stack->operator_count == stack->operator_capacity &&
+        (stack->operators = grow(ts, stack->operators, &stack->operator_capacity, 1)) == NULL)
+        return -1;
+    stack->operators[stack->operator_count++] = kind;
+    return 0;
+}
 
-    if (op == '+' || op == '-') {
-        (*expr)++;
-        return op;
+/*
+ * reduce - combines the pending operators that bind at least as tightly as
+ * min_precedence with their operands, stopping at an open parenthesis.
+ * Returns 0 on success, or -1 with ts->error set.
+ */
+static int reduce(TokenStream *ts, ParseStack *stack, int min_precedence) {
+    while (stack->operator_count > 0) {
+        unsigned char kind = stack->operators[stack->operator_count - 1];
+        if (precedence[kind] < min_precedence)
+            break;
+
+        Node *right = stack->operands[--stack->operand_count];
+        Node *left = stack->operands[stack->operand_count - 1];
+        Node *node = ts->dag != NULL ? dag_op(ts->dag, kind, left, right)
+                                     : new_op_node(ts->arena, kind, left, right);
+        if (checked(ts, node) == NULL)
+            return -1;
+        stack->operands[stack->operand_count - 1] = node;
+        stack->operator_count--;
     }
+    return 0;
+}
 
+/*
+ * print_paren_debug - prints the token found where a closing parenthesis may
+ * follow a parenthesized expression.
+ */
+static void print_paren_debug(TokenStream *ts) {
+    const Token *tok = current(ts);
+    DIAG(ts->diag, DIAG_DEBUG, "Debug: Current char after expr() in expp: '%c'\n",
+         tok ? ts->text[tok->start] : '\0');
+}
 
-    return '\0';
+/*
+ * abandon - gives up on an expression after an error, printing the debug
+ * line of every parenthesized expression still open, innermost first.
+ * Returns NULL for the caller to propagate.
+ */
+static Node *abandon(TokenStream *ts, const ParseStack *stack) {
+    for (int i = stack->operator_count - 1; i >= 0; i--) {
+        if (stack->operators[i] == OPEN_PAREN)
+            print_paren_debug(ts);
+    }
+    return NULL;
 }
 
 /**
- * mul_div_tok - identifies multiplication and division tokens.
- * @expr: pointer to the string containing the expression to parse.
+ * expr - parses the <expr> non-terminal of the grammar.
+ * @ts: the token stream being parsed.
  *
- * Returns the multiplication or division character if found, otherwise returns a null character.
+ * The grammar's levels <ttail>, <stail>, <ftail> and <factor> only differ in
+ * which operators they accept, so instead of one function per level the
+ * expression is parsed by precedence climbing over the precedence table
+ * above: operands and pending operators are kept on explicit stacks, and an
+ * operator is combined with its operands once an operator that binds no
+ * tighter follows it (strictly weaker for the right associative ^). Opening
+ * parentheses are pushed as markers that no operator is combined past. The
+ * C stack use is constant however deeply the input nests; stacks deeper
+ * than PARSE_LOCAL_STACK move into the arena.
+ * Returns the tree of the expression, or NULL with ts->error set.
  */
-char mul_div_tok(char **expr) {
-    while (isspace(**expr)) (*expr)++; 
+Node *expr(TokenStream *ts) {
+    Node *local_operands[PARSE_LOCAL_STACK];
+    unsigned char local_operators[PARSE_LOCAL_STACK];
+    ParseStack stack = {
+        local_operands, 0, PARSE_LOCAL_STACK,
+        local_operators, 0, PARSE_LOCAL_STACK,
+    };
+
+    for (;;) {
+        // <expp>: any number of opening parentheses, then a number
+        while (current_is(ts, LEFT_PAREN)) {
+            if (push_operator(ts, &stack, OPEN_PAREN) != 0)
+                return abandon(ts, &stack);
+            ts->pos++;
+        }
+        Node *operand = num(ts);
+        if (operand == NULL || push_operand(ts, &stack, operand) != 0)
+            return abandon(ts, &stack);
+
+        // Then a binary operator, or the end of the innermost open expression
+        for (;;) {
+            const Token *tok = current(ts);
+            unsigned char kind = tok != NULL ? binary_kind[tok->category] : NODE_NUM;
+
+            if (kind != NODE_NUM) {
+                int min_precedence = precedence[kind] + (kind == NODE_POW);
+                if (reduce(ts, &stack, min_precedence) != 0 ||
+                    push_operator(ts, &stack, kind) != 0)
+                    return abandon(ts, &stack);
+                ts->pos++;
+                break;
+            }
 
-    char op = **expr;
-    if (op == '*' || op == '/') {
-        (*expr)++;
-        return op; 
+            if (reduce(ts, &stack, 1) != 0)
+                return abandon(ts, &stack);
+            if (stack.operator_count == 0)
+                return stack.operands[0];
+
+            // The parenthesized expression on top is complete
+            print_paren_debug(ts);
+            stack.operator_count--;
+            if (!current_is(ts, RIGHT_PAREN)) {
+                fail(ts, MISSING_CLOSING_PARENTHESIS);
+                return abandon(ts, &stack);
+            }
+            ts->pos++; // Consume the closing parenthesis
+        }
     }
-
-    return '\0';
 }
 
 /**
- * compare_tok - identifies comparison tokens.
- * @expr: pointer to the string containing the expression to parse.
+ * num - parses the <num> non-terminal of the grammar.
+ * @ts: the token stream being parsed.
  *
- * Returns a pointer to the comparison operator if found, otherwise returns NULL.
+ * this function parses a number, handling potential sign prefixes. A second
+ * sign may follow the first directly, so "--3" is 3 and "+-3" is -3; it
+ * must itself touch the digits. Where names are allowed, a name may stand
+ * in for the number after a single sign.
+ * Returns a literal node holding the parsed number.
  */
-char* compare_tok(char **expr) {
-
-    while (isspace(**expr)) (*expr)++; 
-
-    char first_char = **expr;
-
-    if (first_char == '<' || first_char == '>' || first_char  == '!' || first_char == '=') {
-        char second_char = *(*expr + 1);
-
-        static char result[3] = {'\0', '\0', '\0'};
+Node *num(TokenStream *ts) {
+    int sign = 1;
+    const Token *tok = current(ts);
+
+    if (tok != NULL && (tok->category == ADD_OP || tok->category == SUB_OP)) {
+        sign = (tok->category == SUB_OP) ? -1 : 1;
+        ts->pos++;
+        const Token *next = current(ts);
+
+        // After consuming a sign, there should be no space before the number
+        if (next != NULL && next->start != tok->start + tok->length) {
+            return fail(ts, ERROR); // Syntax error due to space after sign
+        }
+        tok = next;
+
+        // As strtol() did, a second sign may sit between the first and the digits
+        if (tok != NULL && (tok->category == ADD_OP || tok->category == SUB_OP)) {
+            sign *= (tok->category == SUB_OP) ? -1 : 1;
+            ts->pos++;
+            next = current(ts);
+            if (next == NULL || next->category != INT_LITERAL ||
+                next->start != tok->start + tok->length) {
+                return fail(ts, NO_DIGITS);
+            }
+            tok = next;
+        }
+    }
 
-        if (second_char == '=' || (first_char == '!' && second_char == '=')) {
-            result[0] = first_char;
-            result[1] = second_char;
-            *expr += 2;
-            return result; 
-        }else if (first_char == '<' || first_char == '>') {
-            result[0] = first_char;
-            *expr += 1;
+    if (tok != NULL && tok->category == IDENTIFIER && ts->variables != NULL) {
+        return name(ts, sign);
+    }
+    if (tok == NULL || tok->category != INT_LITERAL) {
+        return fail(ts, NO_DIGITS);  // No digits were parsed
+    }
 
-            return result;
+    // A negative literal may reach VALUE_MIN, one beyond -VALUE_MAX
+    UValue limit = (UValue)VALUE_MAX + (sign < 0);
+    UValue value = 0;
+    for (unsigned int i = 0; i < tok->length; i++) {
+        unsigned int digit = ts->text[tok->start + i] - '0';
+        if (value > (limit - digit) / 10) {
+            return fail(ts, NUMBER_OUT_OF_RANGE);  // Number out of the range of a Value
         }
+        value = value * 10 + digit;
     }
 
-    return NULL;
+    ts->pos++;
+    Value literal = sign < 0 ? (Value)(0 - value) : (Value)value;
+    if (ts->dag != NULL)
+        return checked(ts, dag_num(ts->dag, literal));
+    return checked(ts, new_num_node(ts->arena, literal));
 }
 
 /**
- * num - parses the <num> non-terminal of the grammar.
- * @expr: pointer to the string containing the expression to parse.
+ * name - parses the <name> non-terminal of the grammar.
+ * @ts: the token stream being parsed, with the name under the cursor.
+ * @sign: -1 if a minus sign is attached to the name, otherwise 1.
  *
- * this function parses a number, handling potential sign prefixes.
- * Returns the parsed number as an integer.
+ * The name is resolved to its slot here, so evaluating the tree never looks
+ * at its text. A variable that has not been assigned by an earlier line
+ * cannot be read, which the parser can tell because lines are parsed and
+ * evaluated one at a time.
+ * Returns a node reading the variable, negated if it is signed.
  */
-int num(char **expr) {
-    int sign = 1; 
-    while (isspace(**expr)) (*expr)++;
-
-    if (**expr == '+' || **expr == '-') {
-        sign = (**expr == '-') ? -1 : 1;
-        (*expr)++;
-
-        // After consuming a sign, there should be no space before the number       
-        if (isspace(**expr)) {
-            //fprintf(stderr, "Syntax error: unexpected space after sign\n");
-            return ERROR; // Syntax error due to space after sign                   
-        }
-    }
+Node *name(TokenStream *ts, int sign) {
+    const Token *tok = current(ts);
+    int slot = variable_lookup(ts->variables, ts->text + tok->start, tok->length);
 
-   
-    char *next;
-    errno = 0;
-    long value = strtol(*expr, &next, 10);  
-
-    if (*expr == next) {
-        fprintf(stderr, "Syntax error: no digits found\n");
-        return ERROR;  // No digits were parsed
-    } else if (errno == ERANGE) {
-        fprintf(stderr, "Error: number out of range\n");
-        return ERROR;  // Number out of valid long range
+    if (slot < 0 || !ts->variables->assigned[slot]) {
+        return fail(ts, UNDEFINED_VARIABLE);
     }
+    ts->pos++;
 
-    *expr = next;
-    return (int)value * sign;
+    Node *node = checked(ts, new_var_node(ts->arena, slot));
+    if (node == NULL || sign > 0) {
+        return node;
+    }
+    // -name is 0 - name, so negating VALUE_MIN overflows as it should
+    Node *zero = checked(ts, new_num_node(ts->arena, 0));
+    return zero == NULL ? NULL : checked(ts, new_op_node(ts->arena, NODE_SUB, zero, node));
 }
@@ -1,22 +1,57 @@
-#ifndef PARSER_H
-#define PARSER_H
-
-#define ERROR -999999
-#define MISSING_SEMICOLON -999998
-#define MISSING_CLOSING_PARENTHESIS -999997
-
-int bexpr(char *token);
-int expr(char **expr);                                                          
-int ttail(char **expr, int acc);                                                
-int term(char **expr);                                                          
-int stail(char **expr, int acc);                                                
-int stmt(char **expr);                                                          
-int ftail(char **expr, int acc);                                                
-int factor(char **expr);                                                        
-int expp(char **current_expr);                                                          
-char add_sub_tok(char **expr);                                                  
-char mul_div_tok(char **expr);                                                  
-char* compare_tok(char **expr);                                                 
-int num(char **expr);
-
-#endif // PARSER_H
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stdio.h>
+#include "lexer.h"
+#include "ast.h"
+#include "bignum.h"
+#include "variables.h"
+#include "diag.h"
+#include "dag.h"
+
+#define ERROR -999999
+#define MISSING_SEMICOLON -999998
+#define MISSING_CLOSING_PARENTHESIS -999997
+
+/* Finer errors, each reported as ERROR is but carrying its own message */
+#define NO_DIGITS -999996
+#define NUMBER_OUT_OF_RANGE -999995
+#define DIVISION_BY_ZERO -999994
+#define INTEGER_OVERFLOW -999993
+#define EXPONENT_OVERFLOW -999992
+#define EXPONENT_OUT_OF_RANGE -999991
+#define INVALID_OPERATOR -999990
+#define OUT_OF_MEMORY -999989
+#define UNDEFINED_VARIABLE -999988
+
+/* Cursor over the tokens of one line */
+typedef struct {
+    const char *text;       /* The line the tokens refer to */
+    size_t length;          /* Length of the line */
+    const Token *tokens;
+    int count;
+    int pos;                /* Index of the token under the cursor */
+    Arena *arena;           /* Arena receiving the expression tree */
+    int error;              /* Error code once parsing has failed */
+    DiagSink *diag;         /* Sink receiving debug output, or NULL */
+    Variables *variables;   /* Slots of the names, or NULL if names are not allowed */
+    Dag *dag;               /* DAG interning the nodes across lines, or NULL */
+} TokenStream;
+
+Value bexpr(char *token);
+Value bexpr_tokens(const char *text, size_t length, const Token *tokens, int count);
+int evaluate_tokens(const char *text, size_t length, const Token *tokens, int count,
+                    Arena *arena, Variables *variables, DiagSink *diag, Value *value);
+int evaluate_tokens_dag(const char *text, size_t length, const Token *tokens, int count,
+                        Arena *arena, Dag *dag, DiagSink *diag, Value *value);
+int evaluate_tokens_big(const char *text, size_t length, const Token *tokens, int count,
+                        Arena *arena, BigEvaluator *big, DiagSink *diag, Value *value,
+                        char **digits);
+const char *error_message(int status);
+void report_error(FILE *file, int status);
+Node *parse_bexpr(TokenStream *ts);
+Node *expr(TokenStream *ts);
+Node *num(TokenStream *ts);
+Node *name(TokenStream *ts, int sign);
+
+#endif // PARSER_H
@@ -0,0 +1,160 @@
+/*
+ * ring.c - bounded single-producer/single-consumer queue.
+ * The producer publishes an item by storing it and then advancing the tail
+ * with release ordering; the consumer reads the tail with acquire ordering
+ * before loading the item, and hands the slot back the same way through the
+ * head.
+ * A thread that has spun long enough announces itself in sleepers, checks
+ * the queue once more and sleeps on the wakeups futex. The other side,
+ * after advancing its counter, wakes it if sleepers is set. Both sides order
+ * their store before their load with a full fence, so either the sleeper
+ * sees the counter move or the other side sees the sleeper; the fast path
+ * only adds the fence and one load.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "ring.h"
+#include "util.h"
+
+/* Failed attempts spent spinning before a waiting thread sleeps */
+#define SPIN_LIMIT 100
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() ((void)0)
+#endif
+
+/*
+ * can_push - checks whether the producer at tail has a free slot.
+ */
+static int can_push(Ring *ring, size_t tail) {
+    return tail - atomic_load(&ring->head) <= ring->mask;
+}
+
+/*
+ * can_pop - checks whether the consumer at head has an item.
+ */
+static int can_pop(Ring *ring, size_t head) {
+    return atomic_load(&ring->tail) != head;
+}
+
+/*
+ * sleep_until - sleeps until the other side moves, unless it already has.
+ * Returns when the queue may be ready; the caller checks again.
+ */
+static void sleep_until(Ring *ring, int (*ready)(Ring *, size_t), size_t position) {
+    unsigned int wakeups = atomic_load(&ring->wakeups);
+
+    atomic_fetch_add(&ring->sleepers, 1);
+    if (!ready(ring, position))
+        syscall(SYS_futex, (uint32_t *)&ring->wakeups, FUTEX_WAIT_PRIVATE, wakeups,
+                NULL, NULL, 0);
+    atomic_fetch_sub(&ring->sleepers, 1);
+}
+
+/*
+ * wait_until - waits until the queue is ready for the caller, spinning
+ * first and then sleeping, and counts the wait.
+ */
+static void wait_until(Ring *ring, int (*ready)(Ring *, size_t), size_t position,
+                       StallCounter *stalls) {
+    double start = monotonic_seconds();
+
+    for (int attempt = 0; !ready(ring, position); attempt++) {
+        if (attempt < SPIN_LIMIT)
+            cpu_relax();
+        else
+            sleep_until(ring, ready, position);
+    }
+    stalls->stalls++;
+    stalls->seconds += monotonic_seconds() - start;
+}
+
+/*
+ * wake - wakes the other side if it is sleeping, after the caller has
+ * advanced its counter.
+ */
+static void wake(Ring *ring) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->sleepers, memory_order_relaxed) != 0) {
+        atomic_fetch_add(&ring->wakeups, 1);
+        syscall(SYS_futex, (uint32_t *)&ring->wakeups, FUTEX_WAKE_PRIVATE, INT_MAX,
+                NULL, NULL, 0);
+    }
+}
+
+/**
+ * ring_init - initializes an empty queue.
+ * @ring: the queue.
+ * @capacity: the minimum capacity.
+ *
+ * Returns 0 on success, or -1 when out of memory.
+ */
+int ring_init(Ring *ring, size_t capacity) {
+    size_t size = 1;
+    while (size < capacity)
+        size *= 2;
+    ring->items = malloc(size * sizeof(void *));
+    if (ring->items == NULL)
+        return -1;
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->wakeups, 0);
+    atomic_init(&ring->sleepers, 0);
+    return 0;
+}
+
+/**
+ * ring_push - pushes an item, waiting while the queue is full.
+ * @ring: the queue.
+ * @item: the item.
+ * @stalls: counts the wait.
+ */
+void ring_push(Ring *ring, void *item, StallCounter *stalls) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) > ring->mask)
+        wait_until(ring, can_push, tail, stalls);
+
+    ring->items[tail & ring->mask] = item;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    wake(ring);
+}
+
+/**
+ * ring_pop - pops the oldest item, waiting while the queue is empty.
+ * @ring: the queue.
+ * @stalls: counts the wait.
+ *
+ * Returns the item.
+ */
+void *ring_pop(Ring *ring, StallCounter *stalls) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    if (atomic_load_explicit(&ring->tail, memory_order_acquire) == head)
+        wait_until(ring, can_pop, head, stalls);
+
+    void *item = ring->items[head & ring->mask];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    wake(ring);
+    return item;
+}
+
+/**
+ * ring_free - releases the memory held by a queue.
+ * @ring: the queue.
+ */
+void ring_free(Ring *ring) {
+    free(ring->items);
+    ring->items = NULL;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file ring.h
+ * @brief Bounded single-producer/single-consumer queue of pointers. One thread
+ * pushes and one thread pops; the two only share the head and tail counters,
+ * which are C11 atomics on separate cache lines, so neither side ever takes a
+ * lock. A full queue holds the producer back and an empty queue holds the
+ * consumer back. Waiting threads spin briefly and then sleep on a futex
+ * until the other side moves, so a stage waiting on a slow producer, such
+ * as a quiet pipe, uses no CPU. Each wait is counted so a pipeline can tell
+ * which stage limits it.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+typedef struct {
+    void **items;
+    size_t mask;                            /* Capacity - 1; capacity is a power of two */
+    _Alignas(64) atomic_size_t head;        /* Next item to pop, advanced by the consumer */
+    _Alignas(64) atomic_size_t tail;        /* Next free slot, advanced by the producer */
+    _Alignas(64) atomic_uint wakeups;       /* Futex word, bumped to wake a sleeping side */
+    atomic_uint sleepers;                   /* Threads about to sleep or sleeping */
+} Ring;
+
+/**
+ * Time one thread spent waiting on its queues.
+ */
+typedef struct {
+    unsigned long stalls;   /* Number of pushes or pops that had to wait */
+    double seconds;         /* Total time spent waiting */
+} StallCounter;
+
+/**
+ * Initializes an empty queue.
+ *
+ * @param ring The queue.
+ * @param capacity Number of items it can hold, rounded up to a power of two.
+ * @return 0 on success, or -1 when out of memory.
+ */
+int ring_init(Ring *ring, size_t capacity);
+
+/**
+ * Pushes an item, waiting while the queue is full. Called only by the
+ * producer.
+ *
+ * @param ring The queue.
+ * @param item The item; NULL is a valid item.
+ * @param stalls Counts the wait, if any.
+ */
+void ring_push(Ring *ring, void *item, StallCounter *stalls);
+
+/**
+ * Pops the oldest item, waiting while the queue is empty. Called only by the
+ * consumer.
+ *
+ * @param ring The queue.
+ * @param stalls Counts the wait, if any.
+ * @return The item.
+ */
+void *ring_pop(Ring *ring, StallCounter *stalls);
+
+/**
+ * Releases the memory held by a queue.
+ *
+ * @param ring The queue.
+ */
+void ring_free(Ring *ring);
+
+#endif // RING_H
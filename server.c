@@ -0,0 +1,610 @@
+/*
+ * server.c - Unix domain socket server answering batches of expressions.
+ * The calling thread runs an epoll loop over the listening socket, the
+ * connections, an eventfd that the workers write when a request has been
+ * answered, and a signalfd for SIGINT and SIGTERM. Complete requests are
+ * queued for the worker threads, which interpret them into in-memory output
+ * writers; the loop then sends each response as fast as its socket accepts
+ * it. A connection has at most one request with the workers at a time and is
+ * not read from until that response is sent, so a client that sends faster
+ * than it reads is held back instead of filling the server's memory.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#define _GNU_SOURCE    /* accept4 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "server.h"
+#include "batch.h"
+#include "input.h"
+
+/* Events taken from epoll at a time */
+#define MAX_EVENTS 64
+
+/* Bytes a connection reads at a time */
+#define READ_BYTES (64 * 1024)
+
+/* Reads of one connection per event, so a busy client cannot hold up the rest */
+#define MAX_READS 16
+
+/* Most bytes a connection buffers: a request of the largest size */
+#define MAX_BUFFERED (SERVER_HEADER + (size_t)SERVER_MAX_FRAME)
+
+/* Connections waiting to be accepted */
+#define LISTEN_BACKLOG 128
+
+typedef struct Connection Connection;
+
+/* A request handed to the workers, and its response once answered */
+typedef struct Job {
+    struct Job *next;
+    Connection *connection;
+    char *input;            /* The lines of the request */
+    size_t length;
+    OutputWriter output;    /* The response, frame header included */
+    int status;             /* 0, or -1 if the worker ran out of memory */
+} Job;
+
+struct Connection {
+    Connection *prev;
+    Connection *next;
+    int fd;                 /* The socket, or -1 once it has been closed */
+    unsigned int events;    /* Events the socket is watched for */
+    char *input;            /* Bytes received and not yet handed to a job */
+    size_t length;
+    size_t capacity;
+    Job *job;               /* The request with the workers, or NULL */
+    OutputWriter response;  /* The response being sent */
+    size_t sent;
+    int closed;             /* The client will send nothing more */
+};
+
+/* Requests waiting for a worker and requests answered */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;    /* Signaled when a request is queued */
+    Job *pending;
+    Job *pending_tail;
+    Job *done;
+    int stopping;
+    int notify;             /* eventfd written when a request is answered */
+    OutputFormat format;
+} JobQueue;
+
+typedef struct {
+    JobQueue *queue;
+    LineInterpreter interp;
+} ServerWorker;
+
+/* State of the event loop */
+typedef struct {
+    int epoll;
+    Connection *connections;
+    Connection *closed;     /* Closed connections, freed after each wait */
+    JobQueue queue;
+} Server;
+
+/**
+ * frame_length - reads a frame length.
+ * @header: the first SERVER_HEADER bytes of a frame.
+ *
+ * Returns the number of bytes that follow.
+ */
+uint32_t frame_length(const unsigned char *header) {
+    return header[0] | (uint32_t)header[1] << 8 | (uint32_t)header[2] << 16 |
+           (uint32_t)header[3] << 24;
+}
+
+/**
+ * put_frame_length - writes a frame length.
+ * @header: receives SERVER_HEADER bytes.
+ * @length: the number of bytes that follow.
+ */
+void put_frame_length(unsigned char *header, uint32_t length) {
+    header[0] = length;
+    header[1] = length >> 8;
+    header[2] = length >> 16;
+    header[3] = length >> 24;
+}
+
+/*
+ * free_job - releases a job and its buffers.
+ */
+static void free_job(Job *job) {
+    free(job->input);
+    output_free(&job->output);
+    free(job);
+}
+
+/*
+ * answer - interprets the lines of a request into its response frame.
+ */
+static void answer(LineInterpreter *interp, Job *job, OutputFormat format) {
+    unsigned char header[SERVER_HEADER] = {0};
+
+    job->status = -1;
+    if (output_init(&job->output, NULL, format) != 0)
+        return;
+    output_bytes(&job->output, header, SERVER_HEADER);
+
+    const char *line = job->input;
+    const char *end = job->input + job->length;
+    while (line < end) {
+        // The last line of a request may lack its newline
+        const char *newline = find_newline(line, end);
+        if (interpret_line(interp, &job->output, line, newline - line) != 0)
+            return;
+        line = newline + 1;
+    }
+    if (job->output.error || job->output.length - SERVER_HEADER > SERVER_MAX_FRAME)
+        return;
+    put_frame_length((unsigned char *)job->output.buffer, job->output.length - SERVER_HEADER);
+    job->status = 0;
+}
+
+/*
+ * worker_main - answers queued requests until the server stops.
+ */
+static void *worker_main(void *arg) {
+    ServerWorker *worker = arg;
+    JobQueue *queue = worker->queue;
+    uint64_t one = 1;
+
+    pthread_mutex_lock(&queue->lock);
+    for (;;) {
+        while (queue->pending == NULL && !queue->stopping)
+            pthread_cond_wait(&queue->work, &queue->lock);
+        if (queue->stopping)
+            break;
+        Job *job = queue->pending;
+        queue->pending = job->next;
+        pthread_mutex_unlock(&queue->lock);
+
+        answer(&worker->interp, job, queue->format);
+
+        pthread_mutex_lock(&queue->lock);
+        job->next = queue->done;
+        queue->done = job;
+        // The loop drains the counter on every wake, so it cannot overflow
+        (void)!write(queue->notify, &one, sizeof(one));
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return NULL;
+}
+
+/*
+ * watch - sets the events a connection is watched for.
+ * Returns 0 on success, or -1 on failure.
+ */
+static int watch(Server *server, Connection *conn, unsigned int events) {
+    if (conn->events == events)
+        return 0;
+    struct epoll_event event = { .events = events, .data.ptr = conn };
+    conn->events = events;
+    return epoll_ctl(server->epoll, EPOLL_CTL_MOD, conn->fd, &event);
+}
+
+/*
+ * drop - closes a connection. It is freed after the current wait, or once
+ * the workers are done with its request.
+ */
+static void drop(Server *server, Connection *conn) {
+    if (conn->fd < 0)
+        return;
+    epoll_ctl(server->epoll, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    conn->fd = -1;
+
+    if (conn->prev != NULL)
+        conn->prev->next = conn->next;
+    else
+        server->connections = conn->next;
+    if (conn->next != NULL)
+        conn->next->prev = conn->prev;
+    conn->prev = NULL;
+    conn->next = NULL;
+    if (conn->job == NULL) {
+        conn->next = server->closed;
+        server->closed = conn;
+    }
+}
+
+/*
+ * free_connection - releases the buffers of a closed connection.
+ */
+static void free_connection(Connection *conn) {
+    free(conn->input);
+    output_free(&conn->response);
+    free(conn);
+}
+
+/*
+ * accept_connections - accepts every connection waiting on the socket.
+ */
+static void accept_connections(Server *server, int listener) {
+    for (;;) {
+        int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;     // EAGAIN once the backlog is empty; other errors drop the attempt
+
+        Connection *conn = calloc(1, sizeof(Connection));
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = conn };
+        if (conn == NULL || epoll_ctl(server->epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->events = EPOLLIN;
+        conn->next = server->connections;
+        if (conn->next != NULL)
+            conn->next->prev = conn;
+        server->connections = conn;
+    }
+}
+
+/*
+ * receive - reads what the client has sent, up to MAX_READS times. Reading
+ * stops once a whole request of the largest size is buffered; epoll reports
+ * the rest again once a request has been taken out. A frame announcing more
+ * than SERVER_MAX_FRAME bytes is refused as soon as its header arrives.
+ * Returns 0 on success, or -1 on a read error, an oversize frame or when
+ * out of memory.
+ */
+static int receive(Connection *conn) {
+    for (int reads = 0; reads < MAX_READS && conn->length < MAX_BUFFERED; reads++) {
+        if (conn->capacity - conn->length < READ_BYTES && conn->capacity < MAX_BUFFERED) {
+            size_t capacity = conn->capacity ? conn->capacity * 2 : READ_BYTES;
+            while (capacity - conn->length < READ_BYTES)
+                capacity *= 2;
+            if (capacity > MAX_BUFFERED)
+                capacity = MAX_BUFFERED;
+            char *grown = realloc(conn->input, capacity);
+            if (grown == NULL)
+                return -1;
+            conn->input = grown;
+            conn->capacity = capacity;
+        }
+        ssize_t count = read(conn->fd, conn->input + conn->length, conn->capacity - conn->length);
+        if (count > 0) {
+            conn->length += count;
+            if (conn->length >= SERVER_HEADER &&
+                frame_length((const unsigned char *)conn->input) > SERVER_MAX_FRAME)
+                return -1;
+            continue;
+        }
+        if (count == 0) {
+            conn->closed = 1;
+            return 0;
+        }
+        if (errno == EINTR)
+            continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    return 0;
+}
+
+/*
+ * transmit - sends as much of the response as the socket accepts.
+ * Returns 0 on success, or -1 on a write error.
+ */
+static int transmit(Connection *conn) {
+    while (conn->sent < conn->response.length) {
+        ssize_t count = send(conn->fd, conn->response.buffer + conn->sent,
+                             conn->response.length - conn->sent, MSG_NOSIGNAL);
+        if (count >= 0) {
+            conn->sent += count;
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    return 0;
+}
+
+/*
+ * advance - moves a connection on once its response is sent: the next
+ * complete request is queued, or else the socket is read again.
+ * Returns 0 on success, or -1 if the connection is to be closed.
+ */
+static int advance(Server *server, Connection *conn) {
+    if (conn->job != NULL)
+        return watch(server, conn, 0);
+    if (conn->sent < conn->response.length)
+        return watch(server, conn, EPOLLOUT);
+    output_free(&conn->response);
+    conn->sent = 0;
+
+    if (conn->length >= SERVER_HEADER) {
+        uint32_t length = frame_length((const unsigned char *)conn->input);
+        if (length > SERVER_MAX_FRAME)
+            return -1;
+        if (conn->length - SERVER_HEADER >= length) {
+            Job *job = calloc(1, sizeof(Job));
+            if (job == NULL || (job->input = malloc(length ? length : 1)) == NULL) {
+                free(job);
+                return -1;
+            }
+            memcpy(job->input, conn->input + SERVER_HEADER, length);
+            job->length = length;
+            job->connection = conn;
+            conn->length -= SERVER_HEADER + length;
+            memmove(conn->input, conn->input + SERVER_HEADER + length, conn->length);
+            conn->job = job;
+
+            JobQueue *queue = &server->queue;
+            pthread_mutex_lock(&queue->lock);
+            if (queue->pending == NULL)
+                queue->pending = job;
+            else
+                queue->pending_tail->next = job;
+            queue->pending_tail = job;
+            pthread_cond_signal(&queue->work);
+            pthread_mutex_unlock(&queue->lock);
+            return watch(server, conn, 0);
+        }
+    }
+    // A client that has shut down cannot complete a partial request
+    return conn->closed ? -1 : watch(server, conn, EPOLLIN);
+}
+
+/*
+ * service - handles the events of a connection. A client that has shut
+ * down both directions can no longer read its responses, so it is dropped.
+ */
+static void service(Server *server, Connection *conn, unsigned int events) {
+    if (conn->fd < 0)
+        return;
+    if ((events & (EPOLLERR | EPOLLHUP)) ||
+        ((events & EPOLLIN) && receive(conn) != 0) ||
+        ((events & EPOLLOUT) && transmit(conn) != 0) ||
+        advance(server, conn) != 0)
+        drop(server, conn);
+}
+
+/*
+ * collect - takes the answered requests from the workers and starts sending
+ * their responses.
+ */
+static void collect(Server *server) {
+    JobQueue *queue = &server->queue;
+    uint64_t count;
+
+    (void)!read(queue->notify, &count, sizeof(count));
+    pthread_mutex_lock(&queue->lock);
+    Job *job = queue->done;
+    queue->done = NULL;
+    pthread_mutex_unlock(&queue->lock);
+
+    while (job != NULL) {
+        Job *next = job->next;
+        Connection *conn = job->connection;
+        conn->job = NULL;
+        if (conn->fd < 0) {
+            // The client went away while its request was being answered
+            conn->next = server->closed;
+            server->closed = conn;
+        } else if (job->status == 0) {
+            conn->response = job->output;
+            conn->sent = 0;
+            job->output.buffer = NULL;
+            if (transmit(conn) != 0 || advance(server, conn) != 0)
+                drop(server, conn);
+        } else {
+            drop(server, conn);
+        }
+        free_job(job);
+        job = next;
+    }
+}
+
+/*
+ * open_socket - creates the listening socket, replacing a stale socket file.
+ * Returns the socket, or -1 with a message on stderr.
+ */
+static int open_socket(const char *path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    struct stat st;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: Socket path %s is too long.\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Could not create a socket.\n");
+        return -1;
+    }
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        // A socket nobody listens on is left over from a server that died
+        if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0) {
+            fprintf(stderr, "Error: A server is already listening on %s.\n", path);
+            close(fd);
+            return -1;
+        }
+        unlink(path);
+    }
+    close(fd);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(fd, LISTEN_BACKLOG) != 0) {
+        fprintf(stderr, "Error: Could not listen on %s.\n", path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * add_source - watches a descriptor of the server itself, tagged with the
+ * address of the variable holding it.
+ * Returns 0 on success, or -1 on failure.
+ */
+static int add_source(Server *server, int *fd) {
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = fd };
+    return *fd < 0 ? -1 : epoll_ctl(server->epoll, EPOLL_CTL_ADD, *fd, &event);
+}
+
+/**
+ * serve - listens on a Unix domain socket and answers requests until SIGINT
+ * or SIGTERM arrives.
+ * @path: path of the socket.
+ * @threads: number of worker threads.
+ * @cache_bytes: combined cache cap of the workers, or 0 for no caches.
+ * @bignum: nonzero to give each worker an arbitrary-precision evaluator.
+ * @format: format of the responses.
+ *
+ * The signals are blocked before the workers start, so they inherit the
+ * mask and the signals are only ever read from the signalfd.
+ * Returns 0 after a clean shutdown, or 1 on error.
+ */
+int serve(const char *path, int threads, size_t cache_bytes, int bignum, OutputFormat format) {
+    Server server = { .epoll = -1 };
+    ServerWorker *workers = calloc(threads, sizeof(ServerWorker));
+    pthread_t *ids = calloc(threads, sizeof(pthread_t));
+    sigset_t signals, saved;
+    int listener = -1, signals_fd = -1, started = 0, status = 1;
+
+    server.queue.notify = -1;
+    server.queue.format = format;
+    pthread_mutex_init(&server.queue.lock, NULL);
+    pthread_cond_init(&server.queue.work, NULL);
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &saved);
+
+    if (workers == NULL || ids == NULL) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        goto done;
+    }
+    if ((listener = open_socket(path)) < 0)
+        goto done;
+    server.epoll = epoll_create1(EPOLL_CLOEXEC);
+    server.queue.notify = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    signals_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (server.epoll < 0 || add_source(&server, &listener) != 0 ||
+        add_source(&server, &server.queue.notify) != 0 || add_source(&server, &signals_fd) != 0) {
+        fprintf(stderr, "Error: Could not set up the event loop.\n");
+        goto done;
+    }
+
+    for (; started < threads; started++) {
+        ServerWorker *worker = &workers[started];
+        worker->queue = &server.queue;
+        if (cache_bytes > 0 && (worker->interp.cache = cache_create(cache_bytes / threads)) == NULL)
+            break;
+        if (bignum && (worker->interp.big = big_create()) == NULL) {
+            cache_destroy(worker->interp.cache);
+            break;
+        }
+        if (pthread_create(&ids[started], NULL, worker_main, worker) != 0) {
+            cache_destroy(worker->interp.cache);
+            big_destroy(worker->interp.big);
+            break;
+        }
+    }
+    if (started == 0) {
+        fprintf(stderr, "Error: Could not start the workers.\n");
+        goto done;
+    }
+    fprintf(stderr, "Listening on %s with %d threads.\n", path, started);
+
+    struct epoll_event events[MAX_EVENTS];
+    status = 0;
+    for (int running = 1; running; ) {
+        int count = epoll_wait(server.epoll, events, MAX_EVENTS, -1);
+        if (count < 0 && errno != EINTR) {
+            status = 1;
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            void *tag = events[i].data.ptr;
+            if (tag == &listener)
+                accept_connections(&server, listener);
+            else if (tag == &server.queue.notify)
+                collect(&server);
+            else if (tag == &signals_fd) {
+                // Consume the signal so restoring the mask does not deliver it
+                struct signalfd_siginfo info;
+                (void)!read(signals_fd, &info, sizeof(info));
+                running = 0;
+            }
+            else
+                service(&server, tag, events[i].events);
+        }
+        while (server.closed != NULL) {
+            Connection *conn = server.closed;
+            server.closed = conn->next;
+            free_connection(conn);
+        }
+    }
+
+done:
+    pthread_mutex_lock(&server.queue.lock);
+    server.queue.stopping = 1;
+    pthread_cond_broadcast(&server.queue.work);
+    pthread_mutex_unlock(&server.queue.lock);
+    for (int i = 0; i < started; i++) {
+        pthread_join(ids[i], NULL);
+        if (workers[i].interp.cache != NULL) {
+            cache_report(workers[i].interp.cache, stderr);
+            cache_destroy(workers[i].interp.cache);
+        }
+        big_destroy(workers[i].interp.big);
+        free_line_interpreter(&workers[i].interp);
+    }
+
+    // Every job is now queued or answered; connections dropped meanwhile
+    // are freed with their job
+    Job *lists[] = { server.queue.pending, server.queue.done };
+    for (int i = 0; i < 2; i++) {
+        for (Job *job = lists[i]; job != NULL; ) {
+            Job *next = job->next;
+            if (job->connection->fd < 0)
+                free_connection(job->connection);
+            free_job(job);
+            job = next;
+        }
+    }
+    while (server.connections != NULL) {
+        Connection *conn = server.connections;
+        server.connections = conn->next;
+        close(conn->fd);
+        free_connection(conn);
+    }
+    if (listener >= 0) {
+        close(listener);
+        unlink(path);
+    }
+    if (signals_fd >= 0)
+        close(signals_fd);
+    if (server.queue.notify >= 0)
+        close(server.queue.notify);
+    if (server.epoll >= 0)
+        close(server.epoll);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    pthread_mutex_destroy(&server.queue.lock);
+    pthread_cond_destroy(&server.queue.work);
+    free(workers);
+    free(ids);
+    return status;
+}
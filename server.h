@@ -0,0 +1,68 @@
+/**
+ * @file server.h
+ * @brief Long-running server mode. Instead of starting the interpreter for
+ * every batch of expressions, clients connect to a Unix domain socket and
+ * send batches as requests; each is answered with the output that the
+ * interpreter would have written for an input file holding the batch, in the
+ * server's output format.
+ *
+ * Requests and responses are frames: a 4-byte little-endian length followed
+ * by that many bytes. A request holds lines of input separated by newlines,
+ * and its response holds their records. A client may send several requests
+ * without waiting; the responses come back in the order of the requests.
+ * A frame longer than SERVER_MAX_FRAME bytes closes the connection.
+ *
+ * One thread waits on every connection with epoll and hands complete
+ * requests to a pool of worker threads, each with its own buffers, cache and
+ * evaluator, so no connection can hold up the others while it sends.
+ * Nothing is written to stdout, and error messages are not written at all.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "output.h"
+
+/* Largest request or response accepted, in bytes */
+#define SERVER_MAX_FRAME (64u * 1024 * 1024)
+
+/* Bytes of the length that starts every frame */
+#define SERVER_HEADER 4
+
+/**
+ * Listens on a Unix domain socket and answers requests until SIGINT or
+ * SIGTERM arrives. A stale socket file left at the path is replaced.
+ *
+ * @param path Path of the socket.
+ * @param threads Number of worker threads.
+ * @param cache_bytes If not 0, each worker caches results within an equal
+ * share of this many bytes and its counters are written to stderr at exit.
+ * @param bignum If not 0, each worker evaluates with arbitrary precision.
+ * @param format Format of the responses.
+ * @return 0 after a clean shutdown, or 1 if the socket cannot be set up or
+ * memory runs out.
+ */
+int serve(const char *path, int threads, size_t cache_bytes, int bignum, OutputFormat format);
+
+/**
+ * Reads a frame length.
+ *
+ * @param header The first SERVER_HEADER bytes of a frame.
+ * @return The number of bytes that follow.
+ */
+uint32_t frame_length(const unsigned char *header);
+
+/**
+ * Writes a frame length.
+ *
+ * @param header Receives SERVER_HEADER bytes.
+ * @param length The number of bytes that follow.
+ */
+void put_frame_length(unsigned char *header, uint32_t length);
+
+#endif // SERVER_H
@@ -0,0 +1,308 @@
+/*
+ * stats.c - instrumentation counters of serial runs.
+ * The clock is the time stamp counter where there is one, since reading it
+ * takes a few nanoseconds where clock_gettime() takes tens; the summary
+ * converts ticks to nanoseconds with the rate measured between stats_init()
+ * and stats_write(). The latency histogram is HDR-style: values below 32
+ * ticks have a bucket each, and every power of two above is split into 32
+ * equal buckets, so a bucket is found with one count of leading zeros.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+#include "parser.h"
+#include "output.h"
+#include "util.h"
+
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif
+
+/* Names of the statuses in the summary, indexed as by status_index() */
+static const char *const status_names[STATS_STATUSES] = {
+    "ok", "blank", "lexical_error", "error", "missing_semicolon",
+    "missing_closing_parenthesis", "no_digits", "number_out_of_range",
+    "division_by_zero", "integer_overflow", "exponent_overflow",
+    "exponent_out_of_range", "invalid_operator", "out_of_memory",
+    "undefined_variable",
+};
+
+/* Percentiles of the latency in the summary, in thousandths */
+static const int percentiles[] = { 500, 900, 990, 999 };
+static const char *const percentile_names[] = { "p50", "p90", "p99", "p999" };
+
+/**
+ * stats_now - reads the clock of the instrumentation.
+ *
+ * Returns the current tick.
+ */
+uint64_t stats_now(void) {
+#ifdef __x86_64__
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+/**
+ * stats_init - clears the counters and starts the clock.
+ * @stats: the counters.
+ */
+void stats_init(Stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->min_ticks = UINT64_MAX;
+    stats->start_seconds = monotonic_seconds();
+    stats->start_ticks = stats_now();
+}
+
+/**
+ * stats_mark - charges the ticks since the last mark to a phase.
+ * @stats: the counters.
+ * @phase: the phase that just ended.
+ * @tick: the tick of the last mark, updated to the current tick.
+ *
+ * Returns the ticks charged.
+ */
+uint64_t stats_mark(Stats *stats, Phase phase, uint64_t *tick) {
+    uint64_t now = stats_now();
+    uint64_t ticks = now - *tick;
+    stats->phase_ticks[phase] += ticks;
+    *tick = now;
+    return ticks;
+}
+
+/*
+ * bucket_index - finds the histogram bucket of a count of ticks.
+ */
+static int bucket_index(uint64_t ticks) {
+    if (ticks < (1u << STATS_SUB_BITS))
+        return ticks;
+    int exponent = 63 - __builtin_clzll(ticks);
+    int shift = exponent - STATS_SUB_BITS;
+    return ((shift + 1) << STATS_SUB_BITS) + ((ticks >> shift) & ((1u << STATS_SUB_BITS) - 1));
+}
+
+/*
+ * bucket_middle - finds the middle of the range of counts in a bucket.
+ */
+static double bucket_middle(int index) {
+    if (index < (1 << STATS_SUB_BITS))
+        return index;
+    int shift = (index >> STATS_SUB_BITS) - 1;
+    uint64_t low = (uint64_t)((1 << STATS_SUB_BITS) + (index & ((1 << STATS_SUB_BITS) - 1))) << shift;
+    return low + ((uint64_t)1 << shift) / 2.0;
+}
+
+/*
+ * status_index - maps the status of a line to its counter.
+ */
+static int status_index(int status) {
+    if (status >= 0 && status <= STATS_LEXICAL_ERROR)
+        return status;
+    if (status < ERROR || status > UNDEFINED_VARIABLE)
+        status = ERROR;
+    return 3 + (status - ERROR);
+}
+
+/*
+ * sift_down - restores the min-heap of slow lines below an entry.
+ */
+static void sift_down(SlowLine *heap, int count, int i) {
+    for (;;) {
+        int smallest = i;
+        int left = 2 * i + 1, right = left + 1;
+        if (left < count && heap[left].ticks < heap[smallest].ticks)
+            smallest = left;
+        if (right < count && heap[right].ticks < heap[smallest].ticks)
+            smallest = right;
+        if (smallest == i)
+            return;
+        SlowLine swap = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = swap;
+        i = smallest;
+    }
+}
+
+/*
+ * keep_slow - keeps a line if it is among the slowest so far.
+ */
+static void keep_slow(Stats *stats, const char *line, size_t length, uint64_t ticks) {
+    SlowLine *heap = stats->slowest;
+    SlowLine *slot;
+    int i;
+
+    if (stats->slow_count < STATS_SLOWEST) {
+        // Sift the new line up from the end
+        i = stats->slow_count++;
+        while (i > 0 && heap[(i - 1) / 2].ticks > ticks) {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        slot = &heap[i];
+    } else if (ticks > heap[0].ticks) {
+        slot = &heap[0];
+    } else {
+        return;
+    }
+
+    slot->ticks = ticks;
+    slot->number = stats->lines;
+    slot->length = length;
+    memcpy(slot->text, line, length < STATS_TEXT ? length : STATS_TEXT);
+    if (slot == &heap[0] && stats->slow_count == STATS_SLOWEST)
+        sift_down(heap, stats->slow_count, 0);
+}
+
+/**
+ * stats_line - records a line that has been interpreted.
+ * @stats: the counters.
+ * @line: the line.
+ * @length: length of the line.
+ * @status: status of the line.
+ * @ticks: latency of the line.
+ */
+void stats_line(Stats *stats, const char *line, size_t length, int status, uint64_t ticks) {
+    stats->lines++;
+    stats->statuses[status_index(status)]++;
+    stats->histogram[bucket_index(ticks)]++;
+    stats->total_ticks += ticks;
+    if (ticks < stats->min_ticks)
+        stats->min_ticks = ticks;
+    if (ticks > stats->max_ticks)
+        stats->max_ticks = ticks;
+    keep_slow(stats, line, length, ticks);
+}
+
+/*
+ * whole_sequences - shortens the kept start of a longer line so it does not
+ * end inside a UTF-8 sequence.
+ * Returns the length of the text to write.
+ */
+static size_t whole_sequences(const char *text, size_t length) {
+    size_t start = length;
+
+    // Find the lead byte of the last sequence, at most 3 bytes back
+    while (start > 0 && length - start < 3 && ((unsigned char)text[start - 1] & 0xc0) == 0x80)
+        start--;
+    if (start == 0)
+        return length;
+    unsigned char lead = text[start - 1];
+    size_t count = lead >= 0xf0 ? 4 : lead >= 0xe0 ? 3 : lead >= 0xc0 ? 2 : 1;
+    return length - (start - 1) < count ? start - 1 : length;
+}
+
+/*
+ * write_text - writes text as a JSON string, with U+FFFD in place of each
+ * byte that is not valid UTF-8.
+ */
+static void write_text(FILE *file, const char *text, size_t length) {
+    fputc('"', file);
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = text[i];
+        size_t count;
+        if (c == '"' || c == '\\')
+            fprintf(file, "\\%c", c);
+        else if (c < 0x20 || c == 0x7f)
+            fprintf(file, "\\u%04x", c);
+        else if (c < 0x80)
+            fputc(c, file);
+        else if ((count = utf8_sequence(text + i, length - i)) == 0)
+            fputs("\\ufffd", file);
+        else {
+            fwrite(text + i, 1, count, file);
+            i += count - 1;
+        }
+    }
+    fputc('"', file);
+}
+
+/*
+ * slower - orders slow lines from the slowest, then by line number.
+ */
+static int slower(const void *a, const void *b) {
+    const SlowLine *x = a, *y = b;
+    if (x->ticks != y->ticks)
+        return x->ticks < y->ticks ? 1 : -1;
+    return x->number < y->number ? -1 : x->number > y->number;
+}
+
+/**
+ * stats_write - writes the summary of a run as JSON.
+ * @stats: the counters.
+ * @file: the file receiving the summary.
+ *
+ * Returns 0 on success, or -1 on a write error.
+ */
+int stats_write(const Stats *stats, FILE *file) {
+    double seconds = monotonic_seconds() - stats->start_seconds;
+    uint64_t ticks = stats_now() - stats->start_ticks;
+    double ns_per_tick = ticks > 0 ? seconds * 1e9 / ticks : 0;
+    uint64_t phase_total = 0;
+
+    fprintf(file, "{\"lines\":%lu,\"seconds\":%.6f,\"lines_per_second\":%.0f,",
+            stats->lines, seconds, seconds > 0 ? stats->lines / seconds : 0);
+    fprintf(file, "\"ns_per_tick\":%.4f,\"phases\":{", ns_per_tick);
+    static const char *const phase_names[NUM_PHASES] = { "read", "lex", "evaluate", "output" };
+    for (int p = 0; p < NUM_PHASES; p++)
+        phase_total += stats->phase_ticks[p];
+    for (int p = 0; p < NUM_PHASES; p++)
+        fprintf(file, "%s\"%s\":{\"ticks\":%llu,\"ns\":%.0f,\"share\":%.4f}", p ? "," : "",
+                phase_names[p], (unsigned long long)stats->phase_ticks[p],
+                stats->phase_ticks[p] * ns_per_tick,
+                phase_total ? (double)stats->phase_ticks[p] / phase_total : 0);
+
+    fprintf(file, "},\"latency_ns\":{\"count\":%lu", stats->lines);
+    if (stats->lines > 0) {
+        fprintf(file, ",\"min\":%.0f,\"mean\":%.1f", stats->min_ticks * ns_per_tick,
+                (double)stats->total_ticks / stats->lines * ns_per_tick);
+        int bucket = 0;
+        uint64_t seen = stats->histogram[0];
+        for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+            // The line at or above which a share of the lines lies
+            uint64_t rank = (stats->lines * (uint64_t)percentiles[i] + 999) / 1000;
+            while (seen < rank)
+                seen += stats->histogram[++bucket];
+            // A bucket may reach past the extremes it holds
+            double middle = bucket_middle(bucket);
+            if (middle > stats->max_ticks)
+                middle = stats->max_ticks;
+            if (middle < stats->min_ticks)
+                middle = stats->min_ticks;
+            fprintf(file, ",\"%s\":%.0f", percentile_names[i], middle * ns_per_tick);
+        }
+        fprintf(file, ",\"max\":%.0f", stats->max_ticks * ns_per_tick);
+    }
+
+    fputs("},\"statuses\":{", file);
+    int first = 1;
+    for (int s = 0; s < STATS_STATUSES; s++) {
+        if (stats->statuses[s] == 0)
+            continue;
+        fprintf(file, "%s\"%s\":%lu", first ? "" : ",", status_names[s], stats->statuses[s]);
+        first = 0;
+    }
+
+    SlowLine slowest[STATS_SLOWEST];
+    memcpy(slowest, stats->slowest, stats->slow_count * sizeof(SlowLine));
+    qsort(slowest, stats->slow_count, sizeof(SlowLine), slower);
+    fputs("},\"slowest\":[", file);
+    for (int i = 0; i < stats->slow_count; i++) {
+        const SlowLine *slow = &slowest[i];
+        fprintf(file, "%s{\"line\":%lu,\"ns\":%.0f,\"length\":%zu,\"text\":", i ? "," : "",
+                slow->number, slow->ticks * ns_per_tick, slow->length);
+        if (slow->length <= STATS_TEXT)
+            write_text(file, slow->text, slow->length);
+        else
+            write_text(file, slow->text, whole_sequences(slow->text, STATS_TEXT));
+        fputc('}', file);
+    }
+    fputs("]}\n", file);
+    return fflush(file) == 0 && !ferror(file) ? 0 : -1;
+}
@@ -0,0 +1,125 @@
+/**
+ * @file stats.h
+ * @brief Instrumentation of serial runs (the -S option). When enabled, the
+ * interpreter reads a cycle counter at the boundaries of the phases of each
+ * line and charges the time between them to reading, lexing, evaluation or
+ * output formatting. Each line's latency, from lexing to its record, goes
+ * into a histogram with logarithmic buckets of 32 linear steps, so
+ * percentiles are within about 3%; the statuses of the lines are counted,
+ * and the slowest lines are kept with their text. The summary is one JSON
+ * object.
+ *
+ * Instrumentation is off when the interpreter has no Stats, and then costs
+ * one test of a pointer per phase.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Phases the time of a run is charged to */
+typedef enum {
+    PHASE_READ,         /* Finding the next line of the input */
+    PHASE_LEX,          /* Lexing the line and checking for lexical errors */
+    PHASE_EVALUATE,     /* Cache lookup, parsing and evaluation */
+    PHASE_OUTPUT,       /* Formatting the record, and writing full buffers */
+    NUM_PHASES
+} Phase;
+
+/* Statuses of lines besides 0 and the error codes of parser.h */
+#define STATS_BLANK 1
+#define STATS_LEXICAL_ERROR 2
+
+/* Slowest lines kept */
+#define STATS_SLOWEST 10
+
+/* Bytes of the text of a slow line kept */
+#define STATS_TEXT 80
+
+/* Sub-buckets of each power of two in the latency histogram */
+#define STATS_SUB_BITS 5
+
+/* Buckets of the latency histogram, covering every 64-bit count of ticks */
+#define STATS_BUCKETS ((64 - STATS_SUB_BITS + 1) << STATS_SUB_BITS)
+
+/* Statuses counted: ok, blank, lexical error and the error codes */
+#define STATS_STATUSES 15
+
+/* A line among the slowest */
+typedef struct {
+    uint64_t ticks;
+    unsigned long number;   /* Line number, from 1 */
+    size_t length;          /* Length of the whole line */
+    char text[STATS_TEXT];  /* Start of the line */
+} SlowLine;
+
+/**
+ * Counters of a run. Initialize with stats_init().
+ */
+typedef struct {
+    uint64_t phase_ticks[NUM_PHASES];
+    unsigned long lines;
+    unsigned long statuses[STATS_STATUSES];
+    uint64_t histogram[STATS_BUCKETS];
+    uint64_t min_ticks;
+    uint64_t max_ticks;
+    uint64_t total_ticks;   /* Sum of the latencies of the lines */
+    SlowLine slowest[STATS_SLOWEST]; /* Min-heap on ticks */
+    int slow_count;
+    uint64_t start_ticks;
+    double start_seconds;
+} Stats;
+
+/**
+ * Clears the counters and starts the clock of the run.
+ *
+ * @param stats The counters.
+ */
+void stats_init(Stats *stats);
+
+/**
+ * Reads the clock of the instrumentation: the time stamp counter on x86-64,
+ * or else a monotonic clock in nanoseconds.
+ *
+ * @return The current tick.
+ */
+uint64_t stats_now(void);
+
+/**
+ * Charges the ticks since the last mark to a phase.
+ *
+ * @param stats The counters.
+ * @param phase The phase that just ended.
+ * @param tick The tick of the last mark; receives the current tick.
+ * @return The ticks charged.
+ */
+uint64_t stats_mark(Stats *stats, Phase phase, uint64_t *tick);
+
+/**
+ * Records a line that has been interpreted.
+ *
+ * @param stats The counters.
+ * @param line The line.
+ * @param length Length of the line in bytes.
+ * @param status 0, STATS_BLANK, STATS_LEXICAL_ERROR or an error code.
+ * @param ticks Latency of the line.
+ */
+void stats_line(Stats *stats, const char *line, size_t length, int status, uint64_t ticks);
+
+/**
+ * Writes the summary of a run as one JSON object on a line. Ticks are
+ * converted to nanoseconds with the rate measured over the run.
+ *
+ * @param stats The counters.
+ * @param file File receiving the summary.
+ * @return 0 on success, or -1 on a write error.
+ */
+int stats_write(const Stats *stats, FILE *file);
+
+#endif // STATS_H
@@ -1,7 +1,8 @@
 
 /**                                                                             
  * tokenizer.c - A simple token recognizer.                                     
- * This program tokenizes given input based on regular expressions.                                                                            
+ * This program tokenizes given input with the table-driven lexer in lexer.c,
+ * streaming the input through it so no line is too long to tokenize.
  * NOTE: The terms 'token' and 'lexeme' are used interchangeably in this        
  *       program.                                                               
  *                                                                              
@@ -12,155 +13,131 @@
 #include <stdio.h>                                                              
 #include <string.h>                                                             
 #include <stdlib.h>                                                             
-#include <pcre.h>                                                               
 #include <ctype.h>                                                              
 #include "tokenizer.h"                                                          
+#include "lexer.h"
+#include "diag.h"
 #include <stdbool.h>                                                            
                                                                                 
-// global variables                                                             
-char *line; // Global pointer to the line of input                                                                                       
-FILE  *out_file = NULL; // File pointer for output file                                                         
-int count; //Global variable that counts lexemes                                                    
-                                                                                
 // Function prototypes                                                          
-void get_token(char *token_ptr);                                                
-                                                                                
-/**                                                                             
- * Main function of the tokenizer.                                              
- * Opens the input and output files, reads the input file                       
- * line by line, and processes each line.                                       
- *                                                                              
- * @param argc Number of command line arguments                                 
- * @param argv Array of command line arguments                                  
- * @return Exit status code                                                     
- */                                                                             
-int main(int argc, char *argv[])                                                
-{                                                                               
-  char token[TSIZE];     /* Spot to hold a token, fixed size */                 
-  char input_line[LINE]; /* Line of input, fixed size        */                 
-  FILE *in_file = NULL;  /* File pointer                     */                 
-  int start = 0;                                                                
-                                                                                
-                                                                                
-  if (argc != 3)                                                                
-  {                                                                             
-    printf("Usage: tokenizer inputFile outputFile\n");                          
-    exit(1);                                                                    
-  }                                                                             
-                                                                                
-  in_file = fopen(argv[1], "r");                                                
-  if (in_file == NULL)                                                          
-  {                                                                             
-    fprintf(stderr, "ERROR: could not open %s for reading\n", argv[1]);         
-    exit(1);                                                                    
-  }                                                                             
-                                                                                
-  out_file = fopen(argv[2], "w");                                               
-  if (out_file == NULL)                                                         
-  {                                                                             
-    fprintf(stderr, "ERROR: could not open %s for writing\n", argv[2]);         
-    exit(1);                                                                    
-  }                                                                             
-                                                                                
-  // (optional) can add some code here if you want some here                    
-                                                                                
-  count = 0; //lexeme count is 0                                                                              
-  while (fgets(input_line, LINE, in_file) != NULL)                              
-  {                                                                             
-    // Add code here. Keep this file no longer than 50 lines of code.           
-    // Use helper functions.                                                    
-    line = input_line;                                                          
-   // start = TRUE;                                                             
-                                                                                
-    get_token(line);                                                            
-    // Output the statement number                                                                                                                           
-                                                                                
+void get_token(char *token_ptr, FILE* out_file);
                                                                                 
-  }                                                                             
-                                                                                
-  fclose(in_file);                                                              
-  fclose(out_file);                                                             
-  return 0;                                                                     
-                                                                                
-}                                                                               
-  /**                                                                           
-   * Tokenizes a given string based on predefined                               
-   * regular expressions.                                                       
+#ifndef TOKENIZER_NO_MAIN
+/* Bytes of input read at a time; lines and lexemes may be longer */
+#define CHUNK_SIZE 65536
+
+/*
+ * print_piece - prints a piece of a lexeme as get_token() prints the
+ * lexeme: lexemes on stdout, and unknown text as a lexical error in the
+ * output file. Unknown text split into pieces is written as it comes, with
+ * the prefix report_lexical_error() writes.
+ */
+static void print_piece(const LexPiece *piece, FILE *out_file)
+{
+  int first = (piece->flags & LEX_FIRST) != 0;
+  int last = (piece->flags & LEX_LAST) != 0;
+
+  if (piece->category != UNKNOWN) {
+    DIAG(diag_stdout(), DIAG_DEBUG, "%s%.*s%s", first ? "This is Lexeme: " : "",
+         (int)piece->length, piece->text, last ? "\n" : "");
+    return;
+  }
+  if (first && last) {
+    report_lexical_error(out_file, piece->text, piece->length);
+    return;
+  }
+  if (first)
+    fputs(LEXICAL_ERROR_PREFIX, out_file);
+  fwrite(piece->text, 1, piece->length, out_file);
+  if (last)
+    fputc('\n', out_file);
+}
+
+/**
+ * Main function of the tokenizer.
+ * Opens the input and output files and streams the input file through the
+ * lexer a chunk at a time, so lines and lexemes of any length are
+ * tokenized in constant memory.
+ *
+ * @param argc Number of command line arguments
+ * @param argv Array of command line arguments
+ * @return Exit status code
+ */
+int main(int argc, char *argv[])
+{
+  static char chunk[CHUNK_SIZE]; /* Input being tokenized   */
+  FILE *in_file = NULL;          /* File pointer            */
+  FILE *out_file = NULL;         /* Output file             */
+  LexStream stream;              /* Lexer state across chunks */
+  LexPiece piece;
+  size_t length;
+
+  if (argc != 3)
+  {
+    printf("Usage: tokenizer inputFile outputFile\n");
+    exit(1);
+  }
+
+  in_file = fopen(argv[1], "r");
+  if (in_file == NULL)
+  {
+    fprintf(stderr, "ERROR: could not open %s for reading\n", argv[1]);
+    exit(1);
+  }
+
+  out_file = fopen(argv[2], "w");
+  if (out_file == NULL)
+  {
+    fprintf(stderr, "ERROR: could not open %s for writing\n", argv[2]);
+    exit(1);
+  }
+
+  lex_stream_init(&stream, 0);
+  do
+  {
+    length = fread(chunk, 1, CHUNK_SIZE, in_file);
+    if (length > 0)
+      lex_stream_feed(&stream, chunk, length);
+    else
+      lex_stream_end(&stream);
+    while (lex_stream_next(&stream, &piece))
+      print_piece(&piece, out_file);
+  } while (length > 0);
+
+  fclose(in_file);
+  fclose(out_file);
+  return 0;
+}
+#endif // TOKENIZER_NO_MAIN
+  /**
+   * Tokenizes a given string with the table-driven
+   * lexer.
    *                                                                            
    * It finds all the tokens in the given string and                            
    * prints them to the output file.                                            
    *                                                                            
    * @param token_ptr Pointer to the string to be tokenized                     
    */                                                                           
- void get_token(char *token_ptr, FILE* out_file)                                                
- {                                                                              
-                                                                                
-    const char *error;                                                          
-    int erroffset;                                                              
-    pcre *re;                                                                   
-    int ovector[30], rc;                                                        
-                                                                                
-    // Pattern to match numbers, single and double character operators          
-    char *pattern = "(\\d+|!=|==|<=|>=|[=+\\-*/^<>();])";                       
-                                                                                
-    // Compile the regular expression pattern                                   
-    re = pcre_compile(pattern, 0, &error, &erroffset, NULL);                    
-                                                                                
-    if (re == NULL)                                                             
-    {                                                                           
-      printf("PCRE compilation failed at offset %d: %s\n", erroffset, error);   
-      exit(EXIT_FAILURE);                                                       
-    }                                                                           
-                                                                                
-    // Execute the regular expression and find matches                          
-    int i = 0;                                                                  
-    int previous_end = 0; // Track end of the last match                        
-    int  statement = 0;                                                         
-    while ((rc = pcre_exec(re, NULL, token_ptr, strlen(token_ptr), i, 0,        
-        ovector, sizeof(ovector)/sizeof(ovector[0]))) >= 0) {                   
-         // Handle non-matching segment before this match                       
-        if (ovector[0] > previous_end && isNotWhitespaceOrTab(token_ptr +       
-            previous_end)) {                                                    
-            // There's a non-matching segment before this match                 
-            int nonmatch_length = ovector[0] - previous_end;                    
-            char nonmatch[128]; // Ensure this is adequately sized              
-            strncpy(nonmatch, token_ptr + previous_end, nonmatch_length);       
-            nonmatch[nonmatch_length] = '\0';                                   
-                                                                                
-                                                                                
-                                                                                
+ void get_token(char *token_ptr, FILE* out_file)
+ {
+    size_t length = strlen(token_ptr);
+    size_t pos = 0;
+    Token tok;
+
+    // The lexer's tables are constant, so there is nothing to set up per line
+    while ((pos = lex_next(token_ptr, length, pos, &tok)) != 0) {
+        if (tok.category == UNKNOWN) {
             // Process non-matching segment (e.g., log error, handle as invalid input)
-            //process_nonmatch(out_file, nonmatch);                             
-            report_lexical_error(out_file, nonmatch);                           
-                                                                                
-                                                                                
-         }                                                                      
-         char substring[128]; // Buffer to hold the matched substring           
-         int substring_length = ovector[1] - ovector[0];                        
-         strncpy(substring, token_ptr  + ovector[0], substring_length);         
-         substring[substring_length] = '\0';                                    
-                                                                                
-         if(strcmp(substring, ";") == 0){                                       
-             statement = 1;                                                     
-         }                                                                      
-         //process_lexeme(substring);                                           
-         printf("This is Lexeme: %s\n", substring);                             
-                                                                                
-         previous_end = ovector[1];                                             
-         i = ovector[1]; // Update position to continue searching                
-                                                                                
-    }                                                                           
-                                                                                
-                                                                               
-                                                                                
-    //process_last_match(token_ptr, previous_end, out_file);                    
-                                                                                
-    // Free up the regular expression**/                                         
-    pcre_free(re);                                                              
-}                                                                               
-                                                                                
-                                                                                
-                                                                                
+            report_lexical_error(out_file, token_ptr + tok.start, tok.length);
+            continue;
+        }
+        DIAG(diag_stdout(), DIAG_DEBUG, "This is Lexeme: %.*s\n", (int)tok.length,
+             token_ptr + tok.start);
+    }
+}
+
+
+
 /**                                                                             
  * Determines if a character is neither a space nor a tab.                      
  *                                                                              
@@ -169,9 +146,15 @@ int main(int argc, char *argv[])
  */                                                                             
 int isNotWhitespaceOrTab(char* c) {                                             
     return *c != ' ' && *c != '\t';                                             
-}   
-
-void report_lexical_error(FILE* out_file, const char* error_text) {
-    fprintf(out_file, "Lexical error: %s\n", error_text);
 }
 
+/**
+ * Reports text that is not a lexeme in the output file.
+ *
+ * @param out_file File the error is written to.
+ * @param error_text The text that could not be tokenized.
+ * @param length Length of the text in bytes.
+ */
+void report_lexical_error(FILE* out_file, const char* error_text, size_t length) {
+    fprintf(out_file, LEXICAL_ERROR_PREFIX "%.*s\n", (int)length, error_text);
+}
@@ -2,7 +2,7 @@
  * @file tokenizer.h
  * @brief Header file for the tokenizer project, which provides functionality for tokenizing
  * textual input into recognizable tokens (lexemes) according to specified patterns. It includes
- * definitions for maximum line lengths, token sizes, boolean values, and token categories. This
+ * definitions for boolean values and token categories. This
  * file declares functions for processing tokens, handling unmatched segments, and categorizing
  * lexemes. The tokenizer is capable of distinguishing various types of operators, parentheses,
  * integer literals, and identifies unrecognized segments as unknown tokens. It supports detailed
@@ -14,12 +14,18 @@
  * @version 03/16/2024
  */
 
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <stdio.h>
+
 /* Constants */
-#define LINE 100
-#define TSIZE 20
 #define TRUE 1
 #define FALSE 0
 
+/* Start of the message of text that is not a lexeme */
+#define LEXICAL_ERROR_PREFIX "Lexical error: "
+
     
 /**                                                                             
  * Token categories enumeration.                                                
@@ -31,7 +37,7 @@ typedef enum {
     LEFT_PAREN, RIGHT_PAREN, EXPON_OP, ASSIGN_OP,
     LESS_THEN_OP, LESS_THEN_OR_EQUAL_OP, GREATER_THEN_OP, GREATER_THEN_OR_EQUAL_OP,
     EQUALS_OP, NOT_OP, NOT_EQUALS_OP, SEMI_COLON,
-    INT_LITERAL, UNKNOWN
+    INT_LITERAL, IDENTIFIER, UNKNOWN
 } TokenCategory;
 
 
@@ -70,16 +76,16 @@ void process_last_match(char *, int , FILE *);
 void process_nonmatch(FILE *out_file, char *token_ptr);
 
 /**
- * Tokenizes the input string into recognized tokens using predefined regular 
- * expressions. Each token found is categorized and processed, and details are 
+ * Tokenizes the input string into recognized tokens using the table-driven
+ * lexer declared in lexer.h. Each token found is categorized and processed, and details are 
  * printed to the output file. The function handles both matching tokens and 
  * segments of text that do not match any token patterns, ensuring comprehensive 
  * analysis of the input. Non-matching segments can indicate potential errors or 
  * unrecognized symbols. After tokenizing, it also addresses any remaining text 
  * post-last recognized token for completeness.
  *
- * Utilizes PCRE for efficient pattern matching, crucial for parsing in compilers 
- * and interpreters.
+ * The lexer's automaton is built at compile time, so no pattern is compiled
+ * per line.
  *
  * @param token_ptr Pointer to the input string to be tokenized.
  */
@@ -132,4 +138,14 @@ TokenCategory match_token_category(char *);
  */
 void process_matching(FILE *, char * );
 
-void report_lexical_error(FILE* out_file, const char* error_text);
+/**
+ * Reports text that is not a lexeme in the tokenizer's output file. The
+ * interpreter writes its own record for such lines; see output.h.
+ *
+ * @param out_file File the error is written to.
+ * @param error_text The text that could not be tokenized.
+ * @param length Length of the text in bytes.
+ */
+void report_lexical_error(FILE* out_file, const char* error_text, size_t length);
+
+#endif // TOKENIZER_H
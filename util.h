@@ -0,0 +1,47 @@
+/**
+ * @file util.h
+ * @brief Small helpers shared by the modules: the monotonic clock in
+ * seconds, and the FNV-1a hash used for lookups and checksums. They are
+ * inline, so every program links without another source file.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Reads the monotonic clock.
+ *
+ * @return Seconds since an arbitrary point, for measuring intervals.
+ */
+static inline double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Hashes bytes with 64-bit FNV-1a. The hash is stored in binary expression
+ * files and sidecars, so it must not change.
+ *
+ * @param bytes The bytes.
+ * @param length Number of bytes.
+ * @return The hash.
+ */
+static inline uint64_t fnv1a(const void *bytes, size_t length) {
+    const unsigned char *p = bytes;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+#endif // UTIL_H
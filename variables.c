@@ -0,0 +1,158 @@
+/*
+ * variables.c - interning of variable names into dense slots.
+ * The names are kept in one growing buffer and found through an
+ * open-addressing hash table with linear probing, which is doubled whenever
+ * it would become more than half full. Hashing only happens while lines are
+ * parsed; evaluation uses the slot numbers stored in the trees.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "variables.h"
+#include "util.h"
+
+/* Slots and hash table entries allocated for the first name */
+#define INITIAL_SLOTS 64
+
+/*
+ * find_entry - finds the hash table entry holding a name, or the empty entry
+ * where it would be inserted. The table must not be full.
+ * Returns the index of the entry.
+ */
+static size_t find_entry(const Variables *vars, const char *name, size_t length) {
+    size_t mask = vars->table_size - 1;
+    size_t i = fnv1a(name, length) & mask;
+
+    for (;; i = (i + 1) & mask) {
+        int slot = vars->table[i] - 1;
+        if (slot < 0)
+            return i;
+        if (vars->lengths[slot] == length &&
+            memcmp(vars->names + vars->offsets[slot], name, length) == 0)
+            return i;
+    }
+}
+
+/**
+ * variable_lookup - finds the slot of a name.
+ * @vars: the variables.
+ * @name: the name.
+ * @length: length of the name.
+ *
+ * Returns the slot, or -1 if the name has none.
+ */
+int variable_lookup(const Variables *vars, const char *name, size_t length) {
+    if (vars->table_size == 0)
+        return -1;
+    return vars->table[find_entry(vars, name, length)] - 1;
+}
+
+/*
+ * grow_table - doubles the hash table and inserts every slot again.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int grow_table(Variables *vars) {
+    size_t size = vars->table_size ? vars->table_size * 2 : 2 * INITIAL_SLOTS;
+    int *table = calloc(size, sizeof(int));
+    if (table == NULL)
+        return -1;
+
+    free(vars->table);
+    vars->table = table;
+    vars->table_size = size;
+    for (int slot = 0; slot < vars->count; slot++)
+        table[find_entry(vars, vars->names + vars->offsets[slot], vars->lengths[slot])] = slot + 1;
+    return 0;
+}
+
+/*
+ * grow_slots - doubles the arrays indexed by slot.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int grow_slots(Variables *vars) {
+    int capacity = vars->capacity ? vars->capacity * 2 : INITIAL_SLOTS;
+    size_t *offsets = realloc(vars->offsets, capacity * sizeof(size_t));
+    if (offsets != NULL)
+        vars->offsets = offsets;
+    unsigned int *lengths = realloc(vars->lengths, capacity * sizeof(unsigned int));
+    if (lengths != NULL)
+        vars->lengths = lengths;
+    Value *values = realloc(vars->values, capacity * sizeof(Value));
+    if (values != NULL)
+        vars->values = values;
+    unsigned char *assigned = realloc(vars->assigned, capacity);
+    if (assigned != NULL)
+        vars->assigned = assigned;
+    if (offsets == NULL || lengths == NULL || values == NULL || assigned == NULL)
+        return -1;
+
+    vars->capacity = capacity;
+    return 0;
+}
+
+/*
+ * store_name - appends the text of a name to the name buffer.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int store_name(Variables *vars, const char *name, size_t length) {
+    if (vars->names_length + length > vars->names_capacity) {
+        size_t capacity = vars->names_capacity ? vars->names_capacity * 2 : 1024;
+        while (capacity < vars->names_length + length)
+            capacity *= 2;
+        char *grown = realloc(vars->names, capacity);
+        if (grown == NULL)
+            return -1;
+        vars->names = grown;
+        vars->names_capacity = capacity;
+    }
+    memcpy(vars->names + vars->names_length, name, length);
+    vars->names_length += length;
+    return 0;
+}
+
+/**
+ * variable_intern - finds or creates the slot of a name.
+ * @vars: the variables.
+ * @name: the name.
+ * @length: length of the name.
+ *
+ * Returns the slot, or -1 when out of memory.
+ */
+int variable_intern(Variables *vars, const char *name, size_t length) {
+    if (2 * ((size_t)vars->count + 1) > vars->table_size && grow_table(vars) != 0)
+        return -1;
+    size_t entry = find_entry(vars, name, length);
+    if (vars->table[entry] != 0)
+        return vars->table[entry] - 1;
+
+    if (vars->count == vars->capacity && grow_slots(vars) != 0)
+        return -1;
+    size_t offset = vars->names_length;
+    if (store_name(vars, name, length) != 0)
+        return -1;
+
+    int slot = vars->count++;
+    vars->offsets[slot] = offset;
+    vars->lengths[slot] = length;
+    vars->values[slot] = 0;
+    vars->assigned[slot] = 0;
+    vars->table[entry] = slot + 1;
+    return slot;
+}
+
+/**
+ * free_variables - releases the names and values.
+ * @vars: the variables.
+ */
+void free_variables(Variables *vars) {
+    free(vars->names);
+    free(vars->offsets);
+    free(vars->lengths);
+    free(vars->values);
+    free(vars->assigned);
+    free(vars->table);
+    memset(vars, 0, sizeof(*vars));
+}
@@ -0,0 +1,67 @@
+/**
+ * @file variables.h
+ * @brief Variables of the -V mode, where a line may assign an expression to a
+ * name ("rate = 3 * 4;") and later lines use the name in place of a number.
+ * A name is interned once, when the first line naming it is parsed, and given
+ * a dense slot number. The parser stores the slot in the tree, so evaluating
+ * a name indexes the array of values instead of hashing the name again.
+ * Slots are never reused, and a slot can only be read once an assignment to
+ * it has succeeded.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef VARIABLES_H
+#define VARIABLES_H
+
+#include <stddef.h>
+#include "ast.h"
+
+/**
+ * The names seen so far and the values of their slots. A zeroed table is
+ * empty and ready to use.
+ */
+typedef struct {
+    char *names;            /* Text of every name, one after another */
+    size_t names_length;
+    size_t names_capacity;
+    size_t *offsets;        /* Offset of each slot's name in names */
+    unsigned int *lengths;  /* Length of each slot's name */
+    Value *values;          /* Value of each slot */
+    unsigned char *assigned;/* Set once an assignment to the slot succeeded */
+    int count;              /* Number of slots */
+    int capacity;
+    int *table;             /* Open-addressing hash table of slot + 1, 0 if empty */
+    size_t table_size;      /* A power of two, at least twice count */
+} Variables;
+
+/**
+ * Finds the slot of a name.
+ *
+ * @param vars The variables.
+ * @param name The name; it need not be NUL-terminated.
+ * @param length Length of the name in bytes.
+ * @return The slot, or -1 if the name has no slot.
+ */
+int variable_lookup(const Variables *vars, const char *name, size_t length);
+
+/**
+ * Finds the slot of a name, giving it the next free slot if it has none.
+ * A new slot is not assigned.
+ *
+ * @param vars The variables.
+ * @param name The name; it need not be NUL-terminated.
+ * @param length Length of the name in bytes.
+ * @return The slot, or -1 when out of memory.
+ */
+int variable_intern(Variables *vars, const char *name, size_t length);
+
+/**
+ * Releases the names and values, leaving the table empty.
+ *
+ * @param vars The variables.
+ */
+void free_variables(Variables *vars);
+
+#endif // VARIABLES_H
@@ -0,0 +1,274 @@
+/*
+ * vm.c - compiles expression trees to stack-machine bytecode and runs it.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#include <stdlib.h>
+#include "vm.h"
+#include "parser.h"
+
+/* Programs needing a deeper stack than this allocate one per run */
+#define VM_LOCAL_STACK 64
+
+/* Opcode of each tree node kind */
+static const unsigned char node_opcode[] = {
+    [NODE_NUM] = OP_PUSH,
+    [NODE_ADD] = OP_ADD, [NODE_SUB] = OP_SUB, [NODE_MUL] = OP_MUL,
+    [NODE_DIV] = OP_DIV, [NODE_POW] = OP_POW,
+    [NODE_LT] = OP_LT, [NODE_LE] = OP_LE, [NODE_GT] = OP_GT,
+    [NODE_GE] = OP_GE, [NODE_EQ] = OP_EQ, [NODE_NE] = OP_NE,
+    [NODE_VAR] = OP_LOAD, [NODE_ASSIGN] = OP_STORE,
+};
+
+/*
+ * emit - appends one int of code, growing the buffer as needed.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int emit(Program *prog, Value word) {
+    if (prog->length == prog->capacity) {
+        int capacity = prog->capacity ? prog->capacity * 2 : 64;
+        Value *grown = realloc(prog->code, capacity * sizeof(Value));
+        if (grown == NULL)
+            return -1;
+        prog->code = grown;
+        prog->capacity = capacity;
+    }
+    prog->code[prog->length++] = word;
+    return 0;
+}
+
+/**
+ * compile_program - compiles an expression tree to bytecode.
+ * @prog: the program receiving the code.
+ * @root: root of the tree.
+ *
+ * The tree is walked in postorder, which is the order of the code, while
+ * the stack depth of every instruction is tracked to size the stack.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+int compile_program(Program *prog, const Node *root) {
+    TreeWalk walk;
+    const Node *node;
+    int depth = 0, status = 0;
+
+    prog->length = 0;
+    prog->max_stack = 0;
+    tree_walk_init(&walk, root);
+    while (status == 0 && (node = tree_walk_next(&walk)) != NULL) {
+        if (node->kind == NODE_NUM || node->kind == NODE_VAR) {
+            if (++depth > prog->max_stack)
+                prog->max_stack = depth;
+            status = emit(prog, node_opcode[node->kind]) != 0 || emit(prog, node->value) != 0 ? -1 : 0;
+        } else if (node->kind == NODE_ASSIGN) {
+            status = emit(prog, OP_STORE) != 0 || emit(prog, node->value) != 0 ? -1 : 0;
+        } else {
+            depth--;
+            status = emit(prog, node_opcode[node->kind]);
+        }
+    }
+    if (walk.failed)
+        status = -1;
+    tree_walk_free(&walk);
+    return status == 0 ? emit(prog, OP_HALT) : -1;
+}
+
+/*
+ * Dispatch: with GCC or Clang every handler jumps straight to the handler of
+ * the next opcode through a label table, which gives each handler its own
+ * indirect branch; otherwise a switch in a loop is used.
+ */
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO 1
+#define CASE(op) L_##op
+#define DISPATCH() goto *dispatch[*pc++]
+#else
+#define CASE(op) case op
+#define DISPATCH() goto dispatch_loop
+#endif
+
+#define BINARY(expression) \
+    do { \
+        Value right = *--sp; \
+        Value left = sp[-1]; \
+        sp[-1] = (expression); \
+    } while (0)
+
+/* Applies a checked arithmetic builtin to the top two values */
+#define CHECKED(builtin) \
+    do { \
+        sp--; \
+        if (builtin(sp[-1], sp[0], &sp[-1])) { \
+            status = INTEGER_OVERFLOW; \
+            goto done; \
+        } \
+    } while (0)
+
+/**
+ * run_program - runs a compiled expression.
+ * @prog: the program to run.
+ * @variables: values of the variables, or NULL.
+ * @value: receives the value.
+ *
+ * Returns 0 on success, or the error code of a runtime error.
+ */
+int run_program(const Program *prog, Value *variables, Value *value) {
+    Value local_stack[VM_LOCAL_STACK];
+    Value *stack = local_stack;
+    int status = 0;
+
+    if (prog->max_stack > VM_LOCAL_STACK) {
+        stack = malloc(prog->max_stack * sizeof(Value));
+        if (stack == NULL)
+            return OUT_OF_MEMORY;
+    }
+
+    Value *sp = stack;
+    const Value *pc = prog->code;
+
+#ifdef VM_COMPUTED_GOTO
+    static const void *const dispatch[] = {
+        [OP_PUSH] = &&L_OP_PUSH,
+        [OP_ADD] = &&L_OP_ADD, [OP_SUB] = &&L_OP_SUB, [OP_MUL] = &&L_OP_MUL,
+        [OP_DIV] = &&L_OP_DIV, [OP_POW] = &&L_OP_POW,
+        [OP_LT] = &&L_OP_LT, [OP_LE] = &&L_OP_LE, [OP_GT] = &&L_OP_GT,
+        [OP_GE] = &&L_OP_GE, [OP_EQ] = &&L_OP_EQ, [OP_NE] = &&L_OP_NE,
+        [OP_HALT] = &&L_OP_HALT,
+        [OP_LOAD] = &&L_OP_LOAD, [OP_STORE] = &&L_OP_STORE,
+    };
+    DISPATCH();
+#else
+dispatch_loop:
+    switch (*pc++) {
+#endif
+
+    CASE(OP_PUSH):
+        *sp++ = *pc++;
+        DISPATCH();
+    CASE(OP_ADD):
+        CHECKED(__builtin_add_overflow);
+        DISPATCH();
+    CASE(OP_SUB):
+        CHECKED(__builtin_sub_overflow);
+        DISPATCH();
+    CASE(OP_MUL):
+        CHECKED(__builtin_mul_overflow);
+        DISPATCH();
+    CASE(OP_DIV):
+        if (sp[-1] == 0) {
+            status = DIVISION_BY_ZERO;
+            goto done;
+        }
+        if (sp[-1] == -1 && sp[-2] == VALUE_MIN) {
+            status = INTEGER_OVERFLOW;
+            goto done;
+        }
+        BINARY(left / right);
+        DISPATCH();
+    CASE(OP_POW):
+        sp--;
+        if ((status = eval_power(sp[-1], sp[0], &sp[-1])) != 0)
+            goto done;
+        DISPATCH();
+    CASE(OP_LT):
+        BINARY(left < right);
+        DISPATCH();
+    CASE(OP_LE):
+        BINARY(left <= right);
+        DISPATCH();
+    CASE(OP_GT):
+        BINARY(left > right);
+        DISPATCH();
+    CASE(OP_GE):
+        BINARY(left >= right);
+        DISPATCH();
+    CASE(OP_EQ):
+        BINARY(left == right);
+        DISPATCH();
+    CASE(OP_NE):
+        BINARY(left != right);
+        DISPATCH();
+    CASE(OP_LOAD):
+        *sp++ = variables[*pc++];
+        DISPATCH();
+    CASE(OP_STORE):
+        variables[*pc++] = sp[-1];
+        DISPATCH();
+    CASE(OP_HALT):
+        *value = sp[-1];
+        goto done;
+
+#ifndef VM_COMPUTED_GOTO
+    default:
+        status = INVALID_OPERATOR;
+        goto done;
+    }
+#endif
+
+done:
+    if (stack != local_stack)
+        free(stack);
+    return status;
+}
+
+/**
+ * verify_program - checks that code from outside the process is safe to run.
+ * @prog: the program to check.
+ * @variable_count: number of variable slots the program may name.
+ *
+ * The code is walked once in order, tracking the stack depth: every opcode
+ * must be known, every operand and slot must lie in the code and the array
+ * of variables, no instruction may take more values than the stack holds,
+ * and the deepest stack must be exactly max_stack, so the stack run_program()
+ * sizes from it can neither overflow nor be made needlessly large. The code
+ * must end with its only OP_HALT, with one value on the stack.
+ * Returns 0 if the program is safe to run, or -1 if it is not.
+ */
+int verify_program(const Program *prog, int variable_count) {
+    int depth = 0, deepest = 0;
+
+    for (int pc = 0; pc < prog->length; ) {
+        Value op = prog->code[pc++];
+        switch (op) {
+            case OP_PUSH:
+            case OP_LOAD:
+            case OP_STORE:
+                if (pc == prog->length)
+                    return -1;
+                if (op != OP_PUSH &&
+                    (prog->code[pc] < 0 || prog->code[pc] >= variable_count))
+                    return -1;
+                pc++;
+                if (op == OP_STORE) {
+                    if (depth < 1)
+                        return -1;
+                } else if (++depth > deepest) {
+                    deepest = depth;
+                }
+                break;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_POW:
+            case OP_LT: case OP_LE: case OP_GT: case OP_GE: case OP_EQ: case OP_NE:
+                if (depth < 2)
+                    return -1;
+                depth--;
+                break;
+            case OP_HALT:
+                return pc == prog->length && depth == 1 && deepest == prog->max_stack ? 0 : -1;
+            default:
+                return -1;
+        }
+    }
+    return -1; // No OP_HALT
+}
+
+/**
+ * free_program - releases the code of a program.
+ * @prog: the program to release.
+ */
+void free_program(Program *prog) {
+    free(prog->code);
+    prog->code = NULL;
+    prog->length = 0;
+    prog->capacity = 0;
+    prog->max_stack = 0;
+}
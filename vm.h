@@ -0,0 +1,89 @@
+/**
+ * @file vm.h
+ * @brief Bytecode compiler and virtual machine for expressions. A parsed
+ * expression tree is flattened into postfix code for a stack machine, so an
+ * expression that is evaluated many times pays for the tree walk once. Each
+ * operator is a single opcode; the VM dispatches on opcodes through a table
+ * of label addresses (computed goto) where the compiler supports it, and
+ * through a switch otherwise.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef VM_H
+#define VM_H
+
+#include "ast.h"
+
+/**
+ * Instruction set of the stack machine. OP_PUSH is followed by its operand
+ * in the code stream, and OP_LOAD and OP_STORE by the slot of a variable:
+ * OP_LOAD pushes the variable and OP_STORE copies the top of the stack into
+ * it. Every other opcode pops its operands and pushes the result. OP_HALT
+ * ends the program with the result on top of the stack.
+ */
+typedef enum {
+    OP_PUSH,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW,
+    OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE,
+    OP_HALT,
+    OP_LOAD, OP_STORE
+} OpCode;
+
+/**
+ * A compiled expression.
+ */
+typedef struct {
+    Value *code;        /* Opcodes and inline operands */
+    int length;         /* Number of words of code */
+    int capacity;
+    int max_stack;      /* Deepest stack the program needs */
+} Program;
+
+/**
+ * Compiles an expression tree, replacing the program's previous code. The
+ * program's buffer is reused, so compiling does not allocate once it has
+ * reached its working size.
+ *
+ * @param prog The program receiving the code.
+ * @param root Root of the expression tree.
+ * @return 0 on success, or -1 when out of memory.
+ */
+int compile_program(Program *prog, const Node *root);
+
+/**
+ * Runs a compiled expression. A program stores its variable only if it
+ * succeeds, since OP_STORE comes last.
+ *
+ * @param prog The program to run.
+ * @param variables Values of the variables, indexed by slot, or NULL if the
+ * program names none.
+ * @param value Receives the value of the expression.
+ * @return 0 on success, or the error code of a runtime error, with the
+ * same semantics as eval_node().
+ */
+int run_program(const Program *prog, Value *variables, Value *value);
+
+/**
+ * Checks that a program read from outside the process, such as from a
+ * binary expression file, is safe to run: every opcode is valid, every
+ * operand lies within the code, every slot is below variable_count, the
+ * stack never underflows, its deepest point is max_stack, and the code ends
+ * with OP_HALT leaving exactly one value. run_program() trusts its program,
+ * so such code must pass this check first.
+ *
+ * @param prog The program to check.
+ * @param variable_count Number of variable slots the program may name.
+ * @return 0 if the program is safe to run, or -1 if it is not.
+ */
+int verify_program(const Program *prog, int variable_count);
+
+/**
+ * Releases the code of a program.
+ *
+ * @param prog The program to release.
+ */
+void free_program(Program *prog);
+
+#endif // VM_H
@@ -0,0 +1,654 @@
+/*
+ * watch.c - incremental runs and the watch mode.
+ *
+ * Sidecar layout, in native byte order:
+ *   header     SidecarHeader
+ *   lines      one WatchLine per input line, in input order
+ *   text       the text of every input line, one after another
+ * The record of line i starts in the output at the sum of the lengths of
+ * the lines before it, and its text likewise in the text. The previous
+ * output is mapped while the new one is written, and the table finding a
+ * line by its hash holds the first line of each distinct text. A line is
+ * only reused if its text is the same, so lines whose hashes collide are
+ * still told apart.
+ * Author: Dagmawi Negatu and Darwin Bueso Galdamez
+ * Date: April 2024
+ */
+
+#define _GNU_SOURCE    /* copy_file_range */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include "watch.h"
+#include "batch.h"
+#include "input.h"
+#include "compress.h"
+#include "parser.h"
+#include "util.h"
+
+#define SIDECAR_MAGIC "EXPRIDX"
+#ifdef VALUE_64
+#define SIDECAR_VERSION 0x102
+#else
+#define SIDECAR_VERSION 2
+#endif
+
+/* Header flags */
+#define FLAG_BIGNUM 1   /* Written with arbitrary precision */
+
+/* Output buffered before it is written to the new file */
+#define FLUSH_BYTES (256 * 1024)
+
+/* Shortest run of copied records worth a copy_file_range() call */
+#define SPLICE_BYTES (64 * 1024)
+
+/* Time to wait for more events after a change, so a save is one run */
+#define SETTLE_MS 50
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t line_count;
+    uint64_t output_size;
+    int64_t output_mtime_sec;
+    int64_t output_mtime_nsec;
+} SidecarHeader;
+
+typedef struct {
+    uint64_t hash;          /* FNV-1a hash of the line's text */
+    uint64_t length;        /* Bytes of the line's record in the output */
+    uint64_t text_length;   /* Bytes of the line's text */
+    int32_t status;         /* Error code reported for the line, or 0 */
+    uint32_t reserved;
+} WatchLine;
+
+/* The output of the previous run */
+typedef struct {
+    int fd;                 /* The old output file, or -1 */
+    const char *map;        /* Its contents */
+    size_t size;
+    WatchLine *lines;
+    uint64_t *offsets;      /* Offset of each line's record */
+    char *text;             /* Text of the lines */
+    uint64_t *text_offsets; /* Offset of each line's text */
+    size_t count;
+    uint32_t *table;        /* Index + 1 of a line, by hash; 0 if free */
+    size_t mask;
+} Previous;
+
+/* The new output, built up in memory and written out in blocks */
+typedef struct {
+    int fd;
+    OutputWriter out;       /* Holds no file, so its length is only reset here */
+    size_t run_start;       /* Offset in the old output of the pending run */
+    size_t run_length;      /* Bytes of copied records not written yet */
+    size_t follows;         /* Index of the old line after the last one copied */
+    WatchLine *lines;
+    size_t count;
+    size_t capacity;
+    char *text;             /* Text of the lines so far */
+    size_t text_length;
+    size_t text_capacity;
+    int error;
+} NextOutput;
+
+/*
+ * sidecar_path - builds the path of the sidecar file of an output file.
+ * Returns the malloc'd path, or NULL when out of memory.
+ */
+static char *sidecar_path(const char *output_path, const char *suffix) {
+    size_t length = strlen(output_path);
+    char *path = malloc(length + strlen(WATCH_SUFFIX) + strlen(suffix) + 1);
+    if (path != NULL) {
+        memcpy(path, output_path, length);
+        strcpy(path + length, WATCH_SUFFIX);
+        strcat(path + length, suffix);
+    }
+    return path;
+}
+
+/*
+ * release_previous - unmaps and frees what was loaded of the previous run.
+ */
+static void release_previous(Previous *prev) {
+    if (prev->map != NULL)
+        munmap((void *)prev->map, prev->size);
+    if (prev->fd >= 0)
+        close(prev->fd);
+    free(prev->lines);
+    free(prev->offsets);
+    free(prev->text);
+    free(prev->text_offsets);
+    free(prev->table);
+    memset(prev, 0, sizeof(*prev));
+    prev->fd = -1;
+}
+
+/*
+ * same_line - tells whether a line of the previous run has the given text.
+ */
+static int same_line(const Previous *prev, size_t index, uint64_t hash, const char *line,
+                     size_t length) {
+    const WatchLine *old = &prev->lines[index];
+    return old->hash == hash && old->text_length == length &&
+           memcmp(prev->text + prev->text_offsets[index], line, length) == 0;
+}
+
+/*
+ * load_previous - loads the sidecar of an output file and maps the output,
+ * if both are there and agree with each other and with this run.
+ * Returns 0 if the previous run can be reused, or -1 if every line has to
+ * be interpreted.
+ */
+static int load_previous(Previous *prev, const char *output_path, const char *sidecar,
+                         uint32_t format, uint32_t flags) {
+    SidecarHeader header;
+    struct stat st;
+
+    memset(prev, 0, sizeof(*prev));
+    prev->fd = -1;
+    FILE *file = fopen(sidecar, "rb");
+    if (file == NULL)
+        return -1;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC)) != 0 ||
+        header.version != SIDECAR_VERSION || header.format != format || header.flags != flags ||
+        header.line_count >= UINT32_MAX)
+        goto stale;
+
+    // An output file edited or replaced since the run no longer matches
+    prev->fd = open(output_path, O_RDONLY | O_CLOEXEC);
+    if (prev->fd < 0 || fstat(prev->fd, &st) != 0 ||
+        (uint64_t)st.st_size != header.output_size ||
+        st.st_mtim.tv_sec != header.output_mtime_sec ||
+        st.st_mtim.tv_nsec != header.output_mtime_nsec)
+        goto stale;
+    prev->size = header.output_size;
+    if (prev->size > 0) {
+        prev->map = mmap(NULL, prev->size, PROT_READ, MAP_PRIVATE, prev->fd, 0);
+        if (prev->map == MAP_FAILED) {
+            prev->map = NULL;
+            goto stale;
+        }
+    }
+
+    prev->count = header.line_count;
+    size_t buckets = 16;
+    while (buckets < 2 * prev->count)
+        buckets *= 2;
+    prev->mask = buckets - 1;
+    prev->lines = malloc(prev->count * sizeof(WatchLine) + 1);
+    prev->offsets = malloc(prev->count * sizeof(uint64_t) + 1);
+    prev->text_offsets = malloc(prev->count * sizeof(uint64_t) + 1);
+    prev->table = calloc(buckets, sizeof(uint32_t));
+    if (prev->lines == NULL || prev->offsets == NULL || prev->text_offsets == NULL ||
+        prev->table == NULL ||
+        fread(prev->lines, sizeof(WatchLine), prev->count, file) != prev->count)
+        goto stale;
+
+    // The text is the rest of the sidecar, so its length is checked before it is read
+    uint64_t offset = 0, text_size = 0;
+    if (fstat(fileno(file), &st) != 0)
+        goto stale;
+    uint64_t text_left = st.st_size - sizeof(header) - prev->count * sizeof(WatchLine);
+    for (size_t i = 0; i < prev->count; i++) {
+        if (prev->lines[i].length > prev->size - offset ||
+            prev->lines[i].text_length > text_left - text_size)
+            goto stale;
+        prev->offsets[i] = offset;
+        offset += prev->lines[i].length;
+        prev->text_offsets[i] = text_size;
+        text_size += prev->lines[i].text_length;
+    }
+    prev->text = malloc(text_size + 1);
+    if (offset != prev->size || text_size != text_left || prev->text == NULL ||
+        fread(prev->text, 1, text_size, file) != text_size)
+        goto stale;
+
+    for (size_t i = 0; i < prev->count; i++) {
+        const char *line = prev->text + prev->text_offsets[i];
+        size_t bucket = prev->lines[i].hash & prev->mask;
+        while (prev->table[bucket] != 0 &&
+               !same_line(prev, prev->table[bucket] - 1, prev->lines[i].hash, line,
+                          prev->lines[i].text_length))
+            bucket = (bucket + 1) & prev->mask;
+        if (prev->table[bucket] == 0)
+            prev->table[bucket] = i + 1;
+    }
+    fclose(file);
+    return 0;
+
+stale:
+    fclose(file);
+    release_previous(prev);
+    return -1;
+}
+
+/*
+ * find_line - finds a line of the previous run by its text.
+ * Returns the index of the line, or -1 if no line had the text.
+ */
+static long find_line(const Previous *prev, uint64_t hash, const char *line, size_t length) {
+    if (prev->table == NULL)
+        return -1;
+    size_t bucket = hash & prev->mask;
+    while (prev->table[bucket] != 0) {
+        uint32_t index = prev->table[bucket] - 1;
+        if (same_line(prev, index, hash, line, length))
+            return index;
+        bucket = (bucket + 1) & prev->mask;
+    }
+    return -1;
+}
+
+/*
+ * write_all - writes the buffered output to the new file.
+ */
+static void write_all(NextOutput *next) {
+    const char *p = next->out.buffer;
+    size_t left = next->out.length;
+    while (left > 0 && !next->error) {
+        ssize_t n = write(next->fd, p, left);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            next->error = 1;
+        else {
+            p += n;
+            left -= n;
+        }
+    }
+    next->out.length = 0;
+}
+
+/*
+ * splice_run - writes the pending run of copied records. A long run is
+ * copied file to file by the kernel, and anything it does not copy is
+ * copied from the mapping.
+ */
+static void splice_run(NextOutput *next, const Previous *prev, WatchCounts *counts) {
+    loff_t from = next->run_start;
+    size_t left = next->run_length;
+
+    next->run_length = 0;
+    if (left >= SPLICE_BYTES) {
+        write_all(next);
+        while (left > 0 && !next->error) {
+            ssize_t n = copy_file_range(prev->fd, &from, next->fd, NULL, left, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            left -= n;
+            counts->spliced += n;
+        }
+    }
+    output_bytes(&next->out, prev->map + from, left);
+    if (next->out.length >= FLUSH_BYTES)
+        write_all(next);
+}
+
+/*
+ * add_line - records the text, record length and error code of a line of
+ * the new output.
+ * Returns 0 on success, or -1 when out of memory.
+ */
+static int add_line(NextOutput *next, uint64_t hash, uint64_t length, const char *line,
+                    size_t text_length, int status) {
+    if (next->count == next->capacity) {
+        size_t capacity = next->capacity ? next->capacity * 2 : 1024;
+        WatchLine *grown = realloc(next->lines, capacity * sizeof(WatchLine));
+        if (grown == NULL)
+            return -1;
+        next->lines = grown;
+        next->capacity = capacity;
+    }
+    if (text_length > next->text_capacity - next->text_length) {
+        size_t capacity = next->text_capacity ? next->text_capacity : 64 * 1024;
+        while (text_length > capacity - next->text_length)
+            capacity *= 2;
+        char *grown = realloc(next->text, capacity);
+        if (grown == NULL)
+            return -1;
+        next->text = grown;
+        next->text_capacity = capacity;
+    }
+    memcpy(next->text + next->text_length, line, text_length);
+    next->text_length += text_length;
+    next->lines[next->count] = (WatchLine){ .hash = hash, .length = length,
+                                            .text_length = text_length, .status = status };
+    next->count++;
+    return 0;
+}
+
+/*
+ * write_sidecar - writes the sidecar of the new output, which has just
+ * been renamed into place.
+ * Returns 0 on success, or -1 on failure.
+ */
+static int write_sidecar(const NextOutput *next, const char *output_path, const char *sidecar,
+                         const char *temporary, uint32_t format, uint32_t flags) {
+    SidecarHeader header = {0};
+    struct stat st;
+
+    if (stat(output_path, &st) != 0)
+        return -1;
+    memcpy(header.magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC));
+    header.version = SIDECAR_VERSION;
+    header.format = format;
+    header.flags = flags;
+    header.line_count = next->count;
+    header.output_size = st.st_size;
+    header.output_mtime_sec = st.st_mtim.tv_sec;
+    header.output_mtime_nsec = st.st_mtim.tv_nsec;
+
+    FILE *file = fopen(temporary, "wb");
+    int status = 0;
+    if (file == NULL ||
+        fwrite(&header, sizeof(header), 1, file) != 1 ||
+        (next->count > 0 &&
+         fwrite(next->lines, sizeof(WatchLine), next->count, file) != next->count) ||
+        fwrite(next->text, 1, next->text_length, file) != next->text_length)
+        status = -1;
+    if (file != NULL && fclose(file) != 0)
+        status = -1;
+    if (status == 0 && rename(temporary, sidecar) != 0)
+        status = -1;
+    if (status != 0)
+        unlink(temporary);
+    return status;
+}
+
+/*
+ * interpret_changes - writes the new output of every input line, copying
+ * the records of lines the previous run had and reporting their errors
+ * again, as a full run would. Write errors are left in next->error.
+ * Returns 0 on success, or -1 on a read error or when out of memory.
+ */
+static int interpret_changes(FILE *in, NextOutput *next, const Previous *prev,
+                             LineInterpreter *interp, WatchCounts *counts) {
+    LineReader reader;
+    const char *line;
+    size_t length;
+    int result;
+
+    if (line_reader_open(&reader, in) != 0)
+        return -1;
+    while ((result = line_reader_next(&reader, &line, &length)) > 0) {
+        uint64_t hash = fnv1a(line, length);
+        // The old line after the last one copied extends the run, even if an
+        // earlier line has the same text
+        long index = next->follows < prev->count &&
+                     same_line(prev, next->follows, hash, line, length) ?
+                     (long)next->follows : find_line(prev, hash, line, length);
+        size_t record;
+        int status;
+        counts->lines++;
+        if (index >= 0) {
+            size_t offset = prev->offsets[index];
+            record = prev->lines[index].length;
+            status = prev->lines[index].status;
+            report_error(interp->errors, status);
+            if (next->run_length > 0 && next->run_start + next->run_length != offset)
+                splice_run(next, prev, counts);
+            if (next->run_length == 0)
+                next->run_start = offset;
+            next->run_length += record;
+            next->follows = index + 1;
+        } else {
+            if (next->run_length > 0)
+                splice_run(next, prev, counts);
+            size_t before = next->out.length;
+            if (interpret_line(interp, &next->out, line, length) != 0) {
+                result = -1;
+                break;
+            }
+            record = next->out.length - before;
+            status = interp->status;
+            counts->evaluated++;
+            if (next->out.length >= FLUSH_BYTES)
+                write_all(next);
+        }
+        if (add_line(next, hash, record, line, length, status) != 0) {
+            result = -1;
+            break;
+        }
+    }
+    if (result == 0 && next->run_length > 0)
+        splice_run(next, prev, counts);
+    if (result == 0)
+        write_all(next);
+    line_reader_close(&reader);
+    return result < 0 || next->out.error ? -1 : 0;
+}
+
+/**
+ * watch_update - brings an output file up to date with its input file.
+ * @input_path: path of the input file.
+ * @output_path: path of the output file.
+ * @format: format of the output.
+ * @cache: result cache, or NULL.
+ * @big: arbitrary-precision evaluator, or NULL.
+ * @counts: receives the counters of the run.
+ *
+ * Returns 0 on success, or 1 on error.
+ */
+int watch_update(const char *input_path, const char *output_path, OutputFormat format,
+                 ResultCache *cache, BigEvaluator *big, WatchCounts *counts) {
+    LineInterpreter interp = { .cache = cache, .big = big, .errors = stderr };
+    NextOutput next = { .fd = -1 };
+    Previous prev;
+    CompressedStream decoder;
+    uint32_t flags = big != NULL ? FLAG_BIGNUM : 0;
+    char *sidecar = sidecar_path(output_path, "");
+    char *temporary = sidecar_path(output_path, ".new");
+    char *output_temporary = malloc(strlen(output_path) + 5);
+    FILE *inputFile = NULL, *in;
+    int status = 1;
+    double start = monotonic_seconds();
+
+    memset(counts, 0, sizeof(*counts));
+    if (sidecar == NULL || temporary == NULL || output_temporary == NULL ||
+        output_init(&next.out, NULL, format) != 0) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        free(sidecar);
+        free(temporary);
+        free(output_temporary);
+        return 1;
+    }
+    strcpy(output_temporary, output_path);
+    strcat(output_temporary, ".new");
+    load_previous(&prev, output_path, sidecar, format, flags);
+    diag_open(&interp.diag, stdout);
+
+    inputFile = fopen(input_path, "r");
+    if (inputFile == NULL) {
+        fprintf(stderr, "Error: Could not open %s.\n", input_path);
+        goto done;
+    }
+    int opened = compressed_open_input(&decoder, inputFile, &in);
+    if (opened != 0) {
+        fprintf(stderr, opened == COMPRESS_UNSUPPORTED ?
+                "Error: %s is compressed with zstd; rebuild with -DHAVE_ZSTD and -lzstd.\n" :
+                "Error: Could not decompress %s.\n", input_path);
+        goto done;
+    }
+    next.fd = open(output_temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (next.fd < 0) {
+        fprintf(stderr, "Error: Could not open %s.\n", output_temporary);
+        compressed_close(&decoder);
+        goto done;
+    }
+
+    int result = interpret_changes(in, &next, &prev, &interp, counts);
+    int decoded = compressed_close(&decoder);
+    int closed = close(next.fd);
+    next.fd = -1;
+    if (decoded != 0)
+        fprintf(stderr, "Error: Could not decompress %s.\n", input_path);
+    else if (result != 0)
+        fprintf(stderr, "Error: Out of memory.\n");
+    else if (next.error || closed != 0 || rename(output_temporary, output_path) != 0)
+        fprintf(stderr, "Error: Could not write %s.\n", output_path);
+    // Without a sidecar the next run interprets every line, which is still right
+    else if (write_sidecar(&next, output_path, sidecar, temporary, format, flags) != 0) {
+        fprintf(stderr, "Error: Could not write %s.\n", sidecar);
+        unlink(sidecar);
+    } else
+        status = 0;
+    if (status != 0)
+        unlink(output_temporary);
+
+done:
+    counts->seconds = monotonic_seconds() - start;
+    if (next.fd >= 0)
+        close(next.fd);
+    if (inputFile != NULL)
+        fclose(inputFile);
+    release_previous(&prev);
+    free_line_interpreter(&interp);
+    output_free(&next.out);
+    free(next.lines);
+    free(next.text);
+    free(sidecar);
+    free(temporary);
+    free(output_temporary);
+    return status;
+}
+
+/**
+ * watch_report - writes the counters of a run.
+ * @counts: the counters.
+ * @file: the stream.
+ */
+void watch_report(const WatchCounts *counts, FILE *file) {
+    fprintf(file, "Incremental: %lu of %lu lines evaluated, %llu bytes spliced, %.3f s\n",
+            counts->evaluated, counts->lines, counts->spliced, counts->seconds);
+}
+
+/*
+ * file_name - finds the last component of a path.
+ */
+static const char *file_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash != NULL ? slash + 1 : path;
+}
+
+/*
+ * input_changed - reads the pending inotify events.
+ * Returns 1 if one of them is about the input file, 0 if none is, or -1 on
+ * a read error.
+ */
+static int input_changed(int inotify, const char *name) {
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+
+    for (;;) {
+        ssize_t n = read(inotify, events, sizeof(events));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return errno == EAGAIN ? changed : -1;
+        for (char *p = events; p < events + n; ) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            if (event->len > 0 && strcmp(event->name, name) == 0)
+                changed = 1;
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+/**
+ * watch - keeps an output file up to date with its input file until SIGINT
+ * or SIGTERM.
+ * @input_path: path of the input file.
+ * @output_path: path of the output file.
+ * @format: format of the output.
+ * @cache: result cache, or NULL.
+ * @big: arbitrary-precision evaluator, or NULL.
+ *
+ * The directory of the input is watched rather than the file, since
+ * editors often save by writing a new file and renaming it over the old.
+ * Returns 0 after SIGINT or SIGTERM, or 1 on error.
+ */
+int watch(const char *input_path, const char *output_path, OutputFormat format,
+          ResultCache *cache, BigEvaluator *big) {
+    const char *name = file_name(input_path);
+    char *directory = strndup(input_path, name - input_path);
+    sigset_t signals, saved;
+    WatchCounts counts;
+    int inotify = -1, signals_fd = -1, status = 1;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &saved);
+
+    if (directory == NULL) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        goto done;
+    }
+    inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    signals_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+    if (inotify < 0 || signals_fd < 0 ||
+        inotify_add_watch(inotify, directory[0] != '\0' ? directory : ".",
+                          IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        fprintf(stderr, "Error: Could not watch %s.\n", input_path);
+        goto done;
+    }
+
+    if (watch_update(input_path, output_path, format, cache, big, &counts) == 0)
+        watch_report(&counts, stderr);
+    fprintf(stderr, "Watching %s.\n", input_path);
+
+    struct pollfd fds[2] = { { .fd = inotify, .events = POLLIN },
+                             { .fd = signals_fd, .events = POLLIN } };
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            goto done;
+        }
+        if (fds[1].revents != 0)
+            break;
+        int changed = input_changed(inotify, name);
+        if (changed < 0)
+            goto done;
+        if (!changed)
+            continue;
+        // Take the rest of a save that writes the file in several steps
+        while (poll(fds, 1, SETTLE_MS) > 0 && input_changed(inotify, name) >= 0)
+            ;
+        if (watch_update(input_path, output_path, format, cache, big, &counts) == 0)
+            watch_report(&counts, stderr);
+    }
+    // Consume the signal so restoring the mask does not deliver it
+    struct signalfd_siginfo info;
+    (void)!read(signals_fd, &info, sizeof(info));
+    status = 0;
+
+done:
+    if (inotify >= 0)
+        close(inotify);
+    if (signals_fd >= 0)
+        close(signals_fd);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    free(directory);
+    return status;
+}
@@ -0,0 +1,93 @@
+/**
+ * @file watch.h
+ * @brief Incremental runs over an input file that changes a few lines at a
+ * time. Next to the output file, a sidecar file named after it with
+ * ".lines" appended records the text of every input line, with its hash,
+ * the length of its record in the output and the error it reported. On the
+ * next run, a line whose text is recorded is not lexed, parsed or
+ * evaluated: its record is copied from the previous output and its error
+ * message is written on stderr again, and only new and edited lines are
+ * interpreted. A line is matched by its hash, then compared with the
+ * recorded text, so two lines whose hashes collide are never confused.
+ * Lines are matched by their text rather than their position, so lines
+ * inserted or deleted above a line do not make it change.
+ *
+ * The new output is written beside the old one and renamed over it. Runs of
+ * records that are copied whole are spliced with copy_file_range(), so the
+ * kernel copies them, or shares their blocks on file systems that can;
+ * reading and hashing the input is the only work proportional to its size.
+ * The sidecar also records the size and modification time of the output,
+ * and the format and precision it was written in: if any of them differ,
+ * every line is interpreted again.
+ *
+ * Every line is independent of the others, so variables are not supported.
+ * The parser's debug output (-d) is only written for the lines interpreted.
+ *
+ * @author Dagmawi Negatu and Darwin Bueso Galdamez
+ * @version 04/21/2024
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "cache.h"
+#include "bignum.h"
+#include "output.h"
+
+/* Suffix of the sidecar file of an output file */
+#define WATCH_SUFFIX ".lines"
+
+/**
+ * The counters of one incremental run.
+ */
+typedef struct {
+    unsigned long lines;        /* Lines in the input */
+    unsigned long evaluated;    /* Lines interpreted; the others were reused */
+    unsigned long long spliced; /* Output bytes copied by the kernel */
+    double seconds;
+} WatchCounts;
+
+/**
+ * Brings an output file and its sidecar up to date with an input file,
+ * interpreting only the lines not in the previous run. The input may be
+ * compressed (see compress.h).
+ *
+ * @param input_path Path of the input file.
+ * @param output_path Path of the output file.
+ * @param format Format of the output.
+ * @param cache Result cache for the interpreted lines, or NULL.
+ * @param big Evaluator for arbitrary precision, or NULL to evaluate in Values.
+ * @param counts Receives the counters of the run.
+ * @return 0 on success, or 1 on error, after reporting it on stderr. The
+ * output file is only replaced once its new contents are complete.
+ */
+int watch_update(const char *input_path, const char *output_path, OutputFormat format,
+                 ResultCache *cache, BigEvaluator *big, WatchCounts *counts);
+
+/**
+ * Runs watch_update() and then again every time the input file is written
+ * or replaced, until SIGINT or SIGTERM arrives. The counters of each run are
+ * reported on stderr. A run that fails is reported and the next change is
+ * awaited.
+ *
+ * @param input_path Path of the input file.
+ * @param output_path Path of the output file.
+ * @param format Format of the output.
+ * @param cache Result cache shared by the runs, or NULL.
+ * @param big Evaluator for arbitrary precision, or NULL to evaluate in Values.
+ * @return 0 after SIGINT or SIGTERM, or 1 if the input could not be watched.
+ */
+int watch(const char *input_path, const char *output_path, OutputFormat format,
+          ResultCache *cache, BigEvaluator *big);
+
+/**
+ * Writes the counters of a run on a stream.
+ *
+ * @param counts The counters.
+ * @param file The stream.
+ */
+void watch_report(const WatchCounts *counts, FILE *file);
+
+#endif // WATCH_H